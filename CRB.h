@@ -12,12 +12,20 @@ typedef enum {
 
 typedef struct CRB_Interpreter_tag CRB_Interpreter;
 
+typedef enum {
+	CRB_BYTECODE_EXECUTE_MODE = 0,
+	CRB_AST_EXECUTE_MODE,
+} CRB_ExecuteMode;
+
 CRB_Interpreter *CRB_create_interpreter(Encoding source_encoding,
 										Encoding env_encoding);
 int CRB_compile(CRB_Interpreter *interpreter, char *filename);
 int CRB_interpret(CRB_Interpreter *interpreter);
 void CRB_dispose_interpreter(CRB_Interpreter *interpreter);
 void CRB_reset_interpreter(CRB_Interpreter **pinter);
+void CRB_set_execute_mode(CRB_Interpreter *interpreter, CRB_ExecuteMode mode);
+/* compile hot bytecode to machine code where supported, on by default */
+void CRB_set_jit_enabled(CRB_Interpreter *interpreter, int enabled);
 
 void CRB_dump_interpreter(CRB_Interpreter *interpreter, FILE *fpout);
 void CRB_load_interpreter(CRB_Interpreter *interpreter, FILE *fpin);
@@ -32,38 +32,46 @@ typedef enum {
 	CRB_SCOPE_CHAIN_VALUE,
 	CRB_CLOSURE_VALUE,
 	CRB_FAKE_METHOD_VALUE,
+	CRB_MAP_VALUE,
+	CRB_SET_VALUE,
+	CRB_RECORD_VALUE,
 } CRB_ValueType;
 
-typedef struct {
-    CRB_NativePointerInfo       *info;
-    void                        *pointer;
-} CRB_NativePointer;
-
-typedef struct {
-	Expression *closure_expr;
-	CRB_Object *scope_obj;
-} CRB_Closure;
-
-typedef struct {
-	char *filename;
-	int line_number;
-	char *method_name;
-	CRB_Object *object;
-} CRB_FakeMethod;
-
+/*
+ * A value is its type and one word, 16 bytes.  A closure keeps its
+ * function and scope in a heap object, a fake method and a native
+ * pointer put the method or the pointer info in index.  Native code
+ * should go through the accessors below.
+ */
 typedef struct {
     CRB_ValueType       type;
+	int					index;
     union {
         CRB_Boolean     boolean_value;
         int             int_value;
         double          double_value;
         CRB_Object      *object_value;
-        CRB_NativePointer       native_pointer;
-		CRB_Closure		closure_value;
-		CRB_FakeMethod	fake_method;
+		void			*pointer_value;
     } u;
 } CRB_Value;
 
+#define CRB_value_type(value)		((value)->type)
+#define CRB_boolean_value(value)	((value)->u.boolean_value)
+#define CRB_int_value(value)		((value)->u.int_value)
+#define CRB_double_value(value)		((value)->u.double_value)
+#define CRB_object_value(value)		((value)->u.object_value)
+#define CRB_native_pointer(value)	((value)->u.pointer_value)
+#define CRB_native_pointer_info(value) \
+	CRB_get_native_pointer_info((value)->index)
+
+#define CRB_set_native_pointer(value, pointer, info) \
+	((value)->type = CRB_NATIVE_POINTER_VALUE, \
+	 (value)->index = CRB_native_pointer_info_index(info), \
+	 (value)->u.pointer_value = (pointer))
+
+int CRB_native_pointer_info_index(CRB_NativePointerInfo *info);
+CRB_NativePointerInfo *CRB_get_native_pointer_info(int index);
+
 typedef void CRB_NativeFunctionProc(CRB_Interpreter *interpreter,
                                     CRB_LocalEnvironment *env,     
 									int arg_count,
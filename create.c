@@ -1,7 +1,10 @@
+#include <string.h>
 #include "MEM.h"
 #include "DBG.h"
 #include "crowbar.h"
 
+static ParameterList *alloc_parameter_list(void);
+
 void
 crb_function_define(char *identifier, ParameterList *parameter_list,
                     Block *block)
@@ -20,60 +23,143 @@ crb_function_define(char *identifier, ParameterList *parameter_list,
     f = crb_malloc(sizeof(FunctionDefinition));
     f->name = identifier;
     f->type = CROWBAR_FUNCTION_DEFINITION;
-    f->u.crowbar_f.parameter = parameter_list;
+    f->u.crowbar_f.parameter = parameter_list ? parameter_list
+											: alloc_parameter_list();
     f->u.crowbar_f.block = block;
+	f->u.crowbar_f.local_variable_count = -1;
+	f->u.crowbar_f.has_closure = CRB_FALSE;
+	f->u.crowbar_f.code = NULL;
 
 	f->filename = inter->current_file_name;
 	f->line_number = inter->current_line_number;
 
-    f->next = inter->function_list;
-    inter->function_list = f;
+	crb_add_function(inter, f);
 }
 
-ParameterList *
-crb_create_parameter(char *identifier)
+/*
+ * "record name { field, ... }" defines name() making a record of its
+ * arguments.  The field names are kept in an array, the offset of a
+ * field is its index there.
+ */
+void
+crb_record_define(char *identifier, IdentifierList *field_list)
+{
+    FunctionDefinition *f;
+    CRB_Interpreter *inter;
+    IdentifierList *pos;
+    int count = 0;
+    int i;
+
+    if (crb_search_function(identifier)) {
+        crb_compile_error(FUNCTION_MULTIPLE_DEFINE_ERR,
+                          STRING_MESSAGE_ARGUMENT, "name", identifier,
+                          MESSAGE_ARGUMENT_END);
+        return;
+    }
+    inter = crb_get_current_interpreter();
+
+    f = crb_malloc(sizeof(FunctionDefinition));
+    f->name = identifier;
+    f->type = RECORD_DEFINITION;
+    for (pos = field_list; pos; pos = pos->next)
+        count++;
+    f->u.record_f.field_count = count;
+    f->u.record_f.field = crb_malloc(sizeof(char*) * (count ? count : 1));
+    for (pos = field_list, count = 0; pos; pos = pos->next, count++) {
+        for (i = 0; i < count; i++) {
+            if (!strcmp(f->u.record_f.field[i], pos->name)) {
+                crb_compile_error(FIELD_MULTIPLE_DEFINE_ERR,
+                                  STRING_MESSAGE_ARGUMENT, "name", pos->name,
+                                  MESSAGE_ARGUMENT_END);
+                return;
+            }
+        }
+        f->u.record_f.field[count] = pos->name;
+    }
+
+	f->filename = inter->current_file_name;
+	f->line_number = inter->current_line_number;
+
+	crb_add_function(inter, f);
+}
+
+/*
+ * The lists below are arrays grown in powers of two while the parser
+ * appends to them; the unused tail is dropped when crb_layout_tree
+ * copies the tree.
+ */
+static void *
+grow_list(void *array, int count, size_t size)
+{
+	void *new_array;
+
+	if (count & (count - 1))
+		return array;
+
+	new_array = crb_tree_malloc(size * (count ? count * 2 : 1));
+	if (count > 0)
+		memcpy(new_array, array, size * count);
+
+	return new_array;
+}
+
+static ParameterList *
+alloc_parameter_list(void)
 {
-    ParameterList       *p;
+	ParameterList *p;
 
-    p = crb_malloc(sizeof(ParameterList));
-    p->name = identifier;
-    p->next = NULL;
+	p = crb_tree_malloc(sizeof(ParameterList));
+	p->count = 0;
+	p->name = NULL;
 
-    return p;
+	return p;
+}
+
+ParameterList *
+crb_create_parameter(char *identifier)
+{
+    return crb_chain_parameter(NULL, identifier);
 }
 
 ParameterList *
 crb_chain_parameter(ParameterList *list, char *identifier)
 {
-    ParameterList *pos;
+	if (list == NULL)
+		list = alloc_parameter_list();
 
-    for (pos = list; pos->next; pos = pos->next)
-        ;
-    pos->next = crb_create_parameter(identifier);
+	list->name = grow_list(list->name, list->count, sizeof(char*));
+	list->name[list->count++] = identifier;
 
     return list;
 }
 
-ArgumentList *
-crb_create_argument_list(Expression *expression)
+static ArgumentList *
+alloc_argument_list(void)
 {
-    ArgumentList *al;
+	ArgumentList *al;
+
+	al = crb_tree_malloc(sizeof(ArgumentList));
+	al->count = 0;
+	al->expression = NULL;
 
-    al = crb_malloc(sizeof(ArgumentList));
-    al->expression = expression;
-    al->next = NULL;
+	return al;
+}
 
-    return al;
+ArgumentList *
+crb_create_argument_list(Expression *expression)
+{
+    return crb_chain_argument_list(NULL, expression);
 }
 
 ArgumentList *
 crb_chain_argument_list(ArgumentList *list, Expression *expr)
 {
-    ArgumentList *pos;
+	if (list == NULL)
+		list = alloc_argument_list();
 
-    for (pos = list; pos->next; pos = pos->next)
-        ;
-    pos->next = crb_create_argument_list(expr);
+	list->expression = grow_list(list->expression, list->count,
+								sizeof(Expression*));
+	list->expression[list->count++] = expr;
 
     return list;
 }
@@ -81,39 +167,113 @@ crb_chain_argument_list(ArgumentList *list, Expression *expr)
 StatementList *
 crb_create_statement_list(Statement *statement)
 {
-    StatementList *sl;
-
-    sl = crb_malloc(sizeof(StatementList));
-    sl->statement = statement;
-    sl->next = NULL;
-
-    return sl;
+    return crb_chain_statement_list(NULL, statement);
 }
 
 StatementList *
 crb_chain_statement_list(StatementList *list, Statement *statement)
 {
-    StatementList *pos;
-
-    if (list == NULL)
-        return crb_create_statement_list(statement);
+	if (list == NULL) {
+		list = crb_tree_malloc(sizeof(StatementList));
+		list->count = 0;
+		list->statement = NULL;
+	}
 
-    for (pos = list; pos->next; pos = pos->next)
-        ;
-    pos->next = crb_create_statement_list(statement);
+	list->statement = grow_list(list->statement, list->count,
+								sizeof(Statement*));
+	list->statement[list->count++] = statement;
 
     return list;
 }
 
+static unsigned int
+hash_location(char *filename, int line_number)
+{
+	return (unsigned int)((size_t)filename >> 3) * 31u
+		+ (unsigned int)line_number;
+}
+
+static void
+grow_location(CRB_Interpreter *inter)
+{
+	int size;
+	unsigned int h;
+	int i;
+
+	inter->location_alloc = inter->location_alloc ? inter->location_alloc * 2
+												: 64;
+	inter->location = MEM_realloc(inter->location,
+								  sizeof(CodeLocation) * inter->location_alloc);
+	size = inter->location_alloc * 2;
+	MEM_free(inter->location_hash);
+	inter->location_hash = MEM_malloc(sizeof(int) * size);
+	for (i = 0; i < size; i++)
+		inter->location_hash[i] = -1;
+	for (i = 0; i < inter->location_count; i++) {
+		h = hash_location(inter->location[i].filename,
+						  inter->location[i].line_number) & (size - 1);
+		while (inter->location_hash[h] >= 0)
+			h = (h + 1) & (size - 1);
+		inter->location_hash[h] = i;
+	}
+}
+
+/*
+ * The index of filename and line_number in inter->location, added if
+ * it is not there yet.  A node keeps this index in place of the file
+ * and the line, so the nodes of one line share an entry, and so do the
+ * calls the natives build on the C stack each time they run.
+ */
+int
+crb_location_index(CRB_Interpreter *inter, char *filename, int line_number)
+{
+	CodeLocation *location;
+	unsigned int mask;
+	unsigned int h;
+	int i;
+
+	/* the parser asks for the line of the node before most of the time */
+	i = inter->location_count - 1;
+	if (i >= 0 && inter->location[i].line_number == line_number
+		&& inter->location[i].filename == filename)
+		return i;
+
+	if (inter->location_count == inter->location_alloc)
+		grow_location(inter);
+	mask = inter->location_alloc * 2 - 1;
+	for (h = hash_location(filename, line_number) & mask;
+		 (i = inter->location_hash[h]) >= 0; h = (h + 1) & mask) {
+		location = &inter->location[i];
+		if (location->line_number == line_number
+			&& location->filename == filename)
+			return i;
+	}
+
+	i = inter->location_count++;
+	inter->location[i].filename = filename;
+	inter->location[i].line_number = line_number;
+	inter->location_hash[h] = i;
+
+	return i;
+}
+
+static int
+current_location(void)
+{
+	CRB_Interpreter *inter = crb_get_current_interpreter();
+
+	return crb_location_index(inter, inter->current_file_name,
+							  inter->current_line_number);
+}
+
 Expression *
 crb_alloc_expression(ExpressionType type)
 {
     Expression  *expr;
 
-    expr = crb_malloc(sizeof(Expression));
+    expr = crb_tree_malloc(sizeof(Expression));
     expr->type = type;
-	expr->filename = crb_get_current_interpreter()->current_file_name;
-    expr->line_number = crb_get_current_interpreter()->current_line_number;
+	expr->location = current_location();
 
     return expr;
 }
@@ -214,7 +374,10 @@ crb_create_function_call_expression(Expression *expr,
 
     exp = crb_alloc_expression(FUNCTION_CALL_EXPRESSION);
     exp->u.function_call_expression.expr = expr;
-    exp->u.function_call_expression.argument = argument;
+    exp->u.function_call_expression.argument = argument ? argument
+												: alloc_argument_list();
+	exp->u.function_call_expression.cached_function = NULL;
+	exp->u.function_call_expression.cached_generation = 0;
 
     return exp;
 }
@@ -245,10 +408,9 @@ alloc_statement(StatementType type)
 {
     Statement *st;
 
-    st = crb_malloc(sizeof(Statement));
+    st = crb_tree_malloc(sizeof(Statement));
     st->type = type;
-	st->filename = crb_get_current_interpreter()->current_file_name;
-    st->line_number = crb_get_current_interpreter()->current_line_number;
+	st->location = current_location();
 
     return st;
 }
@@ -269,7 +431,7 @@ crb_create_global_identifier(char *identifier)
 {
     IdentifierList      *i_list;
 
-    i_list = crb_malloc(sizeof(IdentifierList));
+    i_list = crb_tree_malloc(sizeof(IdentifierList));
     i_list->name = identifier;
     i_list->next = NULL;
 
@@ -291,7 +453,7 @@ crb_chain_identifier(IdentifierList *list, char *identifier)
 Statement *
 crb_create_if_statement(Expression *condition,
                         Statement *then_statement, 
-						Elsif *elsif_list,
+						ElsifList *elsif_list,
                         Statement *else_statement)
 {
     Statement *st;
@@ -305,14 +467,17 @@ crb_create_if_statement(Expression *condition,
     return st;
 }
 
-Elsif *
-crb_chain_elsif_list(Elsif *list, Elsif *add)
+ElsifList *
+crb_chain_elsif_list(ElsifList *list, Elsif *add)
 {
-    Elsif *pos;
+	if (list == NULL) {
+		list = crb_tree_malloc(sizeof(ElsifList));
+		list->count = 0;
+		list->elsif = NULL;
+	}
 
-    for (pos = list; pos->next; pos = pos->next)
-        ;
-    pos->next = add;
+	list->elsif = grow_list(list->elsif, list->count, sizeof(Elsif));
+	list->elsif[list->count++] = *add;
 
     return list;
 }
@@ -322,10 +487,9 @@ crb_create_elsif(Expression *expr, Statement *statement)
 {
     Elsif *ei;
 
-    ei = crb_malloc(sizeof(Elsif));
+    ei = crb_tree_malloc(sizeof(Elsif));
     ei->condition = expr;
     ei->statement = statement;
-    ei->next = NULL;
 
     return ei;
 }
@@ -362,7 +526,7 @@ crb_create_block(StatementList *statement_list)
 {
     Block *block;
 
-    block = crb_malloc(sizeof(Block));
+    block = crb_tree_malloc(sizeof(Block));
     block->statement_list = statement_list;
 
     return block;
@@ -411,26 +575,33 @@ Statement *crb_create_block_statement(Block *block)
 }
 
 
-ExpressionList *crb_create_expression_list(Expression *expr)
+static ExpressionList *
+alloc_expression_list(void)
 {
 	ExpressionList *list;
 
-	list = crb_malloc(sizeof(ExpressionList));
-	list->expression = expr;
-	list->next = NULL;
+	list = crb_tree_malloc(sizeof(ExpressionList));
+	list->count = 0;
+	list->expression = NULL;
 
 	return list;
 }
 
+ExpressionList *crb_create_expression_list(Expression *expr)
+{
+	return crb_chain_expression_list(NULL, expr);
+}
+
 
 ExpressionList *crb_chain_expression_list(ExpressionList *list,
 											Expression *expr)
 {
-	ExpressionList *pos;
-	for (pos = list; pos->next != NULL; pos = pos->next)
-		;
+	if (list == NULL)
+		list = alloc_expression_list();
 
-	pos->next = crb_create_expression_list(expr);
+	list->expression = grow_list(list->expression, list->count,
+								sizeof(Expression*));
+	list->expression[list->count++] = expr;
 
 	return list;
 }
@@ -439,6 +610,9 @@ Expression* crb_create_array_expression(ExpressionList *list)
 {
 	Expression *expr;
 
+	if (list == NULL)
+		list = alloc_expression_list();
+
 	expr = crb_alloc_expression(ARRAY_EXPRESSION);
 	expr->u.array_expression = list;
 
@@ -479,8 +653,9 @@ Expression* crb_create_member_expression(Expression *assoc_expr,
 	expr = crb_alloc_expression(MEMBER_EXPRESSION);
 	expr->u.member_expression.expression = assoc_expr;
 	expr->u.member_expression.member_name = member_name;
+	expr->u.member_expression.cached_record = NULL;
+	expr->u.member_expression.cached_field = 0;
 
-	
 	return expr;
 }
 
@@ -495,8 +670,11 @@ Expression* crb_create_closure_definition(char *name,
 	FunctionDefinition *f = crb_malloc(sizeof(FunctionDefinition));
     f->name = name;
     f->type = CROWBAR_FUNCTION_DEFINITION;
-    f->u.crowbar_f.parameter = param;
+    f->u.crowbar_f.parameter = param ? param : alloc_parameter_list();
     f->u.crowbar_f.block = block;
+	f->u.crowbar_f.local_variable_count = -1;
+	f->u.crowbar_f.has_closure = CRB_FALSE;
+	f->u.crowbar_f.code = NULL;
 
 	expr->u.closure_definition.function = f;
 
@@ -550,8 +728,8 @@ void crb_init_identifier_expression(Expression *expr, char *identifier,
 									char *filename, int line_number)
 {
 	expr->type = IDENTIFIER_EXPRESSION;
-	expr->filename = filename;
-	expr->line_number = line_number;
+	expr->location = crb_location_index(crb_get_current_interpreter(),
+										filename, line_number);
 	expr->u.identifier = identifier;
 }
 
@@ -563,24 +741,27 @@ void crb_init_member_expression(Expression *expr,
 {
 
 	expr->type = MEMBER_EXPRESSION;
-	expr->filename = filename;
-	expr->line_number = line_number;
+	expr->location = crb_location_index(crb_get_current_interpreter(),
+										filename, line_number);
 	expr->u.member_expression.expression = assoc_expr;
 	expr->u.member_expression.member_name = member_name;
-
-	
+	expr->u.member_expression.cached_record = NULL;
+	expr->u.member_expression.cached_field = 0;
 }
 
 
 void crb_init_argument_list(ArgumentList *argument,
-									Expression *expression)
+							int count, Expression **expression)
 {
 
+    argument->count = count;
     argument->expression = expression;
-    argument->next = NULL;
 
 }
 
+/* calls built on the C stack without arguments share this one */
+static ArgumentList empty_argument_list = {0, NULL};
+
 void crb_init_function_call_expression(Expression *expr,
 									Expression *func_expr, 
 									ArgumentList *argument,
@@ -588,10 +769,13 @@ void crb_init_function_call_expression(Expression *expr,
 {
 
     expr->type = FUNCTION_CALL_EXPRESSION;
-	expr->filename = filename;
-	expr->line_number = line_number;
+	expr->location = crb_location_index(crb_get_current_interpreter(),
+										filename, line_number);
 	expr->u.function_call_expression.expr = func_expr;
-    expr->u.function_call_expression.argument = argument;
+    expr->u.function_call_expression.argument = argument ? argument
+												: &empty_argument_list;
+	expr->u.function_call_expression.cached_function = NULL;
+	expr->u.function_call_expression.cached_generation = 0;
 
 }
 
@@ -15,7 +15,9 @@
 #define LINE_BUF_SIZE           (1024)
 #define STACK_ALLOC_SIZE		(256)
 #define HEAP_THRESHOLD_SIZE		(1024*256)
-#define ARRAY_ALLOC_SIZE		(1024)
+#define ARRAY_MIN_ALLOC_SIZE	(8)
+#define ARRAY_MAP_SIZE			(1024*1024)
+#define FUNCTION_HASH_SIZE		(256)
 
 typedef enum {
     PARSE_ERR = 1,
@@ -25,6 +27,7 @@ typedef enum {
 	CR_IN_REGEXP_ERR,
 	UNEXPECTED_WIDE_STRING_IN_COMPILE_ERR,
 	CAN_NOT_CREATE_REGEXP_IN_COMPILE_ERR,
+	FIELD_MULTIPLE_DEFINE_ERR,
     COMPILE_ERROR_COUNT_PLUS_1
 } CompileError;
 
@@ -66,6 +69,10 @@ typedef enum {
 	NO_SUCH_GROUP_INDEX_ERR,
 	FOREACH_NOT_ARRAY_TYPE_ERR,
 	NOT_BOOLEAN_FOR_NOT_EXPRESSION,
+	ARRAY_SIZE_MISMATCH_ERR,
+	ARRAY_CHANGED_IN_SORT_ERR,
+	MAP_KEY_TYPE_ERR,
+	NO_SUCH_FIELD_ERR,
     RUNTIME_ERROR_COUNT_PLUS_1
 } RuntimeError;
 
@@ -85,6 +92,7 @@ typedef struct {
 typedef struct ParameterList_tag ParameterList;
 typedef struct Block_tag Block;
 typedef struct FunctionDefinition_tag FunctionDefinition;
+typedef struct ByteCode_tag ByteCode;
 
 typedef enum {
     BOOLEAN_EXPRESSION = 1,
@@ -135,9 +143,12 @@ typedef enum {
 #define dkc_is_logical_operator(operator) \
   ((operator) == LOGICAL_AND_EXPRESSION || (operator) == LOGICAL_OR_EXPRESSION)
 
-typedef struct ArgumentList_tag {
-    Expression *expression;
-    struct ArgumentList_tag *next;
+/* the argument, array element, parameter, statement and elsif lists
+ * are counted arrays: the grammar only ever appends to them, and callers
+ * want the count before they touch the elements */
+typedef struct {
+	int			count;
+	Expression	**expression;
 } ArgumentList;
 
 typedef enum {
@@ -167,6 +178,10 @@ typedef struct {
 typedef struct {
     Expression			*expr;
 	ArgumentList        *argument;
+	/* call-site cache, valid while cached_generation equals
+	 * inter->function_generation */
+	FunctionDefinition	*cached_function;
+	int					cached_generation;
 } FunctionCallExpression;
 
 
@@ -175,9 +190,9 @@ typedef struct {
 	Expression *index;
 } IndexExpression;
 
-typedef struct ExpressionList_tag {
-	Expression *expression;
-	struct ExpressionList_tag *next;
+typedef struct {
+	int			count;
+	Expression	**expression;
 } ExpressionList;
 
 typedef struct {
@@ -187,6 +202,9 @@ typedef struct {
 typedef struct {
 	Expression *expression;
 	char* member_name;
+	/* the record type last seen here and the offset of the field in it */
+	FunctionDefinition	*cached_record;
+	int					cached_field;
 } MemberExpression;
 
 typedef struct {
@@ -202,10 +220,24 @@ typedef struct CRB_Regexp_tag {
 } CRB_Regexp;
 
 
+/*
+ * A source position.  The tree nodes keep the index of theirs in
+ * inter->location, where the nodes of one line share an entry, see
+ * crb_location_index; a compiled instruction keeps its own.
+ */
+typedef struct {
+	char		*filename;
+	int			line_number;
+} CodeLocation;
+
+#define crb_node_filename(inter, node) \
+	((inter)->location[(node)->location].filename)
+#define crb_node_line_number(inter, node) \
+	((inter)->location[(node)->location].line_number)
+
 struct Expression_tag {
     ExpressionType type;
-	char *filename;
-    int line_number;
+	int location;
     union {
         CRB_Boolean             boolean_value;
         int                     int_value;
@@ -228,9 +260,9 @@ struct Expression_tag {
 
 typedef struct Statement_tag Statement;
 
-typedef struct StatementList_tag {
-    Statement   *statement;
-    struct StatementList_tag    *next;
+typedef struct {
+	int			count;
+	Statement	**statement;
 } StatementList;
 
 struct Block_tag {
@@ -246,16 +278,20 @@ typedef struct {
     IdentifierList      *identifier_list;
 } GlobalStatement;
 
-typedef struct Elsif_tag {
+typedef struct {
     Expression  *condition;
     Statement   *statement;
-    struct Elsif_tag    *next;
 } Elsif;
 
+typedef struct {
+	int			count;
+	Elsif		*elsif;
+} ElsifList;
+
 typedef struct {
     Expression  *condition;
     Statement   *then_statement;
-    Elsif       *elsif_list;
+    ElsifList   *elsif_list;
     Statement   *else_statement;
 } IfStatement;
 
@@ -314,8 +350,7 @@ typedef enum {
 
 struct Statement_tag {
     StatementType       type;
-	char				*filename;
-    int                 line_number;
+	int					location;
     union {
         Expression      *expression_s;
         GlobalStatement global_s;
@@ -331,13 +366,14 @@ struct Statement_tag {
 };
 
 struct ParameterList_tag {
-    char        *name;
-    struct ParameterList_tag *next;
+	int			count;
+	char		**name;
 };
 
 typedef enum {
     CROWBAR_FUNCTION_DEFINITION = 1,
-    NATIVE_FUNCTION_DEFINITION
+    NATIVE_FUNCTION_DEFINITION,
+	RECORD_DEFINITION
 } FunctionDefinitionType;
 
 struct FunctionDefinition_tag {
@@ -347,13 +383,25 @@ struct FunctionDefinition_tag {
         struct {
             ParameterList       *parameter;
             Block               *block;
+			/* filled by crb_alloc_local_environment on the first call,
+			 * -1 until then */
+			int					local_variable_count;
+			CRB_Boolean			has_closure;
+			/* compiled on the first call in bytecode mode */
+			ByteCode			*code;
         } crowbar_f;
         struct {
             CRB_NativeFunctionProc      *proc;
         } native_f;
+		/* "record name { field, ... }", called by name to make one */
+		struct {
+			int					field_count;
+			char				**field;
+		} record_f;
 		
     } u;
     struct FunctionDefinition_tag       *next;
+	struct FunctionDefinition_tag		*hash_next;
 	char *filename;
 	int line_number;
 };
@@ -369,24 +417,222 @@ typedef enum {
     RETURN_STATEMENT_RESULT,
     BREAK_STATEMENT_RESULT,
     CONTINUE_STATEMENT_RESULT,
+	TAIL_CALL_STATEMENT_RESULT,
     STATEMENT_RESULT_TYPE_COUNT_PLUS_1
 } StatementResultType;
 
+#define dkc_is_return_result(type) \
+	((type) == RETURN_STATEMENT_RESULT || (type) == TAIL_CALL_STATEMENT_RESULT)
+
+/* "return f(...)" of a crowbar function, the callee value (if any) and
+ * the arguments are left on the stack for the current frame to reuse */
+typedef struct {
+	FunctionDefinition	*func;
+	Expression			*expr;
+	CRB_Value			callee;
+	int					arg_count;
+} TailCall;
+
 typedef struct {
     StatementResultType type;
     union {
         CRB_Value       return_value;
+		TailCall		tail_call;
     } u;
 } StatementResult;
 
 
+typedef enum {
+	OP_PUSH_NULL = 1,
+	OP_PUSH_BOOLEAN,
+	OP_PUSH_INT,
+	OP_PUSH_DOUBLE,
+	OP_PUSH_STRING,
+	OP_PUSH_REGEXP,
+	OP_PUSH_VARIABLE,
+	OP_PUSH_INDEX,
+	OP_PUSH_MEMBER,
+	OP_PUSH_CLOSURE,
+	OP_PUSH_CALLEE,
+	OP_NEW_ARRAY,
+	OP_CREATE_VARIABLE,
+	OP_STORE_VARIABLE,
+	OP_STORE_INDEX,
+	OP_STORE_MEMBER,
+	OP_INCDEC_VARIABLE,
+	OP_INCDEC_INDEX,
+	OP_INCDEC_MEMBER,
+	OP_NOT_LVALUE,
+	OP_POP,
+	OP_ADD,
+	OP_SUB,
+	OP_MUL,
+	OP_DIV,
+	OP_MOD,
+	OP_EQ,
+	OP_NE,
+	OP_GT,
+	OP_GE,
+	OP_LT,
+	OP_LE,
+	/* quickened forms of OP_ADD..OP_LE, in the same order */
+	OP_ADD_INT,
+	OP_SUB_INT,
+	OP_MUL_INT,
+	OP_DIV_INT,
+	OP_MOD_INT,
+	OP_EQ_INT,
+	OP_NE_INT,
+	OP_GT_INT,
+	OP_GE_INT,
+	OP_LT_INT,
+	OP_LE_INT,
+	OP_ADD_DOUBLE,
+	OP_SUB_DOUBLE,
+	OP_MUL_DOUBLE,
+	OP_DIV_DOUBLE,
+	OP_MOD_DOUBLE,
+	OP_EQ_DOUBLE,
+	OP_NE_DOUBLE,
+	OP_GT_DOUBLE,
+	OP_GE_DOUBLE,
+	OP_LT_DOUBLE,
+	OP_LE_DOUBLE,
+	OP_ADD_STRING,
+	OP_NOT,
+	OP_MINUS,
+	OP_AND_JUMP,
+	OP_OR_JUMP,
+	OP_CHECK_BOOLEAN,
+	OP_JUMP,
+	OP_JUMP_IF_FALSE,
+	OP_CALL,
+	OP_TAIL_CALL,
+	OP_RETURN,
+	OP_BREAK,
+	OP_CONTINUE,
+	OP_GLOBAL,
+	OP_TRY,
+	OP_THROW,
+	OP_FOREACH_INIT,
+	OP_FOREACH_NEXT,
+	OP_FOREACH_STEP,
+	OP_FOREACH_END,
+	OP_HOIST_RECEIVER,
+	OP_HOISTED_SIZE,
+	OP_HOISTED_LENGTH,
+	OP_HOIST_END,
+	OP_END,
+	OPCODE_COUNT_PLUS_1
+} OpCode;
+
+#if defined(__GNUC__) && !defined(CRB_SWITCH_DISPATCH)
+#define CRB_THREADED_CODE
+#endif
+
+/* hot code is compiled to x86-64 machine code, see jit.c */
+#if defined(__GNUC__) && defined(__x86_64__) && defined(__linux__) \
+	&& !defined(CRB_NO_JIT)
+#define CRB_JIT
+#endif
+
+/*
+ * Code runs in the VM first and is compiled after CRB_JIT_THRESHOLD
+ * entries, or when one of its loops has jumped back CRB_OSR_THRESHOLD
+ * times, then the running code moves on to the machine code at once.
+ */
+#ifndef CRB_JIT_THRESHOLD
+#define CRB_JIT_THRESHOLD	(1000)
+#endif
+#ifndef CRB_OSR_THRESHOLD
+#define CRB_OSR_THRESHOLD	(1000)
+#endif
+
+typedef struct {
+	OpCode		opcode;
+	int			operand;
+	int			operand2;
+#ifdef CRB_THREADED_CODE
+	void		*handler;	/* label of the opcode in crb_execute_byte_code */
+#endif
+} Instruction;
+
+typedef union {
+	double		double_value;
+	void		*pointer;
+} CodeConstant;
+
+/*
+ * A compiled statement list.  location[i] is the source position of
+ * code[i] for error messages, pointers to the AST (names, literals,
+ * call expressions) go into the constant pool.
+ */
+struct ByteCode_tag {
+	Instruction		*code;
+	CodeLocation	*location;
+	int				code_size;
+	CodeConstant	*constant;
+	int				constant_count;
+	CRB_Boolean		threaded;	/* handlers filled in */
+	int				hotness;	/* entries */
+	void			*native;	/* machine code from jit.c, or NULL */
+	int				*native_label;	/* offset of code[i] in native */
+	CRB_Boolean		native_failed;
+};
+
+/* try runs each part as its own code, see OP_TRY in vm.c */
+typedef struct {
+	Statement		*statement;
+	ByteCode		*run_code;
+	ByteCode		*catch_code;
+	ByteCode		*final_code;
+} TryCode;
+
+
+/*
+ * The state machine code runs an instruction with.  It calls back into
+ * vm.c for everything but the simplest instructions, see
+ * crb_jit_helper.
+ */
+typedef struct {
+	CRB_Interpreter			*inter;
+	CRB_LocalEnvironment	*env;
+	ByteCode				*code;
+	int						base_sp;
+	StatementResult			result;
+} JitFrame;
+
+typedef int (*JitHelper)(JitFrame *frame, int pc);
+
+typedef struct JitArea_tag {
+	void				*address;
+	size_t				size;
+	struct JitArea_tag	*next;
+} JitArea;
+
 typedef struct GlobalVariableRef_tag {
     Variable *variable;
     struct GlobalVariableRef_tag *next;
 } GlobalVariableRef;
 
+/*
+ * A call frame.  Frames are recycled through inter->free_env.  Local
+ * variables live in the pre-sized variable slots; environ_scope is only
+ * created for functions whose body defines a closure, which may capture
+ * the scope after the frame is gone.
+ */
 struct CRB_LocalEnvironment_tag {
 	CRB_Object *environ_scope;
+	CRB_Object *outer_scope;	/* captured scope of a closure call */
+	CRB_Boolean is_closure;
+	Variable *variable;
+	int variable_count;
+	int variable_alloc_size;
+	Variable *overflow_variable;
+	GlobalVariableRef *global_ref;
+	/* try and foreach statements running here that need the value
+	 * stack kept as is, no tail calls while nonzero */
+	int stack_hold;
 	int caller_line_number;
 	char *func_name;
 	struct CRB_LocalEnvironment_tag *parent_env;
@@ -395,14 +641,71 @@ struct CRB_LocalEnvironment_tag {
 struct CRB_String_tag {
     CRB_CHAR    *string;
     CRB_Boolean is_literal;
+    CRB_Boolean has_hash;
+    unsigned int hash;      /* crb_string_hash(), once has_hash */
 };
 
+/*
+ * An array holding only ints or only doubles keeps them packed.  The
+ * first element stored in an empty array picks the kind, storing any
+ * other type turns the array into a GENERIC_ARRAY for good.
+ *
+ * A view made by array.view() owns no elements, it shows view_length
+ * of them from offset in parent and reads and writes go to the parent.
+ * The parent may move or drop them, so kind, length and u of a view are
+ * refreshed by crb_array_sync before they are used.  A change of the
+ * size or of the kind of a view copies the elements into an array of
+ * its own first, and the view no longer follows the parent.
+ */
+typedef enum {
+	GENERIC_ARRAY = 1,
+	INT_ARRAY,
+	DOUBLE_ARRAY
+} ArrayKind;
+
 typedef struct CRB_Array_tag {
+	ArrayKind kind;
 	int alloc_size;
 	int length;
-	CRB_Value *array;
+	union {
+		CRB_Value	*value;			/* GENERIC_ARRAY */
+		int			*int_value;		/* INT_ARRAY */
+		double		*double_value;	/* DOUBLE_ARRAY */
+	} u;
+	struct CRB_Object_tag *parent;	/* NULL unless a view */
+	int offset;
+	int view_length;
 } CRB_Array;
 
+/* big arrays live in pages of their own, see heap.c */
+#if defined(__linux__) && !defined(CRB_NO_ARRAY_MAP)
+#define CRB_ARRAY_MAP
+#endif
+
+#define crb_array_sync(obj) \
+	((obj)->u.array.parent == NULL ? (void)0 : crb_sync_array_view(obj))
+
+/*
+ * new_map() keys strings by their contents and ints by value.  The
+ * entries are kept in the order they were put, index is an open
+ * addressing table of entry numbers, see map.c.  A new_set() is the
+ * same table with null values.
+ */
+typedef struct {
+	unsigned int	hash;
+	CRB_Value		key;	/* null once removed */
+	CRB_Value		value;
+} MapEntry;
+
+typedef struct {
+	int			count;			/* entries not removed */
+	int			entry_count;	/* entries used, removed ones too */
+	int			entry_alloc;
+	MapEntry	*entry;
+	int			index_size;		/* a power of two, 0 while empty */
+	int			*index;			/* -1 where no entry is */
+} CRB_Map;
+
 
 
 typedef struct CRB_Assoc_tag {
@@ -417,6 +720,12 @@ typedef struct CRB_ScopeChain_tag {
 	CRB_Boolean is_closure;
 } CRB_ScopeChain;
 
+/* what a closure value points to */
+typedef struct {
+	FunctionDefinition *function;
+	CRB_Object *scope_obj;
+} CRB_Closure;
+
 typedef struct {
 	int stack_alloc_size;
 	int stack_pointer;
@@ -424,8 +733,8 @@ typedef struct {
 } Stack;
 
 typedef struct {
-	int current_heap_size;
-	int current_threshold;
+	size_t current_heap_size;
+	size_t current_threshold;
 	CRB_Object *header;
 	int gc_enabled;
 } Heap;
@@ -435,39 +744,69 @@ typedef struct {
 	jmp_buf jumper;
 	int stack_pos;
 	CRB_LocalEnvironment *env_pos;
+	int gc_enabled;		/* a native left by a throw does not enable it */
 } RecoverEnvironment;
 
 
 struct CRB_Interpreter_tag {
     MEM_Storage         interpreter_storage;
     MEM_Storage         execute_storage;
+	/* the syntax tree nodes, see crb_layout_tree */
+	MEM_Storage			tree_storage;
+	size_t				tree_size;
     FunctionDefinition  *function_list;
+	FunctionDefinition	*function_hash[FUNCTION_HASH_SIZE];
+	int					function_generation;
     StatementList       *statement_list;
+	/* the positions of the tree nodes, see crb_location_index */
+	CodeLocation		*location;
+	int					location_count;
+	int					location_alloc;
+	int					*location_hash;	/* location_alloc * 2 slots */
 	char				*current_file_name;
     int                 current_line_number;
 	Stack				stack;
 	Heap				heap;
 	CRB_LocalEnvironment *top_env;
 	CRB_LocalEnvironment first_env;
+	CRB_LocalEnvironment *free_env;
 	Encoding            source_encoding;
 	Encoding			env_encoding;
 	jmp_buf             exception_jumper;
 	CRB_Object			*throwed_exception;
 	int					compile_state;
 	CRB_Regexp			*regexp_literals;
+	CRB_ExecuteMode		execute_mode;
+	/* what crb_optimize did, recorded in the dumped .crb_code */
+	CRB_Boolean			tree_optimized;
+	int					folded_expression_count;
+	int					removed_statement_count;
+	int					inlined_call_count;
+	CRB_Boolean			jit_enabled;
+	JitArea				*jit_area;	/* machine code pages to unmap */
 };
 
 
+/* an instance of a record, its fields in the order they are declared */
+typedef struct {
+	FunctionDefinition	*definition;
+	CRB_Value			*field;
+} CRB_Record;
+
 typedef enum {
 	STRING_OBJECT = 1,
 	ARRAY_OBJECT,
 	ASSOC_OBJECT,
 	SCOPE_CHAIN_OBJECT,
+	CLOSURE_OBJECT,
+	MAP_OBJECT,
+	SET_OBJECT,
+	RECORD_OBJECT,
 	OBJECT_TYPE_COUNT_PLUS_1
 } ObjectType;
 
 #define dkc_is_object_value(type) \
-	((type) == CRB_STRING_VALUE || (type) == CRB_ARRAY_VALUE || (type) == CRB_ASSOC_VALUE  || (type) == CRB_SCOPE_CHAIN_VALUE )
+	((type) == CRB_STRING_VALUE || (type) == CRB_ARRAY_VALUE || (type) == CRB_ASSOC_VALUE  || (type) == CRB_SCOPE_CHAIN_VALUE || (type) == CRB_MAP_VALUE || (type) == CRB_SET_VALUE || (type) == CRB_RECORD_VALUE )
 
 struct CRB_Object_tag {
 	ObjectType type;
@@ -477,6 +816,9 @@ struct CRB_Object_tag {
 		CRB_Array array;
 		CRB_Assoc assoc;
 		CRB_ScopeChain scope_chain;
+		CRB_Closure closure;
+		CRB_Map map;		/* MAP_OBJECT and SET_OBJECT */
+		CRB_Record record;
 	} u;
 	struct CRB_Object_tag *prev;
 	struct CRB_Object_tag *next;
@@ -487,10 +829,30 @@ typedef struct {
 	CRB_CHAR *string;
 } VString;
 
+/* kernels over packed array elements, see vector.c */
+typedef struct {
+	int		(*int_sum)(int *a, int n);
+	int		(*int_min)(int *a, int n);
+	int		(*int_max)(int *a, int n);
+	int		(*int_dot)(int *a, int *b, int n);
+	void	(*int_scale)(int *a, int n, int k);
+	void	(*int_add)(int *a, int *b, int n);
+	void	(*int_fill)(int *a, int n, int v);
+	void	(*int_range)(int *a, int n, int start);
+	double	(*double_sum)(double *a, int n);
+	double	(*double_min)(double *a, int n);
+	double	(*double_max)(double *a, int n);
+	double	(*double_dot)(double *a, double *b, int n);
+	void	(*double_scale)(double *a, int n, double k);
+	void	(*double_add)(double *a, double *b, int n);
+	void	(*double_fill)(double *a, int n, double v);
+} VectorKernels;
+
 
 /* create.c */
 void crb_function_define(char *identifier, ParameterList *parameter_list,
                          Block *block);
+void crb_record_define(char *identifier, IdentifierList *field_list);
 ParameterList *crb_create_parameter(char *identifier);
 ParameterList *crb_chain_parameter(ParameterList *list,
                                    char *identifier);
@@ -499,6 +861,8 @@ ArgumentList *crb_chain_argument_list(ArgumentList *list, Expression *expr);
 StatementList *crb_create_statement_list(Statement *statement);
 StatementList *crb_chain_statement_list(StatementList *list,
                                         Statement *statement);
+int crb_location_index(CRB_Interpreter *inter, char *filename,
+					   int line_number);
 Expression *crb_alloc_expression(ExpressionType type);
 Expression *crb_create_assign_expression(AssignType assign_type,
 											Expression *left,
@@ -517,9 +881,9 @@ IdentifierList *crb_create_global_identifier(char *identifier);
 IdentifierList *crb_chain_identifier(IdentifierList *list, char *identifier);
 Statement *crb_create_if_statement(Expression *condition,
                                     Statement *then_statement, 
-									Elsif *elsif_list,
+									ElsifList *elsif_list,
                                     Statement *else_statement);
-Elsif *crb_chain_elsif_list(Elsif *list, Elsif *add);
+ElsifList *crb_chain_elsif_list(ElsifList *list, Elsif *add);
 Elsif *crb_create_elsif(Expression *expr, Statement *statement);
 Statement *crb_create_while_statement(Expression *condition, 
 									Statement *statement);
@@ -563,7 +927,7 @@ void crb_init_member_expression(Expression *expr,
 								char *filename, int line_number);
 
 void crb_init_argument_list(ArgumentList *argument,
-									Expression *expression);
+							int count, Expression **expression);
 
 void crb_init_function_call_expression(Expression *expr,
 									Expression *func_expr, 
@@ -585,6 +949,31 @@ char crb_regexp_start_char();
 StatementResult
 crb_execute_statement_list(CRB_Interpreter *inter,
                            CRB_LocalEnvironment *env, StatementList *list);
+void crb_execute_global(CRB_Interpreter *inter, CRB_LocalEnvironment *env,
+						Statement *statement);
+void crb_throw_value(CRB_Interpreter *inter, CRB_LocalEnvironment *env,
+					Statement *statement);
+
+/* optimize.c */
+void crb_optimize(CRB_Interpreter *inter);
+
+/* layout.c */
+void crb_layout_tree(CRB_Interpreter *inter);
+
+/* generate.c */
+ByteCode *crb_generate_code(CRB_Interpreter *inter, FunctionDefinition *func,
+							StatementList *list);
+
+/* vm.c */
+StatementResult crb_execute_byte_code(CRB_Interpreter *inter,
+									CRB_LocalEnvironment *env,
+									ByteCode *code);
+JitHelper crb_jit_helper(OpCode opcode);
+
+/* jit.c */
+CRB_Boolean crb_jit_compile(CRB_Interpreter *inter, ByteCode *code);
+void crb_jit_run(JitFrame *frame, int pc);
+void crb_jit_dispose(CRB_Interpreter *inter);
 
 /* eval.c */
 CRB_Value crb_eval_binary_expression(CRB_Interpreter *inter,
@@ -596,6 +985,26 @@ CRB_Value crb_eval_minus_expression(CRB_Interpreter *inter,
 								Expression *operand);
 CRB_Value crb_eval_expression(CRB_Interpreter *inter,
                           CRB_LocalEnvironment *env, Expression *expr);
+StatementResult crb_eval_tail_call(CRB_Interpreter *inter,
+								CRB_LocalEnvironment *env,
+								Expression *expr);
+void crb_chain_string(CRB_Interpreter *inter, CRB_Value *left,
+					CRB_Value *right, CRB_Value *result);
+void crb_eval_binary_values(CRB_Interpreter *inter, ExpressionType operator,
+							CRB_Value *left_val, CRB_Value *right_val,
+							CRB_Value *result,
+							char *filename, int line_number);
+void crb_eval_compound_assign(CRB_Interpreter *inter, AssignType type,
+							CRB_Value *dest, CRB_Value *src,
+							CRB_Value *result,
+							char *filename, int line_number);
+FunctionDefinition *crb_search_called_function(CRB_Interpreter *inter,
+											Expression *expr);
+void crb_call_stacked_function(CRB_Interpreter *inter, Expression *expr,
+							int arg_count);
+StatementResult crb_tail_call_stacked_function(CRB_Interpreter *inter,
+											Expression *expr,
+											int arg_count);
 
 CRB_Value* crb_eval_and_peek_expression(CRB_Interpreter *inter,
 					CRB_LocalEnvironment *env, Expression *expr);
@@ -615,18 +1024,50 @@ CRB_Object *crb_create_crowbar_string(CRB_Interpreter *inter, CRB_CHAR *str);
 CRB_Object* crb_string_substr(CRB_Interpreter *inter, CRB_Object *obj,
 								int begin, int len);
 
+size_t crb_array_element_size(ArrayKind kind);
 CRB_Object* crb_create_array(CRB_Interpreter *inter, int array_size);
+CRB_Object* crb_create_array_of(CRB_Interpreter *inter, int array_size,
+								CRB_Value *value);
+void crb_array_get(CRB_Object *obj, int pos, CRB_Value *val);
 void crb_array_add(CRB_Interpreter *inter, CRB_Object *obj, CRB_Value *val);
 int crb_array_size(CRB_Interpreter *inter, CRB_Object *obj);
 void crb_array_resize(CRB_Interpreter *inter, CRB_Object *obj, int new_size);
 void crb_array_set(CRB_Interpreter *inter, CRB_Object *obj, int pos, CRB_Value *val);
 void crb_array_insert(CRB_Interpreter *inter, CRB_Object *obj, int pos, CRB_Value *val);
 void crb_array_remove(CRB_Interpreter *inter, CRB_Object *obj, int pos);
+void crb_array_reshape(CRB_Interpreter *inter, CRB_Object *obj,
+						ArrayKind kind, int length);
+void crb_array_convert(CRB_Interpreter *inter, CRB_Object *obj,
+						ArrayKind kind);
+void crb_array_reserve(CRB_Interpreter *inter, CRB_Object *obj, int size);
+void crb_array_clear(CRB_Interpreter *inter, CRB_Object *obj);
+CRB_Object* crb_array_slice(CRB_Interpreter *inter, CRB_Object *obj,
+							int begin, int end);
+CRB_Object* crb_array_concat(CRB_Interpreter *inter, CRB_Object *left,
+							CRB_Object *right);
+void crb_array_extend(CRB_Interpreter *inter, CRB_Object *obj,
+						CRB_Object *other);
+int crb_array_index_of(CRB_Object *obj, CRB_Value *val);
+void crb_array_reverse(CRB_Object *obj);
+CRB_Object* crb_array_view(CRB_Interpreter *inter, CRB_Object *obj,
+							int begin, int end);
+void crb_sync_array_view(CRB_Object *obj);
+void crb_dispose_array(CRB_Interpreter *inter, CRB_Object *obj);
+void *crb_alloc_storage(size_t size);
+void *crb_realloc_storage(void *p, size_t old_size, size_t new_size);
+void crb_free_storage(void *p, size_t size);
 
 CRB_Object* crb_create_assoc(CRB_Interpreter *inter);
+CRB_Object* crb_create_map(CRB_Interpreter *inter);
+CRB_Object* crb_create_set(CRB_Interpreter *inter);
+CRB_Object* crb_create_record(CRB_Interpreter *inter,
+							  FunctionDefinition *definition);
 CRB_Object* crb_create_scope_chain(CRB_Interpreter *inter, 
 									CRB_Object *prev_scope,
 									CRB_Boolean is_closure);
+void crb_create_closure(CRB_Interpreter *inter, CRB_Value *value,
+						FunctionDefinition *function,
+						CRB_Object *scope_obj);
 
 CRB_Boolean crb_add_scope_global_ref(CRB_Interpreter *inter,
 									CRB_Object *scope,
@@ -656,6 +1097,7 @@ void crb_remove_scope_variable(CRB_Interpreter *inter,
 CRB_Interpreter *crb_get_current_interpreter(void);
 void crb_set_current_interpreter(CRB_Interpreter *inter);
 void *crb_malloc(size_t size);
+void *crb_tree_malloc(size_t size);
 void *crb_execute_malloc(CRB_Interpreter *inter, size_t size);
 
 Variable* CRB_add_global_variable(CRB_Interpreter *inter, char *identifier,
@@ -672,8 +1114,39 @@ Variable* crb_search_local_variable(CRB_Interpreter *inter,
 CRB_NativeFunctionProc *
 crb_search_native_function(CRB_Interpreter *inter, char *name);
 FunctionDefinition *crb_search_function(char *name);
+FunctionDefinition *crb_search_function_in(CRB_Interpreter *inter,
+											char *name);
+void crb_add_function(CRB_Interpreter *inter, FunctionDefinition *func);
 char *crb_get_operator_string(ExpressionType type);
 
+/* environment.c */
+CRB_LocalEnvironment *
+crb_alloc_local_environment(CRB_Interpreter *inter, FunctionDefinition *func,
+							CRB_Object *outer_scope, CRB_Boolean is_closure,
+							int line_number);
+void crb_reuse_local_environment(CRB_Interpreter *inter,
+								FunctionDefinition *func,
+								CRB_Object *outer_scope,
+								CRB_Boolean is_closure);
+void crb_dispose_local_environment(CRB_Interpreter *inter);
+void crb_dispose_environment_pool(CRB_Interpreter *inter);
+Variable* crb_search_env_variable(CRB_Interpreter *inter,
+								CRB_LocalEnvironment *env,
+								char *identifier,
+								CRB_Boolean can_create);
+void crb_bind_env_variable(CRB_Interpreter *inter,
+							CRB_LocalEnvironment *env,
+							char *identifier, CRB_Value *value);
+void crb_bind_env_parameters(CRB_Interpreter *inter,
+							CRB_LocalEnvironment *env,
+							ParameterList *param, CRB_Value *args);
+void crb_remove_env_variable(CRB_Interpreter *inter,
+							CRB_LocalEnvironment *env,
+							char *identifier);
+CRB_Boolean crb_add_env_global_ref(CRB_Interpreter *inter,
+								CRB_LocalEnvironment *env,
+								char *identifier);
+
 
 void crb_vstr_clear(VString *v);
 void crb_vstr_append_string(VString *v, char *str);
@@ -721,7 +1194,45 @@ Encoding CRB_set_encoding(Encoding type);
 
 
 /* fake_method.c */
-FunctionDefinition crb_get_fake_method_definition(CRB_Value fake_method_val);
+void crb_set_fake_method(CRB_Value *value, CRB_Object *object,
+						char *method_name);
+FunctionDefinition crb_get_fake_method_definition(CRB_Value *fake_method_val,
+												char *filename,
+												int line_number);
+
+/* sort.c */
+void crb_array_sort(CRB_Interpreter *inter, CRB_Object *obj,
+					CRB_Value *comparator, char *filename, int line_number);
+
+/* vector.c */
+VectorKernels *crb_vector_kernels(void);
+
+/* map.c */
+CRB_Boolean crb_is_map_key(CRB_Value *key);
+unsigned int crb_string_hash(CRB_Object *str);
+CRB_Value *crb_map_get(CRB_Object *obj, CRB_Value *key);
+void crb_map_put(CRB_Interpreter *inter, CRB_Object *obj,
+				 CRB_Value *key, CRB_Value *value);
+CRB_Boolean crb_map_remove(CRB_Object *obj, CRB_Value *key);
+int crb_map_next(CRB_Object *obj, int pos);
+CRB_Object *crb_map_keys(CRB_Interpreter *inter, CRB_Object *obj);
+CRB_Object *crb_map_values(CRB_Interpreter *inter, CRB_Object *obj);
+CRB_Boolean crb_set_add(CRB_Interpreter *inter, CRB_Object *obj,
+						CRB_Value *key);
+CRB_Object *crb_set_union(CRB_Interpreter *inter,
+						  CRB_Object *left, CRB_Object *right);
+CRB_Object *crb_set_intersect(CRB_Interpreter *inter,
+							  CRB_Object *left, CRB_Object *right);
+CRB_Object *crb_set_difference(CRB_Interpreter *inter,
+							   CRB_Object *left, CRB_Object *right);
+void crb_dispose_map(CRB_Interpreter *inter, CRB_Object *obj);
+
+/* record.c */
+void crb_construct_record(CRB_Interpreter *inter, Expression *expr,
+						  FunctionDefinition *func, int arg_count);
+CRB_Value *crb_record_field(CRB_Interpreter *inter, CRB_Object *obj,
+							Expression *expr);
+void crb_dispose_record(CRB_Interpreter *inter, CRB_Object *obj);
 
 /* exception.c */
 void exception_build_stack_trace(CRB_Interpreter *inter,
@@ -12,6 +12,7 @@
     StatementList       *statement_list;
     Block               *block;
     Elsif               *elsif;
+    ElsifList           *elsif_list;
     IdentifierList      *identifier_list;
 	ExpressionList		*expression_list;
 }
@@ -24,7 +25,7 @@
         EQ NE GT GE LT LE ADD SUB MUL DIV MOD TRUE_T FALSE_T GLOBAL_T
 		LB RB DOT INCREMENT DECREMENT CLOSURE TRY CATCH FINALLY THROW
 		FOREACH COLON ADD_ASSIGN SUB_ASSIGN MUL_ASSIGN DIV_ASSIGN
-		MOD_ASSIGN NOT
+		MOD_ASSIGN NOT RECORD
 %type   <parameter_list> parameter_list
 %type   <argument_list> argument_list
 %type   <expression> expression expression_opt
@@ -39,7 +40,8 @@
 		try_statement throw_statement foreach_statement
 %type   <statement_list> statement_list
 %type   <block> block
-%type   <elsif> elsif elsif_list
+%type   <elsif> elsif
+%type   <elsif_list> elsif_list
 %type   <identifier_list> identifier_list
 %type   <expression_list> expression_list
 %%
@@ -49,6 +51,7 @@ translation_unit
         ;
 definition_or_statement
         : function_definition
+        | record_definition
         | statement
         {
             CRB_Interpreter *inter = crb_get_current_interpreter();
@@ -67,6 +70,16 @@ function_definition
             crb_function_define($2, NULL, $5);
         }
         ;
+record_definition
+        : RECORD IDENTIFIER LC identifier_list RC
+        {
+            crb_record_define($2, $4);
+        }
+        | RECORD IDENTIFIER LC RC
+        {
+            crb_record_define($2, NULL);
+        }
+        ;
 parameter_list
         : IDENTIFIER
         {
@@ -388,6 +401,9 @@ if_statement
         ;
 elsif_list
         : elsif
+        {
+            $$ = crb_chain_elsif_list(NULL, $1);
+        }
         | elsif_list elsif
         {
             $$ = crb_chain_elsif_list($1, $2);
@@ -18,6 +18,14 @@ static void dump_line_number(char *filename, int line_number, FILE *fpout)
 	fprintf(fpout, "#line: %d\n", line_number);
 }
 
+/* a node keeps the index of its file and line in inter->location */
+static void dump_node_location(int location, FILE *fpout)
+{
+	CodeLocation *pos = &crb_get_current_interpreter()->location[location];
+
+	dump_line_number(pos->filename, pos->line_number, fpout);
+}
+
 
 static const char* space_num_string(int space_num)
 {
@@ -34,21 +42,23 @@ static const char* space_num_string(int space_num)
 static void dump_parameter(ParameterList *parameter, FILE *fpout,
 							int space_num)
 {
-	while (parameter!=NULL) {
+	int i;
+
+	for (i = 0; i < parameter->count; i++) {
 		fprintf(fpout, "%sPARAMETER %s\n", space_num_string(space_num),
-				parameter->name);
-		parameter = parameter->next;
+				parameter->name[i]);
 	}
 }
 
 static void dump_block(Block *block, FILE *fpout, int space_num)
 {
-	StatementList *list;
+	StatementList *list = block->statement_list;
+	int i;
 	
 	fprintf(fpout, "%sBLOCK\n", space_num_string(space_num));
 	
-	for (list = block->statement_list; list != NULL; list = list->next)
-		dump_statement(list->statement, fpout, space_num+1);
+	for (i = 0; list != NULL && i < list->count; i++)
+		dump_statement(list->statement[i], fpout, space_num+1);
 
 	fprintf(fpout, "%sEND_BLOCK\n", space_num_string(space_num));
 }
@@ -57,7 +67,19 @@ static void dump_block(Block *block, FILE *fpout, int space_num)
 static void dump_function(FunctionDefinition *function_def, FILE *fpout,
 							int space_num)
 {
+	int i;
+
 	while (function_def!=NULL) {
+		if (function_def->type == RECORD_DEFINITION) {
+			dump_line_number(function_def->filename,
+								function_def->line_number, fpout);
+			fprintf(fpout, "%sRECORD %s\n", space_num_string(space_num),
+					function_def->name);
+			for (i = 0; i < function_def->u.record_f.field_count; i++) {
+				fprintf(fpout, "%sFIELD %s\n", space_num_string(space_num+1),
+						function_def->u.record_f.field[i]);
+			}
+		}
 		if (function_def->type != CROWBAR_FUNCTION_DEFINITION) {
 			function_def = function_def->next;
 			continue;
@@ -256,25 +278,19 @@ static void dump_minus_expression(Expression *expression, FILE *fpout,
 static void dump_function_call_expression(Expression *expression,
 											FILE *fpout, int space_num)
 {
-	int argument_num = 0;
 	ArgumentList *list = expression->u.function_call_expression.argument;
-	while (list != NULL) {
-		argument_num++;
-		list = list->next;
-	}
+	int i;
 
 	fprintf(fpout, "%sFUNCTION_CALL_EXPRESSION %d\n",
 				space_num_string(space_num), 
-				argument_num);
+				list->count);
 	fprintf(fpout, "%sFUNCTION_NAME\n", space_num_string(space_num+1));
 	dump_expression(expression->u.function_call_expression.expr,
 					fpout, space_num+2);
 
-	list = expression->u.function_call_expression.argument;
-	while (list!=NULL) {
+	for (i = 0; i < list->count; i++) {
 		fprintf(fpout, "%sARGUMENT\n", space_num_string(space_num+1));
-		dump_expression(list->expression, fpout, space_num+2);
-		list = list->next;
+		dump_expression(list->expression[i], fpout, space_num+2);
 	}
 }
 
@@ -291,18 +307,13 @@ static void dump_null_expression(Expression *expression, FILE *fpout,
 static void dump_array_expression(Expression *expression,
 									FILE *fpout, int space_num)
 {
-	int expr_num = 0;
-	ExpressionList *list;
-	for (list = expression->u.array_expression; list != NULL;
-			list = list->next)
-		expr_num++;
+	ExpressionList *list = expression->u.array_expression;
+	int i;
 
 	fprintf(fpout, "%sARRAY_EXPRESSION %d\n",
-			space_num_string(space_num), expr_num);
-	for (list = expression->u.array_expression; list != NULL;
-			list = list->next) {
-		dump_expression(list->expression, fpout, space_num+1);
-	}
+			space_num_string(space_num), list->count);
+	for (i = 0; i < list->count; i++)
+		dump_expression(list->expression[i], fpout, space_num+1);
 }
 
 static void dump_index_expression(Expression *expression,
@@ -361,7 +372,7 @@ static void dump_closure_definition(Expression *expression,
 static void dump_expression(Expression *expression, FILE *fpout,
 														int space_num)
 {
-	dump_line_number(expression->filename, expression->line_number, fpout);
+	dump_node_location(expression->location, fpout);
 	switch (expression->type) {
 		case BOOLEAN_EXPRESSION:
 			dump_boolean_expression(expression, fpout, space_num);
@@ -464,8 +475,10 @@ static void dump_global_statement(Statement *statement, FILE *fpout,
 static void dump_if_statement(Statement *statement, FILE *fpout,
 															int space_num)
 {
-	Elsif *elsif_list = statement->u.if_s.elsif_list;
+	ElsifList *elsif_list = statement->u.if_s.elsif_list;
 	Statement *else_stat = statement->u.if_s.else_statement;
+	Elsif *elsif;
+	int i;
 	
 	fprintf(fpout, "%sIF_STATEMENT %s\n", space_num_string(space_num),
 			(elsif_list || else_stat) ? "HAVE_NEXT" : "NOT_HAVE_NEXT");
@@ -473,14 +486,14 @@ static void dump_if_statement(Statement *statement, FILE *fpout,
 	dump_expression(statement->u.if_s.condition, fpout, space_num+1);
 	dump_statement(statement->u.if_s.then_statement, fpout, space_num+1);
 
-	while (elsif_list != NULL) {
+	for (i = 0; elsif_list != NULL && i < elsif_list->count; i++) {
+		elsif = &elsif_list->elsif[i];
 
 		fprintf(fpout, "%sELSIF %s\n", space_num_string(space_num+1),
-		  (elsif_list->next || else_stat) ? "HAVE_NEXT" : "NOT_HAVE_NEXT");
-		dump_expression(elsif_list->condition, fpout, space_num+2);
-		dump_statement(elsif_list->statement, fpout, space_num+2);
-
-		elsif_list = elsif_list->next;
+		  (i + 1 < elsif_list->count || else_stat)
+		  ? "HAVE_NEXT" : "NOT_HAVE_NEXT");
+		dump_expression(elsif->condition, fpout, space_num+2);
+		dump_statement(elsif->statement, fpout, space_num+2);
 	}
 
 	if (else_stat != NULL) {
@@ -594,7 +607,7 @@ static void dump_foreach_statement(Statement *statement, FILE *fpout,
 
 static void dump_statement(Statement *statement, FILE *fpout, int space_num)
 {
-	dump_line_number(statement->filename, statement->line_number, fpout);
+	dump_node_location(statement->location, fpout);
 	switch (statement->type) {
 		case EXPRESSION_STATEMENT:
 			dump_expression_statement(statement, fpout, space_num);
@@ -642,11 +655,17 @@ static void dump_statement(Statement *statement, FILE *fpout, int space_num)
 
 void CRB_dump_interpreter(CRB_Interpreter *interpreter, FILE *fpout)
 {
+	if (interpreter->tree_optimized)
+		fprintf(fpout, "#optimized: folded %d, removed %d, inlined %d\n",
+				interpreter->folded_expression_count,
+				interpreter->removed_statement_count,
+				interpreter->inlined_call_count);
+
 	dump_function(interpreter->function_list, fpout, 0);
 	
-	StatementList *list;
-	for (list = interpreter->statement_list; list != NULL; 
-												list = list->next)
-		dump_statement(list->statement, fpout, 0);
+	StatementList *list = interpreter->statement_list;
+	int i;
+	for (i = 0; list != NULL && i < list->count; i++)
+		dump_statement(list->statement[i], fpout, 0);
 			
 }
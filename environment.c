@@ -0,0 +1,490 @@
+#include <stdio.h>
+#include <string.h>
+#include "MEM.h"
+#include "DBG.h"
+#include "crowbar.h"
+
+#define ENV_VARIABLE_MIN_ALLOC_SIZE (8)
+
+
+/*
+ * Walk a function body once to size its variable slots and to find
+ * out whether it defines closures.  Closure bodies are not entered,
+ * they get their own frame when called.
+ */
+typedef struct {
+	int variable_count;
+	CRB_Boolean has_closure;
+} LocalInfo;
+
+static void analyze_statement(Statement *st, LocalInfo *info);
+
+static void analyze_expression(Expression *expr, LocalInfo *info)
+{
+	ArgumentList *arg;
+	ExpressionList *list;
+	int i;
+
+	if (expr == NULL)
+		return;
+
+	switch (expr->type) {
+	case ASSIGN_EXPRESSION:
+		if (expr->u.assign_expression.left->type == IDENTIFIER_EXPRESSION)
+			info->variable_count++;
+		analyze_expression(expr->u.assign_expression.left, info);
+		analyze_expression(expr->u.assign_expression.operand, info);
+		break;
+	case ADD_EXPRESSION:
+	case SUB_EXPRESSION:
+	case MUL_EXPRESSION:
+	case DIV_EXPRESSION:
+	case MOD_EXPRESSION:
+	case EQ_EXPRESSION:
+	case NE_EXPRESSION:
+	case GT_EXPRESSION:
+	case GE_EXPRESSION:
+	case LT_EXPRESSION:
+	case LE_EXPRESSION:
+	case LOGICAL_AND_EXPRESSION:
+	case LOGICAL_OR_EXPRESSION:
+		analyze_expression(expr->u.binary_expression.left, info);
+		analyze_expression(expr->u.binary_expression.right, info);
+		break;
+	case NOT_EXPRESSION:
+		analyze_expression(expr->u.not_expression.sub_expr, info);
+		break;
+	case MINUS_EXPRESSION:
+		analyze_expression(expr->u.minus_expression, info);
+		break;
+	case FUNCTION_CALL_EXPRESSION:
+		analyze_expression(expr->u.function_call_expression.expr, info);
+		arg = expr->u.function_call_expression.argument;
+		for (i = 0; i < arg->count; i++)
+			analyze_expression(arg->expression[i], info);
+		break;
+	case ARRAY_EXPRESSION:
+		list = expr->u.array_expression;
+		for (i = 0; i < list->count; i++)
+			analyze_expression(list->expression[i], info);
+		break;
+	case INDEX_EXPRESSION:
+		analyze_expression(expr->u.index_expression.array, info);
+		analyze_expression(expr->u.index_expression.index, info);
+		break;
+	case POST_INCREMENT_EXPRESSION:
+	case PREV_INCREMENT_EXPRESSION:
+	case POST_DECREMENT_EXPRESSION:
+	case PREV_DECREMENT_EXPRESSION:
+		analyze_expression(expr->u.inc_dec.operand, info);
+		break;
+	case MEMBER_EXPRESSION:
+		analyze_expression(expr->u.member_expression.expression, info);
+		break;
+	case CLOSURE_DEFINITION:
+		info->has_closure = CRB_TRUE;
+		break;
+	default:
+		break;
+	}
+}
+
+static void analyze_statement_list(StatementList *list, LocalInfo *info)
+{
+	int i;
+
+	for (i = 0; list && i < list->count; i++)
+		analyze_statement(list->statement[i], info);
+}
+
+static void analyze_statement(Statement *st, LocalInfo *info)
+{
+	ElsifList *elsif_list;
+	int i;
+
+	if (st == NULL)
+		return;
+
+	switch (st->type) {
+	case EXPRESSION_STATEMENT:
+		analyze_expression(st->u.expression_s, info);
+		break;
+	case IF_STATEMENT:
+		analyze_expression(st->u.if_s.condition, info);
+		analyze_statement(st->u.if_s.then_statement, info);
+		elsif_list = st->u.if_s.elsif_list;
+		for (i = 0; elsif_list && i < elsif_list->count; i++) {
+			analyze_expression(elsif_list->elsif[i].condition, info);
+			analyze_statement(elsif_list->elsif[i].statement, info);
+		}
+		analyze_statement(st->u.if_s.else_statement, info);
+		break;
+	case WHILE_STATEMENT:
+		analyze_expression(st->u.while_s.condition, info);
+		analyze_statement(st->u.while_s.statement, info);
+		break;
+	case FOR_STATEMENT:
+		analyze_expression(st->u.for_s.init, info);
+		analyze_expression(st->u.for_s.condition, info);
+		analyze_expression(st->u.for_s.post, info);
+		analyze_statement(st->u.for_s.statement, info);
+		break;
+	case RETURN_STATEMENT:
+		analyze_expression(st->u.return_s.return_value, info);
+		break;
+	case BLOCK_STATEMENT:
+		analyze_statement_list(st->u.block_s.block->statement_list, info);
+		break;
+	case TRY_STATEMENT:
+		if (st->u.try_s.identifier)
+			info->variable_count++;
+		analyze_statement(st->u.try_s.run_st, info);
+		analyze_statement(st->u.try_s.catch_st, info);
+		analyze_statement(st->u.try_s.final_st, info);
+		break;
+	case THROW_STATEMENT:
+		analyze_expression(st->u.throw_s.throw_expr, info);
+		break;
+	case FOREACH_STATEMENT:
+		info->variable_count += 3;	/* identifier, array and iterator */
+		analyze_expression(st->u.foreach_s.array_expr, info);
+		analyze_statement(st->u.foreach_s.sub_st, info);
+		break;
+	default:
+		break;
+	}
+}
+
+static void analyze_function(FunctionDefinition *func)
+{
+	LocalInfo info;
+
+	info.variable_count = func->u.crowbar_f.parameter->count;
+	info.has_closure = CRB_FALSE;
+
+	analyze_statement_list(func->u.crowbar_f.block->statement_list, &info);
+
+	func->u.crowbar_f.local_variable_count = info.variable_count;
+	func->u.crowbar_f.has_closure = info.has_closure;
+}
+
+
+/* size the slots for func and create the scope if func needs one,
+ * env must already be inter->top_env */
+static void setup_local_environment(CRB_Interpreter *inter,
+									CRB_LocalEnvironment *env,
+									FunctionDefinition *func,
+									CRB_Object *outer_scope,
+									CRB_Boolean is_closure)
+{
+	/* one slot for "this" or the closure name */
+	int slot_count = 1;
+	CRB_Boolean need_scope = CRB_FALSE;
+
+	if (func->type == CROWBAR_FUNCTION_DEFINITION) {
+		if (func->u.crowbar_f.local_variable_count < 0)
+			analyze_function(func);
+		slot_count += func->u.crowbar_f.local_variable_count;
+		need_scope = func->u.crowbar_f.has_closure;
+	}
+
+	/* slots never move while the frame is live, Variable pointers
+	 * handed out by the lookups stay valid */
+	if (env->variable_alloc_size < slot_count) {
+		if (slot_count < ENV_VARIABLE_MIN_ALLOC_SIZE)
+			slot_count = ENV_VARIABLE_MIN_ALLOC_SIZE;
+		env->variable = MEM_realloc(env->variable,
+									sizeof(Variable) * slot_count);
+		env->variable_alloc_size = slot_count;
+	}
+
+	env->variable_count = 0;
+	env->overflow_variable = NULL;
+	env->global_ref = NULL;
+	env->environ_scope = NULL;
+	env->outer_scope = outer_scope;
+	env->is_closure = is_closure;
+	env->stack_hold = 0;
+	env->func_name = func->name;
+
+	if (need_scope) {
+		/* closures defined here may outlive the frame */
+		env->environ_scope = crb_create_scope_chain(inter,
+							is_closure ? outer_scope
+										: inter->first_env.environ_scope,
+							is_closure);
+	}
+}
+
+static void release_local_environment(CRB_LocalEnvironment *env)
+{
+	while (env->overflow_variable) {
+		Variable *tmp = env->overflow_variable;
+		env->overflow_variable = tmp->next;
+		MEM_free(tmp);
+	}
+	while (env->global_ref) {
+		GlobalVariableRef *tmp = env->global_ref;
+		env->global_ref = tmp->next;
+		MEM_free(tmp);
+	}
+	env->variable_count = 0;
+	env->environ_scope = NULL;
+	env->outer_scope = NULL;
+}
+
+
+CRB_LocalEnvironment *
+crb_alloc_local_environment(CRB_Interpreter *inter, FunctionDefinition *func,
+							CRB_Object *outer_scope, CRB_Boolean is_closure,
+							int line_number)
+{
+	CRB_LocalEnvironment *env;
+
+	env = inter->free_env;
+	if (env != NULL) {
+		inter->free_env = env->parent_env;
+	} else {
+		env = MEM_malloc(sizeof(CRB_LocalEnvironment));
+		env->variable = NULL;
+		env->variable_alloc_size = 0;
+	}
+
+	env->caller_line_number = line_number;
+	env->parent_env = inter->top_env;
+	inter->top_env = env;
+
+	setup_local_environment(inter, env, func, outer_scope, is_closure);
+
+	return env;
+}
+
+
+/* turn the top frame into a frame of func, for a tail call */
+void crb_reuse_local_environment(CRB_Interpreter *inter,
+								FunctionDefinition *func,
+								CRB_Object *outer_scope,
+								CRB_Boolean is_closure)
+{
+	CRB_LocalEnvironment *env = inter->top_env;
+
+	DBG_assert(env != NULL && env != &inter->first_env,
+			("crb_reuse_local_environment without local env\n"));
+
+	release_local_environment(env);
+	setup_local_environment(inter, env, func, outer_scope, is_closure);
+}
+
+
+void crb_dispose_local_environment(CRB_Interpreter *inter)
+{
+	CRB_LocalEnvironment *env = inter->top_env;
+
+	DBG_assert(env != NULL && env != &inter->first_env,
+			("crb_dispose_local_environment without local env\n"));
+
+	inter->top_env = env->parent_env;
+	release_local_environment(env);
+
+	env->parent_env = inter->free_env;
+	inter->free_env = env;
+}
+
+
+void crb_dispose_environment_pool(CRB_Interpreter *inter)
+{
+	while (inter->free_env) {
+		CRB_LocalEnvironment *env = inter->free_env;
+		inter->free_env = env->parent_env;
+		if (env->variable)
+			MEM_free(env->variable);
+		MEM_free(env);
+	}
+}
+
+
+static Variable *search_frame_variable(CRB_LocalEnvironment *env,
+										char *identifier)
+{
+	GlobalVariableRef *ref_pos;
+	Variable *variable;
+	int i;
+
+	for (ref_pos = env->global_ref; ref_pos; ref_pos = ref_pos->next) {
+		if (strcmp(ref_pos->variable->name, identifier) == 0)
+			return ref_pos->variable;
+	}
+
+	for (i = 0; i < env->variable_count; i++) {
+		variable = &env->variable[i];
+		if (variable->name && strcmp(variable->name, identifier) == 0)
+			return variable;
+	}
+
+	for (variable = env->overflow_variable; variable;
+			variable = variable->next) {
+		if (strcmp(variable->name, identifier) == 0)
+			return variable;
+	}
+
+	return NULL;
+}
+
+static Variable *add_frame_variable(CRB_LocalEnvironment *env,
+									char *identifier)
+{
+	Variable *variable;
+	int i;
+
+	if (env->variable_count < env->variable_alloc_size) {
+		variable = &env->variable[env->variable_count++];
+	} else {
+		/* reuse a slot released by crb_remove_env_variable */
+		for (i = 0; i < env->variable_count; i++) {
+			if (env->variable[i].name == NULL)
+				break;
+		}
+		if (i < env->variable_count) {
+			variable = &env->variable[i];
+		} else {
+			variable = MEM_malloc(sizeof(Variable));
+			variable->next = env->overflow_variable;
+			env->overflow_variable = variable;
+		}
+	}
+	variable->name = identifier;
+	variable->value.type = CRB_NULL_VALUE;
+
+	return variable;
+}
+
+
+/* search the variables of env itself, without walking any outer scope */
+Variable* crb_search_env_variable(CRB_Interpreter *inter,
+								CRB_LocalEnvironment *env,
+								char *identifier,
+								CRB_Boolean can_create)
+{
+	Variable *variable;
+
+	if (env->environ_scope)
+		return crb_search_scope_variable(inter, env->environ_scope,
+										identifier, can_create);
+
+	variable = search_frame_variable(env, identifier);
+	if (variable == NULL && can_create)
+		variable = add_frame_variable(env, identifier);
+
+	return variable;
+}
+
+
+/* bind a parameter, the caller guarantees the name is not bound yet */
+void crb_bind_env_variable(CRB_Interpreter *inter,
+							CRB_LocalEnvironment *env,
+							char *identifier, CRB_Value *value)
+{
+	Variable *variable;
+
+	if (env->environ_scope)
+		variable = crb_search_scope_variable(inter, env->environ_scope,
+											identifier, CRB_TRUE);
+	else
+		variable = add_frame_variable(env, identifier);
+
+	variable->value = *value;
+}
+
+
+/* bind the parameters to the values at args in one pass, there are as
+ * many values as parameters */
+void crb_bind_env_parameters(CRB_Interpreter *inter,
+							CRB_LocalEnvironment *env,
+							ParameterList *param, CRB_Value *args)
+{
+	Variable *variable;
+	int i;
+
+	if (env->environ_scope) {
+		for (i = 0; i < param->count; i++)
+			crb_bind_env_variable(inter, env, param->name[i], &args[i]);
+		return;
+	}
+
+	/* the frame was sized for the parameters and the callee name */
+	DBG_assert(env->variable_count + param->count
+				<= env->variable_alloc_size,
+			("no slots for %d parameters\n", param->count));
+
+	variable = &env->variable[env->variable_count];
+	for (i = 0; i < param->count; i++) {
+		variable[i].name = param->name[i];
+		variable[i].value = args[i];
+	}
+	env->variable_count += param->count;
+}
+
+
+void crb_remove_env_variable(CRB_Interpreter *inter,
+							CRB_LocalEnvironment *env,
+							char *identifier)
+{
+	Variable *variable, *prev;
+	int i;
+
+	if (env->environ_scope) {
+		crb_remove_scope_variable(inter, env->environ_scope, identifier);
+		return;
+	}
+
+	/* slots are only marked dead, other slots must not move */
+	for (i = 0; i < env->variable_count; i++) {
+		variable = &env->variable[i];
+		if (variable->name && strcmp(variable->name, identifier) == 0) {
+			variable->name = NULL;
+			variable->value.type = CRB_NULL_VALUE;
+			return;
+		}
+	}
+
+	for (prev = NULL, variable = env->overflow_variable; variable;
+			prev = variable, variable = variable->next) {
+		if (strcmp(variable->name, identifier) == 0) {
+			if (prev)
+				prev->next = variable->next;
+			else
+				env->overflow_variable = variable->next;
+			MEM_free(variable);
+			return;
+		}
+	}
+}
+
+
+CRB_Boolean crb_add_env_global_ref(CRB_Interpreter *inter,
+								CRB_LocalEnvironment *env,
+								char *identifier)
+{
+	GlobalVariableRef *ref_pos;
+	Variable *variable;
+
+	if (env->environ_scope)
+		return crb_add_scope_global_ref(inter, env->environ_scope,
+										identifier);
+
+	for (ref_pos = env->global_ref; ref_pos; ref_pos = ref_pos->next) {
+		if (strcmp(ref_pos->variable->name, identifier) == 0)
+			return CRB_TRUE;
+	}
+
+	variable = crb_search_global_variable(inter, identifier);
+	if (variable == NULL)
+		return CRB_FALSE;
+
+	ref_pos = MEM_malloc(sizeof(GlobalVariableRef));
+	ref_pos->variable = variable;
+	ref_pos->next = env->global_ref;
+	env->global_ref = ref_pos;
+
+	return CRB_TRUE;
+}
@@ -10,6 +10,7 @@ MessageFormat crb_compile_error_message_format[] = {
 	{"error in regexp literal definition"},
 	{"unexpected wide string in compilation"},
 	{"can not create regexp in compilation"},
+	{"field name conflict ($(name))"},
     {"dummy"},
 };
 
@@ -50,7 +51,11 @@ MessageFormat crb_runtime_error_message_format[] = {
 	{"unexpected wide string"},
 	{"group index overflow"},
 	{"no such group index: $(g_idx)"},
-	{"foreach not array type"},
+	{"foreach needs an array or an object with iterator()"},
 	{"not boolean value for not expression"},
+	{"array sizes differ: $(size) and $(other_size)"},
+	{"the comparator of sort() changed the array"},
+	{"a map key or a set element should be a string or an int."},
+	{"record $(name) has no field \"$(member_name)\""},
     {"dummy"},
 };
@@ -109,9 +109,7 @@ static void eval_regexp_expression(CRB_Interpreter *inter,
 									CRB_Regexp *regexp)
 {
 	CRB_Value v;
-	v.type = CRB_NATIVE_POINTER_VALUE;
-	v.u.native_pointer.info = crb_get_regexp_info();
-	v.u.native_pointer.pointer = (void*)regexp;
+	CRB_set_native_pointer(&v, (void*)regexp, crb_get_regexp_info());
 
 	push_value(inter, &v);
 }
@@ -159,7 +157,8 @@ eval_identifier_expression(CRB_Interpreter *inter,
 			env, expr->u.identifier, CRB_FALSE);
 
 	if (variable == NULL) {
-    	crb_runtime_error(expr->filename, expr->line_number, 
+    	crb_runtime_error(crb_node_filename(inter, expr),
+							crb_node_line_number(inter, expr), 
 							VARIABLE_NOT_FOUND_ERR,
                               STRING_MESSAGE_ARGUMENT,
                               "name", expr->u.identifier,
@@ -189,9 +188,28 @@ static CRB_Value* get_identifier_lvalue(CRB_Interpreter *inter,
 
 
 
-static CRB_Value* get_array_element_lvalue(CRB_Interpreter *inter,
+static void check_array_index(CRB_Interpreter *inter, Expression *expr,
+								CRB_Object *array, int index)
+{
+	crb_array_sync(array);
+	if (index < 0 || index >= array->u.array.length)
+		crb_runtime_error(crb_node_filename(inter, expr),
+				crb_node_line_number(inter, expr), 
+				ARRAY_INDEX_OUT_OF_BOUND_ERR,
+				INT_MESSAGE_ARGUMENT, "size",
+				array->u.array.length,
+				INT_MESSAGE_ARGUMENT, "index",
+				index);
+}
+
+/*
+ * A packed array has no CRB_Value to point at, so an element is
+ * addressed by the array and the index, read with crb_array_get and
+ * written with crb_array_set.
+ */
+static CRB_Object* eval_array_element(CRB_Interpreter *inter,
 										CRB_LocalEnvironment *env,
-										Expression *expr)
+										Expression *expr, int *index)
 {
 	CRB_Value *array_val;
 	CRB_Value *index_val;
@@ -203,30 +221,24 @@ static CRB_Value* get_array_element_lvalue(CRB_Interpreter *inter,
 	index_val = peek_stack(inter, 0);
 
 	if (array_val->type != CRB_ARRAY_VALUE)
-		crb_runtime_error(expr->filename, expr->line_number, 
+		crb_runtime_error(crb_node_filename(inter, expr),
+				crb_node_line_number(inter, expr), 
 				INDEX_OPERAND_NOT_ARRAY_ERR,
 				MESSAGE_ARGUMENT_END);
 	if (index_val->type != CRB_INT_VALUE)
-		crb_runtime_error(expr->filename, expr->line_number, 
+		crb_runtime_error(crb_node_filename(inter, expr),
+				crb_node_line_number(inter, expr), 
 				INDEX_OPERAND_NOT_INT_ERR,
 				MESSAGE_ARGUMENT_END);
-	if (index_val->u.int_value < 0 ||
-			index_val->u.int_value >= 
-				array_val->u.object_value->u.array.length)
-		crb_runtime_error(expr->filename, expr->line_number, 
-				ARRAY_INDEX_OUT_OF_BOUND_ERR,
-				INT_MESSAGE_ARGUMENT, "size",
-				array_val->u.object_value->u.array.length,
-				INT_MESSAGE_ARGUMENT, "index",
-				index_val->u.int_value);
+	check_array_index(inter, expr, array_val->u.object_value,
+						index_val->u.int_value);
 
 	// we need to keep array_val on the stack to make sure it 
 	// will not be garbage collected!!!
+	*index = index_val->u.int_value;
 	pop_value(inter);
 	
-	return &array_val->u.object_value->u.array.array[
-				index_val->u.int_value];
-
+	return array_val->u.object_value;
 }
 
 
@@ -241,8 +253,12 @@ static CRB_Value* get_member_expression_lvalue(CRB_Interpreter *inter,
 	eval_expression(inter, env, expr->u.member_expression.expression);
 	CRB_Value *left_val = peek_stack(inter, 0);
 
+	if (left_val->type == CRB_RECORD_VALUE)
+		return crb_record_field(inter, left_val->u.object_value, expr);
+
 	if (left_val->type != CRB_ASSOC_VALUE)
-		crb_runtime_error(expr->filename, expr->line_number, 
+		crb_runtime_error(crb_node_filename(inter, expr),
+				crb_node_line_number(inter, expr), 
 				MEMBER_OPERATION_NOT_ASSOC_ERR,
 				MESSAGE_ARGUMENT_END);
 
@@ -254,7 +270,8 @@ static CRB_Value* get_member_expression_lvalue(CRB_Interpreter *inter,
 		if (variable != NULL)
 			ret_val = &(variable->value);
 		else {
-			crb_runtime_error(expr->filename, expr->line_number, 
+			crb_runtime_error(crb_node_filename(inter, expr),
+					crb_node_line_number(inter, expr), 
 					NO_SUCH_MEMBER_ERR,
 					STRING_MESSAGE_ARGUMENT, "member_name",
 					expr->u.member_expression.member_name,
@@ -275,12 +292,11 @@ static CRB_Value* get_lvalue(CRB_Interpreter *inter,
 
 	if (expr->type == IDENTIFIER_EXPRESSION)
 		dest = get_identifier_lvalue(inter, env, expr->u.identifier);
-	else if (expr->type == INDEX_EXPRESSION)
-		dest = get_array_element_lvalue(inter, env, expr);
 	else if (expr->type == MEMBER_EXPRESSION)
 		dest = get_member_expression_lvalue(inter, env, expr, CRB_TRUE);
 	else
-		crb_runtime_error(expr->filename, expr->line_number, 
+		crb_runtime_error(crb_node_filename(inter, expr),
+						crb_node_line_number(inter, expr), 
 						NOT_LVALUE_ERR,
 						MESSAGE_ARGUMENT_END);
 
@@ -294,22 +310,102 @@ eval_binary_expression(CRB_Interpreter *inter, CRB_LocalEnvironment *env,
                            ExpressionType operator,
                            Expression *left, Expression *right);
 
-static void get_temp_variable_name(CRB_Interpreter *inter,
-									CRB_LocalEnvironment *env,
-									char *tmp_name)
+/* dest op= src in place, the caller stores the result to dest */
+void
+crb_eval_compound_assign(CRB_Interpreter *inter, AssignType type,
+					 CRB_Value *dest, CRB_Value *src, CRB_Value *result,
+					 char *filename, int line_number)
 {
-	int id = 0;
-	Variable *var = NULL;
-
-	do {
-		id++;
-		sprintf(tmp_name, "crowbar.tmp_name_%d", id);
-		var = crb_search_scope_variable(inter, env->environ_scope,
-										tmp_name, CRB_FALSE);
-	} while (var != NULL);
-	
+	ExpressionType expr_type;
+
+	if (dest->type == CRB_INT_VALUE && src->type == CRB_INT_VALUE) {
+		result->type = CRB_INT_VALUE;
+		switch (type) {
+		case ADD_ASSIGN_TYPE:
+			result->u.int_value = dest->u.int_value + src->u.int_value;
+			return;
+		case SUB_ASSIGN_TYPE:
+			result->u.int_value = dest->u.int_value - src->u.int_value;
+			return;
+		case MUL_ASSIGN_TYPE:
+			result->u.int_value = dest->u.int_value * src->u.int_value;
+			return;
+		default:
+			break;
+		}
+	}
+	else if (dest->type == CRB_DOUBLE_VALUE
+			&& (src->type == CRB_DOUBLE_VALUE
+				|| src->type == CRB_INT_VALUE)) {
+		double right = (src->type == CRB_DOUBLE_VALUE)
+							? src->u.double_value : src->u.int_value;
+
+		result->type = CRB_DOUBLE_VALUE;
+		switch (type) {
+		case ADD_ASSIGN_TYPE:
+			result->u.double_value = dest->u.double_value + right;
+			return;
+		case SUB_ASSIGN_TYPE:
+			result->u.double_value = dest->u.double_value - right;
+			return;
+		case MUL_ASSIGN_TYPE:
+			result->u.double_value = dest->u.double_value * right;
+			return;
+		case DIV_ASSIGN_TYPE:
+			result->u.double_value = dest->u.double_value / right;
+			return;
+		default:
+			break;
+		}
+	}
+	else if (dest->type == CRB_STRING_VALUE && type == ADD_ASSIGN_TYPE) {
+		crb_chain_string(inter, dest, src, result);
+		return;
+	}
+
+	if (type == ADD_ASSIGN_TYPE) expr_type = ADD_EXPRESSION;
+	else if (type == SUB_ASSIGN_TYPE) expr_type = SUB_EXPRESSION;
+	else if (type == MUL_ASSIGN_TYPE) expr_type = MUL_EXPRESSION;
+	else if (type == DIV_ASSIGN_TYPE) expr_type = DIV_EXPRESSION;
+	else if (type == MOD_ASSIGN_TYPE) expr_type = MOD_EXPRESSION;
+	else DBG_panic(("unexpected assign_type: %d\n", type));
+
+	crb_eval_binary_values(inter, expr_type, dest, src, result,
+						filename, line_number);
 }
 
+static void 
+eval_assign_array_element(CRB_Interpreter *inter, CRB_LocalEnvironment *env,
+						AssignType type,
+						Expression *left, Expression *expression)
+{
+	CRB_Object *array;
+	CRB_Value *src;
+	int index;
+
+	array = eval_array_element(inter, env, left, &index);
+
+	eval_expression(inter, env, expression);
+	src = peek_stack(inter, 0);
+	// the right side may have shrunk the array
+	check_array_index(inter, left, array, index);
+
+	if (type != ASSIGN_TYPE) {
+		CRB_Value dest;
+		CRB_Value result;
+
+		crb_array_get(array, index, &dest);
+		crb_eval_compound_assign(inter, type, &dest, src, &result,
+							crb_node_filename(inter, left),
+							crb_node_line_number(inter, left));
+		*src = result;
+	}
+	crb_array_set(inter, array, index, src);
+
+	// pop the array value after assignment
+	*peek_stack(inter, 1) = *src;
+	pop_value(inter);
+}
 
 static void 
 eval_assign_expression(CRB_Interpreter *inter, CRB_LocalEnvironment *env,
@@ -319,62 +415,32 @@ eval_assign_expression(CRB_Interpreter *inter, CRB_LocalEnvironment *env,
     CRB_Value  *src;
     CRB_Value  *dest;
 
+	if (left->type == INDEX_EXPRESSION) {
+		eval_assign_array_element(inter, env, type, left, expression);
+		return;
+	}
+
 	dest = get_lvalue(inter, env, left);
     
 	eval_expression(inter, env, expression);
 	src = peek_stack(inter, 0);
 
 
-	if (type == ASSIGN_TYPE)
-		*dest = *src;
-	else {
-		// we should not repeat executing left expr
-
-		ExpressionType expr_type;
-
-		if (type == ADD_ASSIGN_TYPE) expr_type = ADD_EXPRESSION;
-		else if (type == SUB_ASSIGN_TYPE) expr_type = SUB_EXPRESSION;
-		else if (type == MUL_ASSIGN_TYPE) expr_type = MUL_EXPRESSION;
-		else if (type == DIV_ASSIGN_TYPE) expr_type = DIV_EXPRESSION;
-		else if (type == MOD_ASSIGN_TYPE) expr_type = MOD_EXPRESSION;
-		else DBG_panic(("unexpected assign_type: %d\n", type));
-
-		char tmp_name1[100];
-		char tmp_name2[100];
-		get_temp_variable_name(inter, env, tmp_name1);
-		Variable *var = crb_search_scope_variable(inter, 
-							env->environ_scope, tmp_name1, CRB_TRUE);
-		var->value = *dest;
-
-		get_temp_variable_name(inter, env, tmp_name2);
-		Variable *var2 = crb_search_scope_variable(inter,
-							env->environ_scope, tmp_name2, CRB_TRUE);
-		var2->value = *src;
-		shrink_stack(inter, 1);
-
-		
-		Expression id_expr1;
-		crb_init_identifier_expression(&id_expr1, tmp_name1,
-										__FILE__, __LINE__);
-
-		Expression id_expr2;
-		crb_init_identifier_expression(&id_expr2, tmp_name2,
-										__FILE__, __LINE__);
-
-		eval_binary_expression(inter, env, expr_type, &id_expr1,
-								&id_expr2);
+	if (type != ASSIGN_TYPE) {
+		// we should not repeat executing left expr, so compute
+		// dest op src directly and leave the result on the stack
+		CRB_Value result;
 
-		crb_remove_scope_variable(inter, env->environ_scope, tmp_name1);
-		crb_remove_scope_variable(inter, env->environ_scope, tmp_name2);
-
-		src = peek_stack(inter, 0);	
+		crb_eval_compound_assign(inter, type, dest, src, &result,
+							crb_node_filename(inter, left),
+							crb_node_line_number(inter, left));
+		*src = result;
 	}
 
 
 	*dest = *src;
-	if (left->type == INDEX_EXPRESSION 
-			|| left->type == MEMBER_EXPRESSION) {
-		// pop the array/assoc value after assignment
+	if (left->type == MEMBER_EXPRESSION) {
+		// pop the assoc value after assignment
 		CRB_Value *ret_pos = peek_stack(inter, 1);
 		*ret_pos = *src;
 		pop_value(inter);
@@ -597,7 +663,7 @@ eval_binary_null(CRB_Interpreter *inter, ExpressionType operator,
 }
 
 void
-chain_string(CRB_Interpreter *inter, CRB_Value *left, CRB_Value *right,
+crb_chain_string(CRB_Interpreter *inter, CRB_Value *left, CRB_Value *right,
 				CRB_Value *result)
 {
 	CRB_CHAR *right_str;
@@ -620,80 +686,83 @@ chain_string(CRB_Interpreter *inter, CRB_Value *left, CRB_Value *right,
 
 }
 
-static void
-eval_binary_expression(CRB_Interpreter *inter, CRB_LocalEnvironment *env,
-                           ExpressionType operator,
-                           Expression *left, Expression *right)
+void
+crb_eval_binary_values(CRB_Interpreter *inter, ExpressionType operator,
+				   CRB_Value *left_val, CRB_Value *right_val,
+				   CRB_Value *result, char *filename, int line_number)
 {
-    CRB_Value   *left_val;
-    CRB_Value   *right_val;
-    CRB_Value   result;
-
-    eval_expression(inter, env, left);
-    eval_expression(inter, env, right);
-	left_val = peek_stack(inter, 1);
-	right_val = peek_stack(inter, 0);
-
     if (left_val->type == CRB_INT_VALUE
         && right_val->type == CRB_INT_VALUE) {
         eval_binary_int(inter, operator,
                         left_val->u.int_value, right_val->u.int_value,
-                        &result, left->filename, left->line_number);
+                        result, filename, line_number);
     } else if (left_val->type == CRB_DOUBLE_VALUE
                && right_val->type == CRB_DOUBLE_VALUE) {
         eval_binary_double(inter, operator,
                            left_val->u.double_value, 
 						   right_val->u.double_value,
-                           &result, left->filename, left->line_number);
+                           result, filename, line_number);
     } else if (left_val->type == CRB_INT_VALUE
                && right_val->type == CRB_DOUBLE_VALUE) {
-        left_val->u.double_value = left_val->u.int_value;
         eval_binary_double(inter, operator,
-                           left_val->u.double_value, 
+                           left_val->u.int_value, 
 						   right_val->u.double_value,
-                           &result, left->filename, left->line_number);
+                           result, filename, line_number);
     } else if (left_val->type == CRB_DOUBLE_VALUE
                && right_val->type == CRB_INT_VALUE) {
-        right_val->u.double_value = right_val->u.int_value;
         eval_binary_double(inter, operator,
                            left_val->u.double_value, 
-						   right_val->u.double_value,
-                           &result, left->filename, left->line_number);
+						   right_val->u.int_value,
+                           result, filename, line_number);
     } else if (left_val->type == CRB_BOOLEAN_VALUE
                && right_val->type == CRB_BOOLEAN_VALUE) {
-        result.type = CRB_BOOLEAN_VALUE;
-        result.u.boolean_value
+        result->type = CRB_BOOLEAN_VALUE;
+        result->u.boolean_value
             = eval_binary_boolean(inter, operator,
                                   left_val->u.boolean_value,
                                   right_val->u.boolean_value,
-								  left->filename,
-                                  left->line_number);
+								  filename, line_number);
     } else if (left_val->type == CRB_STRING_VALUE
                && operator == ADD_EXPRESSION) {
-		chain_string(inter, left_val, right_val, &result);
+		crb_chain_string(inter, left_val, right_val, result);
     
 	} else if (left_val->type == CRB_STRING_VALUE
                && right_val->type == CRB_STRING_VALUE) {
-        result.type = CRB_BOOLEAN_VALUE;
-        result.u.boolean_value
+        result->type = CRB_BOOLEAN_VALUE;
+        result->u.boolean_value
             = eval_compare_string(operator, left_val, right_val,
-                                  left->filename, left->line_number);
+                                  filename, line_number);
     } else if (left_val->type == CRB_NULL_VALUE
                || right_val->type == CRB_NULL_VALUE) {
-        result.type = CRB_BOOLEAN_VALUE;
-        result.u.boolean_value
+        result->type = CRB_BOOLEAN_VALUE;
+        result->u.boolean_value
             = eval_binary_null(inter, operator, left_val, right_val,
-                                left->filename,
-								left->line_number);
+                                filename, line_number);
     } else {
         char *op_str = crb_get_operator_string(operator);
 		printf("operator=%d, %s, left_type=%d, right_type=%d\n",
 				operator, op_str, left_val->type, right_val->type);
-        crb_runtime_error(left->filename, left->line_number, 
+        crb_runtime_error(filename, line_number, 
 						BAD_OPERAND_TYPE_ERR,
                           STRING_MESSAGE_ARGUMENT, "operator", op_str,
                           MESSAGE_ARGUMENT_END);
     }
+}
+
+static void
+eval_binary_expression(CRB_Interpreter *inter, CRB_LocalEnvironment *env,
+                           ExpressionType operator,
+                           Expression *left, Expression *right)
+{
+    CRB_Value   result;
+
+    eval_expression(inter, env, left);
+    eval_expression(inter, env, right);
+
+	crb_eval_binary_values(inter, operator, peek_stack(inter, 1),
+						peek_stack(inter, 0), &result,
+						crb_node_filename(inter, left),
+						crb_node_line_number(inter, left));
 
 	pop_value(inter);
 	pop_value(inter);
@@ -719,7 +788,8 @@ static void eval_not_expression(CRB_Interpreter *inter,
 	CRB_Value *pv = peek_stack(inter, 0);
 
 	if (pv->type != CRB_BOOLEAN_VALUE) {
-		crb_runtime_error(sub_expr->filename, sub_expr->line_number, 
+		crb_runtime_error(crb_node_filename(inter, sub_expr),
+						crb_node_line_number(inter, sub_expr), 
 						NOT_BOOLEAN_FOR_NOT_EXPRESSION,
 						MESSAGE_ARGUMENT_END);
 	}
@@ -744,7 +814,8 @@ eval_logical_and_or_expression(CRB_Interpreter *inter,
 	left_val = pop_value(inter);
 
     if (left_val.type != CRB_BOOLEAN_VALUE) {
-        crb_runtime_error(left->filename, left->line_number, 
+        crb_runtime_error(crb_node_filename(inter, left),
+							crb_node_line_number(inter, left), 
 							NOT_BOOLEAN_TYPE_ERR,
                           MESSAGE_ARGUMENT_END);
     }
@@ -765,7 +836,8 @@ eval_logical_and_or_expression(CRB_Interpreter *inter,
     eval_expression(inter, env, right);
     right_val = pop_value(inter);
 	if (right_val.type != CRB_BOOLEAN_VALUE) {
-        crb_runtime_error(right->filename, right->line_number, 
+        crb_runtime_error(crb_node_filename(inter, right),
+							crb_node_line_number(inter, right), 
 							NOT_BOOLEAN_TYPE_ERR,
                           MESSAGE_ARGUMENT_END);
     }
@@ -797,7 +869,8 @@ eval_minus_expression(CRB_Interpreter *inter, CRB_LocalEnvironment *env,
         result.type = CRB_DOUBLE_VALUE;
         result.u.double_value = -operand_val.u.double_value;
     } else {
-        crb_runtime_error(operand->filename, operand->line_number, 
+        crb_runtime_error(crb_node_filename(inter, operand),
+							crb_node_line_number(inter, operand), 
 							MINUS_OPERAND_TYPE_ERR,
                           MESSAGE_ARGUMENT_END);
     }
@@ -815,60 +888,15 @@ CRB_Value crb_eval_minus_expression(CRB_Interpreter *inter,
 }
 
 
-static CRB_LocalEnvironment *
-alloc_local_environment(CRB_Interpreter *inter, CRB_Object *prev_scope,
-						CRB_Boolean is_closure,
-						int line_number, char *func_name)
-{
-    CRB_LocalEnvironment *ret;
-    ret = MEM_malloc(sizeof(CRB_LocalEnvironment));
-
-	if (prev_scope == NULL)
-		prev_scope = inter->top_env->environ_scope;
-
-    ret->environ_scope = crb_create_scope_chain(inter, prev_scope,
-												is_closure);
-	ret->caller_line_number = line_number;
-	ret->func_name = func_name;
-	ret->parent_env = inter->top_env;
-	inter->top_env = ret;
-
-    return ret;
-}
-
-static void
-dispose_local_environment(CRB_Interpreter *inter)
-{
-	DBG_assert(inter->top_env!=NULL, 
-			("dispose_local_environment with top_env\n"));
-
-	CRB_LocalEnvironment *env = inter->top_env;
-	inter->top_env = env->parent_env;
-
-
-    MEM_free(env);
-}
-
 static void
 call_native_function(CRB_Interpreter *inter, CRB_LocalEnvironment *env,
-					 CRB_LocalEnvironment *caller_env,
-                     Expression *expr, CRB_NativeFunctionProc *proc)
+                     Expression *expr, CRB_NativeFunctionProc *proc,
+					 int arg_count)
 {
-    int         arg_count;
-    ArgumentList        *arg_p;
-
-   	//printf("call_native_function, before argument\n"); 
-    
-    for (arg_p = expr->u.function_call_expression.argument,  arg_count = 0;
-         arg_p; arg_p = arg_p->next, arg_count++) {
-        eval_expression(inter, caller_env, arg_p->expression);
-    }
-
-	//printf("call_native_function, after argument\n");
-
 	// use the stack to pass arguments and get result
 	crb_gc_disable(inter);
-    proc(inter, env, arg_count, expr->filename, expr->line_number);
+    proc(inter, env, arg_count, crb_node_filename(inter, expr),
+    		crb_node_line_number(inter, expr));
 
 	//printf("after proc\n");
 
@@ -876,45 +904,90 @@ call_native_function(CRB_Interpreter *inter, CRB_LocalEnvironment *env,
 
 }
 
+/* bind the closure name or "this" of a fake method in the new frame */
+static void
+bind_callee(CRB_Interpreter *inter, CRB_LocalEnvironment *env,
+			FunctionDefinition *func, CRB_Value *callee)
+{
+	if (callee->type == CRB_CLOSURE_VALUE) {
+		if (func->name != NULL) {
+			// add the closure name to scope
+			crb_bind_env_variable(inter, env, func->name, callee);
+		}
+	}
+	else if (callee->type == CRB_FAKE_METHOD_VALUE) {
+		CRB_Value this_value;
+
+		this_value.type = crb_object_type_to_value_type(
+								callee->u.object_value->type);
+		this_value.u.object_value = callee->u.object_value;
+		crb_bind_env_variable(inter, env, "this", &this_value);
+	}
+}
+
 static void
 call_crowbar_function(CRB_Interpreter *inter, CRB_LocalEnvironment *env,
-						CRB_LocalEnvironment *caller_env,
-                      Expression *expr, FunctionDefinition *func)
+                      Expression *expr, FunctionDefinition *func,
+					  int arg_count)
 {
     CRB_Value   value;
     StatementResult     result;
-    ArgumentList        *arg_p;
-    ParameterList       *param_p;
-
-
-
-    for (arg_p = expr->u.function_call_expression.argument,
-             param_p = func->u.crowbar_f.parameter;
-         arg_p;
-         arg_p = arg_p->next, param_p = param_p->next) {
-        CRB_Value *arg_val;
-
-        if (param_p == NULL) {
-            crb_runtime_error(expr->filename, expr->line_number, 
+	int i;
+
+	for (;;) {
+		// arguments are on the stack, copy them into the parameter slots
+		if (arg_count < func->u.crowbar_f.parameter->count) {
+			crb_runtime_error(crb_node_filename(inter, expr),
+								crb_node_line_number(inter, expr),
+								ARGUMENT_TOO_FEW_ERR,
+							  MESSAGE_ARGUMENT_END);
+		} else if (arg_count > func->u.crowbar_f.parameter->count) {
+			crb_runtime_error(crb_node_filename(inter, expr),
+								crb_node_line_number(inter, expr),
 								ARGUMENT_TOO_MANY_ERR,
-                              MESSAGE_ARGUMENT_END);
-        }
-        eval_expression(inter, caller_env, arg_p->expression);
-        arg_val = peek_stack(inter, 0);
-		Variable *variable = crb_search_scope_variable(inter,
-								env->environ_scope, param_p->name, 
-								CRB_TRUE);
-		variable->value = *arg_val;
-		pop_value(inter);
-    }
-    if (param_p) {
-        crb_runtime_error(expr->filename, expr->line_number, 
-							ARGUMENT_TOO_FEW_ERR,
-                          MESSAGE_ARGUMENT_END);
-    }
-    result = crb_execute_statement_list(inter, env,
-                                        func->u.crowbar_f.block
-                                        ->statement_list);
+							  MESSAGE_ARGUMENT_END);
+		}
+		if (arg_count > 0) {
+			crb_bind_env_parameters(inter, env, func->u.crowbar_f.parameter,
+									peek_stack(inter, arg_count - 1));
+		}
+		shrink_stack(inter, arg_count);
+
+		if (inter->execute_mode == CRB_AST_EXECUTE_MODE) {
+			result = crb_execute_statement_list(inter, env,
+											func->u.crowbar_f.block
+											->statement_list);
+		} else {
+			if (func->u.crowbar_f.code == NULL) {
+				func->u.crowbar_f.code = crb_generate_code(inter, func,
+							func->u.crowbar_f.block->statement_list);
+			}
+			result = crb_execute_byte_code(inter, env,
+											func->u.crowbar_f.code);
+		}
+		if (result.type != TAIL_CALL_STATEMENT_RESULT)
+			break;
+
+		// "return f(...)": run f in this frame instead of nesting
+		TailCall *tail = &result.u.tail_call;
+		CRB_Boolean is_closure = (tail->callee.type == CRB_CLOSURE_VALUE);
+
+		func = tail->func;
+		expr = tail->expr;
+		arg_count = tail->arg_count;
+		crb_reuse_local_environment(inter, func,
+				is_closure ? tail->callee.u.object_value->u.closure.scope_obj : NULL,
+				is_closure);
+		bind_callee(inter, env, func, &tail->callee);
+		if (is_closure) {
+			// the frame holds the scope now, drop the closure value
+			// from below the arguments
+			for (i = arg_count; i > 0; i--)
+				*peek_stack(inter, i) = *peek_stack(inter, i - 1);
+			shrink_stack(inter, 1);
+		}
+	}
+
     if (result.type == RETURN_STATEMENT_RESULT) {
         value = result.u.return_value;
     } else {
@@ -924,28 +997,38 @@ call_crowbar_function(CRB_Interpreter *inter, CRB_LocalEnvironment *env,
     push_value(inter, &value);
 }
 
-static void
-eval_function_call_expression(CRB_Interpreter *inter,
-								CRB_LocalEnvironment *env,
-                              	Expression *expr)
+/* the global function named by the call expression, through its cache */
+FunctionDefinition *
+crb_search_called_function(CRB_Interpreter *inter, Expression *expr)
 {
-    FunctionDefinition  *func = NULL;
-	CRB_Boolean is_closure = CRB_FALSE;
-	CRB_Value value;
-	CRB_Object *prev_scope = NULL;
-	FunctionDefinition fake_function;
-	CRB_Boolean is_fake_method = CRB_FALSE;
+	FunctionCallExpression *call = &expr->u.function_call_expression;
 
-	CRB_LocalEnvironment *local_env;
-	
+	if (call->cached_generation != inter->function_generation) {
+		call->cached_function = crb_search_function_in(inter,
+										call->expr->u.identifier);
+		call->cached_generation = inter->function_generation;
+	}
+
+	return call->cached_function;
+}
 
+/*
+ * Find the function to call.  A closure or fake method is copied to
+ * *callee and stays on the stack until the new frame holds it, for a
+ * global function callee->type is CRB_NULL_VALUE.
+ */
+static FunctionDefinition *
+eval_callee(CRB_Interpreter *inter, CRB_LocalEnvironment *env,
+			Expression *expr, CRB_Value *callee,
+			FunctionDefinition *fake_function)
+{
+    FunctionDefinition  *func = NULL;
 	Expression *function_name_expr = expr->u.function_call_expression.expr;
 
-	if (function_name_expr->type == IDENTIFIER_EXPRESSION) {
-    	char *identifier = function_name_expr->u.identifier;
+	callee->type = CRB_NULL_VALUE;
 
-    	func = crb_search_function(identifier);
-	}
+	if (function_name_expr->type == IDENTIFIER_EXPRESSION)
+		func = crb_search_called_function(inter, expr);
 
 	if (func == NULL) {
 		eval_expression(inter, env, function_name_expr);
@@ -954,70 +1037,229 @@ eval_function_call_expression(CRB_Interpreter *inter,
 		pv = peek_stack(inter, 0);
 
 		if (pv->type == CRB_CLOSURE_VALUE) {
-			is_closure = CRB_TRUE;
-			value = *pv;
-			func = pv->u.closure_value.closure_expr->u.closure_definition.function;
-			prev_scope = pv->u.closure_value.scope_obj;
+			*callee = *pv;
+			func = pv->u.object_value->u.closure.function;
 		}
 		else if (pv->type == CRB_FAKE_METHOD_VALUE) {
-			fake_function = crb_get_fake_method_definition(*pv);
-			func = &fake_function;
-			is_fake_method = CRB_TRUE;
-			value = *pv;
+			*fake_function = crb_get_fake_method_definition(pv,
+											crb_node_filename(inter, expr),
+											crb_node_line_number(inter, expr));
+			func = fake_function;
+			*callee = *pv;
+		}
+		else {
+			pop_value(inter);
 		}
-		pop_value(inter);
 	}
 
 	if (func == NULL) {
-		crb_runtime_error(expr->filename, expr->line_number, 
+		crb_runtime_error(crb_node_filename(inter, expr),
+							crb_node_line_number(inter, expr),
 							FUNCTION_NOT_FOUND_ERR,
                           STRING_MESSAGE_ARGUMENT, "name", "",
                           MESSAGE_ARGUMENT_END);
 	}
 
-	//printf("call function %d, name_expr->type=%d\n", func->type,
-	//		function_name_expr->type);
+	return func;
+}
+
+/* evaluate the arguments in the caller's frame onto the stack */
+static int
+eval_arguments(CRB_Interpreter *inter, CRB_LocalEnvironment *env,
+			   Expression *expr)
+{
+	ArgumentList *arg = expr->u.function_call_expression.argument;
+	int i;
+
+	for (i = 0; i < arg->count; i++)
+		eval_expression(inter, env, arg->expression[i]);
+
+	return arg->count;
+}
 
-	//printf("before alloc_local_environment\n");
-	local_env = alloc_local_environment(inter, prev_scope, is_closure,
-										expr->line_number, func->name);
-	//printf("after alloc_local_environment\n");
+static void
+call_function(CRB_Interpreter *inter, Expression *expr,
+			  FunctionDefinition *func, CRB_Value *callee, int arg_count)
+{
+	CRB_LocalEnvironment *local_env;
+	CRB_Boolean is_closure = (callee->type == CRB_CLOSURE_VALUE);
 
 	//printf("call function %s\n", func->name ? func->name : "unknown");
 
-	if (is_closure) {
-		if (func->name != NULL) {
-			// add the closure name to scope
-			Variable *variable = crb_search_scope_variable(
-					inter, local_env->environ_scope, func->name,
-					CRB_TRUE);
-			variable->value = value;
-		}
-	}
-	else if (is_fake_method) {
-		Variable *variable = crb_search_scope_variable(
-				inter, local_env->environ_scope, "this",
-				CRB_TRUE);
-		variable->value.type = crb_object_type_to_value_type(
-								value.u.fake_method.object->type);
-		variable->value.u.object_value = value.u.fake_method.object;
+	if (func->type == RECORD_DEFINITION) {
+		// a record constructor needs no frame
+		crb_construct_record(inter, expr, func, arg_count);
+		return;
 	}
 
+	local_env = crb_alloc_local_environment(inter, func,
+					is_closure ? callee->u.object_value->u.closure.scope_obj : NULL,
+					is_closure, crb_node_line_number(inter, expr));
+	bind_callee(inter, local_env, func, callee);
 
     switch (func->type) {
     case CROWBAR_FUNCTION_DEFINITION:
-        call_crowbar_function(inter, local_env, env, expr, func);
+        call_crowbar_function(inter, local_env, expr, func, arg_count);
         break;
     case NATIVE_FUNCTION_DEFINITION:
-        call_native_function(inter, local_env, env, expr, 
-								func->u.native_f.proc);
+        call_native_function(inter, local_env, expr,
+								func->u.native_f.proc, arg_count);
         break;
     default:
         DBG_panic(("bad case..%d\n", func->type));
     }
-	
-	dispose_local_environment(inter);
 
+	if (callee->type != CRB_NULL_VALUE) {
+		// drop the callee value below the result
+		*peek_stack(inter, 1) = *peek_stack(inter, 0);
+		shrink_stack(inter, 1);
+	}
+
+	crb_dispose_local_environment(inter);
+}
+
+static void
+eval_function_call_expression(CRB_Interpreter *inter,
+								CRB_LocalEnvironment *env,
+                              	Expression *expr)
+{
+    FunctionDefinition  *func;
+	FunctionDefinition fake_function;
+	CRB_Value callee;
+	int arg_count;
+
+	func = eval_callee(inter, env, expr, &callee, &fake_function);
+	arg_count = eval_arguments(inter, env, expr);
+	call_function(inter, expr, func, &callee, arg_count);
+}
+
+
+/*
+ * "return f(...)" in a function frame.  A crowbar function is not called
+ * here, the callee and the arguments are left on the stack and the
+ * caller's call_crowbar_function runs it in the same frame.
+ */
+StatementResult crb_eval_tail_call(CRB_Interpreter *inter,
+								CRB_LocalEnvironment *env,
+								Expression *expr)
+{
+	StatementResult result;
+    FunctionDefinition  *func;
+	FunctionDefinition fake_function;
+	CRB_Value callee;
+	int arg_count;
+
+	func = eval_callee(inter, env, expr, &callee, &fake_function);
+	arg_count = eval_arguments(inter, env, expr);
+
+	if (func->type == CROWBAR_FUNCTION_DEFINITION) {
+		result.type = TAIL_CALL_STATEMENT_RESULT;
+		result.u.tail_call.func = func;
+		result.u.tail_call.expr = expr;
+		result.u.tail_call.callee = callee;
+		result.u.tail_call.arg_count = arg_count;
+	} else {
+		call_function(inter, expr, func, &callee, arg_count);
+		result.type = RETURN_STATEMENT_RESULT;
+		result.u.return_value = pop_value(inter);
+	}
+
+	return result;
+}
+
+
+/*
+ * The bytecode calling convention: the callee value is on the stack
+ * below the arguments, CRB_NULL_VALUE there stands for the global
+ * function named by expr.
+ */
+static FunctionDefinition *
+stacked_callee(CRB_Interpreter *inter, Expression *expr, int arg_count,
+			   CRB_Value *callee, FunctionDefinition *fake_function)
+{
+    FunctionDefinition  *func = NULL;
+	CRB_Value *pv = peek_stack(inter, arg_count);
+
+	*callee = *pv;
+	if (pv->type == CRB_CLOSURE_VALUE) {
+		func = pv->u.object_value->u.closure.function;
+	}
+	else if (pv->type == CRB_FAKE_METHOD_VALUE) {
+		*fake_function = crb_get_fake_method_definition(pv,
+										crb_node_filename(inter, expr),
+										crb_node_line_number(inter, expr));
+		func = fake_function;
+	}
+	else {
+		callee->type = CRB_NULL_VALUE;
+		if (pv->type == CRB_NULL_VALUE
+				&& expr->u.function_call_expression.expr->type
+					== IDENTIFIER_EXPRESSION)
+			func = crb_search_called_function(inter, expr);
+	}
+
+	if (func == NULL) {
+		crb_runtime_error(crb_node_filename(inter, expr),
+							crb_node_line_number(inter, expr),
+							FUNCTION_NOT_FOUND_ERR,
+                          STRING_MESSAGE_ARGUMENT, "name", "",
+                          MESSAGE_ARGUMENT_END);
+	}
+
+	return func;
+}
+
+/* remove the callee slot of a global function from below the arguments */
+static void
+drop_callee_slot(CRB_Interpreter *inter, int arg_count)
+{
+	int i;
+
+	for (i = arg_count; i > 0; i--)
+		*peek_stack(inter, i) = *peek_stack(inter, i - 1);
+	shrink_stack(inter, 1);
+}
+
+void crb_call_stacked_function(CRB_Interpreter *inter, Expression *expr,
+							int arg_count)
+{
+    FunctionDefinition  *func;
+	FunctionDefinition fake_function;
+	CRB_Value callee;
+
+	func = stacked_callee(inter, expr, arg_count, &callee, &fake_function);
+	if (callee.type == CRB_NULL_VALUE)
+		drop_callee_slot(inter, arg_count);
+	call_function(inter, expr, func, &callee, arg_count);
+}
+
+/* crb_eval_tail_call() for the bytecode calling convention */
+StatementResult crb_tail_call_stacked_function(CRB_Interpreter *inter,
+											Expression *expr,
+											int arg_count)
+{
+	StatementResult result;
+    FunctionDefinition  *func;
+	FunctionDefinition fake_function;
+	CRB_Value callee;
+
+	func = stacked_callee(inter, expr, arg_count, &callee, &fake_function);
+	if (callee.type == CRB_NULL_VALUE)
+		drop_callee_slot(inter, arg_count);
+
+	if (func->type == CROWBAR_FUNCTION_DEFINITION) {
+		result.type = TAIL_CALL_STATEMENT_RESULT;
+		result.u.tail_call.func = func;
+		result.u.tail_call.expr = expr;
+		result.u.tail_call.callee = callee;
+		result.u.tail_call.arg_count = arg_count;
+	} else {
+		call_function(inter, expr, func, &callee, arg_count);
+		result.type = RETURN_STATEMENT_RESULT;
+		result.u.return_value = pop_value(inter);
+	}
+
+	return result;
 }
 
 
@@ -1025,27 +1267,19 @@ static void eval_array_expression(CRB_Interpreter *inter,
 									CRB_LocalEnvironment *env,
 									Expression *expr)
 {
-	int array_size = 0;
-	ExpressionList *list;
-
-	for (list = expr->u.array_expression; list != NULL; list = list->next)
-		array_size++;
-
+	ExpressionList *list = expr->u.array_expression;
 	CRB_Value array_val;
+	int i;
+
+	// the elements stay on the stack until the array holds them
+	for (i = 0; i < list->count; i++)
+		eval_expression(inter, env, list->expression[i]);
 
 	array_val.type = CRB_ARRAY_VALUE;
-	array_val.u.object_value = crb_create_array(inter, array_size);
+	array_val.u.object_value = crb_create_array_of(inter, list->count,
+				&inter->stack.stack[inter->stack.stack_pointer - list->count]);
+	shrink_stack(inter, list->count);
 	push_value(inter, &array_val);
-
-	int i = 0;
-	for (list = expr->u.array_expression; list != NULL; 
-			list = list->next) {
-		eval_expression(inter, env, list->expression);
-		CRB_Value *pv = peek_stack(inter, 0);
-		array_val.u.object_value->u.array.array[i++] = *pv;
-		pop_value(inter);
-	}
-	
 }
 
 
@@ -1053,13 +1287,13 @@ static void eval_index_expression(CRB_Interpreter *inter,
 									CRB_LocalEnvironment *env,
 									Expression *expr)
 {
-	CRB_Value *left;
+	CRB_Object *array;
+	int index;
 
-	left = get_array_element_lvalue(inter, env, expr);
+	array = eval_array_element(inter, env, expr, &index);
 
 	// replace array to array[] on the stack	
-	CRB_Value *ret_pos = peek_stack(inter, 0);
-	*ret_pos = *left;
+	crb_array_get(array, index, peek_stack(inter, 0));
 
 }
 
@@ -1067,11 +1301,22 @@ static void eval_incdec_expression(CRB_Interpreter *inter,
 									CRB_LocalEnvironment *env,
 									Expression *expr)
 {
+	Expression *operand = expr->u.inc_dec.operand;
+	CRB_Object *array;
+	CRB_Value element;
 	CRB_Value *dest;
-
-	dest = get_lvalue(inter, env, expr->u.inc_dec.operand);
+	int index;
+
+	if (operand->type == INDEX_EXPRESSION) {
+		array = eval_array_element(inter, env, operand, &index);
+		crb_array_get(array, index, &element);
+		dest = &element;
+	} else {
+		dest = get_lvalue(inter, env, operand);
+	}
 	if (dest->type != CRB_INT_VALUE)
-		crb_runtime_error(expr->filename, expr->line_number, 
+		crb_runtime_error(crb_node_filename(inter, expr),
+				crb_node_line_number(inter, expr), 
 				INC_DEC_OPERAND_TYPE_ERR,
 				MESSAGE_ARGUMENT_END);
 
@@ -1094,6 +1339,14 @@ static void eval_incdec_expression(CRB_Interpreter *inter,
 		push_value(inter, &old_value);
 	}
 
+	if (operand->type == INDEX_EXPRESSION)
+		crb_array_set(inter, array, index, dest);
+	if (operand->type == INDEX_EXPRESSION
+			|| operand->type == MEMBER_EXPRESSION) {
+		// pop the array/assoc value under the result
+		*peek_stack(inter, 1) = *peek_stack(inter, 0);
+		pop_value(inter);
+	}
 }
 
 
@@ -1109,6 +1362,9 @@ static void eval_member_expression(CRB_Interpreter *inter,
 	CRB_Value *left_val = peek_stack(inter, 0);
 
 
+	if (left_val->type == CRB_RECORD_VALUE)
+		ret_val = crb_record_field(inter, left_val->u.object_value, expr);
+
 	if (left_val->type == CRB_ASSOC_VALUE) {
 		Variable *variable = crb_search_assoc_variable(inter, 
 							left_val->u.object_value, 
@@ -1119,18 +1375,15 @@ static void eval_member_expression(CRB_Interpreter *inter,
 	}
 
 	if (ret_val == NULL && dkc_is_object_value(left_val->type)) {
-		fake_method_value.type = CRB_FAKE_METHOD_VALUE;
-		fake_method_value.u.fake_method.method_name = 
-				expr->u.member_expression.member_name;
-		fake_method_value.u.fake_method.object = left_val->u.object_value;
-		fake_method_value.u.fake_method.filename = expr->filename;
-		fake_method_value.u.fake_method.line_number = expr->line_number;
+		crb_set_fake_method(&fake_method_value, left_val->u.object_value,
+							expr->u.member_expression.member_name);
 
 		ret_val = &fake_method_value;
 	}
 
 	if (ret_val == NULL) {
-		crb_runtime_error(expr->filename, expr->line_number, 
+		crb_runtime_error(crb_node_filename(inter, expr),
+				crb_node_line_number(inter, expr), 
 				MEMBER_OPERATION_NOT_ASSOC_ERR,
 				MESSAGE_ARGUMENT_END);
 		
@@ -1148,9 +1401,10 @@ static void eval_closure_definition(CRB_Interpreter *inter,
 {
 	CRB_Value value;
 	
-	value.type = CRB_CLOSURE_VALUE;
-	value.u.closure_value.closure_expr = expr;
-	value.u.closure_value.scope_obj = env->environ_scope;
+	DBG_assert(env->environ_scope != NULL,
+			("closure defined in a frame without scope\n"));
+	crb_create_closure(inter, &value, expr->u.closure_definition.function,
+						env->environ_scope);
 	push_value(inter, &value);
 }
 
@@ -62,7 +62,7 @@ void exception_build_stack_trace(CRB_Interpreter *inter,
 		value.type = CRB_ASSOC_VALUE;
 		value.u.object_value = trace_assoc;
 		
-		stack_trace_array->u.array.array[i] = value;
+		stack_trace_array->u.array.u.value[i] = value;
 
 
 
@@ -96,7 +96,7 @@ void exception_print_stack_trace(CRB_Interpreter *inter,
 
 	int i;
 	for (i=0; i<trace_array->u.array.length; i++) {
-		CRB_Value *pv = &(trace_array->u.array.array[i]);
+		CRB_Value *pv = &(trace_array->u.array.u.value[i]);
 		CRB_Object *trace_obj = pv->u.object_value;
 
 		Variable *name_variable = crb_search_assoc_variable(inter,
@@ -121,6 +121,7 @@ void crb_save_environment(CRB_Interpreter *inter, RecoverEnvironment *recover)
 	memcpy(&(recover->save_jumper), &(inter->exception_jumper), sizeof(jmp_buf));
 	recover->stack_pos = inter->stack.stack_pointer;
 	recover->env_pos = inter->top_env;
+	recover->gc_enabled = inter->heap.gc_enabled;
 
 }
 
@@ -129,10 +130,8 @@ void crb_recover_environment(CRB_Interpreter *inter, RecoverEnvironment *recover
 {
 	inter->stack.stack_pointer = recover->stack_pos;
 	while (inter->top_env != recover->env_pos) {
-		CRB_LocalEnvironment *tmp_env = inter->top_env;
-		inter->top_env = inter->top_env->parent_env;
-		MEM_free(tmp_env);
-
+		crb_dispose_local_environment(inter);
 	}
+	inter->heap.gc_enabled = recover->gc_enabled;
 	memcpy(&(inter->exception_jumper), &(recover->save_jumper), sizeof(jmp_buf));
 }
@@ -21,53 +21,64 @@ execute_expression_statement(CRB_Interpreter *inter, CRB_LocalEnvironment *env,
     return result;
 }
 
-static StatementResult
-execute_global_statement(CRB_Interpreter *inter, CRB_LocalEnvironment *env,
-                         Statement *statement)
+void
+crb_execute_global(CRB_Interpreter *inter, CRB_LocalEnvironment *env,
+				   Statement *statement)
 {
     IdentifierList *pos;
-    StatementResult result;
-
-    result.type = NORMAL_STATEMENT_RESULT;
 
     if (env == NULL) {
-        crb_runtime_error(statement->filename,
-						statement->line_number,
+        crb_runtime_error(crb_node_filename(inter, statement),
+						crb_node_line_number(inter, statement),
                           GLOBAL_STATEMENT_IN_TOPLEVEL_ERR,
                           MESSAGE_ARGUMENT_END);
     }
     for (pos = statement->u.global_s.identifier_list; pos; pos = pos->next) {
-		CRB_Boolean ret = crb_add_scope_global_ref(inter, 
-								env->environ_scope, pos->name);
+		CRB_Boolean ret = crb_add_env_global_ref(inter, env, pos->name);
 		if (ret == CRB_FALSE) {
 			crb_runtime_error(
-							statement->filename,
-							statement->line_number,
+							crb_node_filename(inter, statement),
+							crb_node_line_number(inter, statement),
 							GLOBAL_VARIABLE_NOT_FOUND_ERR,
 							STRING_MESSAGE_ARGUMENT, "name",
 							pos->name, MESSAGE_ARGUMENT_END);
 		}
     }
+}
+
+static StatementResult
+execute_global_statement(CRB_Interpreter *inter, CRB_LocalEnvironment *env,
+                         Statement *statement)
+{
+    StatementResult result;
+
+    result.type = NORMAL_STATEMENT_RESULT;
+
+	crb_execute_global(inter, env, statement);
 
     return result;
 }
 
 static StatementResult
 execute_elsif(CRB_Interpreter *inter, CRB_LocalEnvironment *env,
-              Elsif *elsif_list, CRB_Boolean *executed)
+              ElsifList *elsif_list, CRB_Boolean *executed)
 {
     StatementResult result;
     CRB_Value   cond;
     Elsif *pos;
+	int i;
 
     *executed = CRB_FALSE;
     result.type = NORMAL_STATEMENT_RESULT;
-    for (pos = elsif_list; pos; pos = pos->next) {
+	if (elsif_list == NULL)
+		goto FUNC_END;
+    for (i = 0; i < elsif_list->count; i++) {
+		pos = &elsif_list->elsif[i];
         cond = crb_eval_expression(inter, env, pos->condition);
         if (cond.type != CRB_BOOLEAN_VALUE) {
             crb_runtime_error(
-								pos->condition->filename,
-								pos->condition->line_number,
+								crb_node_filename(inter, pos->condition),
+								crb_node_line_number(inter, pos->condition),
                               NOT_BOOLEAN_TYPE_ERR, MESSAGE_ARGUMENT_END);
         }
         if (cond.u.boolean_value) {
@@ -95,8 +106,8 @@ execute_if_statement(CRB_Interpreter *inter, CRB_LocalEnvironment *env,
     cond = crb_eval_expression(inter, env, statement->u.if_s.condition);
     if (cond.type != CRB_BOOLEAN_VALUE) {
         crb_runtime_error(
-							statement->u.if_s.condition->filename,
-							statement->u.if_s.condition->line_number,
+			crb_node_filename(inter, statement->u.if_s.condition),
+			crb_node_line_number(inter, statement->u.if_s.condition),
                           NOT_BOOLEAN_TYPE_ERR, MESSAGE_ARGUMENT_END);
     }
     DBG_assert(cond.type == CRB_BOOLEAN_VALUE, ("cond.type..%d", cond.type));
@@ -133,8 +144,8 @@ execute_while_statement(CRB_Interpreter *inter, CRB_LocalEnvironment *env,
         cond = crb_eval_expression(inter, env, statement->u.while_s.condition);
         if (cond.type != CRB_BOOLEAN_VALUE) {
             crb_runtime_error(
-							statement->u.while_s.condition->filename,
-							statement->u.while_s.condition->line_number,
+				crb_node_filename(inter, statement->u.while_s.condition),
+				crb_node_line_number(inter, statement->u.while_s.condition),
                               NOT_BOOLEAN_TYPE_ERR, MESSAGE_ARGUMENT_END);
         }
         DBG_assert(cond.type == CRB_BOOLEAN_VALUE,
@@ -145,7 +156,7 @@ execute_while_statement(CRB_Interpreter *inter, CRB_LocalEnvironment *env,
         result = execute_statement(inter, env,
                                    statement->u.while_s.statement);
                                            
-        if (result.type == RETURN_STATEMENT_RESULT) {
+        if (dkc_is_return_result(result.type)) {
             break;
         } 
 		else if (result.type == BREAK_STATEMENT_RESULT) {
@@ -179,8 +190,8 @@ execute_for_statement(CRB_Interpreter *inter, CRB_LocalEnvironment *env,
                                        statement->u.for_s.condition);
             if (cond.type != CRB_BOOLEAN_VALUE) {
                 crb_runtime_error(
-						statement->u.for_s.condition->filename,
-						statement->u.for_s.condition->line_number,
+					crb_node_filename(inter, statement->u.for_s.condition),
+					crb_node_line_number(inter, statement->u.for_s.condition),
                         NOT_BOOLEAN_TYPE_ERR, MESSAGE_ARGUMENT_END);
             }
             DBG_assert(cond.type == CRB_BOOLEAN_VALUE,
@@ -190,7 +201,7 @@ execute_for_statement(CRB_Interpreter *inter, CRB_LocalEnvironment *env,
         }
         result = execute_statement(inter, env,
                                    statement->u.for_s.statement);
-        if (result.type == RETURN_STATEMENT_RESULT) {
+        if (dkc_is_return_result(result.type)) {
             break;
         } 
 		else if (result.type == BREAK_STATEMENT_RESULT) {
@@ -215,6 +226,14 @@ execute_return_statement(CRB_Interpreter *inter, CRB_LocalEnvironment *env,
 {
     StatementResult result;
 
+	Expression *expr = statement->u.return_s.return_value;
+
+	if (expr && expr->type == FUNCTION_CALL_EXPRESSION
+			&& env != &inter->first_env && env->stack_hold == 0) {
+		// try and foreach need their stack and frame back
+		return crb_eval_tail_call(inter, env, expr);
+	}
+
     result.type = RETURN_STATEMENT_RESULT;
     if (statement->u.return_s.return_value) {
         result.u.return_value
@@ -258,7 +277,9 @@ static StatementResult execute_try_statement(CRB_Interpreter *inter,
 	StatementResult result;
 	RecoverEnvironment recover;
 	int throw_after_finally = 0;
+	int stack_hold = env->stack_hold;
 
+	env->stack_hold = stack_hold + 1;
 	crb_save_environment(inter, &recover);
 	int jmp_value = setjmp(inter->exception_jumper);
 
@@ -269,14 +290,14 @@ static StatementResult execute_try_statement(CRB_Interpreter *inter,
 	}
 	else {
 		crb_recover_environment(inter, &recover);
+		env->stack_hold = stack_hold + 1;
 
 		if (statement->u.try_s.identifier != NULL) {
 			char *identifier = statement->u.try_s.identifier;
 
 			CRB_Object *obj = inter->throwed_exception;
-			Variable *variable = crb_search_scope_variable(inter, 
-									env->environ_scope, identifier,
-									CRB_TRUE);
+			Variable *variable = crb_search_env_variable(inter, env,
+									identifier, CRB_TRUE);
 			variable->value.type = CRB_ASSOC_VALUE;
 			variable->value.u.object_value = obj;
 		}
@@ -294,6 +315,7 @@ static StatementResult execute_try_statement(CRB_Interpreter *inter,
 			}
 			else {
 				crb_recover_environment(inter, &recover);
+				env->stack_hold = stack_hold + 1;
 				throw_after_finally = 1;
 			}
 
@@ -303,6 +325,7 @@ static StatementResult execute_try_statement(CRB_Interpreter *inter,
 
 	if (statement->u.try_s.final_st)
 		result = execute_statement(inter, env, statement->u.try_s.final_st);
+	env->stack_hold = stack_hold;
 
 	if (throw_after_finally)
 		longjmp(inter->exception_jumper, 1);
@@ -310,33 +333,41 @@ static StatementResult execute_try_statement(CRB_Interpreter *inter,
 	return result;
 }
 
-static StatementResult execute_throw_statement(CRB_Interpreter *inter,
-											CRB_LocalEnvironment *env,
-											Statement *statement)
+/* throw the value on the stack top */
+void crb_throw_value(CRB_Interpreter *inter, CRB_LocalEnvironment *env,
+					Statement *statement)
 {
-	StatementResult result;
-
-	CRB_Value *pv = crb_eval_and_peek_expression(inter, env, 
-						statement->u.throw_s.throw_expr);
+	CRB_Value *pv = crb_stack_peek_value(inter, 0);
 
 	if (pv->type != CRB_ASSOC_VALUE || crb_search_assoc_variable(
 				inter, pv->u.object_value, "is_exception", 
 				CRB_FALSE) == NULL) {
 		crb_runtime_error(
-				statement->filename,
-				statement->line_number, 
+				crb_node_filename(inter, statement),
+				crb_node_line_number(inter, statement), 
 				THROW_NOT_EXCEPTION_TYPE_ERR, MESSAGE_ARGUMENT_END);
 	}
 
 	exception_build_stack_trace(inter, env,
 								pv->u.object_value,
-								statement->line_number);
+								crb_node_line_number(inter, statement));
 
 	inter->throwed_exception = pv->u.object_value;
 
 	crb_stack_shrink_size(inter, 1);
 	
 	longjmp(inter->exception_jumper, 1);
+}
+
+static StatementResult execute_throw_statement(CRB_Interpreter *inter,
+											CRB_LocalEnvironment *env,
+											Statement *statement)
+{
+	StatementResult result;
+
+	crb_eval_and_peek_expression(inter, env, 
+						statement->u.throw_s.throw_expr);
+	crb_throw_value(inter, env, statement);
 
 	// code will never execute.
 	result.type = NORMAL_STATEMENT_RESULT;
@@ -367,6 +398,65 @@ static void build_and_call_method_expression(CRB_Interpreter *inter,
 												
 
 
+/*
+ * foreach over an array: walk the elements by index, the array stays
+ * on the stack to keep it alive.  The length is read on every step, so
+ * the body may grow or shrink the array like with the script iterator.
+ * A map or a set is walked the same way over its entries, giving the
+ * keys.
+ */
+static StatementResult execute_foreach_array(CRB_Interpreter *inter,
+					CRB_LocalEnvironment *env, Statement *statement)
+{
+	StatementResult result;
+	CRB_Value *pv = crb_stack_peek_value(inter, 0);
+	CRB_Object *array = pv->u.object_value;
+	CRB_Boolean is_map = (pv->type == CRB_MAP_VALUE
+						  || pv->type == CRB_SET_VALUE);
+	Variable *assign_var;
+	int index;
+
+	assign_var = crb_search_local_variable(inter, env,
+									statement->u.foreach_s.identifier,
+									CRB_TRUE);
+
+	result.type = NORMAL_STATEMENT_RESULT;
+	result.u.return_value.type = CRB_NULL_VALUE;
+
+	env->stack_hold++;
+	for (index = 0; ; index++) {
+		if (is_map) {
+			index = crb_map_next(array, index);
+			if (index < 0)
+				break;
+			assign_var->value = array->u.map.entry[index].key;
+		} else {
+			if (index >= crb_array_size(inter, array))
+				break;
+			crb_array_get(array, index, &assign_var->value);
+		}
+
+		result = execute_statement(inter, env, 
+					statement->u.foreach_s.sub_st);	
+
+		if (dkc_is_return_result(result.type))
+			break;
+		else if (result.type == BREAK_STATEMENT_RESULT) {
+			result.type = NORMAL_STATEMENT_RESULT;
+			break;
+		}
+		else if (result.type == CONTINUE_STATEMENT_RESULT) {
+			result.type = NORMAL_STATEMENT_RESULT;
+		}
+	}
+	env->stack_hold--;
+
+	crb_stack_shrink_size(inter, 1);
+
+	return result;
+}
+
+
 static StatementResult execute_foreach_statement(CRB_Interpreter *inter,
 					CRB_LocalEnvironment *env, Statement *statement)
 {
@@ -375,10 +465,18 @@ static StatementResult execute_foreach_statement(CRB_Interpreter *inter,
 	CRB_Value *pv = crb_eval_and_peek_expression(inter, env, 
 						statement->u.foreach_s.array_expr);
 
-	if (pv->type != CRB_ARRAY_VALUE) {
+	if (pv->type == CRB_ARRAY_VALUE || pv->type == CRB_MAP_VALUE
+			|| pv->type == CRB_SET_VALUE)
+		return execute_foreach_array(inter, env, statement);
+
+	// other iterables provide iterator() returning an object with
+	// is_done(), current_item() and next()
+	if (pv->type != CRB_ASSOC_VALUE
+			|| crb_search_assoc_variable(inter, pv->u.object_value,
+										"iterator", CRB_FALSE) == NULL) {
 		crb_runtime_error(
-				statement->filename,
-				statement->line_number, 
+				crb_node_filename(inter, statement),
+				crb_node_line_number(inter, statement), 
 				FOREACH_NOT_ARRAY_TYPE_ERR, MESSAGE_ARGUMENT_END);
 	}
 	
@@ -395,22 +493,22 @@ static StatementResult execute_foreach_statement(CRB_Interpreter *inter,
 		id++;
 		// well, user cannot create variable with dot.
 		sprintf(array_name, "crowbar.temp_array_%d", id);
-		array_var = crb_search_scope_variable(inter, env->environ_scope,
+		array_var = crb_search_env_variable(inter, env,
 									array_name, CRB_FALSE);
 	} while (array_var != NULL);
 
-	array_var = crb_search_scope_variable(inter, env->environ_scope,
+	array_var = crb_search_env_variable(inter, env,
 									array_name, CRB_TRUE);
 
 	id = 0;
 	do {
 		id++;
 		sprintf(iterator_name, "crowbar.temp_iterator_%d", id);
-		iterator_var = crb_search_scope_variable(inter, env->environ_scope,
+		iterator_var = crb_search_env_variable(inter, env,
 							iterator_name, CRB_FALSE);
 	} while (iterator_var != NULL);
 
-	iterator_var = crb_search_scope_variable(inter, env->environ_scope,
+	iterator_var = crb_search_env_variable(inter, env,
 									iterator_name, CRB_TRUE);
 
 	array_var->value = *pv;
@@ -451,7 +549,7 @@ static StatementResult execute_foreach_statement(CRB_Interpreter *inter,
 		result = execute_statement(inter, env, 
 					statement->u.foreach_s.sub_st);	
 
-		if (result.type == RETURN_STATEMENT_RESULT)
+		if (dkc_is_return_result(result.type))
 			break;
 		else if (result.type == BREAK_STATEMENT_RESULT) {
 			result.type = NORMAL_STATEMENT_RESULT;
@@ -468,9 +566,9 @@ static StatementResult execute_foreach_statement(CRB_Interpreter *inter,
 
 	}
 
-	crb_remove_scope_variable(inter, env->environ_scope,
+	crb_remove_env_variable(inter, env,
 								array_name);
-	crb_remove_scope_variable(inter, env->environ_scope,
+	crb_remove_env_variable(inter, env,
 								iterator_name);
 	
 
@@ -536,12 +634,14 @@ StatementResult
 crb_execute_statement_list(CRB_Interpreter *inter, CRB_LocalEnvironment *env,
                            StatementList *list)
 {
-    StatementList *pos;
     StatementResult result;
+	int i;
 
     result.type = NORMAL_STATEMENT_RESULT;
-    for (pos = list; pos; pos = pos->next) {
-        result = execute_statement(inter, env, pos->statement);
+	if (list == NULL)
+		goto FUNC_END;
+    for (i = 0; i < list->count; i++) {
+        result = execute_statement(inter, env, list->statement[i]);
         if (result.type != NORMAL_STATEMENT_RESULT)
             goto FUNC_END;
     }
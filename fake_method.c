@@ -53,6 +53,150 @@ static void fake_method_array_iterator_proc(CRB_Interpreter *inter,
 										CRB_LocalEnvironment *env,
 										int arg_count,
 										char *filename, int line_number);
+static void fake_method_array_sum_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number);
+
+static void fake_method_array_min_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number);
+
+static void fake_method_array_max_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number);
+
+static void fake_method_array_dot_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number);
+
+static void fake_method_array_scale_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number);
+
+static void fake_method_array_plus_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number);
+
+static void fake_method_array_fill_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number);
+
+static void fake_method_array_range_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number);
+
+static void fake_method_array_sort_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number);
+
+static void fake_method_array_slice_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number);
+
+static void fake_method_array_view_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number);
+
+static void fake_method_array_concat_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number);
+
+static void fake_method_array_extend_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number);
+
+static void fake_method_array_index_of_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number);
+
+static void fake_method_array_contains_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number);
+
+static void fake_method_array_reverse_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number);
+
+static void fake_method_array_reserve_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number);
+
+static void fake_method_array_clear_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number);
+
+static void fake_method_map_get_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number);
+
+static void fake_method_map_put_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number);
+
+static void fake_method_map_has_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number);
+
+static void fake_method_map_remove_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number);
+
+static void fake_method_map_size_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number);
+
+static void fake_method_map_keys_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number);
+
+static void fake_method_map_values_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number);
+
+static void fake_method_set_add_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number);
+
+static void fake_method_set_union_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number);
+
+static void fake_method_set_intersect_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number);
+
+static void fake_method_set_difference_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number);
 
 
 static fake_method_struct fake_method_array[] = {
@@ -64,36 +208,84 @@ static fake_method_struct fake_method_array[] = {
 	{ ARRAY_OBJECT, "insert", fake_method_array_insert_proc },
 	{ ARRAY_OBJECT, "remove", fake_method_array_remove_proc },
 	{ ARRAY_OBJECT, "iterator", fake_method_array_iterator_proc },
+	{ ARRAY_OBJECT, "sum", fake_method_array_sum_proc },
+	{ ARRAY_OBJECT, "min", fake_method_array_min_proc },
+	{ ARRAY_OBJECT, "max", fake_method_array_max_proc },
+	{ ARRAY_OBJECT, "dot", fake_method_array_dot_proc },
+	{ ARRAY_OBJECT, "scale", fake_method_array_scale_proc },
+	{ ARRAY_OBJECT, "plus", fake_method_array_plus_proc },
+	{ ARRAY_OBJECT, "fill", fake_method_array_fill_proc },
+	{ ARRAY_OBJECT, "range", fake_method_array_range_proc },
+	{ ARRAY_OBJECT, "sort", fake_method_array_sort_proc },
+	{ ARRAY_OBJECT, "slice", fake_method_array_slice_proc },
+	{ ARRAY_OBJECT, "view", fake_method_array_view_proc },
+	{ ARRAY_OBJECT, "concat", fake_method_array_concat_proc },
+	{ ARRAY_OBJECT, "extend", fake_method_array_extend_proc },
+	{ ARRAY_OBJECT, "index_of", fake_method_array_index_of_proc },
+	{ ARRAY_OBJECT, "contains", fake_method_array_contains_proc },
+	{ ARRAY_OBJECT, "reverse", fake_method_array_reverse_proc },
+	{ ARRAY_OBJECT, "reserve", fake_method_array_reserve_proc },
+	{ ARRAY_OBJECT, "clear", fake_method_array_clear_proc },
+	{ MAP_OBJECT, "get", fake_method_map_get_proc },
+	{ MAP_OBJECT, "put", fake_method_map_put_proc },
+	{ MAP_OBJECT, "has", fake_method_map_has_proc },
+	{ MAP_OBJECT, "remove", fake_method_map_remove_proc },
+	{ MAP_OBJECT, "size", fake_method_map_size_proc },
+	{ MAP_OBJECT, "keys", fake_method_map_keys_proc },
+	{ MAP_OBJECT, "values", fake_method_map_values_proc },
+	{ SET_OBJECT, "add", fake_method_set_add_proc },
+	{ SET_OBJECT, "has", fake_method_map_has_proc },
+	{ SET_OBJECT, "remove", fake_method_map_remove_proc },
+	{ SET_OBJECT, "size", fake_method_map_size_proc },
+	{ SET_OBJECT, "union", fake_method_set_union_proc },
+	{ SET_OBJECT, "intersect", fake_method_set_intersect_proc },
+	{ SET_OBJECT, "difference", fake_method_set_difference_proc },
+	{ SET_OBJECT, "to_array", fake_method_map_keys_proc },
 	{ ASSOC_OBJECT, "print_stack_trace", fake_method_exception_print_proc },
 	
 	{ OBJECT_TYPE_COUNT_PLUS_1, NULL, NULL }
 };
 
 
-FunctionDefinition crb_get_fake_method_definition(CRB_Value fake_method_val)
+/*
+ * The value of object.method_name keeps the index of the method in
+ * fake_method_array.  A name no method of the object has is kept instead,
+ * for the error when it is called.
+ */
+void crb_set_fake_method(CRB_Value *value, CRB_Object *object,
+						char *method_name)
 {
-	char *method_name = fake_method_val.u.fake_method.method_name;
-	ObjectType type = fake_method_val.u.fake_method.object->type;
 	int i;
 
+	value->type = CRB_FAKE_METHOD_VALUE;
 	for (i=0; fake_method_array[i].fake_method != NULL; i++) {
-		if (type == fake_method_array[i].obj_type &&
+		if (object->type == fake_method_array[i].obj_type &&
 				strcmp(method_name, fake_method_array[i].method_name)==0) {
-			break;
+			value->index = i;
+			value->u.object_value = object;
+			return;
 		}
 	}
+	value->index = -1;
+	value->u.pointer_value = method_name;
+}
+
+
+FunctionDefinition crb_get_fake_method_definition(CRB_Value *fake_method_val,
+												char *filename,
+												int line_number)
+{
+	FunctionDefinition function;
+	int i = fake_method_val->index;
 
-	if (fake_method_array[i].fake_method == NULL) {
-		crb_runtime_error(
-							fake_method_val.u.fake_method.filename,
-							fake_method_val.u.fake_method.line_number,
+	if (i < 0) {
+		crb_runtime_error(filename, line_number,
 							NO_SUCH_METHOD_ERR, STRING_MESSAGE_ARGUMENT,
-							"method_name", method_name, 
+							"method_name", fake_method_val->u.pointer_value, 
 							MESSAGE_ARGUMENT_END);
 	}
 	
-	FunctionDefinition function;
-	function.name = method_name;
+	function.name = fake_method_array[i].method_name;
 	function.type = NATIVE_FUNCTION_DEFINITION;
 	function.u.native_f.proc = fake_method_array[i].fake_method;
 	function.next = NULL;
@@ -173,6 +365,22 @@ static void fake_method_string_substr_proc(CRB_Interpreter *inter,
 
 
 
+/* index must be in 0..limit-1 */
+static void check_array_bound(CRB_Object *this_obj, int index, int limit,
+								char *filename, int line_number)
+{
+	crb_array_sync(this_obj);
+	if (index < 0 || index >= limit) {
+		crb_runtime_error(filename, line_number,
+							ARRAY_INDEX_OUT_OF_BOUND_ERR,
+							INT_MESSAGE_ARGUMENT, "size",
+							this_obj->u.array.length,
+							INT_MESSAGE_ARGUMENT, "index", index,
+							MESSAGE_ARGUMENT_END);
+	}
+}
+
+
 static void fake_method_array_add_proc(CRB_Interpreter *inter,
 										CRB_LocalEnvironment *env,
 										int arg_count,
@@ -269,6 +477,8 @@ static void fake_method_array_insert_proc(CRB_Interpreter *inter,
 							MESSAGE_ARGUMENT_END);
 	}
 
+	check_array_bound(this_obj, args[0].u.int_value,
+						this_obj->u.array.length + 1, filename, line_number);
 	crb_array_insert(inter, this_obj, args[0].u.int_value,
 							&args[1]);
 
@@ -299,6 +509,8 @@ static void fake_method_array_remove_proc(CRB_Interpreter *inter,
 							MESSAGE_ARGUMENT_END);
 	}
 
+	check_array_bound(this_obj, args[0].u.int_value,
+						this_obj->u.array.length, filename, line_number);
 	crb_array_remove(inter, this_obj, args[0].u.int_value);
 
 	crb_stack_shrink_size(inter, 1);
@@ -330,8 +542,9 @@ static void fake_method_array_iterator_proc(CRB_Interpreter *inter,
 	crb_init_identifier_expression(&this_expr, "this",
 									filename, line_number);
 
+	Expression *argument_expr = &this_expr;
 	ArgumentList argument;
-	crb_init_argument_list(&argument, &this_expr);
+	crb_init_argument_list(&argument, 1, &argument_expr);
 
 	Expression func_call_expr;
 	crb_init_function_call_expression(&func_call_expr,
@@ -342,6 +555,809 @@ static void fake_method_array_iterator_proc(CRB_Interpreter *inter,
 
 }
 
+/*
+ * The numeric methods run the kernels of vector.c on packed arrays.  A
+ * generic array, or a mix the kernels do not take, is worked through
+ * element by element with the operators of the language.
+ */
+
+static CRB_Object* this_array(CRB_Interpreter *inter,
+								CRB_LocalEnvironment *env)
+{
+	Variable *this_variable = crb_search_local_variable(inter, env,
+												"this", CRB_FALSE);
+
+	crb_array_sync(this_variable->value.u.object_value);
+
+	return this_variable->value.u.object_value;
+}
+
+/* the array argument of an element-wise method, as long as this */
+static CRB_Object* other_array(CRB_Object *this_obj, CRB_Value *arg,
+								char *func_name,
+								char *filename, int line_number)
+{
+	if (arg->type != CRB_ARRAY_VALUE) {
+		crb_runtime_error(filename, line_number, ARGUMENT_TYPE_MISMATCH_ERR,
+							STRING_MESSAGE_ARGUMENT, "func_name",
+							func_name, MESSAGE_ARGUMENT_END);
+	}
+	crb_array_sync(arg->u.object_value);
+	if (arg->u.object_value->u.array.length != this_obj->u.array.length) {
+		crb_runtime_error(filename, line_number, ARRAY_SIZE_MISMATCH_ERR,
+							INT_MESSAGE_ARGUMENT, "size",
+							this_obj->u.array.length,
+							INT_MESSAGE_ARGUMENT, "other_size",
+							arg->u.object_value->u.array.length,
+							MESSAGE_ARGUMENT_END);
+	}
+
+	return arg->u.object_value;
+}
+
+static void fake_method_array_sum_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number)
+{
+	check_argument_count(arg_count, 0, filename, line_number);
+
+	CRB_Object *this_obj = this_array(inter, env);
+	CRB_Array *array = &this_obj->u.array;
+	CRB_Value ret_val;
+	CRB_Value elem;
+	CRB_Value sum;
+	int i;
+
+	if (array->kind == INT_ARRAY) {
+		ret_val.type = CRB_INT_VALUE;
+		ret_val.u.int_value = crb_vector_kernels()->int_sum(
+									array->u.int_value, array->length);
+	} else if (array->kind == DOUBLE_ARRAY) {
+		ret_val.type = CRB_DOUBLE_VALUE;
+		ret_val.u.double_value = crb_vector_kernels()->double_sum(
+									array->u.double_value, array->length);
+	} else {
+		ret_val.type = CRB_INT_VALUE;
+		ret_val.u.int_value = 0;
+		for (i = 0; i < array->length; i++) {
+			crb_array_get(this_obj, i, &elem);
+			crb_eval_binary_values(inter, ADD_EXPRESSION, &ret_val, &elem,
+									&sum, filename, line_number);
+			ret_val = sum;
+		}
+	}
+
+	crb_stack_push_value(inter, &ret_val);
+}
+
+/* min() and max(), null for an empty array */
+static void array_min_max(CRB_Interpreter *inter, CRB_LocalEnvironment *env,
+							ExpressionType operator,
+							char *filename, int line_number)
+{
+	CRB_Object *this_obj = this_array(inter, env);
+	CRB_Array *array = &this_obj->u.array;
+	VectorKernels *kernels = crb_vector_kernels();
+	CRB_Value ret_val;
+	CRB_Value elem;
+	CRB_Value cmp;
+	int i;
+
+	if (array->length == 0) {
+		ret_val.type = CRB_NULL_VALUE;
+	} else if (array->kind == INT_ARRAY) {
+		ret_val.type = CRB_INT_VALUE;
+		ret_val.u.int_value = (operator == LT_EXPRESSION)
+			? kernels->int_min(array->u.int_value, array->length)
+			: kernels->int_max(array->u.int_value, array->length);
+	} else if (array->kind == DOUBLE_ARRAY) {
+		ret_val.type = CRB_DOUBLE_VALUE;
+		ret_val.u.double_value = (operator == LT_EXPRESSION)
+			? kernels->double_min(array->u.double_value, array->length)
+			: kernels->double_max(array->u.double_value, array->length);
+	} else {
+		crb_array_get(this_obj, 0, &ret_val);
+		for (i = 1; i < array->length; i++) {
+			crb_array_get(this_obj, i, &elem);
+			crb_eval_binary_values(inter, operator, &elem, &ret_val,
+									&cmp, filename, line_number);
+			if (cmp.type == CRB_BOOLEAN_VALUE && cmp.u.boolean_value)
+				ret_val = elem;
+		}
+	}
+
+	crb_stack_push_value(inter, &ret_val);
+}
+
+static void fake_method_array_min_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number)
+{
+	check_argument_count(arg_count, 0, filename, line_number);
+	array_min_max(inter, env, LT_EXPRESSION, filename, line_number);
+}
+
+static void fake_method_array_max_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number)
+{
+	check_argument_count(arg_count, 0, filename, line_number);
+	array_min_max(inter, env, GT_EXPRESSION, filename, line_number);
+}
+
+static void fake_method_array_dot_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number)
+{
+	check_argument_count(arg_count, 1, filename, line_number);
+
+	CRB_Object *this_obj = this_array(inter, env);
+	CRB_Value *args = crb_stack_peek_value(inter, 0);
+	CRB_Object *other = other_array(this_obj, &args[0], "array.dot",
+									filename, line_number);
+	CRB_Array *array = &this_obj->u.array;
+	CRB_Value ret_val;
+	CRB_Value left;
+	CRB_Value right;
+	CRB_Value product;
+	CRB_Value sum;
+	int i;
+
+	if (array->kind == INT_ARRAY && other->u.array.kind == INT_ARRAY) {
+		ret_val.type = CRB_INT_VALUE;
+		ret_val.u.int_value = crb_vector_kernels()->int_dot(
+									array->u.int_value,
+									other->u.array.u.int_value,
+									array->length);
+	} else if (array->kind == DOUBLE_ARRAY
+			&& other->u.array.kind == DOUBLE_ARRAY) {
+		ret_val.type = CRB_DOUBLE_VALUE;
+		ret_val.u.double_value = crb_vector_kernels()->double_dot(
+									array->u.double_value,
+									other->u.array.u.double_value,
+									array->length);
+	} else {
+		ret_val.type = CRB_INT_VALUE;
+		ret_val.u.int_value = 0;
+		for (i = 0; i < array->length; i++) {
+			crb_array_get(this_obj, i, &left);
+			crb_array_get(other, i, &right);
+			crb_eval_binary_values(inter, MUL_EXPRESSION, &left, &right,
+									&product, filename, line_number);
+			crb_eval_binary_values(inter, ADD_EXPRESSION, &ret_val, &product,
+									&sum, filename, line_number);
+			ret_val = sum;
+		}
+	}
+
+	crb_stack_shrink_size(inter, 1);
+	crb_stack_push_value(inter, &ret_val);
+}
+
+static void fake_method_array_scale_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number)
+{
+	check_argument_count(arg_count, 1, filename, line_number);
+
+	CRB_Object *this_obj = this_array(inter, env);
+	CRB_Value *args = crb_stack_peek_value(inter, 0);
+	CRB_Array *array = &this_obj->u.array;
+	CRB_Value ret_val;
+	CRB_Value elem;
+	CRB_Value product;
+	int i;
+
+	if (array->kind == INT_ARRAY && args[0].type == CRB_DOUBLE_VALUE)
+		crb_array_convert(inter, this_obj, DOUBLE_ARRAY);
+
+	if (array->kind == INT_ARRAY && args[0].type == CRB_INT_VALUE) {
+		crb_vector_kernels()->int_scale(array->u.int_value, array->length,
+										args[0].u.int_value);
+	} else if (array->kind == DOUBLE_ARRAY
+			&& (args[0].type == CRB_DOUBLE_VALUE
+				|| args[0].type == CRB_INT_VALUE)) {
+		crb_vector_kernels()->double_scale(array->u.double_value,
+									array->length,
+									(args[0].type == CRB_DOUBLE_VALUE)
+									? args[0].u.double_value
+									: args[0].u.int_value);
+	} else {
+		for (i = 0; i < array->length; i++) {
+			crb_array_get(this_obj, i, &elem);
+			crb_eval_binary_values(inter, MUL_EXPRESSION, &elem, &args[0],
+									&product, filename, line_number);
+			crb_array_set(inter, this_obj, i, &product);
+		}
+	}
+
+	crb_stack_shrink_size(inter, 1);
+
+	ret_val.type = CRB_NULL_VALUE;
+	crb_stack_push_value(inter, &ret_val);
+}
+
+/* element-wise +=, add() already appends */
+static void fake_method_array_plus_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number)
+{
+	check_argument_count(arg_count, 1, filename, line_number);
+
+	CRB_Object *this_obj = this_array(inter, env);
+	CRB_Value *args = crb_stack_peek_value(inter, 0);
+	CRB_Object *other = other_array(this_obj, &args[0], "array.plus",
+									filename, line_number);
+	CRB_Array *array = &this_obj->u.array;
+	CRB_Array *other_array = &other->u.array;
+	CRB_Value ret_val;
+	CRB_Value left;
+	CRB_Value right;
+	CRB_Value sum;
+	int i;
+
+	if (array->kind == INT_ARRAY && other_array->kind == DOUBLE_ARRAY)
+		crb_array_convert(inter, this_obj, DOUBLE_ARRAY);
+
+	if (array->kind == INT_ARRAY && other_array->kind == INT_ARRAY) {
+		crb_vector_kernels()->int_add(array->u.int_value,
+									other_array->u.int_value,
+									array->length);
+	} else if (array->kind == DOUBLE_ARRAY
+			&& other_array->kind == DOUBLE_ARRAY) {
+		crb_vector_kernels()->double_add(array->u.double_value,
+									other_array->u.double_value,
+									array->length);
+	} else if (array->kind == DOUBLE_ARRAY
+			&& other_array->kind == INT_ARRAY) {
+		for (i = 0; i < array->length; i++)
+			array->u.double_value[i] += other_array->u.int_value[i];
+	} else {
+		for (i = 0; i < array->length; i++) {
+			crb_array_get(this_obj, i, &left);
+			crb_array_get(other, i, &right);
+			crb_eval_binary_values(inter, ADD_EXPRESSION, &left, &right,
+									&sum, filename, line_number);
+			crb_array_set(inter, this_obj, i, &sum);
+		}
+	}
+
+	crb_stack_shrink_size(inter, 1);
+
+	ret_val.type = CRB_NULL_VALUE;
+	crb_stack_push_value(inter, &ret_val);
+}
+
+static void fake_method_array_fill_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number)
+{
+	check_argument_count(arg_count, 1, filename, line_number);
+
+	CRB_Object *this_obj = this_array(inter, env);
+	CRB_Value *args = crb_stack_peek_value(inter, 0);
+	CRB_Array *array = &this_obj->u.array;
+	CRB_Value ret_val;
+	int i;
+
+	if (args[0].type == CRB_INT_VALUE) {
+		crb_array_reshape(inter, this_obj, INT_ARRAY, array->length);
+		crb_vector_kernels()->int_fill(array->u.int_value, array->length,
+										args[0].u.int_value);
+	} else if (args[0].type == CRB_DOUBLE_VALUE) {
+		crb_array_reshape(inter, this_obj, DOUBLE_ARRAY, array->length);
+		crb_vector_kernels()->double_fill(array->u.double_value,
+										array->length,
+										args[0].u.double_value);
+	} else {
+		crb_array_reshape(inter, this_obj, GENERIC_ARRAY, array->length);
+		for (i = 0; i < array->length; i++)
+			array->u.value[i] = args[0];
+	}
+
+	crb_stack_shrink_size(inter, 1);
+
+	ret_val.type = CRB_NULL_VALUE;
+	crb_stack_push_value(inter, &ret_val);
+}
+
+/* this becomes begin, begin+1, ..., end-1 */
+static void fake_method_array_range_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number)
+{
+	check_argument_count(arg_count, 2, filename, line_number);
+
+	CRB_Object *this_obj = this_array(inter, env);
+	CRB_Value *args = crb_stack_peek_value(inter, 1);
+	CRB_Value ret_val;
+	int length;
+
+	if (args[0].type != CRB_INT_VALUE || args[1].type != CRB_INT_VALUE) {
+		crb_runtime_error(filename, line_number, ARGUMENT_TYPE_MISMATCH_ERR,
+							STRING_MESSAGE_ARGUMENT, "func_name", 
+							"array.range", MESSAGE_ARGUMENT_END);
+	}
+	length = args[1].u.int_value - args[0].u.int_value;
+	if (length < 0)
+		length = 0;
+
+	crb_array_reshape(inter, this_obj, INT_ARRAY, length);
+	crb_vector_kernels()->int_range(this_obj->u.array.u.int_value, length,
+									args[0].u.int_value);
+
+	crb_stack_shrink_size(inter, 2);
+
+	ret_val.type = CRB_NULL_VALUE;
+	crb_stack_push_value(inter, &ret_val);
+}
+
+/* sort() or sort(compare), see sort.c */
+static void fake_method_array_sort_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number)
+{
+	if (arg_count > 1)
+		check_argument_count(arg_count, 1, filename, line_number);
+
+	CRB_Object *this_obj = this_array(inter, env);
+	CRB_Value ret_val;
+
+	crb_array_sort(inter, this_obj,
+					arg_count == 1 ? crb_stack_peek_value(inter, 0) : NULL,
+					filename, line_number);
+
+	crb_stack_shrink_size(inter, arg_count);
+
+	ret_val.type = CRB_NULL_VALUE;
+	crb_stack_push_value(inter, &ret_val);
+}
+
+/*
+ * The methods below move the elements in blocks with heap.c, a packed
+ * array stays packed as long as what is added is of its kind.
+ */
+
+/* the array argument of a method taking one */
+static CRB_Object* array_argument(CRB_Value *arg, char *func_name,
+									char *filename, int line_number)
+{
+	if (arg->type != CRB_ARRAY_VALUE) {
+		crb_runtime_error(filename, line_number, ARGUMENT_TYPE_MISMATCH_ERR,
+							STRING_MESSAGE_ARGUMENT, "func_name",
+							func_name, MESSAGE_ARGUMENT_END);
+	}
+	crb_array_sync(arg->u.object_value);
+
+	return arg->u.object_value;
+}
+
+/* the arguments (begin) or (begin, end) of slice() and view() */
+static void range_arguments(CRB_Interpreter *inter, CRB_Object *this_obj,
+							int arg_count, char *func_name,
+							int *begin, int *end,
+							char *filename, int line_number)
+{
+	if (arg_count != 2)
+		check_argument_count(arg_count, 1, filename, line_number);
+
+	CRB_Value *args = crb_stack_peek_value(inter, arg_count - 1);
+
+	if (args[0].type != CRB_INT_VALUE
+			|| (arg_count == 2 && args[1].type != CRB_INT_VALUE)) {
+		crb_runtime_error(filename, line_number, ARGUMENT_TYPE_MISMATCH_ERR,
+							STRING_MESSAGE_ARGUMENT, "func_name",
+							func_name, MESSAGE_ARGUMENT_END);
+	}
+	*begin = args[0].u.int_value;
+	*end = (arg_count == 2) ? args[1].u.int_value : this_obj->u.array.length;
+	check_array_bound(this_obj, *end, this_obj->u.array.length + 1,
+						filename, line_number);
+	check_array_bound(this_obj, *begin, *end + 1, filename, line_number);
+}
+
+/* slice(begin) or slice(begin, end), a new array of this[begin..end-1] */
+static void fake_method_array_slice_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number)
+{
+	CRB_Object *this_obj = this_array(inter, env);
+	CRB_Value ret_val;
+	int begin;
+	int end;
+
+	range_arguments(inter, this_obj, arg_count, "array.slice",
+					&begin, &end, filename, line_number);
+
+	ret_val.type = CRB_ARRAY_VALUE;
+	ret_val.u.object_value = crb_array_slice(inter, this_obj, begin, end);
+
+	crb_stack_shrink_size(inter, arg_count);
+	crb_stack_push_value(inter, &ret_val);
+}
+
+/* like slice(), but the elements stay shared with this */
+static void fake_method_array_view_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number)
+{
+	CRB_Object *this_obj = this_array(inter, env);
+	CRB_Value ret_val;
+	int begin;
+	int end;
+
+	range_arguments(inter, this_obj, arg_count, "array.view",
+					&begin, &end, filename, line_number);
+
+	ret_val.type = CRB_ARRAY_VALUE;
+	ret_val.u.object_value = crb_array_view(inter, this_obj, begin, end);
+
+	crb_stack_shrink_size(inter, arg_count);
+	crb_stack_push_value(inter, &ret_val);
+}
+
+/* a new array of the elements of this and then of other */
+static void fake_method_array_concat_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number)
+{
+	check_argument_count(arg_count, 1, filename, line_number);
+
+	CRB_Object *this_obj = this_array(inter, env);
+	CRB_Value *args = crb_stack_peek_value(inter, 0);
+	CRB_Object *other = array_argument(&args[0], "array.concat",
+										filename, line_number);
+	CRB_Value ret_val;
+
+	ret_val.type = CRB_ARRAY_VALUE;
+	ret_val.u.object_value = crb_array_concat(inter, this_obj, other);
+
+	crb_stack_shrink_size(inter, 1);
+	crb_stack_push_value(inter, &ret_val);
+}
+
+/* add() for every element of other */
+static void fake_method_array_extend_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number)
+{
+	check_argument_count(arg_count, 1, filename, line_number);
+
+	CRB_Object *this_obj = this_array(inter, env);
+	CRB_Value *args = crb_stack_peek_value(inter, 0);
+	CRB_Object *other = array_argument(&args[0], "array.extend",
+										filename, line_number);
+	CRB_Value ret_val;
+
+	crb_array_extend(inter, this_obj, other);
+
+	crb_stack_shrink_size(inter, 1);
+
+	ret_val.type = CRB_NULL_VALUE;
+	crb_stack_push_value(inter, &ret_val);
+}
+
+/* the index of the first element == value, -1 if none is */
+static void fake_method_array_index_of_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number)
+{
+	check_argument_count(arg_count, 1, filename, line_number);
+
+	CRB_Object *this_obj = this_array(inter, env);
+	CRB_Value *args = crb_stack_peek_value(inter, 0);
+	CRB_Value ret_val;
+
+	ret_val.type = CRB_INT_VALUE;
+	ret_val.u.int_value = crb_array_index_of(this_obj, &args[0]);
+
+	crb_stack_shrink_size(inter, 1);
+	crb_stack_push_value(inter, &ret_val);
+}
+
+static void fake_method_array_contains_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number)
+{
+	check_argument_count(arg_count, 1, filename, line_number);
+
+	CRB_Object *this_obj = this_array(inter, env);
+	CRB_Value *args = crb_stack_peek_value(inter, 0);
+	CRB_Value ret_val;
+
+	ret_val.type = CRB_BOOLEAN_VALUE;
+	ret_val.u.boolean_value = (crb_array_index_of(this_obj, &args[0]) >= 0);
+
+	crb_stack_shrink_size(inter, 1);
+	crb_stack_push_value(inter, &ret_val);
+}
+
+static void fake_method_array_reverse_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number)
+{
+	check_argument_count(arg_count, 0, filename, line_number);
+
+	CRB_Value ret_val;
+
+	crb_array_reverse(this_array(inter, env));
+
+	ret_val.type = CRB_NULL_VALUE;
+	crb_stack_push_value(inter, &ret_val);
+}
+
+/* room for size elements, the size() stays as it is */
+static void fake_method_array_reserve_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number)
+{
+	check_argument_count(arg_count, 1, filename, line_number);
+
+	CRB_Object *this_obj = this_array(inter, env);
+	CRB_Value *args = crb_stack_peek_value(inter, 0);
+	CRB_Value ret_val;
+
+	if (args[0].type != CRB_INT_VALUE || args[0].u.int_value < 0) {
+		crb_runtime_error(filename, line_number, ARGUMENT_TYPE_MISMATCH_ERR,
+							STRING_MESSAGE_ARGUMENT, "func_name",
+							"array.reserve", MESSAGE_ARGUMENT_END);
+	}
+	crb_array_reserve(inter, this_obj, args[0].u.int_value);
+
+	crb_stack_shrink_size(inter, 1);
+
+	ret_val.type = CRB_NULL_VALUE;
+	crb_stack_push_value(inter, &ret_val);
+}
+
+static void fake_method_array_clear_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number)
+{
+	check_argument_count(arg_count, 0, filename, line_number);
+
+	CRB_Value ret_val;
+
+	crb_array_clear(inter, this_array(inter, env));
+
+	ret_val.type = CRB_NULL_VALUE;
+	crb_stack_push_value(inter, &ret_val);
+}
+
+/*
+ * The map methods, see map.c.  A key is a string or an int, get() of
+ * a key the map does not have is null.  A set is a map without values,
+ * has(), remove(), size() and to_array() (keys()) serve both.
+ */
+
+static CRB_Object* this_map(CRB_Interpreter *inter, CRB_LocalEnvironment *env)
+{
+	Variable *this_variable = crb_search_local_variable(inter, env,
+												"this", CRB_FALSE);
+
+	return this_variable->value.u.object_value;
+}
+
+static void check_map_key(CRB_Value *key, char *filename, int line_number)
+{
+	if (!crb_is_map_key(key)) {
+		crb_runtime_error(filename, line_number, MAP_KEY_TYPE_ERR,
+							MESSAGE_ARGUMENT_END);
+	}
+}
+
+static void fake_method_map_get_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number)
+{
+	check_argument_count(arg_count, 1, filename, line_number);
+
+	CRB_Value *args = crb_stack_peek_value(inter, 0);
+	CRB_Value *value;
+	CRB_Value ret_val;
+
+	check_map_key(&args[0], filename, line_number);
+	value = crb_map_get(this_map(inter, env), &args[0]);
+	if (value != NULL)
+		ret_val = *value;
+	else
+		ret_val.type = CRB_NULL_VALUE;
+
+	crb_stack_shrink_size(inter, 1);
+	crb_stack_push_value(inter, &ret_val);
+}
+
+static void fake_method_map_put_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number)
+{
+	check_argument_count(arg_count, 2, filename, line_number);
+
+	CRB_Value *args = crb_stack_peek_value(inter, 1);
+	CRB_Value ret_val;
+
+	check_map_key(&args[0], filename, line_number);
+	crb_map_put(inter, this_map(inter, env), &args[0], &args[1]);
+
+	crb_stack_shrink_size(inter, 2);
+
+	ret_val.type = CRB_NULL_VALUE;
+	crb_stack_push_value(inter, &ret_val);
+}
+
+static void fake_method_map_has_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number)
+{
+	check_argument_count(arg_count, 1, filename, line_number);
+
+	CRB_Value *args = crb_stack_peek_value(inter, 0);
+	CRB_Value ret_val;
+
+	check_map_key(&args[0], filename, line_number);
+	ret_val.type = CRB_BOOLEAN_VALUE;
+	ret_val.u.boolean_value
+		= (crb_map_get(this_map(inter, env), &args[0]) != NULL);
+
+	crb_stack_shrink_size(inter, 1);
+	crb_stack_push_value(inter, &ret_val);
+}
+
+/* true when the key was there */
+static void fake_method_map_remove_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number)
+{
+	check_argument_count(arg_count, 1, filename, line_number);
+
+	CRB_Value *args = crb_stack_peek_value(inter, 0);
+	CRB_Value ret_val;
+
+	check_map_key(&args[0], filename, line_number);
+	ret_val.type = CRB_BOOLEAN_VALUE;
+	ret_val.u.boolean_value = crb_map_remove(this_map(inter, env), &args[0]);
+
+	crb_stack_shrink_size(inter, 1);
+	crb_stack_push_value(inter, &ret_val);
+}
+
+static void fake_method_map_size_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number)
+{
+	check_argument_count(arg_count, 0, filename, line_number);
+
+	CRB_Value ret_val;
+
+	ret_val.type = CRB_INT_VALUE;
+	ret_val.u.int_value = this_map(inter, env)->u.map.count;
+	crb_stack_push_value(inter, &ret_val);
+}
+
+static void fake_method_map_keys_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number)
+{
+	check_argument_count(arg_count, 0, filename, line_number);
+
+	CRB_Value ret_val;
+
+	ret_val.type = CRB_ARRAY_VALUE;
+	ret_val.u.object_value = crb_map_keys(inter, this_map(inter, env));
+	crb_stack_push_value(inter, &ret_val);
+}
+
+static void fake_method_map_values_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number)
+{
+	check_argument_count(arg_count, 0, filename, line_number);
+
+	CRB_Value ret_val;
+
+	ret_val.type = CRB_ARRAY_VALUE;
+	ret_val.u.object_value = crb_map_values(inter, this_map(inter, env));
+	crb_stack_push_value(inter, &ret_val);
+}
+
+/* true when the element was not there */
+static void fake_method_set_add_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number)
+{
+	check_argument_count(arg_count, 1, filename, line_number);
+
+	CRB_Value *args = crb_stack_peek_value(inter, 0);
+	CRB_Value ret_val;
+
+	check_map_key(&args[0], filename, line_number);
+	ret_val.type = CRB_BOOLEAN_VALUE;
+	ret_val.u.boolean_value = crb_set_add(inter, this_map(inter, env),
+										  &args[0]);
+
+	crb_stack_shrink_size(inter, 1);
+	crb_stack_push_value(inter, &ret_val);
+}
+
+typedef CRB_Object *SetOperation(CRB_Interpreter *inter,
+								 CRB_Object *left, CRB_Object *right);
+
+/* union(), intersect() and difference() give a new set */
+static void set_operation(CRB_Interpreter *inter, CRB_LocalEnvironment *env,
+						  int arg_count, SetOperation *operation,
+						  char *func_name, char *filename, int line_number)
+{
+	check_argument_count(arg_count, 1, filename, line_number);
+
+	CRB_Value *args = crb_stack_peek_value(inter, 0);
+	CRB_Value ret_val;
+
+	if (args[0].type != CRB_SET_VALUE) {
+		crb_runtime_error(filename, line_number, ARGUMENT_TYPE_MISMATCH_ERR,
+							STRING_MESSAGE_ARGUMENT, "func_name",
+							func_name, MESSAGE_ARGUMENT_END);
+	}
+	ret_val.type = CRB_SET_VALUE;
+	ret_val.u.object_value = operation(inter, this_map(inter, env),
+									   args[0].u.object_value);
+
+	crb_stack_shrink_size(inter, 1);
+	crb_stack_push_value(inter, &ret_val);
+}
+
+static void fake_method_set_union_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number)
+{
+	set_operation(inter, env, arg_count, crb_set_union, "set.union",
+				  filename, line_number);
+}
+
+static void fake_method_set_intersect_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number)
+{
+	set_operation(inter, env, arg_count, crb_set_intersect, "set.intersect",
+				  filename, line_number);
+}
+
+static void fake_method_set_difference_proc(CRB_Interpreter *inter,
+										CRB_LocalEnvironment *env,
+										int arg_count,
+										char *filename, int line_number)
+{
+	set_operation(inter, env, arg_count, crb_set_difference,
+				  "set.difference", filename, line_number);
+}
+
 static void fake_method_exception_print_proc(CRB_Interpreter *inter,
 										CRB_LocalEnvironment *env,
 										int arg_count,
@@ -1,27 +1,34 @@
 #include <stdio.h>
+#include <stdint.h>
 #include <string.h>
 #include "MEM.h"
 #include "DBG.h"
 #include "crowbar.h"
 
 
+/*
+ * Collect once the heap has grown by what was live after the last
+ * collection, HEAP_THRESHOLD_SIZE at least.  A collection marks all
+ * that is live, so its cost stays in proportion to what was allocated
+ * since the last one.  Building up a map or an array of millions of
+ * elements no longer marks all of them again on every call.
+ */
 void crb_check_gc(CRB_Interpreter *inter)
 {
 	if (inter->heap.gc_enabled > 0) {
 
-#if 1
-		crb_garbage_collect(inter);
-#else
-
 		if (inter->heap.current_heap_size >= 
 				inter->heap.current_threshold) {
+			size_t heap_size, step;
 
 			crb_garbage_collect(inter);
 
-			inter->heap.current_threshold = inter->heap.current_heap_size
-												+ HEAP_THRESHOLD_SIZE;
+			heap_size = inter->heap.current_heap_size;
+			step = larger(heap_size, HEAP_THRESHOLD_SIZE);
+			// saturate rather than wrap to a threshold below the heap
+			inter->heap.current_threshold
+				= heap_size > SIZE_MAX - step ? SIZE_MAX : heap_size + step;
 		}
-#endif
 
 	}
 
@@ -71,10 +78,17 @@ static void gc_mark_value(CRB_Value *value)
 		gc_mark_object(value->u.object_value);
 		break;
 	case CRB_CLOSURE_VALUE:
-		gc_mark_object(value->u.closure_value.scope_obj);
+		gc_mark_object(value->u.object_value);
+		break;
+	case CRB_MAP_VALUE:
+	case CRB_SET_VALUE:
+	case CRB_RECORD_VALUE:
+		gc_mark_object(value->u.object_value);
 		break;
 	case CRB_FAKE_METHOD_VALUE:
-		gc_mark_object(value->u.fake_method.object);
+		/* a method no object has holds its name instead */
+		if (value->index >= 0)
+			gc_mark_object(value->u.object_value);
 		break;
 	default:
 		*(char*)0 = 1;
@@ -97,8 +111,16 @@ static void gc_mark_object(CRB_Object *object)
 		case ARRAY_OBJECT:
 			{
 				int i;
+				/* the elements of a view are the parent's */
+				if (object->u.array.parent != NULL) {
+					gc_mark_object(object->u.array.parent);
+					break;
+				}
+				/* packed ints and doubles hold no references */
+				if (object->u.array.kind != GENERIC_ARRAY)
+					break;
 				for (i=0; i<object->u.array.length; i++) {
-					gc_mark_value(&(object->u.array.array[i]));
+					gc_mark_value(&(object->u.array.u.value[i]));
 				}
 				break;
 			}
@@ -117,6 +139,29 @@ static void gc_mark_object(CRB_Object *object)
 				gc_mark_object(object->u.scope_chain.prev_scope);
 				break;
 			}
+		case CLOSURE_OBJECT:
+			gc_mark_object(object->u.closure.scope_obj);
+			break;
+		case MAP_OBJECT:
+		case SET_OBJECT:
+			{
+				MapEntry *entry = object->u.map.entry;
+				int i;
+				/* removed entries have null keys and values */
+				for (i=0; i<object->u.map.entry_count; i++) {
+					gc_mark_value(&entry[i].key);
+					gc_mark_value(&entry[i].value);
+				}
+				break;
+			}
+		case RECORD_OBJECT:
+			{
+				int i;
+				for (i=0; i<object->u.record.definition
+								->u.record_f.field_count; i++)
+					gc_mark_value(&object->u.record.field[i]);
+				break;
+			}
 		case OBJECT_TYPE_COUNT_PLUS_1:
 		default:
 			DBG_panic(("unexpected object type: %d\n", object->type));
@@ -137,7 +182,18 @@ static void gc_mark_objects(CRB_Interpreter *inter)
 
 	//printf("gc_mark_objects:, inter->top_env=0x%x\n", inter->top_env);
 	for (env=inter->top_env; env!=NULL; env=env->parent_env) {
+		Variable *variable;
+
 		gc_mark_object(env->environ_scope);
+		gc_mark_object(env->outer_scope);
+		for (i=0; i<env->variable_count; i++) {
+			if (env->variable[i].name)
+				gc_mark_value(&(env->variable[i].value));
+		}
+		for (variable=env->overflow_variable; variable!=NULL;
+				variable=variable->next) {
+			gc_mark_value(&(variable->value));
+		}
 	}
 
 
@@ -188,11 +244,7 @@ static void gc_dispose_object(CRB_Interpreter *inter, CRB_Object *object)
 		}
 		break;
 	case ARRAY_OBJECT:
-		if (object->u.array.array!=NULL) {
-			inter->heap.current_heap_size -=
-				object->u.array.alloc_size * sizeof(CRB_Value);
-			MEM_free(object->u.array.array);
-		}
+		crb_dispose_array(inter, object);
 		break;
 	case ASSOC_OBJECT:
 		dispose_assoc_member(inter, object->u.assoc.member);
@@ -200,6 +252,15 @@ static void gc_dispose_object(CRB_Interpreter *inter, CRB_Object *object)
 	case SCOPE_CHAIN_OBJECT:
 		dispose_scope_chain(inter, object);
 		break;
+	case CLOSURE_OBJECT:
+		break;
+	case MAP_OBJECT:
+	case SET_OBJECT:
+		crb_dispose_map(inter, object);
+		break;
+	case RECORD_OBJECT:
+		crb_dispose_record(inter, object);
+		break;
 	case OBJECT_TYPE_COUNT_PLUS_1:
 	default:
 		DBG_assert(0, ("bad type..%d\n", object->type));
@@ -236,6 +297,6 @@ void crb_garbage_collect(CRB_Interpreter *inter)
 	gc_sweep_objects(inter);
 	//printf("after gc\n");
 
-	//printf("crb_garbage_collect after, heap_size..%d\n",
+	//printf("crb_garbage_collect after, heap_size..%zu\n",
 	//		inter->heap.current_heap_size);
 }
@@ -0,0 +1,1241 @@
+#include <string.h>
+#include "MEM.h"
+#include "DBG.h"
+#include "crowbar.h"
+
+#define CODE_ALLOC_SIZE		(256)
+#define CONSTANT_ALLOC_SIZE	(32)
+
+/*
+ * break and continue inside a loop jump to labels not known yet.  The
+ * pending jumps are chained through their operands (-1 ends a chain)
+ * and patched when the loop is closed.
+ */
+typedef struct LoopLabel_tag {
+	int		break_chain;
+	int		continue_chain;
+	struct LoopLabel_tag *outer;
+} LoopLabel;
+
+/*
+ * The receiver of an X.size() or X.length() in a loop condition is
+ * looked up once before the loop and held on the stack, slot counts
+ * from the stack base of the code.
+ */
+typedef struct {
+	Expression	*call;
+	int			slot;
+} HoistedCall;
+
+typedef struct {
+	CRB_Interpreter	*inter;
+	FunctionDefinition	*func;	/* NULL for the top level */
+	Instruction		*code;
+	CodeLocation	*location;
+	int				code_size;
+	int				code_alloc_size;
+	CodeConstant	*constant;
+	int				constant_count;
+	int				constant_alloc_size;
+	LoopLabel		*loop;
+	int				hold_count;		/* values held on the stack */
+	HoistedCall		*hoisted;
+} CodeBuffer;
+
+static void
+generate_expression(CodeBuffer *cb, Expression *expr);
+
+static void
+generate_statement_list(CodeBuffer *cb, StatementList *list);
+
+static int
+emit(CodeBuffer *cb, char *filename, int line_number,
+	 OpCode opcode, int operand, int operand2)
+{
+	if (cb->code_size == cb->code_alloc_size) {
+		cb->code_alloc_size += CODE_ALLOC_SIZE;
+		cb->code = MEM_realloc(cb->code,
+						sizeof(Instruction) * cb->code_alloc_size);
+		cb->location = MEM_realloc(cb->location,
+						sizeof(CodeLocation) * cb->code_alloc_size);
+	}
+	cb->code[cb->code_size].opcode = opcode;
+	cb->code[cb->code_size].operand = operand;
+	cb->code[cb->code_size].operand2 = operand2;
+	cb->location[cb->code_size].filename = filename;
+	cb->location[cb->code_size].line_number = line_number;
+
+	return cb->code_size++;
+}
+
+static int
+emit_at(CodeBuffer *cb, Expression *expr, OpCode opcode,
+		int operand, int operand2)
+{
+	return emit(cb, crb_node_filename(cb->inter, expr),
+				crb_node_line_number(cb->inter, expr),
+				opcode, operand, operand2);
+}
+
+static int
+emit_st(CodeBuffer *cb, Statement *statement, OpCode opcode,
+		int operand, int operand2)
+{
+	return emit(cb, crb_node_filename(cb->inter, statement),
+				crb_node_line_number(cb->inter, statement),
+				opcode, operand, operand2);
+}
+
+static int
+add_constant(CodeBuffer *cb, CodeConstant *constant)
+{
+	if (cb->constant_count == cb->constant_alloc_size) {
+		cb->constant_alloc_size += CONSTANT_ALLOC_SIZE;
+		cb->constant = MEM_realloc(cb->constant,
+						sizeof(CodeConstant) * cb->constant_alloc_size);
+	}
+	cb->constant[cb->constant_count] = *constant;
+
+	return cb->constant_count++;
+}
+
+static int
+add_pointer(CodeBuffer *cb, void *pointer)
+{
+	CodeConstant constant;
+	int i;
+
+	for (i = 0; i < cb->constant_count; i++) {
+		if (cb->constant[i].pointer == pointer)
+			return i;
+	}
+	constant.pointer = pointer;
+
+	return add_constant(cb, &constant);
+}
+
+static int
+add_double(CodeBuffer *cb, double value)
+{
+	CodeConstant constant;
+
+	constant.double_value = value;
+
+	return add_constant(cb, &constant);
+}
+
+/* point the jump at site (or the chain of jumps starting there) to here */
+static void
+patch_chain(CodeBuffer *cb, int site, int target)
+{
+	while (site >= 0) {
+		int next = cb->code[site].operand;
+
+		cb->code[site].operand = target;
+		site = next;
+	}
+}
+
+static int
+current_label(CodeBuffer *cb)
+{
+	return cb->code_size;
+}
+
+static void
+open_loop(CodeBuffer *cb, LoopLabel *loop)
+{
+	loop->break_chain = -1;
+	loop->continue_chain = -1;
+	loop->outer = cb->loop;
+	cb->loop = loop;
+}
+
+static void
+close_loop(CodeBuffer *cb, LoopLabel *loop, int break_label,
+		   int continue_label)
+{
+	patch_chain(cb, loop->break_chain, break_label);
+	patch_chain(cb, loop->continue_chain, continue_label);
+	cb->loop = loop->outer;
+}
+
+static OpCode
+binary_opcode(ExpressionType type)
+{
+	switch (type) {
+	case ADD_EXPRESSION:	return OP_ADD;
+	case SUB_EXPRESSION:	return OP_SUB;
+	case MUL_EXPRESSION:	return OP_MUL;
+	case DIV_EXPRESSION:	return OP_DIV;
+	case MOD_EXPRESSION:	return OP_MOD;
+	case EQ_EXPRESSION:		return OP_EQ;
+	case NE_EXPRESSION:		return OP_NE;
+	case GT_EXPRESSION:		return OP_GT;
+	case GE_EXPRESSION:		return OP_GE;
+	case LT_EXPRESSION:		return OP_LT;
+	case LE_EXPRESSION:		return OP_LE;
+	default:
+		DBG_panic(("bad binary expression..%d\n", type));
+	}
+	return 0;
+}
+
+/*
+ * Could evaluating expr see whether the variable name exists, through a
+ * call or by naming it?
+ */
+static CRB_Boolean
+may_see_variable(Expression *expr, char *name)
+{
+	switch (expr->type) {
+	case BOOLEAN_EXPRESSION:	/* FALLTHRU */
+	case INT_EXPRESSION:		/* FALLTHRU */
+	case DOUBLE_EXPRESSION:		/* FALLTHRU */
+	case STRING_EXPRESSION:		/* FALLTHRU */
+	case REGEXP_EXPRESSION:		/* FALLTHRU */
+	case NULL_EXPRESSION:
+		return CRB_FALSE;
+	case IDENTIFIER_EXPRESSION:
+		return !strcmp(expr->u.identifier, name);
+	case ADD_EXPRESSION:	/* FALLTHRU */
+	case SUB_EXPRESSION:	/* FALLTHRU */
+	case MUL_EXPRESSION:	/* FALLTHRU */
+	case DIV_EXPRESSION:	/* FALLTHRU */
+	case MOD_EXPRESSION:	/* FALLTHRU */
+	case EQ_EXPRESSION:		/* FALLTHRU */
+	case NE_EXPRESSION:		/* FALLTHRU */
+	case GT_EXPRESSION:		/* FALLTHRU */
+	case GE_EXPRESSION:		/* FALLTHRU */
+	case LT_EXPRESSION:		/* FALLTHRU */
+	case LE_EXPRESSION:		/* FALLTHRU */
+	case LOGICAL_AND_EXPRESSION:	/* FALLTHRU */
+	case LOGICAL_OR_EXPRESSION:
+		return may_see_variable(expr->u.binary_expression.left, name)
+			|| may_see_variable(expr->u.binary_expression.right, name);
+	case NOT_EXPRESSION:
+		return may_see_variable(expr->u.not_expression.sub_expr, name);
+	case MINUS_EXPRESSION:
+		return may_see_variable(expr->u.minus_expression, name);
+	case INDEX_EXPRESSION:
+		return may_see_variable(expr->u.index_expression.array, name)
+			|| may_see_variable(expr->u.index_expression.index, name);
+	case MEMBER_EXPRESSION:
+		return may_see_variable(expr->u.member_expression.expression, name);
+	case ARRAY_EXPRESSION: {
+		ExpressionList *list = expr->u.array_expression;
+		int i;
+
+		for (i = 0; i < list->count; i++) {
+			if (may_see_variable(list->expression[i], name))
+				return CRB_TRUE;
+		}
+		return CRB_FALSE;
+	}
+	default:
+		return CRB_TRUE;
+	}
+}
+
+/* X.size() or X.length() with no arguments */
+static CRB_Boolean
+is_length_call(Expression *expr)
+{
+	Expression *callee;
+
+	if (expr->type != FUNCTION_CALL_EXPRESSION
+		|| expr->u.function_call_expression.argument->count != 0)
+		return CRB_FALSE;
+	callee = expr->u.function_call_expression.expr;
+	if (callee->type != MEMBER_EXPRESSION
+		|| callee->u.member_expression.expression->type
+			!= IDENTIFIER_EXPRESSION)
+		return CRB_FALSE;
+
+	return !strcmp(callee->u.member_expression.member_name, "size")
+		|| !strcmp(callee->u.member_expression.member_name, "length");
+}
+
+static CRB_Boolean
+is_size_call(Expression *expr)
+{
+	return !strcmp(expr->u.function_call_expression.expr
+				->u.member_expression.member_name, "size");
+}
+
+static char *
+length_call_receiver(Expression *expr)
+{
+	return expr->u.function_call_expression.expr
+				->u.member_expression.expression->u.identifier;
+}
+
+/* the first length call in a condition, not looking into closures */
+static Expression *
+find_length_call(Expression *expr)
+{
+	Expression *found = NULL;
+	ArgumentList *arg;
+	ExpressionList *list;
+	int i;
+
+	if (expr == NULL)
+		return NULL;
+
+	if (is_length_call(expr))
+		return expr;
+
+	switch (expr->type) {
+	case ASSIGN_EXPRESSION:
+		found = find_length_call(expr->u.assign_expression.left);
+		if (!found)
+			found = find_length_call(expr->u.assign_expression.operand);
+		break;
+	case ADD_EXPRESSION:	/* FALLTHRU */
+	case SUB_EXPRESSION:	/* FALLTHRU */
+	case MUL_EXPRESSION:	/* FALLTHRU */
+	case DIV_EXPRESSION:	/* FALLTHRU */
+	case MOD_EXPRESSION:	/* FALLTHRU */
+	case EQ_EXPRESSION:		/* FALLTHRU */
+	case NE_EXPRESSION:		/* FALLTHRU */
+	case GT_EXPRESSION:		/* FALLTHRU */
+	case GE_EXPRESSION:		/* FALLTHRU */
+	case LT_EXPRESSION:		/* FALLTHRU */
+	case LE_EXPRESSION:		/* FALLTHRU */
+	case LOGICAL_AND_EXPRESSION:	/* FALLTHRU */
+	case LOGICAL_OR_EXPRESSION:
+		found = find_length_call(expr->u.binary_expression.left);
+		if (!found)
+			found = find_length_call(expr->u.binary_expression.right);
+		break;
+	case NOT_EXPRESSION:
+		found = find_length_call(expr->u.not_expression.sub_expr);
+		break;
+	case MINUS_EXPRESSION:
+		found = find_length_call(expr->u.minus_expression);
+		break;
+	case FUNCTION_CALL_EXPRESSION:
+		found = find_length_call(expr->u.function_call_expression.expr);
+		arg = expr->u.function_call_expression.argument;
+		for (i = 0; i < arg->count && !found; i++)
+			found = find_length_call(arg->expression[i]);
+		break;
+	case ARRAY_EXPRESSION:
+		list = expr->u.array_expression;
+		for (i = 0; i < list->count && !found; i++)
+			found = find_length_call(list->expression[i]);
+		break;
+	case INDEX_EXPRESSION:
+		found = find_length_call(expr->u.index_expression.array);
+		if (!found)
+			found = find_length_call(expr->u.index_expression.index);
+		break;
+	case POST_INCREMENT_EXPRESSION:	/* FALLTHRU */
+	case PREV_INCREMENT_EXPRESSION:	/* FALLTHRU */
+	case POST_DECREMENT_EXPRESSION:	/* FALLTHRU */
+	case PREV_DECREMENT_EXPRESSION:
+		found = find_length_call(expr->u.inc_dec.operand);
+		break;
+	case MEMBER_EXPRESSION:
+		found = find_length_call(expr->u.member_expression.expression);
+		break;
+	default:
+		break;
+	}
+
+	return found;
+}
+
+/*
+ * What running a loop may do to the hoisted receiver: assign it by name,
+ * or run code not visible here (a crowbar function, a method, which may
+ * be a closure in an assoc, or the iterator of a foreach).
+ */
+typedef struct {
+	CRB_Interpreter	*inter;
+	char		*name;
+	Expression	*hoisted_call;
+	CRB_Boolean	writes;
+	CRB_Boolean	calls;
+} LoopEffect;
+
+/* natives that never call back into crowbar code */
+static char *st_plain_native[] = {
+	"print", "println", "fopen", "fclose", "fgets", "fputs",
+	"new_array", "new_object", "new_exception",
+	"reg_search", "reg_match", "reg_replace", "reg_replace_all",
+	"reg_split", NULL
+};
+
+static CRB_Boolean
+is_plain_native(CRB_Interpreter *inter, Expression *callee)
+{
+	FunctionDefinition *func;
+	int i;
+
+	if (callee->type != IDENTIFIER_EXPRESSION)
+		return CRB_FALSE;
+	func = crb_search_function_in(inter, callee->u.identifier);
+	if (func == NULL || func->type != NATIVE_FUNCTION_DEFINITION)
+		return CRB_FALSE;
+	for (i = 0; st_plain_native[i]; i++) {
+		if (!strcmp(st_plain_native[i], callee->u.identifier))
+			return CRB_TRUE;
+	}
+	return CRB_FALSE;
+}
+
+static void
+scan_statement(Statement *statement, LoopEffect *effect);
+
+static void
+scan_expression(Expression *expr, LoopEffect *effect)
+{
+	ArgumentList *arg;
+	ExpressionList *list;
+	Expression *operand;
+	int i;
+
+	if (expr == NULL)
+		return;
+
+	switch (expr->type) {
+	case ASSIGN_EXPRESSION:
+		operand = expr->u.assign_expression.left;
+		if (operand->type == IDENTIFIER_EXPRESSION
+			&& !strcmp(operand->u.identifier, effect->name))
+			effect->writes = CRB_TRUE;
+		scan_expression(operand, effect);
+		scan_expression(expr->u.assign_expression.operand, effect);
+		break;
+	case ADD_EXPRESSION:	/* FALLTHRU */
+	case SUB_EXPRESSION:	/* FALLTHRU */
+	case MUL_EXPRESSION:	/* FALLTHRU */
+	case DIV_EXPRESSION:	/* FALLTHRU */
+	case MOD_EXPRESSION:	/* FALLTHRU */
+	case EQ_EXPRESSION:		/* FALLTHRU */
+	case NE_EXPRESSION:		/* FALLTHRU */
+	case GT_EXPRESSION:		/* FALLTHRU */
+	case GE_EXPRESSION:		/* FALLTHRU */
+	case LT_EXPRESSION:		/* FALLTHRU */
+	case LE_EXPRESSION:		/* FALLTHRU */
+	case LOGICAL_AND_EXPRESSION:	/* FALLTHRU */
+	case LOGICAL_OR_EXPRESSION:
+		scan_expression(expr->u.binary_expression.left, effect);
+		scan_expression(expr->u.binary_expression.right, effect);
+		break;
+	case NOT_EXPRESSION:
+		scan_expression(expr->u.not_expression.sub_expr, effect);
+		break;
+	case MINUS_EXPRESSION:
+		scan_expression(expr->u.minus_expression, effect);
+		break;
+	case FUNCTION_CALL_EXPRESSION:
+		// the hoisted call runs code only while the held receiver is
+		// neither an array nor a string, and then nothing is skipped
+		if (expr != effect->hoisted_call
+			&& !is_plain_native(effect->inter,
+								expr->u.function_call_expression.expr))
+			effect->calls = CRB_TRUE;
+		scan_expression(expr->u.function_call_expression.expr, effect);
+		arg = expr->u.function_call_expression.argument;
+		for (i = 0; i < arg->count; i++)
+			scan_expression(arg->expression[i], effect);
+		break;
+	case ARRAY_EXPRESSION:
+		list = expr->u.array_expression;
+		for (i = 0; i < list->count; i++)
+			scan_expression(list->expression[i], effect);
+		break;
+	case INDEX_EXPRESSION:
+		scan_expression(expr->u.index_expression.array, effect);
+		scan_expression(expr->u.index_expression.index, effect);
+		break;
+	case POST_INCREMENT_EXPRESSION:	/* FALLTHRU */
+	case PREV_INCREMENT_EXPRESSION:	/* FALLTHRU */
+	case POST_DECREMENT_EXPRESSION:	/* FALLTHRU */
+	case PREV_DECREMENT_EXPRESSION:
+		operand = expr->u.inc_dec.operand;
+		if (operand->type == IDENTIFIER_EXPRESSION
+			&& !strcmp(operand->u.identifier, effect->name))
+			effect->writes = CRB_TRUE;
+		scan_expression(operand, effect);
+		break;
+	case MEMBER_EXPRESSION:
+		scan_expression(expr->u.member_expression.expression, effect);
+		break;
+	default:
+		// a closure body only runs when called, which counts above
+		break;
+	}
+}
+
+static void
+scan_statement_list(StatementList *list, LoopEffect *effect)
+{
+	int i;
+
+	for (i = 0; list && i < list->count; i++)
+		scan_statement(list->statement[i], effect);
+}
+
+static void
+scan_statement(Statement *statement, LoopEffect *effect)
+{
+	IdentifierList *id;
+	ElsifList *elsif_list;
+	int i;
+
+	if (statement == NULL)
+		return;
+
+	switch (statement->type) {
+	case EXPRESSION_STATEMENT:
+		scan_expression(statement->u.expression_s, effect);
+		break;
+	case GLOBAL_STATEMENT:
+		for (id = statement->u.global_s.identifier_list; id; id = id->next) {
+			if (!strcmp(id->name, effect->name))
+				effect->writes = CRB_TRUE;
+		}
+		break;
+	case IF_STATEMENT:
+		scan_expression(statement->u.if_s.condition, effect);
+		scan_statement(statement->u.if_s.then_statement, effect);
+		elsif_list = statement->u.if_s.elsif_list;
+		for (i = 0; elsif_list && i < elsif_list->count; i++) {
+			scan_expression(elsif_list->elsif[i].condition, effect);
+			scan_statement(elsif_list->elsif[i].statement, effect);
+		}
+		scan_statement(statement->u.if_s.else_statement, effect);
+		break;
+	case WHILE_STATEMENT:
+		scan_expression(statement->u.while_s.condition, effect);
+		scan_statement(statement->u.while_s.statement, effect);
+		break;
+	case FOR_STATEMENT:
+		scan_expression(statement->u.for_s.init, effect);
+		scan_expression(statement->u.for_s.condition, effect);
+		scan_expression(statement->u.for_s.post, effect);
+		scan_statement(statement->u.for_s.statement, effect);
+		break;
+	case RETURN_STATEMENT:
+		scan_expression(statement->u.return_s.return_value, effect);
+		break;
+	case BLOCK_STATEMENT:
+		scan_statement_list(statement->u.block_s.block->statement_list,
+							effect);
+		break;
+	case TRY_STATEMENT:
+		if (statement->u.try_s.identifier
+			&& !strcmp(statement->u.try_s.identifier, effect->name))
+			effect->writes = CRB_TRUE;
+		scan_statement(statement->u.try_s.run_st, effect);
+		scan_statement(statement->u.try_s.catch_st, effect);
+		scan_statement(statement->u.try_s.final_st, effect);
+		break;
+	case THROW_STATEMENT:
+		scan_expression(statement->u.throw_s.throw_expr, effect);
+		break;
+	case FOREACH_STATEMENT:
+		if (!strcmp(statement->u.foreach_s.identifier, effect->name))
+			effect->writes = CRB_TRUE;
+		effect->calls = CRB_TRUE;	/* iterator() and its methods */
+		scan_expression(statement->u.foreach_s.array_expr, effect);
+		scan_statement(statement->u.foreach_s.sub_st, effect);
+		break;
+	default:
+		break;
+	}
+}
+
+static CRB_Boolean
+declares_global_in_list(StatementList *list, char *name);
+
+/* a "global name;" anywhere in statement, closures aside */
+static CRB_Boolean
+declares_global(Statement *statement, char *name)
+{
+	IdentifierList *id;
+	ElsifList *elsif_list;
+	int i;
+
+	if (statement == NULL)
+		return CRB_FALSE;
+
+	switch (statement->type) {
+	case GLOBAL_STATEMENT:
+		for (id = statement->u.global_s.identifier_list; id; id = id->next) {
+			if (!strcmp(id->name, name))
+				return CRB_TRUE;
+		}
+		return CRB_FALSE;
+	case IF_STATEMENT:
+		if (declares_global(statement->u.if_s.then_statement, name)
+			|| declares_global(statement->u.if_s.else_statement, name))
+			return CRB_TRUE;
+		elsif_list = statement->u.if_s.elsif_list;
+		for (i = 0; elsif_list && i < elsif_list->count; i++) {
+			if (declares_global(elsif_list->elsif[i].statement, name))
+				return CRB_TRUE;
+		}
+		return CRB_FALSE;
+	case WHILE_STATEMENT:
+		return declares_global(statement->u.while_s.statement, name);
+	case FOR_STATEMENT:
+		return declares_global(statement->u.for_s.statement, name);
+	case BLOCK_STATEMENT:
+		return declares_global_in_list(
+						statement->u.block_s.block->statement_list, name);
+	case TRY_STATEMENT:
+		return declares_global(statement->u.try_s.run_st, name)
+			|| declares_global(statement->u.try_s.catch_st, name)
+			|| declares_global(statement->u.try_s.final_st, name);
+	case FOREACH_STATEMENT:
+		return declares_global(statement->u.foreach_s.sub_st, name);
+	default:
+		return CRB_FALSE;
+	}
+}
+
+static CRB_Boolean
+declares_global_in_list(StatementList *list, char *name)
+{
+	int i;
+
+	for (i = 0; list && i < list->count; i++) {
+		if (declares_global(list->statement[i], name))
+			return CRB_TRUE;
+	}
+	return CRB_FALSE;
+}
+
+/*
+ * Is name a parameter no other code can assign: the function defines no
+ * closures and never declares it global.
+ */
+static CRB_Boolean
+is_private_parameter(FunctionDefinition *func, char *name)
+{
+	ParameterList *param;
+	int i;
+
+	if (func == NULL || func->u.crowbar_f.has_closure)
+		return CRB_FALSE;
+	param = func->u.crowbar_f.parameter;
+	for (i = 0; i < param->count; i++) {
+		if (!strcmp(param->name[i], name))
+			break;
+	}
+	if (i == param->count)
+		return CRB_FALSE;
+
+	return !declares_global_in_list(func->u.crowbar_f.block->statement_list,
+									name);
+}
+
+/*
+ * Hold the receiver of a length call in the condition when nothing in
+ * the loop can assign it, the call then reads the length of the held
+ * array or string itself.  Returns the number of values held.
+ */
+static int
+hoist_length_call(CodeBuffer *cb, Statement *statement,
+				  HoistedCall *hoisted, Expression *condition,
+				  Expression *post, Statement *body)
+{
+	LoopEffect effect;
+	Expression *call;
+
+	call = find_length_call(condition);
+	if (call == NULL)
+		return 0;
+
+	effect.inter = cb->inter;
+	effect.name = length_call_receiver(call);
+	effect.hoisted_call = call;
+	effect.writes = CRB_FALSE;
+	effect.calls = CRB_FALSE;
+	scan_expression(condition, &effect);
+	scan_expression(post, &effect);
+	scan_statement(body, &effect);
+
+	if (effect.writes
+		|| (effect.calls && !is_private_parameter(cb->func, effect.name)))
+		return 0;
+
+	hoisted->call = call;
+	hoisted->slot = cb->hold_count;
+	emit_st(cb, statement, OP_HOIST_RECEIVER,
+			add_pointer(cb, effect.name), 0);
+	cb->hold_count++;
+	cb->hoisted = hoisted;
+
+	return 1;
+}
+
+static void
+unhoist_length_call(CodeBuffer *cb, Statement *statement,
+					HoistedCall *outer, int held)
+{
+	if (held) {
+		emit_st(cb, statement, OP_HOIST_END, 0, 0);
+		cb->hold_count--;
+	}
+	cb->hoisted = outer;
+}
+
+/*
+ * Identifier: the value, STORE_VARIABLE.  Index: array, index, value,
+ * STORE_INDEX.  Member: object, value, STORE_MEMBER.  operand2 holds
+ * the AssignType, the stores leave the assigned value on the stack.
+ */
+static void
+generate_assign_expression(CodeBuffer *cb, Expression *expr)
+{
+	Expression *left = expr->u.assign_expression.left;
+	AssignType type = expr->u.assign_expression.type;
+
+	switch (left->type) {
+	case IDENTIFIER_EXPRESSION:
+		// the variable exists while the value is evaluated, a function
+		// called there finds it through its global scope
+		if (may_see_variable(expr->u.assign_expression.operand,
+							left->u.identifier)) {
+			emit_at(cb, left, OP_CREATE_VARIABLE,
+					add_pointer(cb, left->u.identifier), 0);
+		}
+		generate_expression(cb, expr->u.assign_expression.operand);
+		emit_at(cb, left, OP_STORE_VARIABLE,
+				add_pointer(cb, left->u.identifier), type);
+		break;
+	case INDEX_EXPRESSION:
+		generate_expression(cb, left->u.index_expression.array);
+		generate_expression(cb, left->u.index_expression.index);
+		generate_expression(cb, expr->u.assign_expression.operand);
+		emit_at(cb, left, OP_STORE_INDEX, 0, type);
+		break;
+	case MEMBER_EXPRESSION:
+		generate_expression(cb, left->u.member_expression.expression);
+		generate_expression(cb, expr->u.assign_expression.operand);
+		emit_at(cb, left, OP_STORE_MEMBER, add_pointer(cb, left), type);
+		break;
+	default:
+		emit_at(cb, left, OP_NOT_LVALUE, 0, 0);
+		break;
+	}
+}
+
+/* operand2 holds the ExpressionType of the ++/-- */
+static void
+generate_incdec_expression(CodeBuffer *cb, Expression *expr)
+{
+	Expression *operand = expr->u.inc_dec.operand;
+
+	switch (operand->type) {
+	case IDENTIFIER_EXPRESSION:
+		emit_at(cb, expr, OP_INCDEC_VARIABLE,
+				add_pointer(cb, operand->u.identifier), expr->type);
+		break;
+	case INDEX_EXPRESSION:
+		generate_expression(cb, operand->u.index_expression.array);
+		generate_expression(cb, operand->u.index_expression.index);
+		emit_at(cb, expr, OP_INCDEC_INDEX, 0, expr->type);
+		break;
+	case MEMBER_EXPRESSION:
+		generate_expression(cb, operand->u.member_expression.expression);
+		emit_at(cb, expr, OP_INCDEC_MEMBER, add_pointer(cb, operand),
+				expr->type);
+		break;
+	default:
+		emit_at(cb, operand, OP_NOT_LVALUE, 0, 0);
+		break;
+	}
+}
+
+static void
+generate_logical_and_or_expression(CodeBuffer *cb, Expression *expr)
+{
+	Expression *left = expr->u.binary_expression.left;
+	Expression *right = expr->u.binary_expression.right;
+	int site;
+
+	generate_expression(cb, left);
+	site = emit_at(cb, left,
+				expr->type == LOGICAL_AND_EXPRESSION ? OP_AND_JUMP : OP_OR_JUMP,
+				-1, 0);
+	generate_expression(cb, right);
+	emit_at(cb, right, OP_CHECK_BOOLEAN, 0, 0);
+	patch_chain(cb, site, current_label(cb));
+}
+
+/*
+ * The callee slot goes below the arguments.  For a call by name
+ * PUSH_CALLEE leaves null there when the name is a global function.
+ */
+static void
+generate_function_call_expression(CodeBuffer *cb, Expression *expr,
+								  OpCode call_op)
+{
+	Expression *callee = expr->u.function_call_expression.expr;
+	ArgumentList *arg = expr->u.function_call_expression.argument;
+	int i;
+	int site;
+
+	if (cb->hoisted && cb->hoisted->call == expr) {
+		// the held receiver answers directly, the call below is for
+		// anything but an array or a string
+		site = emit_at(cb, expr,
+					is_size_call(expr) ? OP_HOISTED_SIZE : OP_HOISTED_LENGTH,
+					cb->hoisted->slot, -1);
+		generate_expression(cb, callee);
+		emit_at(cb, expr, call_op, add_pointer(cb, expr), 0);
+		cb->code[site].operand2 = current_label(cb);
+		return;
+	}
+
+	if (callee->type == IDENTIFIER_EXPRESSION) {
+		emit_at(cb, callee, OP_PUSH_CALLEE, add_pointer(cb, expr), 0);
+	} else {
+		generate_expression(cb, callee);
+	}
+	for (i = 0; i < arg->count; i++)
+		generate_expression(cb, arg->expression[i]);
+	emit_at(cb, expr, call_op, add_pointer(cb, expr), arg->count);
+}
+
+static void
+generate_array_expression(CodeBuffer *cb, Expression *expr)
+{
+	ExpressionList *list = expr->u.array_expression;
+	int i;
+
+	for (i = 0; i < list->count; i++)
+		generate_expression(cb, list->expression[i]);
+	emit_at(cb, expr, OP_NEW_ARRAY, list->count, 0);
+}
+
+static void
+generate_expression(CodeBuffer *cb, Expression *expr)
+{
+	switch (expr->type) {
+	case BOOLEAN_EXPRESSION:
+		emit_at(cb, expr, OP_PUSH_BOOLEAN, expr->u.boolean_value, 0);
+		break;
+	case INT_EXPRESSION:
+		emit_at(cb, expr, OP_PUSH_INT, expr->u.int_value, 0);
+		break;
+	case DOUBLE_EXPRESSION:
+		emit_at(cb, expr, OP_PUSH_DOUBLE,
+				add_double(cb, expr->u.double_value), 0);
+		break;
+	case STRING_EXPRESSION:
+		emit_at(cb, expr, OP_PUSH_STRING,
+				add_pointer(cb, expr->u.string_value), 0);
+		break;
+	case REGEXP_EXPRESSION:
+		emit_at(cb, expr, OP_PUSH_REGEXP,
+				add_pointer(cb, expr->u.regexp_value), 0);
+		break;
+	case IDENTIFIER_EXPRESSION:
+		emit_at(cb, expr, OP_PUSH_VARIABLE,
+				add_pointer(cb, expr->u.identifier), 0);
+		break;
+	case ASSIGN_EXPRESSION:
+		generate_assign_expression(cb, expr);
+		break;
+	case ADD_EXPRESSION:	/* FALLTHRU */
+	case SUB_EXPRESSION:	/* FALLTHRU */
+	case MUL_EXPRESSION:	/* FALLTHRU */
+	case DIV_EXPRESSION:	/* FALLTHRU */
+	case MOD_EXPRESSION:	/* FALLTHRU */
+	case EQ_EXPRESSION:		/* FALLTHRU */
+	case NE_EXPRESSION:		/* FALLTHRU */
+	case GT_EXPRESSION:		/* FALLTHRU */
+	case GE_EXPRESSION:		/* FALLTHRU */
+	case LT_EXPRESSION:		/* FALLTHRU */
+	case LE_EXPRESSION:
+		generate_expression(cb, expr->u.binary_expression.left);
+		generate_expression(cb, expr->u.binary_expression.right);
+		emit_at(cb, expr->u.binary_expression.left,
+				binary_opcode(expr->type), 0, 0);
+		break;
+	case NOT_EXPRESSION:
+		generate_expression(cb, expr->u.not_expression.sub_expr);
+		emit_at(cb, expr->u.not_expression.sub_expr, OP_NOT, 0, 0);
+		break;
+	case LOGICAL_AND_EXPRESSION:	/* FALLTHRU */
+	case LOGICAL_OR_EXPRESSION:
+		generate_logical_and_or_expression(cb, expr);
+		break;
+	case MINUS_EXPRESSION:
+		generate_expression(cb, expr->u.minus_expression);
+		emit_at(cb, expr->u.minus_expression, OP_MINUS, 0, 0);
+		break;
+	case FUNCTION_CALL_EXPRESSION:
+		generate_function_call_expression(cb, expr, OP_CALL);
+		break;
+	case NULL_EXPRESSION:
+		emit_at(cb, expr, OP_PUSH_NULL, 0, 0);
+		break;
+	case ARRAY_EXPRESSION:
+		generate_array_expression(cb, expr);
+		break;
+	case INDEX_EXPRESSION:
+		generate_expression(cb, expr->u.index_expression.array);
+		generate_expression(cb, expr->u.index_expression.index);
+		emit_at(cb, expr, OP_PUSH_INDEX, 0, 0);
+		break;
+	case PREV_INCREMENT_EXPRESSION:	/* FALLTHRU */
+	case PREV_DECREMENT_EXPRESSION:	/* FALLTHRU */
+	case POST_INCREMENT_EXPRESSION:	/* FALLTHRU */
+	case POST_DECREMENT_EXPRESSION:
+		generate_incdec_expression(cb, expr);
+		break;
+	case MEMBER_EXPRESSION:
+		generate_expression(cb, expr->u.member_expression.expression);
+		emit_at(cb, expr, OP_PUSH_MEMBER, add_pointer(cb, expr), 0);
+		break;
+	case CLOSURE_DEFINITION:
+		emit_at(cb, expr, OP_PUSH_CLOSURE,
+				add_pointer(cb, expr->u.closure_definition.function), 0);
+		break;
+	case EXPRESSION_TYPE_COUNT_PLUS_1:	/* FALLTHRU */
+	default:
+		DBG_panic(("bad case. type..%d\n", expr->type));
+	}
+}
+
+static void
+generate_statement(CodeBuffer *cb, Statement *statement);
+
+/* a jump out of the innermost loop, or a result for the caller */
+static void
+generate_break(CodeBuffer *cb, Statement *statement)
+{
+	if (cb->loop) {
+		cb->loop->break_chain = emit_st(cb, statement, OP_JUMP,
+										cb->loop->break_chain, 0);
+	} else {
+		emit_st(cb, statement, OP_BREAK, 0, 0);
+	}
+}
+
+static void
+generate_continue(CodeBuffer *cb, Statement *statement)
+{
+	if (cb->loop) {
+		cb->loop->continue_chain = emit_st(cb, statement, OP_JUMP,
+										cb->loop->continue_chain, 0);
+	} else {
+		emit_st(cb, statement, OP_CONTINUE, 0, 0);
+	}
+}
+
+static int
+generate_condition(CodeBuffer *cb, Expression *condition)
+{
+	generate_expression(cb, condition);
+	return emit_at(cb, condition, OP_JUMP_IF_FALSE, -1, 0);
+}
+
+static void
+generate_if_statement(CodeBuffer *cb, Statement *statement)
+{
+	IfStatement *if_s = &statement->u.if_s;
+	Elsif *pos;
+	int i;
+	int false_site;
+	int end_chain = -1;
+
+	false_site = generate_condition(cb, if_s->condition);
+	generate_statement(cb, if_s->then_statement);
+	for (i = 0; if_s->elsif_list && i < if_s->elsif_list->count; i++) {
+		pos = &if_s->elsif_list->elsif[i];
+		end_chain = emit_st(cb, statement, OP_JUMP, end_chain, 0);
+		patch_chain(cb, false_site, current_label(cb));
+		false_site = generate_condition(cb, pos->condition);
+		generate_statement(cb, pos->statement);
+	}
+	if (if_s->else_statement) {
+		end_chain = emit_st(cb, statement, OP_JUMP, end_chain, 0);
+		patch_chain(cb, false_site, current_label(cb));
+		generate_statement(cb, if_s->else_statement);
+	} else {
+		patch_chain(cb, false_site, current_label(cb));
+	}
+	patch_chain(cb, end_chain, current_label(cb));
+}
+
+
+static void
+generate_while_statement(CodeBuffer *cb, Statement *statement)
+{
+	LoopLabel loop;
+	HoistedCall hoisted;
+	HoistedCall *outer_hoisted = cb->hoisted;
+	int held;
+	int cond_label;
+	int end_site;
+
+	held = hoist_length_call(cb, statement, &hoisted,
+							statement->u.while_s.condition, NULL,
+							statement->u.while_s.statement);
+	cond_label = current_label(cb);
+	end_site = generate_condition(cb, statement->u.while_s.condition);
+	open_loop(cb, &loop);
+	generate_statement(cb, statement->u.while_s.statement);
+	emit_st(cb, statement, OP_JUMP, cond_label, 0);
+	patch_chain(cb, end_site, current_label(cb));
+	close_loop(cb, &loop, current_label(cb), cond_label);
+	unhoist_length_call(cb, statement, outer_hoisted, held);
+}
+
+static void
+generate_for_statement(CodeBuffer *cb, Statement *statement)
+{
+	ForStatement *for_s = &statement->u.for_s;
+	LoopLabel loop;
+	HoistedCall hoisted;
+	HoistedCall *outer_hoisted = cb->hoisted;
+	int held;
+	int cond_label;
+	int post_label;
+	int end_site = -1;
+
+	if (for_s->init) {
+		generate_expression(cb, for_s->init);
+		emit_st(cb, statement, OP_POP, 0, 0);
+	}
+	held = hoist_length_call(cb, statement, &hoisted, for_s->condition,
+							for_s->post, for_s->statement);
+	cond_label = current_label(cb);
+	if (for_s->condition)
+		end_site = generate_condition(cb, for_s->condition);
+	open_loop(cb, &loop);
+	generate_statement(cb, for_s->statement);
+	post_label = current_label(cb);
+	if (for_s->post) {
+		generate_expression(cb, for_s->post);
+		emit_st(cb, statement, OP_POP, 0, 0);
+	}
+	emit_st(cb, statement, OP_JUMP, cond_label, 0);
+	patch_chain(cb, end_site, current_label(cb));
+	close_loop(cb, &loop, current_label(cb), post_label);
+	unhoist_length_call(cb, statement, outer_hoisted, held);
+}
+
+/*
+ * The iterable and the iteration state stay on the stack for the whole
+ * loop: FOREACH_NEXT assigns the next item or leaves the loop,
+ * FOREACH_STEP advances, FOREACH_END drops both.
+ */
+static void
+generate_foreach_statement(CodeBuffer *cb, Statement *statement)
+{
+	ForeachStatement *foreach_s = &statement->u.foreach_s;
+	LoopLabel loop;
+	int next_label;
+	int step_label;
+	int end_site;
+
+	generate_expression(cb, foreach_s->array_expr);
+	emit_st(cb, statement, OP_FOREACH_INIT, 0, 0);
+	cb->hold_count += 2;
+	next_label = current_label(cb);
+	end_site = emit_st(cb, statement, OP_FOREACH_NEXT,
+						-1, add_pointer(cb, foreach_s->identifier));
+	open_loop(cb, &loop);
+	generate_statement(cb, foreach_s->sub_st);
+	step_label = current_label(cb);
+	emit_st(cb, statement, OP_FOREACH_STEP, 0, 0);
+	emit_st(cb, statement, OP_JUMP, next_label, 0);
+	patch_chain(cb, end_site, current_label(cb));
+	close_loop(cb, &loop, current_label(cb), step_label);
+	emit_st(cb, statement, OP_FOREACH_END, 0, 0);
+	cb->hold_count -= 2;
+}
+
+static void
+generate_return_statement(CodeBuffer *cb, Statement *statement)
+{
+	Expression *expr = statement->u.return_s.return_value;
+
+	if (expr == NULL) {
+		emit_st(cb, statement, OP_PUSH_NULL, 0, 0);
+	} else if (expr->type == FUNCTION_CALL_EXPRESSION) {
+		generate_function_call_expression(cb, expr, OP_TAIL_CALL);
+		return;
+	} else {
+		generate_expression(cb, expr);
+	}
+	emit_st(cb, statement, OP_RETURN, 0, 0);
+}
+
+static ByteCode *
+generate_sub_code(CodeBuffer *outer, Statement *statement);
+
+/*
+ * TRY is followed by the code for a break and a continue coming out of
+ * the try statement, the VM skips to the one it needs.
+ */
+static void
+generate_try_statement(CodeBuffer *cb, Statement *statement)
+{
+	TryStatement *try_s = &statement->u.try_s;
+	TryCode *try_code;
+
+	try_code = MEM_storage_malloc(cb->inter->interpreter_storage,
+								  sizeof(TryCode));
+	try_code->statement = statement;
+	try_code->run_code = generate_sub_code(cb, try_s->run_st);
+	try_code->catch_code = NULL;
+	try_code->final_code = NULL;
+	if (try_s->catch_st)
+		try_code->catch_code = generate_sub_code(cb, try_s->catch_st);
+	if (try_s->final_st)
+		try_code->final_code = generate_sub_code(cb, try_s->final_st);
+
+	emit_st(cb, statement, OP_TRY, add_pointer(cb, try_code), 0);
+	generate_break(cb, statement);
+	generate_continue(cb, statement);
+}
+
+static void
+generate_statement(CodeBuffer *cb, Statement *statement)
+{
+	switch (statement->type) {
+	case EXPRESSION_STATEMENT:
+		generate_expression(cb, statement->u.expression_s);
+		emit_st(cb, statement, OP_POP, 0, 0);
+		break;
+	case GLOBAL_STATEMENT:
+		emit_st(cb, statement, OP_GLOBAL, add_pointer(cb, statement), 0);
+		break;
+	case IF_STATEMENT:
+		generate_if_statement(cb, statement);
+		break;
+	case WHILE_STATEMENT:
+		generate_while_statement(cb, statement);
+		break;
+	case FOR_STATEMENT:
+		generate_for_statement(cb, statement);
+		break;
+	case RETURN_STATEMENT:
+		generate_return_statement(cb, statement);
+		break;
+	case BREAK_STATEMENT:
+		generate_break(cb, statement);
+		break;
+	case CONTINUE_STATEMENT:
+		generate_continue(cb, statement);
+		break;
+	case BLOCK_STATEMENT:
+		generate_statement_list(cb,
+							statement->u.block_s.block->statement_list);
+		break;
+	case TRY_STATEMENT:
+		generate_try_statement(cb, statement);
+		break;
+	case THROW_STATEMENT:
+		generate_expression(cb, statement->u.throw_s.throw_expr);
+		emit_st(cb, statement, OP_THROW, add_pointer(cb, statement), 0);
+		break;
+	case FOREACH_STATEMENT:
+		generate_foreach_statement(cb, statement);
+		break;
+	case STATEMENT_TYPE_COUNT_PLUS_1:	/* FALLTHRU */
+	default:
+		DBG_panic(("bad case...%d", statement->type));
+	}
+}
+
+static void
+generate_statement_list(CodeBuffer *cb, StatementList *list)
+{
+	int i;
+
+	for (i = 0; list && i < list->count; i++)
+		generate_statement(cb, list->statement[i]);
+}
+
+static void
+init_code_buffer(CodeBuffer *cb, CRB_Interpreter *inter,
+				 FunctionDefinition *func)
+{
+	cb->inter = inter;
+	cb->func = func;
+	cb->code = NULL;
+	cb->location = NULL;
+	cb->code_size = 0;
+	cb->code_alloc_size = 0;
+	cb->constant = NULL;
+	cb->constant_count = 0;
+	cb->constant_alloc_size = 0;
+	cb->loop = NULL;
+	cb->hold_count = 0;
+	cb->hoisted = NULL;
+}
+
+/* move the buffer into the interpreter storage */
+static ByteCode *
+fix_code(CodeBuffer *cb)
+{
+	MEM_Storage storage = cb->inter->interpreter_storage;
+	ByteCode *code;
+
+	emit(cb, NULL, 0, OP_END, 0, 0);
+
+	code = MEM_storage_malloc(storage, sizeof(ByteCode));
+	code->code_size = cb->code_size;
+	code->threaded = CRB_FALSE;
+	code->hotness = 0;
+	code->native = NULL;
+	code->native_label = NULL;
+	code->native_failed = CRB_FALSE;
+	code->code = MEM_storage_malloc(storage,
+							sizeof(Instruction) * cb->code_size);
+	memcpy(code->code, cb->code, sizeof(Instruction) * cb->code_size);
+	code->location = MEM_storage_malloc(storage,
+							sizeof(CodeLocation) * cb->code_size);
+	memcpy(code->location, cb->location,
+			sizeof(CodeLocation) * cb->code_size);
+	code->constant_count = cb->constant_count;
+	code->constant = NULL;
+	if (cb->constant_count > 0) {
+		code->constant = MEM_storage_malloc(storage,
+							sizeof(CodeConstant) * cb->constant_count);
+		memcpy(code->constant, cb->constant,
+				sizeof(CodeConstant) * cb->constant_count);
+	}
+
+	MEM_free(cb->code);
+	MEM_free(cb->location);
+	MEM_free(cb->constant);
+
+	return code;
+}
+
+static ByteCode *
+generate_sub_code(CodeBuffer *outer, Statement *statement)
+{
+	CodeBuffer cb;
+
+	init_code_buffer(&cb, outer->inter, outer->func);
+	generate_statement(&cb, statement);
+
+	return fix_code(&cb);
+}
+
+/* func is the function list belongs to, NULL for the top level */
+ByteCode *
+crb_generate_code(CRB_Interpreter *inter, FunctionDefinition *func,
+				  StatementList *list)
+{
+	CodeBuffer cb;
+
+	init_code_buffer(&cb, inter, func);
+	generate_statement_list(&cb, list);
+
+	return fix_code(&cb);
+}
@@ -1,8 +1,15 @@
+#define _GNU_SOURCE		/* for mremap() */
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include "MEM.h"
 #include "DBG.h"
 #include "crowbar.h"
+#ifdef CRB_ARRAY_MAP
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 
 static CRB_Object* alloc_object(CRB_Interpreter *inter, ObjectType type)
@@ -34,6 +41,7 @@ CRB_Object* crb_literal_to_crb_string(CRB_Interpreter *inter, CRB_CHAR *str)
 	object = alloc_object(inter, STRING_OBJECT);
 	object->u.string.string = str;
 	object->u.string.is_literal = CRB_TRUE;
+	object->u.string.has_hash = CRB_FALSE;
 	return object;
 }
 
@@ -87,6 +95,7 @@ CRB_Object* crb_create_crowbar_string(CRB_Interpreter *inter, CRB_CHAR *str)
 	object = alloc_object(inter, STRING_OBJECT);
 	object->u.string.string = str;
 	object->u.string.is_literal = CRB_FALSE;
+	object->u.string.has_hash = CRB_FALSE;
 	inter->heap.current_heap_size += sizeof(CRB_CHAR) * (CRB_wcslen(str)+1);
 
 	return object;
@@ -108,138 +117,705 @@ CRB_Object* crb_string_substr(CRB_Interpreter *inter, CRB_Object *obj,
 }
 
 
-CRB_Object* crb_create_array(CRB_Interpreter *inter, int array_size)
+size_t crb_array_element_size(ArrayKind kind)
+{
+	switch (kind) {
+	case INT_ARRAY:
+		return sizeof(int);
+	case DOUBLE_ARRAY:
+		return sizeof(double);
+	case GENERIC_ARRAY:	/* FALLTHRU */
+	default:
+		return sizeof(CRB_Value);
+	}
+}
+
+static ArrayKind kind_of_value(CRB_Value *val)
+{
+	if (val->type == CRB_INT_VALUE)
+		return INT_ARRAY;
+	if (val->type == CRB_DOUBLE_VALUE)
+		return DOUBLE_ARRAY;
+	return GENERIC_ARRAY;
+}
+
+/*
+ * Elements of ARRAY_MAP_SIZE bytes or more are kept in pages mapped for
+ * the array alone.  Growing them remaps the pages: the kernel moves the
+ * page table entries, not the elements, so a big array grows without
+ * copying what it holds and without the old and the new storage both
+ * being in memory.  Smaller storage comes from MEM_malloc.  Whether a
+ * block is mapped follows from its size, so only the size is kept.
+ * The entries of a map are kept the same way.
+ */
+#ifdef CRB_ARRAY_MAP
+static size_t map_size(size_t size)
+{
+	static size_t page_size;
+
+	if (page_size == 0)
+		page_size = sysconf(_SC_PAGESIZE);
+
+	return (size + page_size - 1) / page_size * page_size;
+}
+
+static void map_failed(size_t size)
+{
+	fprintf(stderr, "failed to map %lu bytes\n",
+			(unsigned long)size);
+	exit(1);
+}
+#endif
+
+void *crb_alloc_storage(size_t size)
+{
+#ifdef CRB_ARRAY_MAP
+	void *p;
+
+	if (size >= ARRAY_MAP_SIZE) {
+		p = mmap(NULL, map_size(size), PROT_READ | PROT_WRITE,
+				 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED)
+			map_failed(size);
+		return p;
+	}
+#endif
+	return MEM_malloc(size);
+}
+
+void crb_free_storage(void *p, size_t size)
+{
+#ifdef CRB_ARRAY_MAP
+	if (size >= ARRAY_MAP_SIZE) {
+		munmap(p, map_size(size));
+		return;
+	}
+#endif
+	MEM_free(p);
+}
+
+void *crb_realloc_storage(void *p, size_t old_size, size_t new_size)
+{
+#ifdef CRB_ARRAY_MAP
+	void *new_p;
+
+	if (old_size >= ARRAY_MAP_SIZE && new_size >= ARRAY_MAP_SIZE) {
+		new_p = mremap(p, map_size(old_size), map_size(new_size),
+					   MREMAP_MAYMOVE);
+		if (new_p == MAP_FAILED)
+			map_failed(new_size);
+		return new_p;
+	}
+	if (old_size >= ARRAY_MAP_SIZE || new_size >= ARRAY_MAP_SIZE) {
+		/* crossing ARRAY_MAP_SIZE copies less than ARRAY_MAP_SIZE */
+		new_p = crb_alloc_storage(new_size);
+		memcpy(new_p, p, smaller(old_size, new_size));
+		crb_free_storage(p, old_size);
+		return new_p;
+	}
+#endif
+	return MEM_realloc(p, new_size);
+}
+
+static void realloc_array(CRB_Interpreter *inter, CRB_Array *array,
+							ArrayKind kind, int alloc_size)
+{
+	size_t old_size = array->alloc_size
+		* crb_array_element_size(array->kind);
+	size_t new_size = alloc_size * crb_array_element_size(kind);
+
+	array->u.value = crb_realloc_storage(array->u.value, old_size, new_size);
+	// new_size - old_size would wrap when the array shrinks
+	inter->heap.current_heap_size -= old_size;
+	inter->heap.current_heap_size += new_size;
+	array->kind = kind;
+	array->alloc_size = alloc_size;
+}
+
+/* turn the packed elements into values */
+static void generalize_array(CRB_Interpreter *inter, CRB_Object *obj)
+{
+	CRB_Array *array = &obj->u.array;
+	size_t old_size = array->alloc_size
+		* crb_array_element_size(array->kind);
+	size_t new_size = sizeof(CRB_Value) * array->alloc_size;
+	CRB_Value *value;
+	int i;
+
+	value = crb_alloc_storage(new_size);
+	for (i = 0; i < array->length; i++)
+		crb_array_get(obj, i, &value[i]);
+
+	inter->heap.current_heap_size -= old_size;
+	inter->heap.current_heap_size += new_size;
+	crb_free_storage(array->u.value, old_size);
+	array->u.value = value;
+	array->kind = GENERIC_ARRAY;
+}
+
+/* make the array able to hold val */
+static void fit_array_kind(CRB_Interpreter *inter, CRB_Object *obj,
+							CRB_Value *val)
+{
+	CRB_Array *array = &obj->u.array;
+	ArrayKind kind = kind_of_value(val);
+
+	if (array->kind == kind)
+		return;
+	if (array->length == 0)
+		realloc_array(inter, array, kind, array->alloc_size);
+	else if (array->kind != GENERIC_ARRAY)
+		generalize_array(inter, obj);
+}
+
+static void store_element(CRB_Array *array, int pos, CRB_Value *val)
+{
+	switch (array->kind) {
+	case INT_ARRAY:
+		array->u.int_value[pos] = val->u.int_value;
+		break;
+	case DOUBLE_ARRAY:
+		array->u.double_value[pos] = val->u.double_value;
+		break;
+	case GENERIC_ARRAY:	/* FALLTHRU */
+	default:
+		array->u.value[pos] = *val;
+		break;
+	}
+}
+
+/*
+ * Room for size elements.  The allocation doubles, so appending n
+ * elements one by one copies O(n) of them in all.
+ */
+static void reserve_array(CRB_Interpreter *inter, CRB_Array *array, int size)
+{
+	int new_size;
+
+	if (size <= array->alloc_size)
+		return;
+
+	if (array->alloc_size > INT_MAX / 2)
+		new_size = INT_MAX;
+	else
+		new_size = larger(array->alloc_size * 2, ARRAY_MIN_ALLOC_SIZE);
+	if (new_size < size)
+		new_size = size;
+	realloc_array(inter, array, array->kind, new_size);
+}
+
+/* give the room back once the array has shrunk to a quarter of it */
+static void trim_array(CRB_Interpreter *inter, CRB_Array *array)
+{
+	if (array->alloc_size > ARRAY_MIN_ALLOC_SIZE
+			&& array->length < array->alloc_size / 4) {
+		realloc_array(inter, array, array->kind,
+						larger(array->length * 2, ARRAY_MIN_ALLOC_SIZE));
+	}
+}
+
+static CRB_Object* alloc_array(CRB_Interpreter *inter, ArrayKind kind,
+								int length)
 {
 	CRB_Object *object;
 
 	object = alloc_object(inter, ARRAY_OBJECT);
-	object->u.array.length = array_size;
-	object->u.array.alloc_size = array_size;
-	object->u.array.array = MEM_malloc(sizeof(CRB_Value)*array_size);
-	inter->heap.current_heap_size += sizeof(CRB_Value)*array_size;
+	object->u.array.kind = kind;
+	object->u.array.length = length;
+	object->u.array.alloc_size = length;
+	object->u.array.u.value = crb_alloc_storage(crb_array_element_size(kind)
+											* length);
+	object->u.array.parent = NULL;
+	object->u.array.offset = 0;
+	object->u.array.view_length = 0;
+	inter->heap.current_heap_size += crb_array_element_size(kind) * length;
+
+	return object;
+}
 
+/* give a view elements of its own before its size or kind changes */
+static void materialize_view(CRB_Interpreter *inter, CRB_Object *obj)
+{
+	CRB_Array *array = &obj->u.array;
+	size_t size;
+	void *value;
+
+	if (array->parent == NULL)
+		return;
+
+	crb_sync_array_view(obj);
+	size = crb_array_element_size(array->kind);
+	value = crb_alloc_storage(size * array->length);
+	memcpy(value, array->u.value, size * array->length);
+	inter->heap.current_heap_size += size * array->length;
+
+	array->u.value = value;
+	array->alloc_size = array->length;
+	array->parent = NULL;
+	array->offset = 0;
+	array->view_length = 0;
+}
+
+/* count elements of src from begin to dst at pos, dst is generic or alike */
+static void copy_elements(CRB_Array *dst, int pos, CRB_Object *src,
+							int begin, int count)
+{
+	CRB_Value value;
+	size_t size;
 	int i;
-	for (i=0; i<array_size; i++)
-		object->u.array.array[i].type = CRB_NULL_VALUE;
 
-	return object;
+	if (dst->kind == src->u.array.kind) {
+		size = crb_array_element_size(dst->kind);
+		memcpy((char*)dst->u.value + pos * size,
+				(char*)src->u.array.u.value + begin * size,
+				count * size);
+		return;
+	}
+
+	DBG_assert(dst->kind == GENERIC_ARRAY || count == 0,
+				("copy to a packed array of another kind\n"));
+	for (i = 0; i < count; i++) {
+		crb_array_get(src, begin + i, &value);
+		dst->u.value[pos + i] = value;
+	}
 }
 
-void crb_array_add(CRB_Interpreter *inter, CRB_Object *obj, CRB_Value *val)
+
+CRB_Object* crb_create_array(CRB_Interpreter *inter, int array_size)
 {
-	int new_size;
+	CRB_Object *object;
 
-	//printf("before crb_array_add\n");
+	object = alloc_array(inter, GENERIC_ARRAY, array_size);
 
-	DBG_assert(obj->type == ARRAY_OBJECT, ("bad type..%d\n", obj->type));
+	int i;
+	for (i=0; i<array_size; i++)
+		object->u.array.u.value[i].type = CRB_NULL_VALUE;
 
-	crb_check_gc(inter);
+	return object;
+}
 
-	//printf("length=%d, alloc_size=%d\n", 
-	//		obj->u.array.length, obj->u.array.alloc_size);
+/* an array of the array_size values, packed when they allow it */
+CRB_Object* crb_create_array_of(CRB_Interpreter *inter, int array_size,
+								CRB_Value *value)
+{
+	CRB_Object *object;
+	ArrayKind kind;
+	int i;
 
-	if (obj->u.array.length + 1 > obj->u.array.alloc_size) {
-		new_size = obj->u.array.alloc_size * 2;
-		if (new_size == 0 || 
-				new_size - obj->u.array.alloc_size > ARRAY_ALLOC_SIZE)
-			new_size = obj->u.array.alloc_size + ARRAY_ALLOC_SIZE;
+	kind = array_size > 0 ? kind_of_value(&value[0]) : GENERIC_ARRAY;
+	for (i = 1; i < array_size && kind != GENERIC_ARRAY; i++) {
+		if (kind_of_value(&value[i]) != kind)
+			kind = GENERIC_ARRAY;
+	}
 
-	//	printf("crb_array_add, length=%d, alloc_size=%d, new_size=%d\n",
-	//			obj->u.array.length, obj->u.array.alloc_size,
-	//			new_size);
+	object = alloc_array(inter, kind, array_size);
+	for (i = 0; i < array_size; i++)
+		store_element(&object->u.array, i, &value[i]);
 
-		obj->u.array.array = MEM_realloc(obj->u.array.array,
-										new_size * sizeof(CRB_Value));
-		inter->heap.current_heap_size += 
-				(new_size - obj->u.array.alloc_size)*sizeof(CRB_Value);
-		obj->u.array.alloc_size = new_size;
+	return object;
+}
+
+void crb_array_get(CRB_Object *obj, int pos, CRB_Value *val)
+{
+	CRB_Array *array = &obj->u.array;
+
+	crb_array_sync(obj);
+	switch (array->kind) {
+	case INT_ARRAY:
+		val->type = CRB_INT_VALUE;
+		val->u.int_value = array->u.int_value[pos];
+		break;
+	case DOUBLE_ARRAY:
+		val->type = CRB_DOUBLE_VALUE;
+		val->u.double_value = array->u.double_value[pos];
+		break;
+	case GENERIC_ARRAY:	/* FALLTHRU */
+	default:
+		*val = array->u.value[pos];
+		break;
 	}
+}
 
-	obj->u.array.array[obj->u.array.length++] = *val;
-	
-	//printf("after crb_array_add\n");
+void crb_array_add(CRB_Interpreter *inter, CRB_Object *obj, CRB_Value *val)
+{
+	DBG_assert(obj->type == ARRAY_OBJECT, ("bad type..%d\n", obj->type));
+
+	crb_check_gc(inter);
 
+	materialize_view(inter, obj);
+	fit_array_kind(inter, obj, val);
+	reserve_array(inter, &obj->u.array, obj->u.array.length + 1);
+	store_element(&obj->u.array, obj->u.array.length++, val);
 }
 
 
 int crb_array_size(CRB_Interpreter *inter, CRB_Object *obj)
 {
+	crb_array_sync(obj);
 	return obj->u.array.length;
 }
 
 
 void crb_array_resize(CRB_Interpreter *inter, CRB_Object *obj, int new_size)
 {
-	int new_alloc_size;
-	CRB_Boolean need_realloc;
-
 	DBG_assert(new_size >=0, (""));
 	
 	crb_check_gc(inter);
-	if (new_size > obj->u.array.alloc_size) {
-		new_alloc_size = obj->u.array.alloc_size * 2;
-		if (new_alloc_size < new_size)
-			new_alloc_size = new_size + ARRAY_ALLOC_SIZE;
-		else if (new_alloc_size - new_size > ARRAY_ALLOC_SIZE)
-			new_alloc_size = new_size + ARRAY_ALLOC_SIZE;
-
-		need_realloc = CRB_TRUE;
-	}
-	else  if (new_size < obj->u.array.alloc_size - ARRAY_ALLOC_SIZE) {
-		new_alloc_size = new_size;
-		need_realloc = CRB_TRUE;
-	}
-	else {
-		need_realloc = CRB_FALSE;
-	}
+	materialize_view(inter, obj);
+	/* the new elements are null */
+	if (new_size > obj->u.array.length && obj->u.array.kind != GENERIC_ARRAY)
+		generalize_array(inter, obj);
 
-	if (need_realloc) {
-		crb_check_gc(inter);
-		obj->u.array.array = MEM_realloc(obj->u.array.array,
-								new_alloc_size * sizeof(CRB_Value));
-		inter->heap.current_heap_size += 
-			(new_alloc_size - obj->u.array.alloc_size)*sizeof(CRB_Value);
-		obj->u.array.alloc_size = new_alloc_size;
-	}
+	reserve_array(inter, &obj->u.array, new_size);
 
 	int i;
 	for (i=obj->u.array.length; i<new_size; i++)
-		obj->u.array.array[i].type = CRB_NULL_VALUE;
+		obj->u.array.u.value[i].type = CRB_NULL_VALUE;
 
 	obj->u.array.length = new_size;
-
+	trim_array(inter, &obj->u.array);
 }
 
 void crb_array_set(CRB_Interpreter *inter, CRB_Object *obj,
 					int pos, CRB_Value *val)
 {
-	DBG_assert(pos >= 0 && pos < obj->u.array.length, (""));
-	obj->u.array.array[pos] = *val;
+	CRB_Array *array = &obj->u.array;
+
+	if (array->parent != NULL) {
+		crb_array_set(inter, array->parent, array->offset + pos, val);
+		crb_sync_array_view(obj);
+		return;
+	}
+	DBG_assert(pos >= 0 && pos < array->length, (""));
+	fit_array_kind(inter, obj, val);
+	store_element(array, pos, val);
 }
 
 void crb_array_insert(CRB_Interpreter *inter, CRB_Object *obj,
 					int pos, CRB_Value *val)
 {
-	DBG_assert(pos >= 0 && pos <= obj->u.array.length, (""));
+	CRB_Array *array = &obj->u.array;
+	size_t size;
 
-	crb_array_resize(inter, obj, obj->u.array.length+1);
-	int i;
-	for (i = obj->u.array.length-1; i > pos; i--) {
-		obj->u.array.array[i] = obj->u.array.array[i-1];
-	}
-	obj->u.array.array[i] = *val;
+	crb_check_gc(inter);
+	materialize_view(inter, obj);
+	DBG_assert(pos >= 0 && pos <= array->length, (""));
+
+	fit_array_kind(inter, obj, val);
+	reserve_array(inter, array, array->length + 1);
+
+	size = crb_array_element_size(array->kind);
+	memmove((char*)array->u.value + (pos + 1) * size,
+			(char*)array->u.value + pos * size,
+			(array->length - pos) * size);
+	array->length++;
+	store_element(array, pos, val);
 }
 
 void crb_array_remove(CRB_Interpreter *inter, CRB_Object *obj,
 					int pos)
 {
-	DBG_assert(pos >= 0 && pos < obj->u.array.length, (""));
+	CRB_Array *array = &obj->u.array;
+	size_t size;
+
+	materialize_view(inter, obj);
+	DBG_assert(pos >= 0 && pos < array->length, (""));
+
+	size = crb_array_element_size(array->kind);
+	memmove((char*)array->u.value + pos * size,
+			(char*)array->u.value + (pos + 1) * size,
+			(array->length - pos - 1) * size);
+	array->length--;
+	trim_array(inter, array);
+}
+
+void crb_array_reserve(CRB_Interpreter *inter, CRB_Object *obj, int size)
+{
+	crb_check_gc(inter);
+	materialize_view(inter, obj);
+	reserve_array(inter, &obj->u.array, size);
+}
+
+/* the room is kept for the elements to come */
+void crb_array_clear(CRB_Interpreter *inter, CRB_Object *obj)
+{
+	materialize_view(inter, obj);
+	obj->u.array.length = 0;
+}
+
+/* a new array of the elements from begin up to end */
+CRB_Object* crb_array_slice(CRB_Interpreter *inter, CRB_Object *obj,
+							int begin, int end)
+{
+	CRB_Object *slice;
+
+	crb_array_sync(obj);
+	DBG_assert(begin >= 0 && begin <= end && end <= obj->u.array.length,
+				("begin..%d, end..%d\n", begin, end));
+
+	slice = alloc_array(inter, obj->u.array.kind, end - begin);
+	copy_elements(&slice->u.array, 0, obj, begin, end - begin);
+
+	return slice;
+}
+
+/* the kind of an array holding the elements of both */
+static ArrayKind joined_kind(CRB_Array *left, CRB_Array *right)
+{
+	if (left->length == 0)
+		return right->kind;
+	if (right->length == 0 || left->kind == right->kind)
+		return left->kind;
+	return GENERIC_ARRAY;
+}
+
+CRB_Object* crb_array_concat(CRB_Interpreter *inter, CRB_Object *left,
+							CRB_Object *right)
+{
+	CRB_Object *array;
+	int left_length = crb_array_size(inter, left);
+	int right_length = crb_array_size(inter, right);
+
+	array = alloc_array(inter, joined_kind(&left->u.array, &right->u.array),
+						left_length + right_length);
+	copy_elements(&array->u.array, 0, left, 0, left_length);
+	copy_elements(&array->u.array, left_length, right, 0, right_length);
+
+	return array;
+}
+
+/* append the elements of other, which may be obj itself */
+void crb_array_extend(CRB_Interpreter *inter, CRB_Object *obj,
+						CRB_Object *other)
+{
+	CRB_Array *array = &obj->u.array;
+	ArrayKind kind;
+	int count;
+
+	crb_check_gc(inter);
+	materialize_view(inter, obj);
+	crb_array_sync(other);
+	kind = joined_kind(array, &other->u.array);
+	count = other->u.array.length;
+	if (array->kind != kind) {
+		if (array->length == 0)
+			realloc_array(inter, array, kind, array->alloc_size);
+		else
+			generalize_array(inter, obj);
+	}
+	reserve_array(inter, array, array->length + count);
+	/* other may be a view of obj */
+	crb_array_sync(other);
+	copy_elements(array, array->length, other, 0, count);
+	array->length += count;
+}
+
+/* == on values, without the errors for the types it does not take */
+static CRB_Boolean values_equal(CRB_Value *left, CRB_Value *right)
+{
+	if (left->type == CRB_INT_VALUE && right->type == CRB_DOUBLE_VALUE)
+		return left->u.int_value == right->u.double_value;
+	if (left->type == CRB_DOUBLE_VALUE && right->type == CRB_INT_VALUE)
+		return left->u.double_value == right->u.int_value;
+	if (left->type != right->type)
+		return CRB_FALSE;
+
+	switch (left->type) {
+	case CRB_BOOLEAN_VALUE:
+		return left->u.boolean_value == right->u.boolean_value;
+	case CRB_INT_VALUE:
+		return left->u.int_value == right->u.int_value;
+	case CRB_DOUBLE_VALUE:
+		return left->u.double_value == right->u.double_value;
+	case CRB_STRING_VALUE:
+		return CRB_wcscmp(left->u.object_value->u.string.string,
+						  right->u.object_value->u.string.string) == 0;
+	case CRB_NULL_VALUE:
+		return CRB_TRUE;
+	case CRB_FAKE_METHOD_VALUE:
+		return left->index == right->index
+			&& left->u.pointer_value == right->u.pointer_value;
+	default:
+		return left->u.pointer_value == right->u.pointer_value;
+	}
+}
+
+/* the index of the first element equal to val, -1 if none is */
+int crb_array_index_of(CRB_Object *obj, CRB_Value *val)
+{
+	CRB_Array *array = &obj->u.array;
+	double number;
+	int i;
+
+	crb_array_sync(obj);
+	if (array->kind == INT_ARRAY && val->type == CRB_INT_VALUE) {
+		for (i = 0; i < array->length; i++) {
+			if (array->u.int_value[i] == val->u.int_value)
+				return i;
+		}
+	} else if (array->kind != GENERIC_ARRAY
+			&& (val->type == CRB_INT_VALUE
+				|| val->type == CRB_DOUBLE_VALUE)) {
+		number = (val->type == CRB_INT_VALUE)
+			? val->u.int_value : val->u.double_value;
+		for (i = 0; i < array->length; i++) {
+			if ((array->kind == INT_ARRAY
+					? array->u.int_value[i]
+					: array->u.double_value[i]) == number)
+				return i;
+		}
+	} else if (array->kind == GENERIC_ARRAY) {
+		for (i = 0; i < array->length; i++) {
+			if (values_equal(&array->u.value[i], val))
+				return i;
+		}
+	}
+
+	return -1;
+}
+
+void crb_array_reverse(CRB_Object *obj)
+{
+	CRB_Array *array = &obj->u.array;
+	CRB_Value value;
+	double d;
+	int n;
+	int i;
+	int j;
+
+	crb_array_sync(obj);
+	for (i = 0, j = array->length - 1; i < j; i++, j--) {
+		switch (array->kind) {
+		case INT_ARRAY:
+			n = array->u.int_value[i];
+			array->u.int_value[i] = array->u.int_value[j];
+			array->u.int_value[j] = n;
+			break;
+		case DOUBLE_ARRAY:
+			d = array->u.double_value[i];
+			array->u.double_value[i] = array->u.double_value[j];
+			array->u.double_value[j] = d;
+			break;
+		case GENERIC_ARRAY:	/* FALLTHRU */
+		default:
+			value = array->u.value[i];
+			array->u.value[i] = array->u.value[j];
+			array->u.value[j] = value;
+			break;
+		}
+	}
+}
+
+/* a view owns no elements */
+void crb_dispose_array(CRB_Interpreter *inter, CRB_Object *obj)
+{
+	CRB_Array *array = &obj->u.array;
+	size_t size = array->alloc_size * crb_array_element_size(array->kind);
+
+	if (array->parent != NULL || array->u.value == NULL)
+		return;
+
+	crb_free_storage(array->u.value, size);
+	inter->heap.current_heap_size -= size;
+}
+
+/* elements begin to end of obj, shared with it */
+CRB_Object* crb_array_view(CRB_Interpreter *inter, CRB_Object *obj,
+							int begin, int end)
+{
+	CRB_Object *view;
+
+	crb_array_sync(obj);
+	DBG_assert(begin >= 0 && begin <= end && end <= obj->u.array.length,
+				("begin..%d, end..%d\n", begin, end));
+
+	/* a view of a view shows the elements of the first parent */
+	if (obj->u.array.parent != NULL) {
+		begin += obj->u.array.offset;
+		end += obj->u.array.offset;
+		obj = obj->u.array.parent;
+	}
+
+	view = alloc_object(inter, ARRAY_OBJECT);
+	view->u.array.alloc_size = 0;
+	view->u.array.parent = obj;
+	view->u.array.offset = begin;
+	view->u.array.view_length = end - begin;
+	crb_sync_array_view(view);
+
+	return view;
+}
+
+/* the parent may have moved, retyped or dropped the elements */
+void crb_sync_array_view(CRB_Object *obj)
+{
+	CRB_Array *view = &obj->u.array;
+	CRB_Array *parent = &view->parent->u.array;
+	int length;
+
+	length = parent->length - view->offset;
+	if (length > view->view_length)
+		length = view->view_length;
+	if (length < 0)
+		length = 0;
+
+	view->kind = parent->kind;
+	view->length = length;
+	view->u.value = (CRB_Value*)((char*)parent->u.value
+							+ view->offset * crb_array_element_size(parent->kind));
+}
+
+/* length elements of kind, left for the caller to fill */
+void crb_array_reshape(CRB_Interpreter *inter, CRB_Object *obj,
+						ArrayKind kind, int length)
+{
+	CRB_Array *array = &obj->u.array;
+
+	DBG_assert(length >= 0, (""));
+
+	crb_check_gc(inter);
+	if (array->parent != NULL) {
+		/* filled in place, the elements are the parent's */
+		crb_sync_array_view(obj);
+		if (kind == array->kind && length == array->length)
+			return;
+		materialize_view(inter, obj);
+	}
+	if (kind != array->kind || length > array->alloc_size) {
+		realloc_array(inter, array, kind, length > array->alloc_size
+										? length : array->alloc_size);
+	}
+	array->length = length;
+}
 
+/* keep the elements, an int array can become a double array */
+void crb_array_convert(CRB_Interpreter *inter, CRB_Object *obj,
+						ArrayKind kind)
+{
+	CRB_Array *array = &obj->u.array;
+	double *value;
 	int i;
-	for (i = pos; i < obj->u.array.length-1; i++) {
-		obj->u.array.array[i] = obj->u.array.array[i+1];
+
+	crb_array_sync(obj);
+	if (array->kind == kind)
+		return;
+	materialize_view(inter, obj);
+	if (kind == GENERIC_ARRAY) {
+		generalize_array(inter, obj);
+		return;
 	}
-	crb_array_resize(inter, obj, obj->u.array.length-1);
+	DBG_assert(array->kind == INT_ARRAY && kind == DOUBLE_ARRAY,
+				("bad conversion %d to %d\n", array->kind, kind));
+
+	value = crb_alloc_storage(sizeof(double) * array->alloc_size);
+	for (i = 0; i < array->length; i++)
+		value[i] = array->u.int_value[i];
+
+	inter->heap.current_heap_size -= sizeof(int) * array->alloc_size;
+	inter->heap.current_heap_size += sizeof(double) * array->alloc_size;
+	crb_free_storage(array->u.value, sizeof(int) * array->alloc_size);
+	array->u.double_value = value;
+	array->kind = DOUBLE_ARRAY;
 }
 
 
@@ -251,6 +827,45 @@ CRB_Object* crb_create_assoc(CRB_Interpreter *inter)
 	return obj;
 }
 
+static CRB_Object* create_map(CRB_Interpreter *inter, ObjectType type)
+{
+	CRB_Object *obj = alloc_object(inter, type);
+	obj->u.map.count = 0;
+	obj->u.map.entry_count = 0;
+	obj->u.map.entry_alloc = 0;
+	obj->u.map.entry = NULL;
+	obj->u.map.index_size = 0;
+	obj->u.map.index = NULL;
+	return obj;
+}
+
+CRB_Object* crb_create_map(CRB_Interpreter *inter)
+{
+	return create_map(inter, MAP_OBJECT);
+}
+
+CRB_Object* crb_create_set(CRB_Interpreter *inter)
+{
+	return create_map(inter, SET_OBJECT);
+}
+
+/* the fields start out null */
+CRB_Object* crb_create_record(CRB_Interpreter *inter,
+							  FunctionDefinition *definition)
+{
+	CRB_Object *obj = alloc_object(inter, RECORD_OBJECT);
+	int count = definition->u.record_f.field_count;
+	int i;
+
+	obj->u.record.definition = definition;
+	obj->u.record.field = MEM_malloc(sizeof(CRB_Value) * (count ? count : 1));
+	for (i = 0; i < count; i++)
+		obj->u.record.field[i].type = CRB_NULL_VALUE;
+	inter->heap.current_heap_size += sizeof(CRB_Value) * count;
+
+	return obj;
+}
+
 
 CRB_Object* crb_create_scope_chain(CRB_Interpreter *inter,
 									CRB_Object *prev_scope,
@@ -279,6 +894,22 @@ CRB_Object* crb_create_scope_chain(CRB_Interpreter *inter,
 }
 
 
+/* scope_obj must be reachable already, from the frame defining the
+ * closure */
+void crb_create_closure(CRB_Interpreter *inter, CRB_Value *value,
+						FunctionDefinition *function,
+						CRB_Object *scope_obj)
+{
+	CRB_Object *obj = alloc_object(inter, CLOSURE_OBJECT);
+
+	obj->u.closure.function = function;
+	obj->u.closure.scope_obj = scope_obj;
+
+	value->type = CRB_CLOSURE_VALUE;
+	value->u.object_value = obj;
+}
+
+
 CRB_Boolean crb_add_scope_global_ref(CRB_Interpreter *inter, 
 								CRB_Object *scope,
 								char *identifier)
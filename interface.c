@@ -34,19 +34,36 @@ CRB_create_interpreter(Encoding source_encoding, Encoding env_encoding)
                                      sizeof(struct CRB_Interpreter_tag));
     interpreter->interpreter_storage = storage;
     interpreter->execute_storage = NULL;
+    interpreter->tree_storage = MEM_open_storage(0);
+    interpreter->tree_size = 0;
     interpreter->function_list = NULL;
+	memset(interpreter->function_hash, 0,
+			sizeof(interpreter->function_hash));
+	interpreter->function_generation = 1;
     interpreter->statement_list = NULL;
+	interpreter->location = NULL;
+	interpreter->location_count = 0;
+	interpreter->location_alloc = 0;
+	interpreter->location_hash = NULL;
 	interpreter->current_file_name = NULL;
     interpreter->current_line_number = 1;
 	init_value_stack(&interpreter->stack);
 	init_object_heap(&interpreter->heap);
 	interpreter->top_env = NULL;
+	interpreter->free_env = NULL;
 	interpreter->source_encoding = source_encoding;
 	interpreter->env_encoding = env_encoding;
 	memset(&(interpreter->exception_jumper), 0, sizeof(jmp_buf));
 	interpreter->throwed_exception = NULL;
 	interpreter->compile_state = 0;
 	interpreter->regexp_literals = NULL;
+	interpreter->execute_mode = CRB_BYTECODE_EXECUTE_MODE;
+	interpreter->tree_optimized = CRB_FALSE;
+	interpreter->folded_expression_count = 0;
+	interpreter->removed_statement_count = 0;
+	interpreter->inlined_call_count = 0;
+	interpreter->jit_enabled = CRB_TRUE;
+	interpreter->jit_area = NULL;
 
     crb_set_current_interpreter(interpreter);
     crb_add_native_functions(interpreter);
@@ -76,6 +93,9 @@ int CRB_compile(CRB_Interpreter *interpreter, char *filename)
         exit(1);
     }
     crb_reset_string_literal_buffer();
+
+	crb_optimize(interpreter);
+	crb_layout_tree(interpreter);
 	
 	// use value_stack for some constant calculation
 	release_value_stack(interpreter);
@@ -109,6 +129,14 @@ static void init_environment(CRB_Interpreter *interpreter)
 {
 	interpreter->first_env.environ_scope = 
 			crb_create_scope_chain(interpreter, NULL, CRB_FALSE);
+	interpreter->first_env.outer_scope = NULL;
+	interpreter->first_env.is_closure = CRB_FALSE;
+	interpreter->first_env.variable = NULL;
+	interpreter->first_env.variable_count = 0;
+	interpreter->first_env.variable_alloc_size = 0;
+	interpreter->first_env.overflow_variable = NULL;
+	interpreter->first_env.global_ref = NULL;
+	interpreter->first_env.stack_hold = 0;
 	interpreter->first_env.parent_env = NULL;
 	interpreter->first_env.func_name = "(top level)";
 	interpreter->first_env.caller_line_number = 0;
@@ -130,8 +158,14 @@ int CRB_interpret(CRB_Interpreter *interpreter)
 
 	if (jmp_value == 0) {
 
-    	crb_execute_statement_list(interpreter, interpreter->top_env, 
+		if (interpreter->execute_mode == CRB_AST_EXECUTE_MODE) {
+			crb_execute_statement_list(interpreter, interpreter->top_env,
+								interpreter->statement_list);
+		} else {
+			ByteCode *code = crb_generate_code(interpreter, NULL,
 								interpreter->statement_list);
+			crb_execute_byte_code(interpreter, interpreter->top_env, code);
+		}
 
 		crb_recover_environment(interpreter, &recover);
 	}
@@ -149,6 +183,7 @@ int CRB_interpret(CRB_Interpreter *interpreter)
 	}
 	
 
+	crb_dispose_environment_pool(interpreter);
 	release_global_strings(interpreter);
 	release_value_stack(interpreter);
 	crb_garbage_collect(interpreter);
@@ -163,12 +198,17 @@ CRB_dispose_interpreter(CRB_Interpreter *interpreter)
 {
 
 	crb_dispose_regexp_literals(interpreter);
+	crb_jit_dispose(interpreter);
     
 	if (interpreter->execute_storage) {
         MEM_dispose_storage(interpreter->execute_storage);
     }
 	
 	
+	MEM_dispose_storage(interpreter->tree_storage);
+	MEM_free(interpreter->location);
+	MEM_free(interpreter->location_hash);
+
 	if (interpreter->interpreter_storage) {
 		/* include interpreter itself */
     	MEM_dispose_storage(interpreter->interpreter_storage);
@@ -188,9 +228,8 @@ CRB_add_native_function(CRB_Interpreter *interpreter,
     fd->name = name;
     fd->type = NATIVE_FUNCTION_DEFINITION;
     fd->u.native_f.proc = proc;
-    fd->next = interpreter->function_list;
 
-    interpreter->function_list = fd;
+	crb_add_function(interpreter, fd);
 }
 
 
@@ -199,6 +238,20 @@ void CRB_reset_interpreter(CRB_Interpreter **pinter)
 	//printf("CRB_reset_interpreter\n");
 	Encoding source_encoding = (*pinter)->source_encoding;
 	Encoding env_encoding = (*pinter)->env_encoding;
+	CRB_ExecuteMode execute_mode = (*pinter)->execute_mode;
+	CRB_Boolean jit_enabled = (*pinter)->jit_enabled;
 	CRB_dispose_interpreter(*pinter);
 	*pinter = CRB_create_interpreter(source_encoding, env_encoding);
+	(*pinter)->execute_mode = execute_mode;
+	(*pinter)->jit_enabled = jit_enabled;
+}
+
+void CRB_set_execute_mode(CRB_Interpreter *interpreter, CRB_ExecuteMode mode)
+{
+	interpreter->execute_mode = mode;
+}
+
+void CRB_set_jit_enabled(CRB_Interpreter *interpreter, int enabled)
+{
+	interpreter->jit_enabled = enabled ? CRB_TRUE : CRB_FALSE;
 }
@@ -0,0 +1,507 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "MEM.h"
+#include "DBG.h"
+#include "crowbar.h"
+
+#ifdef CRB_JIT
+/*
+ * A baseline JIT for x86-64.  Each instruction of a hot ByteCode gets
+ * a template of machine code: jumps become native jumps, integer
+ * arithmetic and comparisons, OP_PUSH_INT and OP_JUMP_IF_FALSE work on
+ * the value stack directly, and everything else calls the helper for
+ * its opcode in vm.c.  While the code runs rbx holds the JitFrame and
+ * r12 the value stack of the interpreter.  The code can be entered at
+ * any instruction, the VM and the machine code share their state.
+ */
+
+#define JIT_ALLOC_SIZE	(4096)
+
+typedef struct {
+	int		at;			/* rel32 to patch */
+	int		target;		/* instruction index, -1 for the exit */
+} JitFixup;
+
+typedef struct {
+	unsigned char	*buf;
+	int				size;
+	int				alloc_size;
+	int				*label;		/* offset of each instruction */
+	int				exit_label;
+	JitFixup		*fixup;
+	int				fixup_count;
+	int				fixup_alloc_size;
+} JitBuffer;
+
+#define VALUE_SIZE		((int)sizeof(CRB_Value))
+#define TYPE_OFFSET		((int)offsetof(CRB_Value, type))
+#define UNION_OFFSET	((int)offsetof(CRB_Value, u))
+#define SP_OFFSET		((int)offsetof(Stack, stack_pointer))
+#define STACK_OFFSET	((int)offsetof(Stack, stack))
+#define ALLOC_OFFSET	((int)offsetof(Stack, stack_alloc_size))
+
+/* displacements from rax, the slot above the stack top */
+#define TOP_TYPE		(-VALUE_SIZE + TYPE_OFFSET)
+#define TOP_VALUE		(-VALUE_SIZE + UNION_OFFSET)
+#define SECOND_TYPE		(-2 * VALUE_SIZE + TYPE_OFFSET)
+#define SECOND_VALUE	(-2 * VALUE_SIZE + UNION_OFFSET)
+
+static void
+emit_byte(JitBuffer *jb, int byte)
+{
+	if (jb->size == jb->alloc_size) {
+		jb->alloc_size += JIT_ALLOC_SIZE;
+		jb->buf = MEM_realloc(jb->buf, jb->alloc_size);
+	}
+	jb->buf[jb->size++] = (unsigned char)byte;
+}
+
+static void
+emit_bytes(JitBuffer *jb, int count, ...)
+{
+	va_list ap;
+	int i;
+
+	va_start(ap, count);
+	for (i = 0; i < count; i++)
+		emit_byte(jb, va_arg(ap, int));
+	va_end(ap);
+}
+
+static void
+emit_int32(JitBuffer *jb, int value)
+{
+	unsigned int u = (unsigned int)value;
+	int i;
+
+	for (i = 0; i < 4; i++)
+		emit_byte(jb, (u >> (i * 8)) & 0xff);
+}
+
+static void
+emit_pointer(JitBuffer *jb, void *pointer)
+{
+	unsigned long long u = (unsigned long long)(size_t)pointer;
+	int i;
+
+	for (i = 0; i < 8; i++)
+		emit_byte(jb, (int)((u >> (i * 8)) & 0xff));
+}
+
+static void
+patch_int32(JitBuffer *jb, int at, int value)
+{
+	unsigned int u = (unsigned int)value;
+	int i;
+
+	for (i = 0; i < 4; i++)
+		jb->buf[at + i] = (u >> (i * 8)) & 0xff;
+}
+
+/* a jump to instruction target, patched when all labels are known */
+static void
+emit_jump_to(JitBuffer *jb, int target)
+{
+	if (jb->fixup_count == jb->fixup_alloc_size) {
+		jb->fixup_alloc_size += JIT_ALLOC_SIZE / sizeof(JitFixup);
+		jb->fixup = MEM_realloc(jb->fixup,
+							sizeof(JitFixup) * jb->fixup_alloc_size);
+	}
+	jb->fixup[jb->fixup_count].at = jb->size;
+	jb->fixup[jb->fixup_count].target = target;
+	jb->fixup_count++;
+	emit_int32(jb, 0);
+}
+
+/* jmp rel32 */
+static void
+emit_jmp(JitBuffer *jb, int target)
+{
+	emit_byte(jb, 0xe9);
+	emit_jump_to(jb, target);
+}
+
+/* jcc rel32, cc is the low byte of 0f 8x */
+static void
+emit_jcc(JitBuffer *jb, int cc, int target)
+{
+	emit_bytes(jb, 2, 0x0f, cc);
+	emit_jump_to(jb, target);
+}
+
+/* a forward jcc (or jmp when cc is 0) within a template */
+static int
+emit_local_jump(JitBuffer *jb, int cc)
+{
+	if (cc)
+		emit_bytes(jb, 2, 0x0f, cc);
+	else
+		emit_byte(jb, 0xe9);
+	emit_int32(jb, 0);
+
+	return jb->size - 4;
+}
+
+static void
+land_local_jump(JitBuffer *jb, int at)
+{
+	patch_int32(jb, at, jb->size - (at + 4));
+}
+
+#define JCC_E	(0x84)
+#define JCC_NE	(0x85)
+#define JCC_GE	(0x8d)
+
+/* helper(frame, pc), the result in eax */
+static void
+emit_call_helper(JitBuffer *jb, int pc, JitHelper helper)
+{
+	emit_bytes(jb, 3, 0x48, 0x89, 0xdf);		/* mov rdi, rbx */
+	emit_byte(jb, 0xbe);						/* mov esi, pc */
+	emit_int32(jb, pc);
+	emit_bytes(jb, 2, 0x48, 0xb8);				/* mov rax, helper */
+	emit_pointer(jb, (void *)helper);
+	emit_bytes(jb, 2, 0xff, 0xd0);				/* call rax */
+}
+
+/* op dword [r12 + offset], for the Stack fields */
+static void
+emit_r12_operation(JitBuffer *jb, int opcode, int reg, int offset)
+{
+	emit_bytes(jb, 5, 0x41, opcode, 0x44 | (reg << 3), 0x24, offset);
+}
+
+/* rax = &stack[stack_pointer] */
+static void
+emit_stack_end(JitBuffer *jb)
+{
+	emit_bytes(jb, 5, 0x49, 0x63, 0x44, 0x24, SP_OFFSET);	/* movsxd */
+	emit_bytes(jb, 3, 0x48, 0x69, 0xc0);				/* imul rax, V */
+	emit_int32(jb, VALUE_SIZE);
+	emit_bytes(jb, 5, 0x49, 0x03, 0x44, 0x24, STACK_OFFSET);	/* add */
+}
+
+/* op [rax + disp32] with ModRM reg field reg */
+static void
+emit_rax_operation(JitBuffer *jb, int opcode, int reg, int disp)
+{
+	emit_bytes(jb, 2, opcode, 0x80 | (reg << 3));
+	emit_int32(jb, disp);
+}
+
+/* cmp dword [rax + disp], type; jne slow */
+static int
+emit_type_guard(JitBuffer *jb, int disp, CRB_ValueType type)
+{
+	emit_rax_operation(jb, 0x81, 7, disp);
+	emit_int32(jb, type);
+
+	return emit_local_jump(jb, JCC_NE);
+}
+
+static void
+emit_pop(JitBuffer *jb)
+{
+	emit_r12_operation(jb, 0xff, 1, SP_OFFSET);		/* dec */
+}
+
+static void
+emit_push_int(JitBuffer *jb, int pc, Instruction *inst)
+{
+	int slow;
+	int done;
+
+	emit_r12_operation(jb, 0x8b, 0, SP_OFFSET);		/* mov eax, sp */
+	emit_r12_operation(jb, 0x3b, 0, ALLOC_OFFSET);	/* cmp eax, alloc */
+	slow = emit_local_jump(jb, JCC_GE);
+	emit_stack_end(jb);
+	emit_rax_operation(jb, 0xc7, 0, TYPE_OFFSET);
+	emit_int32(jb, CRB_INT_VALUE);
+	emit_rax_operation(jb, 0xc7, 0, UNION_OFFSET);
+	emit_int32(jb, inst->operand);
+	emit_r12_operation(jb, 0xff, 0, SP_OFFSET);		/* inc */
+	done = emit_local_jump(jb, 0);
+	land_local_jump(jb, slow);
+	emit_call_helper(jb, pc, crb_jit_helper(OP_PUSH_INT));
+	land_local_jump(jb, done);
+}
+
+/* both operands ints or the generic helper */
+static void
+emit_int_binary(JitBuffer *jb, int pc, Instruction *inst)
+{
+	static const int setcc[] = {
+		0x94, 0x95, 0x9f, 0x9d, 0x9c, 0x9e,		/* EQ NE GT GE LT LE */
+	};
+	int slow1;
+	int slow2;
+	int done;
+
+	emit_stack_end(jb);
+	slow1 = emit_type_guard(jb, TOP_TYPE, CRB_INT_VALUE);
+	slow2 = emit_type_guard(jb, SECOND_TYPE, CRB_INT_VALUE);
+	emit_rax_operation(jb, 0x8b, 1, TOP_VALUE);		/* mov ecx, right */
+	switch (inst->opcode) {
+	case OP_ADD_INT:
+		emit_rax_operation(jb, 0x01, 1, SECOND_VALUE);	/* add */
+		break;
+	case OP_SUB_INT:
+		emit_rax_operation(jb, 0x29, 1, SECOND_VALUE);	/* sub */
+		break;
+	case OP_MUL_INT:
+		emit_rax_operation(jb, 0x8b, 2, SECOND_VALUE);	/* mov edx */
+		emit_bytes(jb, 3, 0x0f, 0xaf, 0xd1);			/* imul edx, ecx */
+		emit_rax_operation(jb, 0x89, 2, SECOND_VALUE);
+		break;
+	default:
+		emit_rax_operation(jb, 0x39, 1, SECOND_VALUE);	/* cmp */
+		emit_bytes(jb, 3, 0x0f, setcc[inst->opcode - OP_EQ_INT], 0xc1);
+		emit_bytes(jb, 3, 0x0f, 0xb6, 0xc9);			/* movzx ecx, cl */
+		emit_rax_operation(jb, 0x89, 1, SECOND_VALUE);
+		emit_rax_operation(jb, 0xc7, 0, SECOND_TYPE);
+		emit_int32(jb, CRB_BOOLEAN_VALUE);
+		break;
+	}
+	emit_pop(jb);
+	done = emit_local_jump(jb, 0);
+	land_local_jump(jb, slow1);
+	land_local_jump(jb, slow2);
+	emit_call_helper(jb, pc, crb_jit_helper(inst->opcode));
+	land_local_jump(jb, done);
+}
+
+static void
+emit_jump_if_false(JitBuffer *jb, int pc, Instruction *inst)
+{
+	int slow;
+	int done;
+
+	emit_stack_end(jb);
+	slow = emit_type_guard(jb, TOP_TYPE, CRB_BOOLEAN_VALUE);
+	emit_rax_operation(jb, 0x8b, 1, TOP_VALUE);		/* mov ecx, value */
+	emit_pop(jb);
+	emit_bytes(jb, 2, 0x85, 0xc9);					/* test ecx, ecx */
+	emit_jcc(jb, JCC_E, inst->operand);
+	done = emit_local_jump(jb, 0);
+	land_local_jump(jb, slow);
+	emit_call_helper(jb, pc, crb_jit_helper(OP_JUMP_IF_FALSE));
+	emit_bytes(jb, 2, 0x85, 0xc0);					/* test eax, eax */
+	emit_jcc(jb, JCC_NE, inst->operand);
+	land_local_jump(jb, done);
+}
+
+static void
+emit_instruction(JitBuffer *jb, ByteCode *code, int pc)
+{
+	Instruction *inst = &code->code[pc];
+	int i;
+
+	switch (inst->opcode) {
+	case OP_PUSH_INT:
+		emit_push_int(jb, pc, inst);
+		break;
+	case OP_POP:
+		emit_pop(jb);
+		break;
+	case OP_ADD_INT:	/* FALLTHRU */
+	case OP_SUB_INT:	/* FALLTHRU */
+	case OP_MUL_INT:	/* FALLTHRU */
+	case OP_EQ_INT:		/* FALLTHRU */
+	case OP_NE_INT:		/* FALLTHRU */
+	case OP_GT_INT:		/* FALLTHRU */
+	case OP_GE_INT:		/* FALLTHRU */
+	case OP_LT_INT:		/* FALLTHRU */
+	case OP_LE_INT:
+		emit_int_binary(jb, pc, inst);
+		break;
+	case OP_JUMP:
+		emit_jmp(jb, inst->operand);
+		break;
+	case OP_JUMP_IF_FALSE:
+		emit_jump_if_false(jb, pc, inst);
+		break;
+	case OP_AND_JUMP:		/* FALLTHRU */
+	case OP_OR_JUMP:		/* FALLTHRU */
+	case OP_FOREACH_NEXT:
+		emit_call_helper(jb, pc, crb_jit_helper(inst->opcode));
+		emit_bytes(jb, 2, 0x85, 0xc0);				/* test eax, eax */
+		emit_jcc(jb, JCC_NE, inst->operand);
+		break;
+	case OP_HOISTED_SIZE:	/* FALLTHRU */
+	case OP_HOISTED_LENGTH:
+		emit_call_helper(jb, pc, crb_jit_helper(inst->opcode));
+		emit_bytes(jb, 2, 0x85, 0xc0);
+		emit_jcc(jb, JCC_NE, inst->operand2);
+		break;
+	case OP_TAIL_CALL:	/* FALLTHRU */
+	case OP_RETURN:		/* FALLTHRU */
+	case OP_BREAK:		/* FALLTHRU */
+	case OP_CONTINUE:	/* FALLTHRU */
+	case OP_END:
+		emit_call_helper(jb, pc, crb_jit_helper(inst->opcode));
+		emit_jmp(jb, -1);
+		break;
+	case OP_TRY:
+		// the helper returns one of the three jumps after TRY or -1
+		emit_call_helper(jb, pc, crb_jit_helper(OP_TRY));
+		for (i = 1; i <= 3; i++) {
+			emit_byte(jb, 0x3d);					/* cmp eax, pc + i */
+			emit_int32(jb, pc + i);
+			emit_jcc(jb, JCC_E, pc + i);
+		}
+		emit_jmp(jb, -1);
+		break;
+	default:
+		DBG_assert(crb_jit_helper(inst->opcode) != NULL,
+				("no helper for opcode..%d\n", inst->opcode));
+		emit_call_helper(jb, pc, crb_jit_helper(inst->opcode));
+		break;
+	}
+}
+
+/*
+ * native(frame, stack, entry): save rbx and r12, keep the stack 16
+ * byte aligned for the helpers and jump to the entry instruction.
+ */
+static void
+emit_prologue(JitBuffer *jb)
+{
+	emit_byte(jb, 0x53);						/* push rbx */
+	emit_bytes(jb, 2, 0x41, 0x54);				/* push r12 */
+	emit_bytes(jb, 4, 0x48, 0x83, 0xec, 0x08);	/* sub rsp, 8 */
+	emit_bytes(jb, 3, 0x48, 0x89, 0xfb);		/* mov rbx, rdi */
+	emit_bytes(jb, 3, 0x49, 0x89, 0xf4);		/* mov r12, rsi */
+	emit_bytes(jb, 2, 0xff, 0xe2);				/* jmp rdx */
+}
+
+static void
+emit_epilogue(JitBuffer *jb)
+{
+	jb->exit_label = jb->size;
+	emit_bytes(jb, 4, 0x48, 0x83, 0xc4, 0x08);	/* add rsp, 8 */
+	emit_bytes(jb, 2, 0x41, 0x5c);				/* pop r12 */
+	emit_byte(jb, 0x5b);						/* pop rbx */
+	emit_byte(jb, 0xc3);						/* ret */
+}
+
+static void
+resolve_jumps(JitBuffer *jb)
+{
+	JitFixup *fixup;
+	int target;
+	int i;
+
+	for (i = 0; i < jb->fixup_count; i++) {
+		fixup = &jb->fixup[i];
+		if (fixup->target < 0)
+			target = jb->exit_label;
+		else
+			target = jb->label[fixup->target];
+		patch_int32(jb, fixup->at, target - (fixup->at + 4));
+	}
+}
+
+/* copy the code into pages of its own and make them executable */
+static void *
+install_code(CRB_Interpreter *inter, JitBuffer *jb)
+{
+	JitArea *area;
+	void *address;
+	size_t size = ((size_t)jb->size + JIT_ALLOC_SIZE - 1)
+		/ JIT_ALLOC_SIZE * JIT_ALLOC_SIZE;
+
+	address = mmap(NULL, size, PROT_READ | PROT_WRITE,
+				   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (address == MAP_FAILED)
+		return NULL;
+	memcpy(address, jb->buf, jb->size);
+	if (mprotect(address, size, PROT_READ | PROT_EXEC) != 0) {
+		munmap(address, size);
+		return NULL;
+	}
+
+	area = MEM_malloc(sizeof(JitArea));
+	area->address = address;
+	area->size = size;
+	area->next = inter->jit_area;
+	inter->jit_area = area;
+
+	return address;
+}
+
+CRB_Boolean
+crb_jit_compile(CRB_Interpreter *inter, ByteCode *code)
+{
+	JitBuffer jb;
+	int pc;
+
+	DBG_assert(SP_OFFSET < 0x80 && STACK_OFFSET < 0x80
+			   && ALLOC_OFFSET < 0x80, ("Stack is too large\n"));
+
+	jb.buf = NULL;
+	jb.size = 0;
+	jb.alloc_size = 0;
+	jb.label = MEM_malloc(sizeof(int) * code->code_size);
+	jb.fixup = NULL;
+	jb.fixup_count = 0;
+	jb.fixup_alloc_size = 0;
+
+	emit_prologue(&jb);
+	for (pc = 0; pc < code->code_size; pc++) {
+		jb.label[pc] = jb.size;
+		emit_instruction(&jb, code, pc);
+	}
+	emit_epilogue(&jb);
+	resolve_jumps(&jb);
+
+	code->native = install_code(inter, &jb);
+	if (code->native == NULL) {
+		code->native_failed = CRB_TRUE;
+	} else {
+		code->native_label = MEM_storage_malloc(inter->interpreter_storage,
+										sizeof(int) * code->code_size);
+		memcpy(code->native_label, jb.label, sizeof(int) * code->code_size);
+	}
+
+	MEM_free(jb.buf);
+	MEM_free(jb.label);
+	MEM_free(jb.fixup);
+
+	return code->native != NULL;
+}
+
+/* run frame->code from instruction pc on */
+void
+crb_jit_run(JitFrame *frame, int pc)
+{
+	ByteCode *code = frame->code;
+	void (*native)(JitFrame *frame, Stack *stack, void *entry);
+
+	native = (void (*)(JitFrame *, Stack *, void *))code->native;
+	native(frame, &frame->inter->stack,
+		   (char *)code->native + code->native_label[pc]);
+}
+
+void
+crb_jit_dispose(CRB_Interpreter *inter)
+{
+	JitArea *area;
+
+	while (inter->jit_area) {
+		area = inter->jit_area;
+		inter->jit_area = area->next;
+		munmap(area->address, area->size);
+		MEM_free(area);
+	}
+}
+
+#else /* CRB_JIT */
+
+void
+crb_jit_dispose(CRB_Interpreter *inter)
+{
+}
+
+#endif /* CRB_JIT */
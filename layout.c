@@ -0,0 +1,406 @@
+#include <string.h>
+#include "MEM.h"
+#include "DBG.h"
+#include "crowbar.h"
+
+/*
+ * The parser and the optimizer allocate tree nodes one by one in
+ * inter->tree_storage, so a function ends up scattered between the
+ * nodes of everything parsed around it and the garbage the optimizer
+ * left.  crb_layout_tree copies every node reachable from the program
+ * into one block, in the order the nodes are visited when they run: a
+ * statement, then its expressions from left to right, then its
+ * sub-statements; a list is followed by its array, the array by its
+ * elements in order.  Arrays the parser grew keep only the used part,
+ * but for the top level statements a later compile appends to.  The old
+ * storage is freed, so the tree is always held once.  The nodes hold
+ * the index of their file and line in inter->location, which is not
+ * part of the tree and stays as it is.
+ *
+ * The walk runs twice, first only summing the sizes, then copying into
+ * a block of that size.
+ */
+
+/* keep doubles and pointers in the nodes aligned */
+#define NODE_ALIGN(size) \
+	(((size) + sizeof(double) - 1) / sizeof(double) * sizeof(double))
+
+typedef struct {
+	char	*next;		/* NULL while counting */
+	size_t	size;
+} TreeArena;
+
+static void *
+place_node(TreeArena *arena, void *node, size_t size)
+{
+	void *p;
+
+	arena->size += NODE_ALIGN(size);
+	if (arena->next == NULL)
+		return node;
+
+	p = arena->next;
+	memcpy(p, node, size);
+	arena->next += NODE_ALIGN(size);
+
+	return p;
+}
+
+static Expression *
+layout_expression(TreeArena *arena, Expression *expr);
+
+static Statement *
+layout_statement(TreeArena *arena, Statement *statement);
+
+/*
+ * alloc_count is the number of statements to make room for, the top
+ * level list keeps the size the parser grows it by, see
+ * layout_program.
+ */
+static StatementList *
+layout_statement_list(TreeArena *arena, StatementList *list,
+					  int alloc_count)
+{
+	StatementList *pos;
+	int i;
+
+	pos = place_node(arena, list, sizeof(StatementList));
+	if (list->count == 0)
+		return pos;
+	pos->statement = place_node(arena, list->statement,
+								sizeof(Statement*) * alloc_count);
+	for (i = 0; i < list->count; i++)
+		pos->statement[i] = layout_statement(arena, list->statement[i]);
+
+	return pos;
+}
+
+static Block *
+layout_block(TreeArena *arena, Block *block)
+{
+	Block *pos;
+
+	if (block == NULL)
+		return NULL;
+	pos = place_node(arena, block, sizeof(Block));
+	if (block->statement_list) {
+		pos->statement_list = layout_statement_list(arena,
+								block->statement_list,
+								block->statement_list->count);
+	}
+
+	return pos;
+}
+
+static ParameterList *
+layout_parameter(TreeArena *arena, ParameterList *list)
+{
+	ParameterList *pos;
+
+	pos = place_node(arena, list, sizeof(ParameterList));
+	if (list->count > 0) {
+		pos->name = place_node(arena, list->name,
+							   sizeof(char*) * list->count);
+	}
+
+	return pos;
+}
+
+static void
+layout_function(TreeArena *arena, FunctionDefinition *func)
+{
+	DBG_assert(func->u.crowbar_f.code == NULL,
+			("%s is compiled already\n", func->name));
+
+	func->u.crowbar_f.parameter = layout_parameter(arena,
+									func->u.crowbar_f.parameter);
+	func->u.crowbar_f.block = layout_block(arena, func->u.crowbar_f.block);
+}
+
+/* ArgumentList and ExpressionList share their layout */
+static Expression **
+layout_expression_array(TreeArena *arena, int count, Expression **array)
+{
+	Expression **pos;
+	int i;
+
+	if (count == 0)
+		return NULL;
+	pos = place_node(arena, array, sizeof(Expression*) * count);
+	for (i = 0; i < count; i++)
+		pos[i] = layout_expression(arena, array[i]);
+
+	return pos;
+}
+
+static ArgumentList *
+layout_argument_list(TreeArena *arena, ArgumentList *list)
+{
+	ArgumentList *pos;
+
+	pos = place_node(arena, list, sizeof(ArgumentList));
+	pos->expression = layout_expression_array(arena, list->count,
+											  list->expression);
+
+	return pos;
+}
+
+static ExpressionList *
+layout_expression_list(TreeArena *arena, ExpressionList *list)
+{
+	ExpressionList *pos;
+
+	pos = place_node(arena, list, sizeof(ExpressionList));
+	pos->expression = layout_expression_array(arena, list->count,
+											  list->expression);
+
+	return pos;
+}
+
+static Expression *
+layout_expression(TreeArena *arena, Expression *expr)
+{
+	Expression *pos;
+
+	if (expr == NULL)
+		return NULL;
+	pos = place_node(arena, expr, sizeof(Expression));
+
+	switch (expr->type) {
+	case BOOLEAN_EXPRESSION:	/* FALLTHRU */
+	case INT_EXPRESSION:		/* FALLTHRU */
+	case DOUBLE_EXPRESSION:		/* FALLTHRU */
+	case STRING_EXPRESSION:		/* FALLTHRU */
+	case REGEXP_EXPRESSION:		/* FALLTHRU */
+	case IDENTIFIER_EXPRESSION:	/* FALLTHRU */
+	case NULL_EXPRESSION:
+		break;
+	case ASSIGN_EXPRESSION:
+		pos->u.assign_expression.left = layout_expression(arena,
+										expr->u.assign_expression.left);
+		pos->u.assign_expression.operand = layout_expression(arena,
+										expr->u.assign_expression.operand);
+		break;
+	case ADD_EXPRESSION:	/* FALLTHRU */
+	case SUB_EXPRESSION:	/* FALLTHRU */
+	case MUL_EXPRESSION:	/* FALLTHRU */
+	case DIV_EXPRESSION:	/* FALLTHRU */
+	case MOD_EXPRESSION:	/* FALLTHRU */
+	case EQ_EXPRESSION:		/* FALLTHRU */
+	case NE_EXPRESSION:		/* FALLTHRU */
+	case GT_EXPRESSION:		/* FALLTHRU */
+	case GE_EXPRESSION:		/* FALLTHRU */
+	case LT_EXPRESSION:		/* FALLTHRU */
+	case LE_EXPRESSION:		/* FALLTHRU */
+	case LOGICAL_AND_EXPRESSION:	/* FALLTHRU */
+	case LOGICAL_OR_EXPRESSION:
+		pos->u.binary_expression.left = layout_expression(arena,
+										expr->u.binary_expression.left);
+		pos->u.binary_expression.right = layout_expression(arena,
+										expr->u.binary_expression.right);
+		break;
+	case NOT_EXPRESSION:
+		pos->u.not_expression.sub_expr = layout_expression(arena,
+										expr->u.not_expression.sub_expr);
+		break;
+	case MINUS_EXPRESSION:
+		pos->u.minus_expression = layout_expression(arena,
+										expr->u.minus_expression);
+		break;
+	case FUNCTION_CALL_EXPRESSION:
+		pos->u.function_call_expression.expr = layout_expression(arena,
+									expr->u.function_call_expression.expr);
+		pos->u.function_call_expression.argument = layout_argument_list(
+				arena, expr->u.function_call_expression.argument);
+		break;
+	case ARRAY_EXPRESSION:
+		pos->u.array_expression = layout_expression_list(arena,
+										expr->u.array_expression);
+		break;
+	case INDEX_EXPRESSION:
+		pos->u.index_expression.array = layout_expression(arena,
+										expr->u.index_expression.array);
+		pos->u.index_expression.index = layout_expression(arena,
+										expr->u.index_expression.index);
+		break;
+	case POST_INCREMENT_EXPRESSION:	/* FALLTHRU */
+	case PREV_INCREMENT_EXPRESSION:	/* FALLTHRU */
+	case POST_DECREMENT_EXPRESSION:	/* FALLTHRU */
+	case PREV_DECREMENT_EXPRESSION:
+		pos->u.inc_dec.operand = layout_expression(arena,
+										expr->u.inc_dec.operand);
+		break;
+	case MEMBER_EXPRESSION:
+		pos->u.member_expression.expression = layout_expression(arena,
+									expr->u.member_expression.expression);
+		break;
+	case CLOSURE_DEFINITION:
+		layout_function(arena, expr->u.closure_definition.function);
+		break;
+	case EXPRESSION_TYPE_COUNT_PLUS_1:	/* FALLTHRU */
+	default:
+		DBG_panic(("bad expression type..%d\n", expr->type));
+	}
+
+	return pos;
+}
+
+static IdentifierList *
+layout_identifier_list(TreeArena *arena, IdentifierList *list)
+{
+	IdentifierList *top = NULL;
+	IdentifierList **tail = &top;
+	IdentifierList *pos;
+
+	for (; list; list = list->next) {
+		pos = place_node(arena, list, sizeof(IdentifierList));
+		*tail = pos;
+		tail = &pos->next;
+	}
+	*tail = NULL;
+
+	return top;
+}
+
+static ElsifList *
+layout_elsif(TreeArena *arena, ElsifList *list)
+{
+	ElsifList *pos;
+	int i;
+
+	if (list == NULL)
+		return NULL;
+	pos = place_node(arena, list, sizeof(ElsifList));
+	pos->elsif = place_node(arena, list->elsif, sizeof(Elsif) * list->count);
+	for (i = 0; i < list->count; i++) {
+		pos->elsif[i].condition = layout_expression(arena,
+												list->elsif[i].condition);
+		pos->elsif[i].statement = layout_statement(arena,
+												list->elsif[i].statement);
+	}
+
+	return pos;
+}
+
+static Statement *
+layout_statement(TreeArena *arena, Statement *statement)
+{
+	Statement *pos;
+
+	if (statement == NULL)
+		return NULL;
+	pos = place_node(arena, statement, sizeof(Statement));
+
+	switch (statement->type) {
+	case EXPRESSION_STATEMENT:
+		pos->u.expression_s = layout_expression(arena,
+												statement->u.expression_s);
+		break;
+	case GLOBAL_STATEMENT:
+		pos->u.global_s.identifier_list = layout_identifier_list(arena,
+									statement->u.global_s.identifier_list);
+		break;
+	case IF_STATEMENT:
+		pos->u.if_s.condition = layout_expression(arena,
+										statement->u.if_s.condition);
+		pos->u.if_s.then_statement = layout_statement(arena,
+										statement->u.if_s.then_statement);
+		pos->u.if_s.elsif_list = layout_elsif(arena,
+										statement->u.if_s.elsif_list);
+		pos->u.if_s.else_statement = layout_statement(arena,
+										statement->u.if_s.else_statement);
+		break;
+	case WHILE_STATEMENT:
+		pos->u.while_s.condition = layout_expression(arena,
+										statement->u.while_s.condition);
+		pos->u.while_s.statement = layout_statement(arena,
+										statement->u.while_s.statement);
+		break;
+	case FOR_STATEMENT:
+		pos->u.for_s.init = layout_expression(arena,
+										statement->u.for_s.init);
+		pos->u.for_s.condition = layout_expression(arena,
+										statement->u.for_s.condition);
+		pos->u.for_s.statement = layout_statement(arena,
+										statement->u.for_s.statement);
+		pos->u.for_s.post = layout_expression(arena,
+										statement->u.for_s.post);
+		break;
+	case RETURN_STATEMENT:
+		pos->u.return_s.return_value = layout_expression(arena,
+										statement->u.return_s.return_value);
+		break;
+	case BREAK_STATEMENT:		/* FALLTHRU */
+	case CONTINUE_STATEMENT:
+		break;
+	case BLOCK_STATEMENT:
+		pos->u.block_s.block = layout_block(arena,
+										statement->u.block_s.block);
+		break;
+	case TRY_STATEMENT:
+		pos->u.try_s.run_st = layout_statement(arena,
+										statement->u.try_s.run_st);
+		pos->u.try_s.catch_st = layout_statement(arena,
+										statement->u.try_s.catch_st);
+		pos->u.try_s.final_st = layout_statement(arena,
+										statement->u.try_s.final_st);
+		break;
+	case THROW_STATEMENT:
+		pos->u.throw_s.throw_expr = layout_expression(arena,
+										statement->u.throw_s.throw_expr);
+		break;
+	case FOREACH_STATEMENT:
+		pos->u.foreach_s.array_expr = layout_expression(arena,
+										statement->u.foreach_s.array_expr);
+		pos->u.foreach_s.sub_st = layout_statement(arena,
+										statement->u.foreach_s.sub_st);
+		break;
+	case STATEMENT_TYPE_COUNT_PLUS_1:	/* FALLTHRU */
+	default:
+		DBG_panic(("bad statement type..%d\n", statement->type));
+	}
+
+	return pos;
+}
+
+static void
+layout_program(CRB_Interpreter *inter, TreeArena *arena)
+{
+	FunctionDefinition *func;
+	int alloc_count;
+
+	/* the next file compiled appends to it as the parser does */
+	if (inter->statement_list) {
+		for (alloc_count = 1; alloc_count < inter->statement_list->count;)
+			alloc_count *= 2;
+		inter->statement_list = layout_statement_list(arena,
+												inter->statement_list,
+												alloc_count);
+	}
+	for (func = inter->function_list; func; func = func->next) {
+		if (func->type == CROWBAR_FUNCTION_DEFINITION)
+			layout_function(arena, func);
+	}
+}
+
+void
+crb_layout_tree(CRB_Interpreter *inter)
+{
+	MEM_Storage storage;
+	TreeArena arena;
+
+	arena.next = NULL;
+	arena.size = 0;
+	layout_program(inter, &arena);
+	if (arena.size == 0)
+		return;
+
+	storage = MEM_open_storage(0);
+	arena.next = MEM_storage_malloc(storage, arena.size);
+	arena.size = 0;
+	layout_program(inter, &arena);
+
+	MEM_dispose_storage(inter->tree_storage);
+	inter->tree_storage = storage;
+	inter->tree_size = arena.size;
+}
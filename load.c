@@ -131,10 +131,20 @@ static LineElement* get_next_line_debug(FILE *fpin,
 			line->argc = 0;
 			if (line->str) {	
 				int line_number;
+				int folded, removed, inlined = 0;
 				if (sscanf(line->str, "#line: %d", &line_number)==1) {
 					crb_get_current_interpreter()->current_line_number = 
 														line_number;
 				}
+				else if (sscanf(line->str,
+							"#optimized: folded %d, removed %d, inlined %d",
+							&folded, &removed, &inlined)>=2) {
+					CRB_Interpreter *inter = crb_get_current_interpreter();
+					inter->tree_optimized = CRB_TRUE;
+					inter->folded_expression_count = folded;
+					inter->removed_statement_count = removed;
+					inter->inlined_call_count = inlined;
+				}
 				else if (strncmp(line->str, "#file:", 
 									strlen("#file:"))==0) {
 					char name_buf[512];
@@ -330,6 +340,46 @@ static void load_function(FILE *fpin)
 }
 
 
+static void load_record(FILE *fpin)
+{
+	LineElement *line;
+	IdentifierList *field_list = NULL;
+	char *identifier;
+
+	line = get_next_line(fpin);
+	DBG_assert(line->argc==2 && strcmp(line->argv[0], "RECORD")==0,
+				("unexpected record: %s\n", line->argv[0]));
+	identifier = crb_create_identifier(line->argv[1]);
+	release_line(line);
+
+	while (1) {
+		line = get_next_line(fpin);
+		if (!line->str) {
+			release_line(line); break;
+		}
+
+		if (line->argc == 0) {
+			release_line(line); continue;
+		}
+
+		if (line->argc==2 && strcmp(line->argv[0], "FIELD")==0) {
+			char *field = crb_create_identifier(line->argv[1]);
+
+			if (field_list == NULL)
+				field_list = crb_create_global_identifier(field);
+			else
+				field_list = crb_chain_identifier(field_list, field);
+			release_line(line);
+		}
+		else {
+			unget_line(line); break;
+		}
+	}
+
+	crb_record_define(identifier, field_list);
+}
+
+
 static Expression* load_boolean_expression(FILE *fpin)
 {
 	LineElement *line;
@@ -1278,7 +1328,7 @@ static Statement* load_if_statement(FILE *fpin)
 			release_line(line);
 			Expression *if_cond = load_expression(fpin);
 			Statement *then_stat = load_statement(fpin);
-			Elsif *elsif_list = NULL;
+			ElsifList *elsif_list = NULL;
 			Statement *else_stat = NULL;
 
 			while (have_next) {
@@ -1299,13 +1349,8 @@ static Statement* load_if_statement(FILE *fpin)
 					Expression *elsif_cond = load_expression(fpin);
 					Statement *elsif_stat = load_statement(fpin);
 					
-					Elsif *elsif_node = crb_create_elsif(elsif_cond,
-														elsif_stat);
-					if (elsif_list == NULL)
-						elsif_list = elsif_node;
-					else
-						elsif_list = crb_chain_elsif_list(elsif_list,
-														elsif_node);
+					elsif_list = crb_chain_elsif_list(elsif_list,
+								crb_create_elsif(elsif_cond, elsif_stat));
 
 				}
 				else if (strcmp(line->argv[0], "ELSE")==0) {
@@ -1768,6 +1813,10 @@ void CRB_load_interpreter(CRB_Interpreter *interpreter, FILE *fpin)
 			unget_line(line);
 			load_function(fpin);
 		}
+		else if (strcmp(line->argv[0], "RECORD")==0) {
+			unget_line(line);
+			load_record(fpin);
+		}
 		else if (str_find(line->argv[0], "STATEMENT")) {
 			unget_line(line);
 			Statement *stat = load_statement(fpin);
@@ -1785,6 +1834,10 @@ void CRB_load_interpreter(CRB_Interpreter *interpreter, FILE *fpin)
 
 	}
 
+	/* a dump written before the optimizer existed */
+	if (!interpreter->tree_optimized)
+		crb_optimize(interpreter);
+	crb_layout_tree(interpreter);
 
 }
 
@@ -115,6 +115,8 @@ void usage()
 	printf("options:\n");
 	printf("  --source_encoding string  -- set the source file encoding\n");
 	printf("  --env_encoding string     -- set the environment encoding\n");
+	printf("  --ast                     -- run the syntax tree, not bytecode\n");
+	printf("  --nojit                   -- never compile bytecode to machine code\n");
 	printf("supported encoding: en, utf8, gbk\n");
 	printf("\n\n");
 }
@@ -133,6 +135,8 @@ main(int argc, char **argv)
 	char *source_name = NULL;
 	Encoding source_encoding = UTF8_ENCODING;
 	Encoding env_encoding = UTF8_ENCODING;
+	CRB_ExecuteMode execute_mode = CRB_BYTECODE_EXECUTE_MODE;
+	int jit_enabled = 1;
 	int i;
 
 	for (i=1; i<argc; i++) {
@@ -152,6 +156,12 @@ main(int argc, char **argv)
 			}
 			env_encoding = string_to_encoding(argv[i]);
 		}
+		else if (strcmp(argv[i], "--ast")==0) {
+			execute_mode = CRB_AST_EXECUTE_MODE;
+		}
+		else if (strcmp(argv[i], "--nojit")==0) {
+			jit_enabled = 0;
+		}
 		else {
 			if (source_name == NULL)
 				source_name = argv[i];
@@ -172,6 +182,8 @@ main(int argc, char **argv)
 
 
     interpreter = CRB_create_interpreter(source_encoding, env_encoding);
+	CRB_set_execute_mode(interpreter, execute_mode);
+	CRB_set_jit_enabled(interpreter, jit_enabled);
 	//printf("CRB_compile\n");
 
 	if (include_builtin_code) {
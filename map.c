@@ -0,0 +1,380 @@
+#include <string.h>
+#include "MEM.h"
+#include "DBG.h"
+#include "crowbar.h"
+
+/*
+ * new_map().  The entries are appended to entry[] in the order they
+ * are put, so keys(), values() and foreach see them in that order.
+ * index[] is an open addressing table of entry numbers, probed
+ * linearly from hash & (index_size - 1) and never more than half full.
+ *
+ * remove() turns the key of its entry to null and takes the entry
+ * number out of index[] by moving the rest of the probe run back, so
+ * the table needs no deleted marks.  The removed entries stay in
+ * entry[] until it fills up, then the live ones are packed and the
+ * table is rebuilt.  The entries are only packed when room is needed
+ * for a new key, so a foreach that only reads or removes sees every
+ * entry once.
+ *
+ * new_set() uses the same table with the values left null.  The hash
+ * of a string is kept in the string object, and an entry keeps the
+ * hash of its key, so the set algebra and the packing never hash a
+ * key again.
+ */
+
+#define MAP_MIN_ALLOC_SIZE	(8)
+#define MAP_NO_ENTRY		(-1)
+
+#define ENTRY_OF(map, slot)	(&(map)->entry[(map)->index[(slot)]])
+
+CRB_Boolean
+crb_is_map_key(CRB_Value *key)
+{
+	return key->type == CRB_STRING_VALUE || key->type == CRB_INT_VALUE;
+}
+
+/* FNV-1a over the characters, worked out once per string object */
+unsigned int
+crb_string_hash(CRB_Object *str)
+{
+	unsigned int hash = 2166136261U;
+	CRB_CHAR *pos;
+
+	DBG_assert(str->type == STRING_OBJECT, ("type..%d\n", str->type));
+	if (str->u.string.has_hash)
+		return str->u.string.hash;
+
+	for (pos = str->u.string.string; *pos; pos++) {
+		hash ^= (unsigned int)*pos;
+		hash *= 16777619U;
+	}
+	str->u.string.hash = hash;
+	str->u.string.has_hash = CRB_TRUE;
+
+	return hash;
+}
+
+/* spread the bits of an int over the table, the final mix of MurmurHash3 */
+static unsigned int
+int_hash(int value)
+{
+	unsigned int hash = (unsigned int)value;
+
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6bU;
+	hash ^= hash >> 13;
+	hash *= 0xc2b2ae35U;
+	hash ^= hash >> 16;
+
+	return hash;
+}
+
+static unsigned int
+key_hash(CRB_Value *key)
+{
+	if (key->type == CRB_INT_VALUE)
+		return int_hash(key->u.int_value);
+
+	return crb_string_hash(key->u.object_value);
+}
+
+static CRB_Boolean
+key_equal(MapEntry *entry, CRB_Value *key, unsigned int hash)
+{
+	if (entry->hash != hash || entry->key.type != key->type)
+		return CRB_FALSE;
+	if (key->type == CRB_INT_VALUE)
+		return entry->key.u.int_value == key->u.int_value;
+	if (entry->key.u.object_value == key->u.object_value)
+		return CRB_TRUE;
+
+	return CRB_wcscmp(entry->key.u.object_value->u.string.string,
+					  key->u.object_value->u.string.string) == 0;
+}
+
+/* the slot of key in index[], or the empty slot where it would go */
+static int
+find_slot(CRB_Map *map, CRB_Value *key, unsigned int hash)
+{
+	int mask = map->index_size - 1;
+	int slot;
+
+	for (slot = hash & mask; map->index[slot] != MAP_NO_ENTRY;
+		 slot = (slot + 1) & mask) {
+		if (key_equal(ENTRY_OF(map, slot), key, hash))
+			break;
+	}
+
+	return slot;
+}
+
+/* pack the live entries into entry_alloc of them and index them again */
+static void
+rebuild(CRB_Interpreter *inter, CRB_Map *map, int entry_alloc)
+{
+	int mask;
+	int slot;
+	int i;
+	int j;
+
+	for (i = 0, j = 0; i < map->entry_count; i++) {
+		if (map->entry[i].key.type != CRB_NULL_VALUE)
+			map->entry[j++] = map->entry[i];
+	}
+	map->entry_count = j;
+
+	map->entry = crb_realloc_storage(map->entry,
+									 sizeof(MapEntry) * map->entry_alloc,
+									 sizeof(MapEntry) * entry_alloc);
+	inter->heap.current_heap_size -= sizeof(MapEntry) * map->entry_alloc;
+	inter->heap.current_heap_size += sizeof(MapEntry) * entry_alloc;
+	map->entry_alloc = entry_alloc;
+
+	crb_free_storage(map->index, sizeof(int) * map->index_size);
+	inter->heap.current_heap_size -= sizeof(int) * map->index_size;
+	map->index_size = entry_alloc * 2;
+	map->index = crb_alloc_storage(sizeof(int) * map->index_size);
+	inter->heap.current_heap_size += sizeof(int) * map->index_size;
+
+	mask = map->index_size - 1;
+	for (slot = 0; slot < map->index_size; slot++)
+		map->index[slot] = MAP_NO_ENTRY;
+	for (i = 0; i < map->entry_count; i++) {
+		for (slot = map->entry[i].hash & mask;
+			 map->index[slot] != MAP_NO_ENTRY; slot = (slot + 1) & mask)
+			;
+		map->index[slot] = i;
+	}
+}
+
+/* the entry of key, NULL when there is none */
+static MapEntry *
+lookup(CRB_Map *map, CRB_Value *key, unsigned int hash)
+{
+	int slot;
+
+	if (map->count == 0)
+		return NULL;
+
+	slot = find_slot(map, key, hash);
+	if (map->index[slot] == MAP_NO_ENTRY)
+		return NULL;
+
+	return ENTRY_OF(map, slot);
+}
+
+CRB_Value *
+crb_map_get(CRB_Object *obj, CRB_Value *key)
+{
+	MapEntry *entry = lookup(&obj->u.map, key, key_hash(key));
+
+	return entry == NULL ? NULL : &entry->value;
+}
+
+/* CRB_FALSE when key was there already, its value is replaced then */
+static CRB_Boolean
+put(CRB_Interpreter *inter, CRB_Map *map, CRB_Value *key, unsigned int hash,
+	CRB_Value *value)
+{
+	MapEntry *entry;
+	int slot;
+
+	DBG_assert(crb_is_map_key(key), ("bad key type..%d\n", key->type));
+
+	if (map->index_size > 0) {
+		slot = find_slot(map, key, hash);
+		if (map->index[slot] != MAP_NO_ENTRY) {
+			ENTRY_OF(map, slot)->value = *value;
+			return CRB_FALSE;
+		}
+	}
+
+	if (map->entry_count == map->entry_alloc) {
+		/* keep the size when packing frees half of the entries */
+		if (map->count <= map->entry_alloc / 2 && map->entry_alloc > 0)
+			rebuild(inter, map, map->entry_alloc);
+		else
+			rebuild(inter, map, larger(map->entry_alloc * 2,
+									   MAP_MIN_ALLOC_SIZE));
+	}
+
+	slot = find_slot(map, key, hash);
+	map->index[slot] = map->entry_count;
+	entry = &map->entry[map->entry_count++];
+	entry->hash = hash;
+	entry->key = *key;
+	entry->value = *value;
+	map->count++;
+
+	return CRB_TRUE;
+}
+
+void
+crb_map_put(CRB_Interpreter *inter, CRB_Object *obj,
+			CRB_Value *key, CRB_Value *value)
+{
+	put(inter, &obj->u.map, key, key_hash(key), value);
+}
+
+CRB_Boolean
+crb_map_remove(CRB_Object *obj, CRB_Value *key)
+{
+	CRB_Map *map = &obj->u.map;
+	int mask = map->index_size - 1;
+	int home;
+	int slot;
+	int next;
+
+	if (map->count == 0)
+		return CRB_FALSE;
+
+	slot = find_slot(map, key, key_hash(key));
+	if (map->index[slot] == MAP_NO_ENTRY)
+		return CRB_FALSE;
+
+	ENTRY_OF(map, slot)->key.type = CRB_NULL_VALUE;
+	ENTRY_OF(map, slot)->value.type = CRB_NULL_VALUE;
+	map->count--;
+
+	/* move back the entries the hole would cut off from their home */
+	for (next = (slot + 1) & mask; map->index[next] != MAP_NO_ENTRY;
+		 next = (next + 1) & mask) {
+		home = ENTRY_OF(map, next)->hash & mask;
+		if (((next - home) & mask) >= ((next - slot) & mask)) {
+			map->index[slot] = map->index[next];
+			slot = next;
+		}
+	}
+	map->index[slot] = MAP_NO_ENTRY;
+
+	return CRB_TRUE;
+}
+
+/* the first entry from pos on not removed, -1 at the end */
+int
+crb_map_next(CRB_Object *obj, int pos)
+{
+	CRB_Map *map = &obj->u.map;
+
+	for (; pos < map->entry_count; pos++) {
+		if (map->entry[pos].key.type != CRB_NULL_VALUE)
+			return pos;
+	}
+
+	return -1;
+}
+
+/* an array of the keys, or of the values, in the order they were put */
+static CRB_Object *
+map_to_array(CRB_Interpreter *inter, CRB_Object *obj, CRB_Boolean keys)
+{
+	CRB_Object *array;
+	MapEntry *entry;
+	int pos;
+
+	/* added one by one, so ints and doubles end up packed */
+	array = crb_create_array(inter, 0);
+	crb_array_reserve(inter, array, obj->u.map.count);
+	for (pos = crb_map_next(obj, 0); pos >= 0;
+		 pos = crb_map_next(obj, pos + 1)) {
+		entry = &obj->u.map.entry[pos];
+		crb_array_add(inter, array, keys ? &entry->key : &entry->value);
+	}
+
+	return array;
+}
+
+CRB_Object *
+crb_map_keys(CRB_Interpreter *inter, CRB_Object *obj)
+{
+	return map_to_array(inter, obj, CRB_TRUE);
+}
+
+CRB_Object *
+crb_map_values(CRB_Interpreter *inter, CRB_Object *obj)
+{
+	return map_to_array(inter, obj, CRB_FALSE);
+}
+
+/* true when the element was not in the set */
+CRB_Boolean
+crb_set_add(CRB_Interpreter *inter, CRB_Object *obj, CRB_Value *key)
+{
+	CRB_Value null_value;
+
+	null_value.type = CRB_NULL_VALUE;
+
+	return put(inter, &obj->u.map, key, key_hash(key), &null_value);
+}
+
+/*
+ * The elements of left that are (want_found) or are not in right, in
+ * the order of left.  right may be NULL for none.
+ */
+static void
+add_filtered(CRB_Interpreter *inter, CRB_Object *set, CRB_Object *left,
+			 CRB_Object *right, CRB_Boolean want_found)
+{
+	MapEntry *entry;
+	CRB_Boolean found;
+	int pos;
+
+	for (pos = crb_map_next(left, 0); pos >= 0;
+		 pos = crb_map_next(left, pos + 1)) {
+		entry = &left->u.map.entry[pos];
+		found = (right != NULL
+				 && lookup(&right->u.map, &entry->key, entry->hash) != NULL);
+		if (found == want_found) {
+			put(inter, &set->u.map, &entry->key, entry->hash,
+				&entry->value);
+		}
+	}
+}
+
+CRB_Object *
+crb_set_union(CRB_Interpreter *inter, CRB_Object *left, CRB_Object *right)
+{
+	CRB_Object *set = crb_create_set(inter);
+
+	add_filtered(inter, set, left, NULL, CRB_FALSE);
+	add_filtered(inter, set, right, NULL, CRB_FALSE);
+
+	return set;
+}
+
+CRB_Object *
+crb_set_intersect(CRB_Interpreter *inter,
+				  CRB_Object *left, CRB_Object *right)
+{
+	CRB_Object *set = crb_create_set(inter);
+
+	add_filtered(inter, set, left, right, CRB_TRUE);
+
+	return set;
+}
+
+CRB_Object *
+crb_set_difference(CRB_Interpreter *inter,
+				   CRB_Object *left, CRB_Object *right)
+{
+	CRB_Object *set = crb_create_set(inter);
+
+	add_filtered(inter, set, left, right, CRB_FALSE);
+
+	return set;
+}
+
+void
+crb_dispose_map(CRB_Interpreter *inter, CRB_Object *obj)
+{
+	CRB_Map *map = &obj->u.map;
+
+	if (map->entry_alloc == 0)
+		return;
+
+	crb_free_storage(map->entry, sizeof(MapEntry) * map->entry_alloc);
+	crb_free_storage(map->index, sizeof(int) * map->index_size);
+	inter->heap.current_heap_size -= sizeof(MapEntry) * map->entry_alloc;
+	inter->heap.current_heap_size -= sizeof(int) * map->index_size;
+}
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "MEM.h"
 #include "DBG.h"
@@ -11,6 +12,40 @@ static CRB_NativePointerInfo st_native_lib_info = {
     NATIVE_LIB_NAME
 };
 
+/*
+ * A native pointer value holds the index of its info in this table.
+ * The infos are static in the libraries defining them, so the table is
+ * shared by all interpreters and never shrinks.
+ */
+#define NATIVE_POINTER_INFO_MAX	(64)
+
+static CRB_NativePointerInfo *st_native_pointer_info[NATIVE_POINTER_INFO_MAX];
+static int st_native_pointer_info_count;
+
+int CRB_native_pointer_info_index(CRB_NativePointerInfo *info)
+{
+	int i;
+
+	for (i = 0; i < st_native_pointer_info_count; i++) {
+		if (st_native_pointer_info[i] == info)
+			return i;
+	}
+	// not a DBG_assert, that is gone from a DBG_NO_DEBUG build
+	if (i >= NATIVE_POINTER_INFO_MAX) {
+		fprintf(stderr, "too many native pointer infos (%d), %s\n",
+				NATIVE_POINTER_INFO_MAX, info->name);
+		exit(1);
+	}
+	st_native_pointer_info[st_native_pointer_info_count++] = info;
+
+	return i;
+}
+
+CRB_NativePointerInfo *CRB_get_native_pointer_info(int index)
+{
+	return st_native_pointer_info[index];
+}
+
 
 
 static void check_argument_count(int arg_count, int true_count,
@@ -108,9 +143,7 @@ void crb_nv_fopen_proc(CRB_Interpreter *interpreter,
 	if (fp == NULL) {
         value.type = CRB_NULL_VALUE;
     } else {
-        value.type = CRB_NATIVE_POINTER_VALUE;
-        value.u.native_pointer.info = &st_native_lib_info;
-        value.u.native_pointer.pointer = fp;
+        CRB_set_native_pointer(&value, fp, &st_native_lib_info);
     }
 
     crb_stack_shrink_size(interpreter, 2);
@@ -120,7 +153,7 @@ void crb_nv_fopen_proc(CRB_Interpreter *interpreter,
 static CRB_Boolean
 check_native_pointer(CRB_Value *value)
 {
-    return value->u.native_pointer.info == &st_native_lib_info;
+    return CRB_native_pointer_info(value) == &st_native_lib_info;
 }
 
 void crb_nv_fclose_proc(CRB_Interpreter *interpreter,
@@ -143,7 +176,7 @@ void crb_nv_fclose_proc(CRB_Interpreter *interpreter,
         crb_runtime_error(filename, line_number, FCLOSE_ARGUMENT_TYPE_ERR,
                           MESSAGE_ARGUMENT_END);
     }
-    fp = args[0].u.native_pointer.pointer;
+    fp = CRB_native_pointer(&args[0]);
     fclose(fp);
 
     crb_stack_shrink_size(interpreter, 1);
@@ -172,7 +205,7 @@ void crb_nv_fgets_proc(CRB_Interpreter *interpreter,
         crb_runtime_error(filename, line_number, FGETS_ARGUMENT_TYPE_ERR,
                           MESSAGE_ARGUMENT_END);
     }
-    fp = args[0].u.native_pointer.pointer;
+    fp = CRB_native_pointer(&args[0]);
 
     while (fgets(buf, LINE_BUF_SIZE, fp)) {
         int new_len;
@@ -223,7 +256,7 @@ void crb_nv_fputs_proc(CRB_Interpreter *interpreter,
         crb_runtime_error(filename, line_number, FPUTS_ARGUMENT_TYPE_ERR,
                           MESSAGE_ARGUMENT_END);
     }
-    fp = args[1].u.native_pointer.pointer;
+    fp = CRB_native_pointer(&args[1]);
 
 	CRB_print_wcs(fp, args[0].u.object_value->u.string.string);
 
@@ -237,16 +270,13 @@ crb_add_std_fp(CRB_Interpreter *inter)
 {
     CRB_Value fp_value;
 
-    fp_value.type = CRB_NATIVE_POINTER_VALUE;
-    fp_value.u.native_pointer.info = &st_native_lib_info;
-
-    fp_value.u.native_pointer.pointer = stdin;
+    CRB_set_native_pointer(&fp_value, stdin, &st_native_lib_info);
     CRB_add_global_variable(inter, "STDIN", &fp_value);
 
-    fp_value.u.native_pointer.pointer = stdout;
+    CRB_set_native_pointer(&fp_value, stdout, &st_native_lib_info);
     CRB_add_global_variable(inter, "STDOUT", &fp_value);
 
-    fp_value.u.native_pointer.pointer = stderr;
+    CRB_set_native_pointer(&fp_value, stderr, &st_native_lib_info);
     CRB_add_global_variable(inter, "STDERR", &fp_value);
 }
 
@@ -265,7 +295,7 @@ static CRB_Value new_array(CRB_Interpreter *inter,
 		value.u.object_value = crb_create_array(inter, args[pos].u.int_value);
 		int i;
 		for (i=0; i<args[pos].u.int_value; i++) {
-			value.u.object_value->u.array.array[i] =
+			value.u.object_value->u.array.u.value[i] =
 				new_array(inter, env, args, arg_count, pos+1);
 		}
 	}
@@ -332,6 +362,70 @@ void crb_nv_new_object_proc(CRB_Interpreter *inter,
 	crb_gc_enable(inter);
 }
 
+void crb_nv_new_map_proc(CRB_Interpreter *inter,
+							CRB_LocalEnvironment *env,
+							int arg_count,
+							char *filename, int line_number)
+{
+	crb_gc_disable(inter);
+
+	check_argument_count(arg_count, 0, filename, line_number);
+
+	CRB_Value map_value;
+
+	map_value.type = CRB_MAP_VALUE;
+	map_value.u.object_value = crb_create_map(inter);
+
+	crb_stack_push_value(inter, &map_value);
+
+	crb_gc_enable(inter);
+}
+
+/* new_set() or new_set(array), the array giving the elements */
+void crb_nv_new_set_proc(CRB_Interpreter *inter,
+							CRB_LocalEnvironment *env,
+							int arg_count,
+							char *filename, int line_number)
+{
+	crb_gc_disable(inter);
+
+	if (arg_count != 0)
+		check_argument_count(arg_count, 1, filename, line_number);
+
+	CRB_Value set_value;
+	CRB_Value element;
+	CRB_Object *array;
+	int size;
+	int i;
+
+	set_value.type = CRB_SET_VALUE;
+	set_value.u.object_value = crb_create_set(inter);
+
+	if (arg_count == 1) {
+		CRB_Value *args = crb_stack_peek_value(inter, 0);
+
+		if (args[0].type != CRB_ARRAY_VALUE)
+			crb_runtime_error(filename, line_number,
+					ARGUMENT_TYPE_MISMATCH_ERR,
+					STRING_MESSAGE_ARGUMENT, "func_name", "new_set",
+					MESSAGE_ARGUMENT_END);
+		array = args[0].u.object_value;
+		size = crb_array_size(inter, array);
+		for (i = 0; i < size; i++) {
+			crb_array_get(array, i, &element);
+			if (!crb_is_map_key(&element))
+				crb_runtime_error(filename, line_number, MAP_KEY_TYPE_ERR,
+						MESSAGE_ARGUMENT_END);
+			crb_set_add(inter, set_value.u.object_value, &element);
+		}
+		crb_stack_shrink_size(inter, 1);
+	}
+
+	crb_stack_push_value(inter, &set_value);
+
+	crb_gc_enable(inter);
+}
+
 void crb_nv_new_exception_proc(CRB_Interpreter *inter,
 							CRB_LocalEnvironment *env,
 							int arg_count,
@@ -384,6 +478,8 @@ add_native_functions(CRB_Interpreter *inter)
     CRB_add_native_function(inter, "fputs", crb_nv_fputs_proc);
 	CRB_add_native_function(inter, "new_array", crb_nv_new_array_proc);
 	CRB_add_native_function(inter, "new_object", crb_nv_new_object_proc);
+	CRB_add_native_function(inter, "new_map", crb_nv_new_map_proc);
+	CRB_add_native_function(inter, "new_set", crb_nv_new_set_proc);
 	CRB_add_native_function(inter, "new_exception", crb_nv_new_exception_proc);
 
 }
@@ -0,0 +1,788 @@
+#include <stdio.h>
+#include <string.h>
+#include "MEM.h"
+#include "DBG.h"
+#include "crowbar.h"
+
+/*
+ * Tree optimizer, run on the parsed or loaded tree before it is executed.
+ * Subtrees made only of literals are folded into one literal and if/while/
+ * for statements whose condition is a boolean literal lose the branches
+ * that can never run.  Anything that would raise a runtime error (bad
+ * operand types, integer division by zero) is left alone so the error
+ * still comes from the right line at run time.
+ *
+ * Calls to small functions made of one return expression are replaced
+ * by that expression, see inline_call.
+ */
+
+static void optimize_expression(CRB_Interpreter *inter, Expression *expr);
+static Statement *optimize_statement(CRB_Interpreter *inter,
+									Statement *statement);
+
+static CRB_Boolean
+is_number_literal(Expression *expr)
+{
+	return expr->type == INT_EXPRESSION || expr->type == DOUBLE_EXPRESSION;
+}
+
+static CRB_Boolean
+is_boolean_literal(Expression *expr, CRB_Boolean value)
+{
+	return expr->type == BOOLEAN_EXPRESSION && expr->u.boolean_value == value;
+}
+
+static void
+literal_to_value(Expression *expr, CRB_Value *v)
+{
+	if (expr->type == INT_EXPRESSION) {
+		v->type = CRB_INT_VALUE;
+		v->u.int_value = expr->u.int_value;
+	} else if (expr->type == DOUBLE_EXPRESSION) {
+		v->type = CRB_DOUBLE_VALUE;
+		v->u.double_value = expr->u.double_value;
+	} else if (expr->type == BOOLEAN_EXPRESSION) {
+		v->type = CRB_BOOLEAN_VALUE;
+		v->u.boolean_value = expr->u.boolean_value;
+	} else {
+		DBG_assert(expr->type == NULL_EXPRESSION,
+					("expr->type..%d\n", expr->type));
+		v->type = CRB_NULL_VALUE;
+	}
+}
+
+/* overwrite expr with the literal for v, like create.c does */
+static void
+value_to_literal(Expression *expr, CRB_Value *v)
+{
+	if (v->type == CRB_INT_VALUE) {
+		expr->type = INT_EXPRESSION;
+		expr->u.int_value = v->u.int_value;
+	} else if (v->type == CRB_DOUBLE_VALUE) {
+		expr->type = DOUBLE_EXPRESSION;
+		expr->u.double_value = v->u.double_value;
+	} else {
+		DBG_assert(v->type == CRB_BOOLEAN_VALUE,
+					("v->type..%d\n", v->type));
+		expr->type = BOOLEAN_EXPRESSION;
+		expr->u.boolean_value = v->u.boolean_value;
+	}
+}
+
+static void
+fold_boolean(CRB_Interpreter *inter, Expression *expr, CRB_Boolean value)
+{
+	expr->type = BOOLEAN_EXPRESSION;
+	expr->u.boolean_value = value;
+	inter->folded_expression_count++;
+}
+
+/* "abc" + literal, with the same text chain_string would produce */
+static void
+fold_string_add(CRB_Interpreter *inter, Expression *expr,
+				Expression *left, Expression *right)
+{
+	CRB_CHAR *right_str;
+	CRB_CHAR *str;
+	CRB_Value v;
+
+	if (right->type == STRING_EXPRESSION) {
+		right_str = right->u.string_value;
+	} else {
+		literal_to_value(right, &v);
+		right_str = CRB_value_to_string(&v);
+	}
+
+	str = crb_malloc(sizeof(CRB_CHAR) * (CRB_wcslen(left->u.string_value)
+										+ CRB_wcslen(right_str) + 1));
+	CRB_wcscpy(str, left->u.string_value);
+	CRB_wcscat(str, right_str);
+
+	if (right->type != STRING_EXPRESSION)
+		MEM_free(right_str);
+
+	expr->type = STRING_EXPRESSION;
+	expr->u.string_value = str;
+	inter->folded_expression_count++;
+}
+
+static void
+fold_binary_expression(CRB_Interpreter *inter, Expression *expr)
+{
+	Expression *left = expr->u.binary_expression.left;
+	Expression *right = expr->u.binary_expression.right;
+	CRB_Value left_val;
+	CRB_Value right_val;
+	CRB_Value result;
+	int cmp;
+
+	if (is_number_literal(left) && is_number_literal(right)) {
+		if (left->type == INT_EXPRESSION && right->type == INT_EXPRESSION
+			&& right->u.int_value == 0
+			&& (expr->type == DIV_EXPRESSION
+				|| expr->type == MOD_EXPRESSION))
+			return;
+		literal_to_value(left, &left_val);
+		literal_to_value(right, &right_val);
+		crb_eval_binary_values(inter, expr->type, &left_val, &right_val,
+							&result, crb_node_filename(inter, left),
+							crb_node_line_number(inter, left));
+		value_to_literal(expr, &result);
+		inter->folded_expression_count++;
+	} else if (left->type == BOOLEAN_EXPRESSION
+				&& right->type == BOOLEAN_EXPRESSION) {
+		if (expr->type == EQ_EXPRESSION)
+			fold_boolean(inter, expr,
+						left->u.boolean_value == right->u.boolean_value);
+		else if (expr->type == NE_EXPRESSION)
+			fold_boolean(inter, expr,
+						left->u.boolean_value != right->u.boolean_value);
+	} else if (left->type == STRING_EXPRESSION
+				&& expr->type == ADD_EXPRESSION) {
+		if (right->type == STRING_EXPRESSION || is_number_literal(right)
+			|| right->type == BOOLEAN_EXPRESSION
+			|| right->type == NULL_EXPRESSION)
+			fold_string_add(inter, expr, left, right);
+	} else if (left->type == STRING_EXPRESSION
+				&& right->type == STRING_EXPRESSION
+				&& dkc_is_compare_operator(expr->type)) {
+		cmp = CRB_wcscmp(left->u.string_value, right->u.string_value);
+		switch (expr->type) {
+		case EQ_EXPRESSION: fold_boolean(inter, expr, cmp == 0); break;
+		case NE_EXPRESSION: fold_boolean(inter, expr, cmp != 0); break;
+		case GT_EXPRESSION: fold_boolean(inter, expr, cmp > 0); break;
+		case GE_EXPRESSION: fold_boolean(inter, expr, cmp >= 0); break;
+		case LT_EXPRESSION: fold_boolean(inter, expr, cmp < 0); break;
+		case LE_EXPRESSION: fold_boolean(inter, expr, cmp <= 0); break;
+		default: DBG_panic(("bad case...%d", expr->type));
+		}
+	} else if (left->type == NULL_EXPRESSION
+				&& right->type == NULL_EXPRESSION) {
+		if (expr->type == EQ_EXPRESSION)
+			fold_boolean(inter, expr, CRB_TRUE);
+		else if (expr->type == NE_EXPRESSION)
+			fold_boolean(inter, expr, CRB_FALSE);
+	}
+}
+
+/*
+ * "false && x" and "true || x" never look at x.  Otherwise the right
+ * operand is only dropped when it is a literal too, since the runtime
+ * checks it is a boolean.
+ */
+static void
+fold_logical_expression(CRB_Interpreter *inter, Expression *expr)
+{
+	Expression *left = expr->u.binary_expression.left;
+	Expression *right = expr->u.binary_expression.right;
+	CRB_Boolean is_and = (expr->type == LOGICAL_AND_EXPRESSION);
+
+	if (left->type != BOOLEAN_EXPRESSION)
+		return;
+
+	if (left->u.boolean_value != is_and)
+		fold_boolean(inter, expr, left->u.boolean_value);
+	else if (right->type == BOOLEAN_EXPRESSION)
+		fold_boolean(inter, expr, right->u.boolean_value);
+}
+
+/*
+ * A function is inlined when its body is "return expr;" and expr has at
+ * most INLINE_MAX_NODES nodes, reads nothing but the parameters, and
+ * assigns, calls and defines nothing.  With no call inside, nothing in
+ * the inlined expression can throw, so no stack trace can miss the
+ * frame.  The arguments take the place of the parameters: they must be
+ * variables or literals, indexed or member access on those, each one
+ * read on every run of the body like the call would, and one read more
+ * than once must not be indexed or member access.  The callee is the
+ * function of that name when the tree is optimized, as the call would
+ * find it.
+ */
+#define INLINE_MAX_NODES			(24)
+#define INLINE_MAX_ARGUMENT_NODES	(8)
+
+typedef struct {
+	ParameterList	*parameter;
+	int				parameter_count;
+	int				node_count;
+	CRB_Boolean		ok;
+	/* per parameter: all reads, reads done on every run */
+	int				use_count[INLINE_MAX_NODES];
+	int				sure_use_count[INLINE_MAX_NODES];
+} InlineInfo;
+
+static int
+parameter_index(ParameterList *parameter, char *name)
+{
+	int i;
+
+	for (i = 0; i < parameter->count; i++) {
+		if (!strcmp(parameter->name[i], name))
+			return i;
+	}
+	return -1;
+}
+
+/* sure is CRB_FALSE under the right operand of && and || */
+static void
+check_inline_expression(Expression *expr, InlineInfo *info,
+						CRB_Boolean sure)
+{
+	ExpressionList *list;
+	int index;
+	int i;
+
+	if (!info->ok)
+		return;
+	if (++info->node_count > INLINE_MAX_NODES) {
+		info->ok = CRB_FALSE;
+		return;
+	}
+
+	switch (expr->type) {
+	case BOOLEAN_EXPRESSION:	/* FALLTHRU */
+	case INT_EXPRESSION:		/* FALLTHRU */
+	case DOUBLE_EXPRESSION:		/* FALLTHRU */
+	case STRING_EXPRESSION:		/* FALLTHRU */
+	case REGEXP_EXPRESSION:		/* FALLTHRU */
+	case NULL_EXPRESSION:
+		break;
+	case IDENTIFIER_EXPRESSION:
+		index = parameter_index(info->parameter, expr->u.identifier);
+		if (index < 0) {
+			info->ok = CRB_FALSE;
+			break;
+		}
+		info->use_count[index]++;
+		if (sure)
+			info->sure_use_count[index]++;
+		break;
+	case ADD_EXPRESSION:	/* FALLTHRU */
+	case SUB_EXPRESSION:	/* FALLTHRU */
+	case MUL_EXPRESSION:	/* FALLTHRU */
+	case DIV_EXPRESSION:	/* FALLTHRU */
+	case MOD_EXPRESSION:	/* FALLTHRU */
+	case EQ_EXPRESSION:		/* FALLTHRU */
+	case NE_EXPRESSION:		/* FALLTHRU */
+	case GT_EXPRESSION:		/* FALLTHRU */
+	case GE_EXPRESSION:		/* FALLTHRU */
+	case LT_EXPRESSION:		/* FALLTHRU */
+	case LE_EXPRESSION:
+		check_inline_expression(expr->u.binary_expression.left, info, sure);
+		check_inline_expression(expr->u.binary_expression.right, info, sure);
+		break;
+	case LOGICAL_AND_EXPRESSION:	/* FALLTHRU */
+	case LOGICAL_OR_EXPRESSION:
+		check_inline_expression(expr->u.binary_expression.left, info, sure);
+		check_inline_expression(expr->u.binary_expression.right, info,
+								CRB_FALSE);
+		break;
+	case NOT_EXPRESSION:
+		check_inline_expression(expr->u.not_expression.sub_expr, info, sure);
+		break;
+	case MINUS_EXPRESSION:
+		check_inline_expression(expr->u.minus_expression, info, sure);
+		break;
+	case ARRAY_EXPRESSION:
+		list = expr->u.array_expression;
+		for (i = 0; i < list->count; i++)
+			check_inline_expression(list->expression[i], info, sure);
+		break;
+	case INDEX_EXPRESSION:
+		check_inline_expression(expr->u.index_expression.array, info, sure);
+		check_inline_expression(expr->u.index_expression.index, info, sure);
+		break;
+	case MEMBER_EXPRESSION:
+		check_inline_expression(expr->u.member_expression.expression,
+								info, sure);
+		break;
+	default:
+		info->ok = CRB_FALSE;
+		break;
+	}
+}
+
+/* the returned expression of func, NULL when func is not inlined */
+static Expression *
+inline_body(FunctionDefinition *func, InlineInfo *info)
+{
+	StatementList *list;
+	int i;
+
+	if (func == NULL || func->type != CROWBAR_FUNCTION_DEFINITION)
+		return NULL;
+
+	list = func->u.crowbar_f.block->statement_list;
+	if (list == NULL || list->count != 1
+		|| list->statement[0]->type != RETURN_STATEMENT
+		|| list->statement[0]->u.return_s.return_value == NULL)
+		return NULL;
+
+	info->parameter = func->u.crowbar_f.parameter;
+	info->parameter_count = info->parameter->count;
+	if (info->parameter_count > INLINE_MAX_NODES)
+		return NULL;
+	for (i = 0; i < info->parameter_count; i++) {
+		info->use_count[i] = 0;
+		info->sure_use_count[i] = 0;
+	}
+	info->node_count = 0;
+	info->ok = CRB_TRUE;
+	check_inline_expression(list->statement[0]->u.return_s.return_value,
+							info, CRB_TRUE);
+	if (!info->ok)
+		return NULL;
+
+	return list->statement[0]->u.return_s.return_value;
+}
+
+static CRB_Boolean
+is_plain_argument(Expression *expr, int *node_count)
+{
+	if (++*node_count > INLINE_MAX_ARGUMENT_NODES)
+		return CRB_FALSE;
+
+	switch (expr->type) {
+	case BOOLEAN_EXPRESSION:	/* FALLTHRU */
+	case INT_EXPRESSION:		/* FALLTHRU */
+	case DOUBLE_EXPRESSION:		/* FALLTHRU */
+	case STRING_EXPRESSION:		/* FALLTHRU */
+	case NULL_EXPRESSION:		/* FALLTHRU */
+	case IDENTIFIER_EXPRESSION:
+		return CRB_TRUE;
+	case INDEX_EXPRESSION:
+		return is_plain_argument(expr->u.index_expression.array, node_count)
+			&& is_plain_argument(expr->u.index_expression.index, node_count);
+	case MEMBER_EXPRESSION:
+		return is_plain_argument(expr->u.member_expression.expression,
+								node_count);
+	default:
+		return CRB_FALSE;
+	}
+}
+
+/*
+ * A copy of expr with the parameters replaced by copies of the
+ * arguments.  Every node keeps its own file and line.
+ */
+static Expression *
+copy_inline_expression(Expression *expr, ParameterList *parameter,
+					   Expression **argument)
+{
+	Expression *copy;
+	ExpressionList *list;
+	int index;
+	int i;
+
+	if (expr->type == IDENTIFIER_EXPRESSION && parameter) {
+		index = parameter_index(parameter, expr->u.identifier);
+		DBG_assert(index >= 0, ("identifier..%s\n", expr->u.identifier));
+		return copy_inline_expression(argument[index], NULL, NULL);
+	}
+
+	copy = crb_tree_malloc(sizeof(Expression));
+	*copy = *expr;
+
+	switch (expr->type) {
+	case ADD_EXPRESSION:	/* FALLTHRU */
+	case SUB_EXPRESSION:	/* FALLTHRU */
+	case MUL_EXPRESSION:	/* FALLTHRU */
+	case DIV_EXPRESSION:	/* FALLTHRU */
+	case MOD_EXPRESSION:	/* FALLTHRU */
+	case EQ_EXPRESSION:		/* FALLTHRU */
+	case NE_EXPRESSION:		/* FALLTHRU */
+	case GT_EXPRESSION:		/* FALLTHRU */
+	case GE_EXPRESSION:		/* FALLTHRU */
+	case LT_EXPRESSION:		/* FALLTHRU */
+	case LE_EXPRESSION:		/* FALLTHRU */
+	case LOGICAL_AND_EXPRESSION:	/* FALLTHRU */
+	case LOGICAL_OR_EXPRESSION:
+		copy->u.binary_expression.left = copy_inline_expression(
+					expr->u.binary_expression.left, parameter, argument);
+		copy->u.binary_expression.right = copy_inline_expression(
+					expr->u.binary_expression.right, parameter, argument);
+		break;
+	case NOT_EXPRESSION:
+		copy->u.not_expression.sub_expr = copy_inline_expression(
+					expr->u.not_expression.sub_expr, parameter, argument);
+		break;
+	case MINUS_EXPRESSION:
+		copy->u.minus_expression = copy_inline_expression(
+					expr->u.minus_expression, parameter, argument);
+		break;
+	case ARRAY_EXPRESSION:
+		list = crb_tree_malloc(sizeof(ExpressionList));
+		list->count = expr->u.array_expression->count;
+		list->expression = crb_tree_malloc(sizeof(Expression*)
+											* list->count);
+		for (i = 0; i < list->count; i++) {
+			list->expression[i] = copy_inline_expression(
+							expr->u.array_expression->expression[i],
+							parameter, argument);
+		}
+		copy->u.array_expression = list;
+		break;
+	case INDEX_EXPRESSION:
+		copy->u.index_expression.array = copy_inline_expression(
+					expr->u.index_expression.array, parameter, argument);
+		copy->u.index_expression.index = copy_inline_expression(
+					expr->u.index_expression.index, parameter, argument);
+		break;
+	case MEMBER_EXPRESSION:
+		copy->u.member_expression.expression = copy_inline_expression(
+					expr->u.member_expression.expression,
+					parameter, argument);
+		break;
+	default:
+		break;
+	}
+
+	return copy;
+}
+
+/* overwrite the call expr with the body of the function it calls */
+static CRB_Boolean
+inline_call(CRB_Interpreter *inter, Expression *expr)
+{
+	Expression *callee = expr->u.function_call_expression.expr;
+	ArgumentList *arg = expr->u.function_call_expression.argument;
+	InlineInfo info;
+	Expression *body;
+	Expression *copy;
+	int node_count;
+	int i;
+
+	if (callee->type != IDENTIFIER_EXPRESSION)
+		return CRB_FALSE;
+	body = inline_body(crb_search_function_in(inter, callee->u.identifier),
+					   &info);
+	if (body == NULL)
+		return CRB_FALSE;
+
+	if (arg->count != info.parameter_count)
+		return CRB_FALSE;
+
+	for (i = 0; i < info.parameter_count; i++) {
+		node_count = 0;
+		if (info.sure_use_count[i] == 0
+			|| !is_plain_argument(arg->expression[i], &node_count)
+			|| (info.use_count[i] > 1 && node_count > 1))
+			return CRB_FALSE;
+	}
+
+	copy = copy_inline_expression(body, info.parameter, arg->expression);
+	copy->location = expr->location;
+	*expr = *copy;
+	inter->inlined_call_count++;
+
+	return CRB_TRUE;
+}
+
+static void
+optimize_function(CRB_Interpreter *inter, FunctionDefinition *func);
+
+static void
+optimize_expression(CRB_Interpreter *inter, Expression *expr)
+{
+	ArgumentList *arg;
+	ExpressionList *list;
+	Expression *operand;
+	int i;
+
+	if (expr == NULL)
+		return;
+
+	switch (expr->type) {
+	case BOOLEAN_EXPRESSION:	/* FALLTHRU */
+	case INT_EXPRESSION:		/* FALLTHRU */
+	case DOUBLE_EXPRESSION:		/* FALLTHRU */
+	case STRING_EXPRESSION:		/* FALLTHRU */
+	case REGEXP_EXPRESSION:		/* FALLTHRU */
+	case IDENTIFIER_EXPRESSION:	/* FALLTHRU */
+	case NULL_EXPRESSION:
+		break;
+	case ASSIGN_EXPRESSION:
+		optimize_expression(inter, expr->u.assign_expression.left);
+		optimize_expression(inter, expr->u.assign_expression.operand);
+		break;
+	case ADD_EXPRESSION:	/* FALLTHRU */
+	case SUB_EXPRESSION:	/* FALLTHRU */
+	case MUL_EXPRESSION:	/* FALLTHRU */
+	case DIV_EXPRESSION:	/* FALLTHRU */
+	case MOD_EXPRESSION:	/* FALLTHRU */
+	case EQ_EXPRESSION:		/* FALLTHRU */
+	case NE_EXPRESSION:		/* FALLTHRU */
+	case GT_EXPRESSION:		/* FALLTHRU */
+	case GE_EXPRESSION:		/* FALLTHRU */
+	case LT_EXPRESSION:		/* FALLTHRU */
+	case LE_EXPRESSION:
+		optimize_expression(inter, expr->u.binary_expression.left);
+		optimize_expression(inter, expr->u.binary_expression.right);
+		fold_binary_expression(inter, expr);
+		break;
+	case LOGICAL_AND_EXPRESSION:	/* FALLTHRU */
+	case LOGICAL_OR_EXPRESSION:
+		optimize_expression(inter, expr->u.binary_expression.left);
+		optimize_expression(inter, expr->u.binary_expression.right);
+		fold_logical_expression(inter, expr);
+		break;
+	case NOT_EXPRESSION:
+		operand = expr->u.not_expression.sub_expr;
+		optimize_expression(inter, operand);
+		if (operand->type == BOOLEAN_EXPRESSION)
+			fold_boolean(inter, expr, !operand->u.boolean_value);
+		break;
+	case MINUS_EXPRESSION:
+		operand = expr->u.minus_expression;
+		optimize_expression(inter, operand);
+		if (operand->type == INT_EXPRESSION) {
+			expr->type = INT_EXPRESSION;
+			expr->u.int_value = -operand->u.int_value;
+			inter->folded_expression_count++;
+		} else if (operand->type == DOUBLE_EXPRESSION) {
+			expr->type = DOUBLE_EXPRESSION;
+			expr->u.double_value = -operand->u.double_value;
+			inter->folded_expression_count++;
+		}
+		break;
+	case FUNCTION_CALL_EXPRESSION:
+		optimize_expression(inter, expr->u.function_call_expression.expr);
+		arg = expr->u.function_call_expression.argument;
+		for (i = 0; i < arg->count; i++)
+			optimize_expression(inter, arg->expression[i]);
+		if (inline_call(inter, expr))
+			optimize_expression(inter, expr);
+		break;
+	case ARRAY_EXPRESSION:
+		list = expr->u.array_expression;
+		for (i = 0; i < list->count; i++)
+			optimize_expression(inter, list->expression[i]);
+		break;
+	case INDEX_EXPRESSION:
+		optimize_expression(inter, expr->u.index_expression.array);
+		optimize_expression(inter, expr->u.index_expression.index);
+		break;
+	case POST_INCREMENT_EXPRESSION:	/* FALLTHRU */
+	case PREV_INCREMENT_EXPRESSION:	/* FALLTHRU */
+	case POST_DECREMENT_EXPRESSION:	/* FALLTHRU */
+	case PREV_DECREMENT_EXPRESSION:
+		optimize_expression(inter, expr->u.inc_dec.operand);
+		break;
+	case MEMBER_EXPRESSION:
+		optimize_expression(inter, expr->u.member_expression.expression);
+		break;
+	case CLOSURE_DEFINITION:
+		optimize_function(inter, expr->u.closure_definition.function);
+		break;
+	case EXPRESSION_TYPE_COUNT_PLUS_1:	/* FALLTHRU */
+	default:
+		DBG_panic(("bad case...%d", expr->type));
+	}
+}
+
+/* the statements optimized away are packed out of the list */
+static void
+optimize_statement_list(CRB_Interpreter *inter, StatementList *list)
+{
+	Statement *st;
+	int i;
+	int count = 0;
+
+	if (list == NULL)
+		return;
+
+	for (i = 0; i < list->count; i++) {
+		st = optimize_statement(inter, list->statement[i]);
+		if (st != NULL)
+			list->statement[count++] = st;
+	}
+	list->count = count;
+}
+
+/* a statement slot that must hold something, like the body of a while */
+static Statement *
+optimize_sub_statement(CRB_Interpreter *inter, Statement *statement)
+{
+	Statement *st;
+
+	st = optimize_statement(inter, statement);
+	if (st == NULL) {
+		st = crb_create_block_statement(crb_create_block(NULL));
+		st->location = statement->location;
+	}
+	return st;
+}
+
+/*
+ * Drop branches whose condition is the literal false, and everything
+ * after a branch whose condition is the literal true.
+ */
+static Statement *
+optimize_if_statement(CRB_Interpreter *inter, Statement *statement)
+{
+	IfStatement *if_s = &statement->u.if_s;
+	ElsifList *list = if_s->elsif_list;
+	Elsif *elsif;
+	int i;
+	int count = 0;
+
+	optimize_expression(inter, if_s->condition);
+	if_s->then_statement = optimize_sub_statement(inter,
+											if_s->then_statement);
+	for (i = 0; list && i < list->count; i++) {
+		elsif = &list->elsif[i];
+		optimize_expression(inter, elsif->condition);
+		elsif->statement = optimize_sub_statement(inter, elsif->statement);
+	}
+	if (if_s->else_statement)
+		if_s->else_statement = optimize_sub_statement(inter,
+											if_s->else_statement);
+
+	for (i = 0; list && i < list->count; i++) {
+		elsif = &list->elsif[i];
+		if (is_boolean_literal(elsif->condition, CRB_FALSE)) {
+			inter->removed_statement_count++;
+		} else if (is_boolean_literal(elsif->condition, CRB_TRUE)) {
+			if (if_s->else_statement)
+				inter->removed_statement_count++;
+			if_s->else_statement = elsif->statement;
+			break;
+		} else {
+			list->elsif[count++] = *elsif;
+		}
+	}
+	if (list)
+		list->count = count;
+
+	/* a false condition hands the if over to the first elsif */
+	for (i = 0; is_boolean_literal(if_s->condition, CRB_FALSE); i++) {
+		inter->removed_statement_count++;
+		if (list == NULL || i == list->count)
+			return if_s->else_statement;
+		if_s->condition = list->elsif[i].condition;
+		if_s->then_statement = list->elsif[i].statement;
+	}
+	if (i > 0) {
+		list->count -= i;
+		memmove(list->elsif, list->elsif + i, sizeof(Elsif) * list->count);
+	}
+	if (list && list->count == 0)
+		if_s->elsif_list = NULL;
+
+	if (is_boolean_literal(if_s->condition, CRB_TRUE)) {
+		if (if_s->elsif_list || if_s->else_statement)
+			inter->removed_statement_count++;
+		return if_s->then_statement;
+	}
+
+	return statement;
+}
+
+static Statement *
+optimize_for_statement(CRB_Interpreter *inter, Statement *statement)
+{
+	ForStatement *for_s = &statement->u.for_s;
+	Statement *st;
+
+	optimize_expression(inter, for_s->init);
+	optimize_expression(inter, for_s->condition);
+	optimize_expression(inter, for_s->post);
+	for_s->statement = optimize_sub_statement(inter, for_s->statement);
+
+	if (for_s->condition == NULL
+		|| !is_boolean_literal(for_s->condition, CRB_FALSE))
+		return statement;
+
+	/* only the initializer is ever run */
+	inter->removed_statement_count++;
+	if (for_s->init == NULL)
+		return NULL;
+	st = crb_create_expression_statement(for_s->init);
+	st->location = statement->location;
+	return st;
+}
+
+static Statement *
+optimize_statement(CRB_Interpreter *inter, Statement *statement)
+{
+	switch (statement->type) {
+	case EXPRESSION_STATEMENT:
+		optimize_expression(inter, statement->u.expression_s);
+		break;
+	case GLOBAL_STATEMENT:
+		break;
+	case IF_STATEMENT:
+		return optimize_if_statement(inter, statement);
+	case WHILE_STATEMENT:
+		optimize_expression(inter, statement->u.while_s.condition);
+		statement->u.while_s.statement = optimize_sub_statement(inter,
+									statement->u.while_s.statement);
+		if (is_boolean_literal(statement->u.while_s.condition, CRB_FALSE)) {
+			inter->removed_statement_count++;
+			return NULL;
+		}
+		break;
+	case FOR_STATEMENT:
+		return optimize_for_statement(inter, statement);
+	case RETURN_STATEMENT:
+		optimize_expression(inter, statement->u.return_s.return_value);
+		break;
+	case BREAK_STATEMENT:		/* FALLTHRU */
+	case CONTINUE_STATEMENT:
+		break;
+	case BLOCK_STATEMENT:
+		optimize_statement_list(inter,
+						statement->u.block_s.block->statement_list);
+		break;
+	case TRY_STATEMENT:
+		statement->u.try_s.run_st = optimize_sub_statement(inter,
+										statement->u.try_s.run_st);
+		if (statement->u.try_s.catch_st)
+			statement->u.try_s.catch_st = optimize_sub_statement(inter,
+										statement->u.try_s.catch_st);
+		if (statement->u.try_s.final_st)
+			statement->u.try_s.final_st = optimize_sub_statement(inter,
+										statement->u.try_s.final_st);
+		break;
+	case THROW_STATEMENT:
+		optimize_expression(inter, statement->u.throw_s.throw_expr);
+		break;
+	case FOREACH_STATEMENT:
+		optimize_expression(inter, statement->u.foreach_s.array_expr);
+		statement->u.foreach_s.sub_st = optimize_sub_statement(inter,
+										statement->u.foreach_s.sub_st);
+		break;
+	case STATEMENT_TYPE_COUNT_PLUS_1:	/* FALLTHRU */
+	default:
+		DBG_panic(("bad case...%d", statement->type));
+	}
+
+	return statement;
+}
+
+static void
+optimize_function(CRB_Interpreter *inter, FunctionDefinition *func)
+{
+	if (func->type != CROWBAR_FUNCTION_DEFINITION)
+		return;
+
+	optimize_statement_list(inter,
+						func->u.crowbar_f.block->statement_list);
+}
+
+/*
+ * Optimize every function and the top level statements.  Running it again
+ * on an optimized tree changes nothing, so it is safe after each compile.
+ */
+void
+crb_optimize(CRB_Interpreter *inter)
+{
+	FunctionDefinition *func;
+
+	for (func = inter->function_list; func; func = func->next)
+		optimize_function(inter, func);
+
+	optimize_statement_list(inter, inter->statement_list);
+
+	inter->tree_optimized = CRB_TRUE;
+}
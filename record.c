@@ -0,0 +1,81 @@
+#include <string.h>
+#include "MEM.h"
+#include "DBG.h"
+#include "crowbar.h"
+
+/*
+ * Records declared by "record Point { x, y }".  Point(1, 2) makes one,
+ * its fields are a single block of values in the order they are
+ * declared.  The member expression p.x remembers the record type it
+ * saw last and the offset of x in it, so a field is looked up by name
+ * only when another record type comes by.
+ */
+
+void
+crb_construct_record(CRB_Interpreter *inter, Expression *expr,
+					 FunctionDefinition *func, int arg_count)
+{
+	CRB_Value record_value;
+	CRB_Value *args;
+	int i;
+
+	if (arg_count < func->u.record_f.field_count) {
+		crb_runtime_error(crb_node_filename(inter, expr),
+						  crb_node_line_number(inter, expr),
+						  ARGUMENT_TOO_FEW_ERR, MESSAGE_ARGUMENT_END);
+	} else if (arg_count > func->u.record_f.field_count) {
+		crb_runtime_error(crb_node_filename(inter, expr),
+						  crb_node_line_number(inter, expr),
+						  ARGUMENT_TOO_MANY_ERR, MESSAGE_ARGUMENT_END);
+	}
+
+	// the arguments stay on the stack until the record holds them
+	record_value.type = CRB_RECORD_VALUE;
+	record_value.u.object_value = crb_create_record(inter, func);
+	if (arg_count > 0) {
+		args = crb_stack_peek_value(inter, arg_count - 1);
+		for (i = 0; i < arg_count; i++)
+			record_value.u.object_value->u.record.field[i] = args[i];
+	}
+	crb_stack_shrink_size(inter, arg_count);
+	crb_stack_push_value(inter, &record_value);
+}
+
+/* the field of the record obj named by the member expression expr */
+CRB_Value *
+crb_record_field(CRB_Interpreter *inter, CRB_Object *obj, Expression *expr)
+{
+	MemberExpression *member = &expr->u.member_expression;
+	FunctionDefinition *definition = obj->u.record.definition;
+	int i;
+
+	if (member->cached_record != definition) {
+		for (i = 0; i < definition->u.record_f.field_count; i++) {
+			if (!strcmp(definition->u.record_f.field[i],
+						member->member_name))
+				break;
+		}
+		if (i == definition->u.record_f.field_count) {
+			crb_runtime_error(crb_node_filename(inter, expr),
+							  crb_node_line_number(inter, expr),
+							  NO_SUCH_FIELD_ERR,
+							  STRING_MESSAGE_ARGUMENT, "name",
+							  definition->name,
+							  STRING_MESSAGE_ARGUMENT, "member_name",
+							  member->member_name,
+							  MESSAGE_ARGUMENT_END);
+		}
+		member->cached_record = definition;
+		member->cached_field = i;
+	}
+
+	return &obj->u.record.field[member->cached_field];
+}
+
+void
+crb_dispose_record(CRB_Interpreter *inter, CRB_Object *obj)
+{
+	MEM_free(obj->u.record.field);
+	inter->heap.current_heap_size -= sizeof(CRB_Value)
+		* obj->u.record.definition->u.record_f.field_count;
+}
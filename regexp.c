@@ -515,7 +515,7 @@ static void nv_search_proc(CRB_Interpreter *inter,
 	args = crb_stack_peek_value(inter, arg_count-1);
 
 	if (args[0].type != CRB_NATIVE_POINTER_VALUE ||
-			args[0].u.native_pointer.info != crb_get_regexp_info()) {
+			CRB_native_pointer_info(&args[0]) != crb_get_regexp_info()) {
 		crb_runtime_error(filename, line_number, 
 							ARGUMENT_TYPE_MISMATCH_ERR, 
 							STRING_MESSAGE_ARGUMENT,
@@ -541,7 +541,7 @@ static void nv_search_proc(CRB_Interpreter *inter,
 		region = args[2].u.object_value;
 	}
 
-	CRB_Regexp *crb_reg = args[0].u.native_pointer.pointer;
+	CRB_Regexp *crb_reg = CRB_native_pointer(&args[0]);
 	CRB_Value result;
 
 	result.type = CRB_BOOLEAN_VALUE;
@@ -575,7 +575,7 @@ static void nv_match_proc(CRB_Interpreter *inter,
 	args = crb_stack_peek_value(inter, arg_count-1);
 
 	if (args[0].type != CRB_NATIVE_POINTER_VALUE ||
-			args[0].u.native_pointer.info != crb_get_regexp_info()) {
+			CRB_native_pointer_info(&args[0]) != crb_get_regexp_info()) {
 		crb_runtime_error(filename, line_number, 
 							ARGUMENT_TYPE_MISMATCH_ERR, 
 							STRING_MESSAGE_ARGUMENT,
@@ -601,7 +601,7 @@ static void nv_match_proc(CRB_Interpreter *inter,
 		region = args[2].u.object_value;
 	}
 
-	CRB_Regexp *crb_reg = args[0].u.native_pointer.pointer;
+	CRB_Regexp *crb_reg = CRB_native_pointer(&args[0]);
 	CRB_Value result;
 
 	result.type = CRB_BOOLEAN_VALUE;
@@ -632,7 +632,7 @@ static void nv_replace_proc(CRB_Interpreter *inter,
 	CRB_Value *args = crb_stack_peek_value(inter, arg_count-1);
 
 	if (args[0].type != CRB_NATIVE_POINTER_VALUE 
-			|| args[0].u.native_pointer.info != crb_get_regexp_info()
+			|| CRB_native_pointer_info(&args[0]) != crb_get_regexp_info()
 			|| args[1].type != CRB_STRING_VALUE
 			|| args[2].type != CRB_STRING_VALUE) {
 			
@@ -646,7 +646,7 @@ static void nv_replace_proc(CRB_Interpreter *inter,
 	CRB_Regexp *crb_reg;
 	CRB_Value result;
 
-	crb_reg = args[0].u.native_pointer.pointer;
+	crb_reg = CRB_native_pointer(&args[0]);
 	
 	result.type = CRB_STRING_VALUE;
 	result.u.object_value = replace_crb_if(inter, env, crb_reg,
@@ -675,7 +675,7 @@ static void nv_replace_all_proc(CRB_Interpreter *inter,
 	CRB_Value *args = crb_stack_peek_value(inter, arg_count-1);
 
 	if (args[0].type != CRB_NATIVE_POINTER_VALUE 
-			|| args[0].u.native_pointer.info != crb_get_regexp_info()
+			|| CRB_native_pointer_info(&args[0]) != crb_get_regexp_info()
 			|| args[1].type != CRB_STRING_VALUE
 			|| args[2].type != CRB_STRING_VALUE) {
 			
@@ -689,7 +689,7 @@ static void nv_replace_all_proc(CRB_Interpreter *inter,
 	CRB_Regexp *crb_reg;
 	CRB_Value result;
 
-	crb_reg = args[0].u.native_pointer.pointer;
+	crb_reg = CRB_native_pointer(&args[0]);
 	
 	result.type = CRB_STRING_VALUE;
 	result.u.object_value = replace_crb_if(inter, env, crb_reg,
@@ -718,7 +718,7 @@ static void nv_split_proc(CRB_Interpreter *inter,
 	CRB_Value *args = crb_stack_peek_value(inter, 1);
 
 	if (args[0].type != CRB_NATIVE_POINTER_VALUE
-			|| args[0].u.native_pointer.info != crb_get_regexp_info()
+			|| CRB_native_pointer_info(&args[0]) != crb_get_regexp_info()
 			|| args[1].type != CRB_STRING_VALUE) {
 		crb_runtime_error(filename, line_number, 
 							ARGUMENT_TYPE_MISMATCH_ERR, 
@@ -730,7 +730,7 @@ static void nv_split_proc(CRB_Interpreter *inter,
 	CRB_Regexp *crb_reg;
 	CRB_Value result;
 
-	crb_reg = args[0].u.native_pointer.pointer;
+	crb_reg = CRB_native_pointer(&args[0]);
 
 	result.type = CRB_ARRAY_VALUE;
 	result.u.object_value = split_crb_if(inter, env,
@@ -0,0 +1,379 @@
+#include <string.h>
+#include "MEM.h"
+#include "DBG.h"
+#include "crowbar.h"
+
+/*
+ * array.sort() and array.sort(compare).  Packed int and double arrays
+ * are sorted in place by an LSD radix sort.  Anything else is a merge
+ * sort of a permutation of the elements, comparing strings, numbers or,
+ * with a comparator, by calling it: compare(a, b) returns a negative
+ * number, zero or a positive number like strcmp().  Every sort is
+ * stable.
+ *
+ * A comparator is user code, it may allocate, throw or change the
+ * array.  sort() runs as a native with the collector off, so it is
+ * turned on around each call of the comparator.  The elements being
+ * sorted are kept on the value stack, where they stay GC roots whatever
+ * it does, and the array is rewritten from them at the end.  The stack
+ * may move while the comparator runs, so the elements are reached by
+ * their index from the base of the run.  Rewriting would lose what the
+ * comparator stored in the array, so that is an error.
+ */
+
+#define SORT_INSERTION_SIZE	(16)
+
+typedef unsigned long long SortKey;
+
+#define SORT_KEY_SIGN	(1ULL << 63)
+
+typedef struct SortContext_tag SortContext;
+
+typedef int SortCompare(SortContext *ctx, int a, int b);
+
+struct SortContext_tag {
+	CRB_Interpreter	*inter;
+	int				base;		/* stack index of element 0 */
+	SortCompare		*compare;
+	CRB_Value		comparator;
+	Expression		call_expr;
+	char			*filename;
+	int				line_number;
+};
+
+#define SORT_VALUE(ctx, i) \
+	(&(ctx)->inter->stack.stack[(ctx)->base + (i)])
+
+static void
+radix_sort(SortKey *key, int n)
+{
+	int count[sizeof(SortKey)][256];
+	SortKey *tmp;
+	SortKey *src;
+	SortKey *dst;
+	SortKey *swap;
+	int digit;
+	int shift;
+	int pos;
+	int c;
+	int i;
+
+	memset(count, 0, sizeof(count));
+	for (i = 0; i < n; i++) {
+		for (digit = 0; digit < (int)sizeof(SortKey); digit++)
+			count[digit][(key[i] >> (digit * 8)) & 0xff]++;
+	}
+
+	tmp = MEM_malloc(sizeof(SortKey) * n);
+	src = key;
+	dst = tmp;
+	for (digit = 0; digit < (int)sizeof(SortKey); digit++) {
+		shift = digit * 8;
+		// every key has the same digit here
+		if (count[digit][(src[0] >> shift) & 0xff] == n)
+			continue;
+
+		for (pos = 0, i = 0; i < 256; i++) {
+			c = count[digit][i];
+			count[digit][i] = pos;
+			pos += c;
+		}
+		for (i = 0; i < n; i++)
+			dst[count[digit][(src[i] >> shift) & 0xff]++] = src[i];
+		swap = src;
+		src = dst;
+		dst = swap;
+	}
+	if (src != key)
+		memcpy(key, src, sizeof(SortKey) * n);
+	MEM_free(tmp);
+}
+
+static void
+sort_int_array(CRB_Array *array)
+{
+	SortKey *key;
+	int i;
+
+	key = MEM_malloc(sizeof(SortKey) * array->length);
+	for (i = 0; i < array->length; i++)
+		key[i] = (unsigned int)array->u.int_value[i] ^ 0x80000000U;
+	radix_sort(key, array->length);
+	for (i = 0; i < array->length; i++)
+		array->u.int_value[i] = (int)((unsigned int)key[i] ^ 0x80000000U);
+	MEM_free(key);
+}
+
+/* negative doubles have their bits flipped, so the keys sort as numbers */
+static void
+sort_double_array(CRB_Array *array)
+{
+	SortKey *key;
+	SortKey bits;
+	int i;
+
+	key = MEM_malloc(sizeof(SortKey) * array->length);
+	for (i = 0; i < array->length; i++) {
+		memcpy(&bits, &array->u.double_value[i], sizeof(SortKey));
+		key[i] = (bits & SORT_KEY_SIGN) ? ~bits : (bits | SORT_KEY_SIGN);
+	}
+	radix_sort(key, array->length);
+	for (i = 0; i < array->length; i++) {
+		bits = (key[i] & SORT_KEY_SIGN) ? (key[i] ^ SORT_KEY_SIGN) : ~key[i];
+		memcpy(&array->u.double_value[i], &bits, sizeof(SortKey));
+	}
+	MEM_free(key);
+}
+
+static int
+compare_string(SortContext *ctx, int a, int b)
+{
+	return CRB_wcscmp(SORT_VALUE(ctx, a)->u.object_value->u.string.string,
+					  SORT_VALUE(ctx, b)->u.object_value->u.string.string);
+}
+
+static int
+compare_number(SortContext *ctx, int a, int b)
+{
+	CRB_Value *left = SORT_VALUE(ctx, a);
+	CRB_Value *right = SORT_VALUE(ctx, b);
+	double left_d;
+	double right_d;
+
+	if (left->type == CRB_INT_VALUE && right->type == CRB_INT_VALUE) {
+		return (left->u.int_value > right->u.int_value)
+			- (left->u.int_value < right->u.int_value);
+	}
+	left_d = (left->type == CRB_INT_VALUE)
+		? left->u.int_value : left->u.double_value;
+	right_d = (right->type == CRB_INT_VALUE)
+		? right->u.int_value : right->u.double_value;
+
+	return (left_d > right_d) - (left_d < right_d);
+}
+
+static int
+compare_call(SortContext *ctx, int a, int b)
+{
+	CRB_Interpreter *inter = ctx->inter;
+	CRB_Value left = *SORT_VALUE(ctx, a);
+	CRB_Value right = *SORT_VALUE(ctx, b);
+	CRB_Value result;
+
+	crb_stack_push_value(inter, &ctx->comparator);
+	crb_stack_push_value(inter, &left);
+	crb_stack_push_value(inter, &right);
+	crb_gc_enable(inter);
+	crb_call_stacked_function(inter, &ctx->call_expr, 2);
+	crb_gc_disable(inter);
+	result = crb_stack_pop_value(inter);
+
+	if (result.type == CRB_INT_VALUE)
+		return (result.u.int_value > 0) - (result.u.int_value < 0);
+	if (result.type == CRB_DOUBLE_VALUE) {
+		return (result.u.double_value > 0.0)
+			- (result.u.double_value < 0.0);
+	}
+	crb_runtime_error(ctx->filename, ctx->line_number,
+						ARGUMENT_TYPE_MISMATCH_ERR,
+						STRING_MESSAGE_ARGUMENT, "func_name",
+						"array.sort", MESSAGE_ARGUMENT_END);
+	return 0;
+}
+
+static void
+insertion_sort(SortContext *ctx, int *perm, int n)
+{
+	int x;
+	int i;
+	int j;
+
+	for (i = 1; i < n; i++) {
+		x = perm[i];
+		for (j = i; j > 0 && ctx->compare(ctx, x, perm[j - 1]) < 0; j--)
+			perm[j] = perm[j - 1];
+		perm[j] = x;
+	}
+}
+
+/* tmp holds n/2 indexes, the left half is merged from there */
+static void
+merge_sort(SortContext *ctx, int *perm, int *tmp, int n)
+{
+	int half;
+	int i;
+	int j;
+	int k;
+
+	if (n <= SORT_INSERTION_SIZE) {
+		insertion_sort(ctx, perm, n);
+		return;
+	}
+	half = n / 2;
+	merge_sort(ctx, perm, tmp, half);
+	merge_sort(ctx, perm + half, tmp, n - half);
+	if (ctx->compare(ctx, perm[half - 1], perm[half]) <= 0)
+		return;
+
+	memcpy(tmp, perm, sizeof(int) * half);
+	for (i = 0, j = half, k = 0; i < half && j < n; k++) {
+		if (ctx->compare(ctx, perm[j], tmp[i]) < 0)
+			perm[k] = perm[j++];
+		else
+			perm[k] = tmp[i++];
+	}
+	while (i < half)
+		perm[k++] = tmp[i++];
+}
+
+/* the same value, not only an equal one */
+static CRB_Boolean
+same_value(CRB_Value *left, CRB_Value *right)
+{
+	if (left->type != right->type)
+		return CRB_FALSE;
+
+	switch (left->type) {
+	case CRB_NULL_VALUE:
+		return CRB_TRUE;
+	case CRB_BOOLEAN_VALUE:
+		return left->u.boolean_value == right->u.boolean_value;
+	case CRB_INT_VALUE:
+		return left->u.int_value == right->u.int_value;
+	case CRB_DOUBLE_VALUE:
+		return !memcmp(&left->u.double_value, &right->u.double_value,
+					   sizeof(double));
+	default:
+		return left->index == right->index
+			&& left->u.pointer_value == right->u.pointer_value;
+	}
+}
+
+/* did the comparator change obj, the elements on the stack are as it was */
+static void
+check_unchanged(SortContext *ctx, CRB_Object *obj, int n)
+{
+	CRB_Value value;
+	int i;
+
+	if (crb_array_size(ctx->inter, obj) == n) {
+		for (i = 0; i < n; i++) {
+			crb_array_get(obj, i, &value);
+			if (!same_value(&value, SORT_VALUE(ctx, i)))
+				break;
+		}
+		if (i == n)
+			return;
+	}
+	crb_runtime_error(ctx->filename, ctx->line_number,
+					  ARRAY_CHANGED_IN_SORT_ERR, MESSAGE_ARGUMENT_END);
+}
+
+/* what sort() without a comparator compares the elements by */
+static SortCompare *
+default_compare(CRB_Object *obj, char *filename, int line_number)
+{
+	CRB_Value value;
+	CRB_Boolean all_string = CRB_TRUE;
+	CRB_Boolean all_number = CRB_TRUE;
+	int i;
+
+	for (i = 0; i < obj->u.array.length; i++) {
+		crb_array_get(obj, i, &value);
+		if (value.type != CRB_STRING_VALUE)
+			all_string = CRB_FALSE;
+		if (value.type != CRB_INT_VALUE && value.type != CRB_DOUBLE_VALUE)
+			all_number = CRB_FALSE;
+	}
+	if (all_string)
+		return compare_string;
+	if (all_number)
+		return compare_number;
+
+	crb_runtime_error(filename, line_number, ARGUMENT_TYPE_MISMATCH_ERR,
+						STRING_MESSAGE_ARGUMENT, "func_name",
+						"array.sort", MESSAGE_ARGUMENT_END);
+	return NULL;
+}
+
+void
+crb_array_sort(CRB_Interpreter *inter, CRB_Object *obj,
+			   CRB_Value *comparator, char *filename, int line_number)
+{
+	CRB_Array *array = &obj->u.array;
+	ArrayKind kind = array->kind;
+	RecoverEnvironment recover;
+	SortContext ctx;
+	Expression name_expr;
+	CRB_Value value;
+	int *perm;
+	int *tmp;
+	int n = array->length;
+	int i;
+
+	if (n < 2)
+		return;
+	if (comparator == NULL && kind == INT_ARRAY) {
+		sort_int_array(array);
+		return;
+	}
+	if (comparator == NULL && kind == DOUBLE_ARRAY) {
+		sort_double_array(array);
+		return;
+	}
+
+	ctx.inter = inter;
+	ctx.filename = filename;
+	ctx.line_number = line_number;
+	if (comparator == NULL) {
+		ctx.compare = default_compare(obj, filename, line_number);
+	} else {
+		if (comparator->type != CRB_CLOSURE_VALUE
+				&& comparator->type != CRB_FAKE_METHOD_VALUE) {
+			crb_runtime_error(filename, line_number,
+								ARGUMENT_TYPE_MISMATCH_ERR,
+								STRING_MESSAGE_ARGUMENT, "func_name",
+								"array.sort", MESSAGE_ARGUMENT_END);
+		}
+		ctx.compare = compare_call;
+		ctx.comparator = *comparator;
+		// one call expression serves every comparison
+		crb_init_identifier_expression(&name_expr, "compare",
+										filename, line_number);
+		crb_init_function_call_expression(&ctx.call_expr, &name_expr, NULL,
+										filename, line_number);
+	}
+
+	for (i = 0; i < n; i++) {
+		crb_array_get(obj, i, &value);
+		crb_stack_push_value(inter, &value);
+	}
+	ctx.base = inter->stack.stack_pointer - n;
+
+	perm = MEM_malloc(sizeof(int) * n);
+	tmp = MEM_malloc(sizeof(int) * (n / 2 + 1));
+	for (i = 0; i < n; i++)
+		perm[i] = i;
+
+	// this also saves the collector being off
+	crb_save_environment(inter, &recover);
+	if (setjmp(inter->exception_jumper) != 0) {
+		// the comparator threw, pass it on
+		crb_recover_environment(inter, &recover);
+		MEM_free(perm);
+		MEM_free(tmp);
+		longjmp(inter->exception_jumper, 1);
+	}
+	merge_sort(&ctx, perm, tmp, n);
+	crb_recover_environment(inter, &recover);
+	if (comparator != NULL)
+		check_unchanged(&ctx, obj, n);
+
+	crb_array_reshape(inter, obj, kind, n);
+	for (i = 0; i < n; i++)
+		crb_array_set(inter, obj, i, SORT_VALUE(&ctx, perm[i]));
+
+	MEM_free(perm);
+	MEM_free(tmp);
+	crb_stack_shrink_size(inter, n);
+}
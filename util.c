@@ -36,20 +36,52 @@ crb_search_native_function(CRB_Interpreter *inter, char *name)
 }
 */
 
+static unsigned int
+hash_function_name(char *name)
+{
+	unsigned int hash = 0;
+
+	while (*name)
+		hash = hash * 31 + (unsigned char)*name++;
+
+	return hash % FUNCTION_HASH_SIZE;
+}
+
 FunctionDefinition *
-crb_search_function(char *name)
+crb_search_function_in(CRB_Interpreter *inter, char *name)
 {
     FunctionDefinition *pos;
-    CRB_Interpreter *inter;
 
-    inter = crb_get_current_interpreter();
-    for (pos = inter->function_list; pos; pos = pos->next) {
+    for (pos = inter->function_hash[hash_function_name(name)];
+			pos; pos = pos->hash_next) {
         if (!strcmp(pos->name, name))
             break;
     }
     return pos;
 }
 
+FunctionDefinition *
+crb_search_function(char *name)
+{
+    return crb_search_function_in(crb_get_current_interpreter(), name);
+}
+
+void
+crb_add_function(CRB_Interpreter *inter, FunctionDefinition *func)
+{
+	unsigned int hash = hash_function_name(func->name);
+
+	func->next = inter->function_list;
+	inter->function_list = func;
+
+	/* newer definitions shadow older ones with the same name */
+	func->hash_next = inter->function_hash[hash];
+	inter->function_hash[hash] = func;
+
+	/* drop every call-site cache */
+	inter->function_generation++;
+}
+
 void *
 crb_malloc(size_t size)
 {
@@ -62,6 +94,17 @@ crb_malloc(size_t size)
     return p;
 }
 
+/* a node of the syntax tree */
+void *
+crb_tree_malloc(size_t size)
+{
+    CRB_Interpreter *inter;
+
+    inter = crb_get_current_interpreter();
+
+    return MEM_storage_malloc(inter->tree_storage, size);
+}
+
 void *
 crb_execute_malloc(CRB_Interpreter *inter, size_t size)
 {
@@ -96,19 +139,19 @@ Variable* crb_search_local_variable(CRB_Interpreter *inter,
 					CRB_LocalEnvironment *env,
 					char *identifier, CRB_Boolean can_create)
 {
-	CRB_Object *scope = env->environ_scope;
-	CRB_Boolean is_closure = scope->u.scope_chain.is_closure;
+	CRB_Object *scope;
+	CRB_Boolean is_closure = env->is_closure;
 	Variable *variable = NULL;
 
 	//printf("before crb_search_local_variable(%s)\n", identifier);
 
-	variable = crb_search_scope_variable(inter, scope, identifier,
-											CRB_FALSE);
+	variable = crb_search_env_variable(inter, env, identifier, CRB_FALSE);
 	if (!variable && is_closure) {
-		while (1) {
-			CRB_Object *prev_scope = scope->u.scope_chain.prev_scope;
-			scope = prev_scope;
-			if (scope == NULL) break;
+		if (env->environ_scope)
+			scope = env->environ_scope->u.scope_chain.prev_scope;
+		else
+			scope = env->outer_scope;
+		for (; scope != NULL; scope = scope->u.scope_chain.prev_scope) {
 			variable = crb_search_scope_variable(inter, scope, identifier,
 													CRB_FALSE);
 			if (variable) break;
@@ -123,9 +166,8 @@ Variable* crb_search_local_variable(CRB_Interpreter *inter,
 	}
 
 	if (!variable && can_create) {
-		scope = inter->top_env->environ_scope;
-		variable = crb_search_scope_variable(inter, scope, identifier,
-													CRB_TRUE);
+		variable = crb_search_env_variable(inter, inter->top_env,
+											identifier, CRB_TRUE);
 	}
 	
 	//printf("after crb_search_local_variable(%s) = 0x%x\n", identifier,
@@ -282,8 +324,8 @@ CRB_CHAR* CRB_value_to_string(CRB_Value *value)
 					value->u.object_value->u.string.string);
 		break;
 	case CRB_NATIVE_POINTER_VALUE:
-		if (value->u.native_pointer.info == crb_get_regexp_info()) {
-			CRB_Regexp *regexp = value->u.native_pointer.pointer;
+		if (CRB_native_pointer_info(value) == crb_get_regexp_info()) {
+			CRB_Regexp *regexp = CRB_native_pointer(value);
 			sprintf(buf, "%%r%c", regexp->protect_char);
 			crb_vstr_append_string(&vstr, buf);
 			crb_vstr_append_wstring(&vstr, regexp->pattern);
@@ -292,8 +334,8 @@ CRB_CHAR* CRB_value_to_string(CRB_Value *value)
 		}
 		else {
 			sprintf(buf, "(%s:%p)",
-				value->u.native_pointer.info->name,
-				value->u.native_pointer.pointer);
+				CRB_native_pointer_info(value)->name,
+				CRB_native_pointer(value));
 			crb_vstr_append_string(&vstr, buf);
 		}
 		break;
@@ -302,12 +344,14 @@ CRB_CHAR* CRB_value_to_string(CRB_Value *value)
 		break;
 	case CRB_ARRAY_VALUE:
 		crb_vstr_append_string(&vstr, "(");
+		crb_array_sync(value->u.object_value);
 		for (i=0; i<value->u.object_value->u.array.length; i++) {
 			CRB_CHAR *new_str;
+			CRB_Value elem;
 			if (i>0)
 				crb_vstr_append_string(&vstr, ", ");
-			new_str = CRB_value_to_string(
-					&value->u.object_value->u.array.array[i]);
+			crb_array_get(value->u.object_value, i, &elem);
+			new_str = CRB_value_to_string(&elem);
 			crb_vstr_append_wstring(&vstr, new_str);
 			MEM_free(new_str);
 		}
@@ -330,6 +374,70 @@ CRB_CHAR* CRB_value_to_string(CRB_Value *value)
 			}
 			crb_vstr_append_string(&vstr, "}");
 
+			break;
+		}
+	case CRB_MAP_VALUE:
+		{
+			CRB_Object *map = value->u.object_value;
+			int pos;
+
+			crb_vstr_append_string(&vstr, "[");
+			for (pos = crb_map_next(map, 0); pos >= 0;
+					pos = crb_map_next(map, pos + 1)) {
+				CRB_CHAR *new_str;
+
+				new_str = CRB_value_to_string(&map->u.map.entry[pos].key);
+				crb_vstr_append_wstring(&vstr, new_str);
+				MEM_free(new_str);
+				crb_vstr_append_string(&vstr, " : ");
+				new_str = CRB_value_to_string(&map->u.map.entry[pos].value);
+				crb_vstr_append_wstring(&vstr, new_str);
+				MEM_free(new_str);
+				if (crb_map_next(map, pos + 1) >= 0)
+					crb_vstr_append_string(&vstr, ", ");
+			}
+			crb_vstr_append_string(&vstr, "]");
+			break;
+		}
+	case CRB_SET_VALUE:
+		{
+			CRB_Object *set = value->u.object_value;
+			int pos;
+
+			crb_vstr_append_string(&vstr, "{");
+			for (pos = crb_map_next(set, 0); pos >= 0;
+					pos = crb_map_next(set, pos + 1)) {
+				CRB_CHAR *new_str;
+
+				new_str = CRB_value_to_string(&set->u.map.entry[pos].key);
+				crb_vstr_append_wstring(&vstr, new_str);
+				MEM_free(new_str);
+				if (crb_map_next(set, pos + 1) >= 0)
+					crb_vstr_append_string(&vstr, ", ");
+			}
+			crb_vstr_append_string(&vstr, "}");
+			break;
+		}
+	case CRB_RECORD_VALUE:
+		{
+			CRB_Record *record = &value->u.object_value->u.record;
+			FunctionDefinition *definition = record->definition;
+			int i;
+
+			crb_vstr_append_string(&vstr, definition->name);
+			crb_vstr_append_string(&vstr, "(");
+			for (i = 0; i < definition->u.record_f.field_count; i++) {
+				CRB_CHAR *new_str;
+
+				crb_vstr_append_string(&vstr, definition->u.record_f.field[i]);
+				crb_vstr_append_string(&vstr, " : ");
+				new_str = CRB_value_to_string(&record->field[i]);
+				crb_vstr_append_wstring(&vstr, new_str);
+				MEM_free(new_str);
+				if (i + 1 < definition->u.record_f.field_count)
+					crb_vstr_append_string(&vstr, ", ");
+			}
+			crb_vstr_append_string(&vstr, ")");
 			break;
 		}
 	case CRB_SCOPE_CHAIN_VALUE:
@@ -367,6 +475,14 @@ CRB_ValueType crb_object_type_to_value_type(ObjectType type)
 		ret_type = CRB_ASSOC_VALUE; break;
 	case SCOPE_CHAIN_OBJECT:
 		ret_type = CRB_SCOPE_CHAIN_VALUE; break;
+	case CLOSURE_OBJECT:
+		ret_type = CRB_CLOSURE_VALUE; break;
+	case MAP_OBJECT:
+		ret_type = CRB_MAP_VALUE; break;
+	case SET_OBJECT:
+		ret_type = CRB_SET_VALUE; break;
+	case RECORD_OBJECT:
+		ret_type = CRB_RECORD_VALUE; break;
 	case OBJECT_TYPE_COUNT_PLUS_1:  // fall through
 	default:
 		DBG_panic(("unexpected object_type: %d\n", type));
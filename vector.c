@@ -0,0 +1,638 @@
+#include "MEM.h"
+#include "DBG.h"
+#include "crowbar.h"
+
+/*
+ * Kernels over the elements of packed arrays, for the numeric array
+ * methods in fake_method.c.  Every kernel has a portable version, on x86
+ * there are SSE2 and AVX2 versions too and the first call of
+ * crb_vector_kernels picks the widest set the CPU runs.  The vector
+ * versions add doubles up in several lanes, so sum() and dot() may round
+ * differently from adding the elements one by one.  Ints wrap around in
+ * every version.
+ */
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) \
+	&& !defined(CRB_NO_VECTOR)
+#define CRB_VECTOR_X86
+#include <immintrin.h>
+#endif
+
+static int
+int_sum(int *a, int n)
+{
+	unsigned int sum = 0;
+	int i;
+
+	for (i = 0; i < n; i++)
+		sum += a[i];
+
+	return (int)sum;
+}
+
+static int
+int_min(int *a, int n)
+{
+	int min = a[0];
+	int i;
+
+	for (i = 1; i < n; i++) {
+		if (a[i] < min)
+			min = a[i];
+	}
+
+	return min;
+}
+
+static int
+int_max(int *a, int n)
+{
+	int max = a[0];
+	int i;
+
+	for (i = 1; i < n; i++) {
+		if (a[i] > max)
+			max = a[i];
+	}
+
+	return max;
+}
+
+static int
+int_dot(int *a, int *b, int n)
+{
+	unsigned int sum = 0;
+	int i;
+
+	for (i = 0; i < n; i++)
+		sum += (unsigned int)a[i] * (unsigned int)b[i];
+
+	return (int)sum;
+}
+
+static void
+int_scale(int *a, int n, int k)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		a[i] = (int)((unsigned int)a[i] * (unsigned int)k);
+}
+
+static void
+int_add(int *a, int *b, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		a[i] = (int)((unsigned int)a[i] + (unsigned int)b[i]);
+}
+
+static void
+int_fill(int *a, int n, int v)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		a[i] = v;
+}
+
+static void
+int_range(int *a, int n, int start)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		a[i] = start + i;
+}
+
+static double
+double_sum(double *a, int n)
+{
+	double sum = 0.0;
+	int i;
+
+	for (i = 0; i < n; i++)
+		sum += a[i];
+
+	return sum;
+}
+
+static double
+double_min(double *a, int n)
+{
+	double min = a[0];
+	int i;
+
+	for (i = 1; i < n; i++) {
+		if (a[i] < min)
+			min = a[i];
+	}
+
+	return min;
+}
+
+static double
+double_max(double *a, int n)
+{
+	double max = a[0];
+	int i;
+
+	for (i = 1; i < n; i++) {
+		if (a[i] > max)
+			max = a[i];
+	}
+
+	return max;
+}
+
+static double
+double_dot(double *a, double *b, int n)
+{
+	double sum = 0.0;
+	int i;
+
+	for (i = 0; i < n; i++)
+		sum += a[i] * b[i];
+
+	return sum;
+}
+
+static void
+double_scale(double *a, int n, double k)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		a[i] *= k;
+}
+
+static void
+double_add(double *a, double *b, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		a[i] += b[i];
+}
+
+static void
+double_fill(double *a, int n, double v)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		a[i] = v;
+}
+
+static VectorKernels portable_kernels = {
+	int_sum, int_min, int_max, int_dot, int_scale, int_add,
+	int_fill, int_range,
+	double_sum, double_min, double_max, double_dot, double_scale,
+	double_add, double_fill
+};
+
+#ifdef CRB_VECTOR_X86
+
+/*
+ * SSE2 has no 32 bit multiply, int_dot and int_scale stay portable.  The
+ * loops do whole vectors and leave the rest to the portable kernel.
+ */
+#define SSE2	__attribute__((target("sse2")))
+
+SSE2 static int
+int_sum_sse2(int *a, int n)
+{
+	__m128i acc = _mm_setzero_si128();
+	int lane[4];
+	int i;
+
+	for (i = 0; i + 4 <= n; i += 4)
+		acc = _mm_add_epi32(acc, _mm_loadu_si128((__m128i*)&a[i]));
+	_mm_storeu_si128((__m128i*)lane, acc);
+
+	return (int)((unsigned int)int_sum(lane, 4)
+				 + (unsigned int)int_sum(&a[i], n - i));
+}
+
+SSE2 static int
+int_min_sse2(int *a, int n)
+{
+	__m128i min = _mm_set1_epi32(a[0]);
+	__m128i x;
+	__m128i gt;
+	int lane[5];
+	int i;
+
+	for (i = 0; i + 4 <= n; i += 4) {
+		x = _mm_loadu_si128((__m128i*)&a[i]);
+		gt = _mm_cmpgt_epi32(min, x);
+		min = _mm_or_si128(_mm_and_si128(gt, x), _mm_andnot_si128(gt, min));
+	}
+	_mm_storeu_si128((__m128i*)lane, min);
+	lane[4] = (i < n) ? int_min(&a[i], n - i) : lane[0];
+
+	return int_min(lane, 5);
+}
+
+SSE2 static int
+int_max_sse2(int *a, int n)
+{
+	__m128i max = _mm_set1_epi32(a[0]);
+	__m128i x;
+	__m128i gt;
+	int lane[5];
+	int i;
+
+	for (i = 0; i + 4 <= n; i += 4) {
+		x = _mm_loadu_si128((__m128i*)&a[i]);
+		gt = _mm_cmpgt_epi32(x, max);
+		max = _mm_or_si128(_mm_and_si128(gt, x), _mm_andnot_si128(gt, max));
+	}
+	_mm_storeu_si128((__m128i*)lane, max);
+	lane[4] = (i < n) ? int_max(&a[i], n - i) : lane[0];
+
+	return int_max(lane, 5);
+}
+
+SSE2 static void
+int_add_sse2(int *a, int *b, int n)
+{
+	__m128i x;
+	int i;
+
+	for (i = 0; i + 4 <= n; i += 4) {
+		x = _mm_add_epi32(_mm_loadu_si128((__m128i*)&a[i]),
+						  _mm_loadu_si128((__m128i*)&b[i]));
+		_mm_storeu_si128((__m128i*)&a[i], x);
+	}
+	int_add(&a[i], &b[i], n - i);
+}
+
+SSE2 static void
+int_fill_sse2(int *a, int n, int v)
+{
+	__m128i x = _mm_set1_epi32(v);
+	int i;
+
+	for (i = 0; i + 4 <= n; i += 4)
+		_mm_storeu_si128((__m128i*)&a[i], x);
+	int_fill(&a[i], n - i, v);
+}
+
+SSE2 static void
+int_range_sse2(int *a, int n, int start)
+{
+	__m128i x = _mm_setr_epi32(start, start + 1, start + 2, start + 3);
+	__m128i step = _mm_set1_epi32(4);
+	int i;
+
+	for (i = 0; i + 4 <= n; i += 4) {
+		_mm_storeu_si128((__m128i*)&a[i], x);
+		x = _mm_add_epi32(x, step);
+	}
+	int_range(&a[i], n - i, start + i);
+}
+
+SSE2 static double
+double_sum_sse2(double *a, int n)
+{
+	__m128d acc = _mm_setzero_pd();
+	double lane[2];
+	int i;
+
+	for (i = 0; i + 2 <= n; i += 2)
+		acc = _mm_add_pd(acc, _mm_loadu_pd(&a[i]));
+	_mm_storeu_pd(lane, acc);
+
+	return lane[0] + lane[1] + double_sum(&a[i], n - i);
+}
+
+SSE2 static double
+double_min_sse2(double *a, int n)
+{
+	__m128d min = _mm_set1_pd(a[0]);
+	double lane[3];
+	int i;
+
+	for (i = 0; i + 2 <= n; i += 2)
+		min = _mm_min_pd(_mm_loadu_pd(&a[i]), min);
+	_mm_storeu_pd(lane, min);
+	lane[2] = (i < n) ? a[i] : lane[0];
+
+	return double_min(lane, 3);
+}
+
+SSE2 static double
+double_max_sse2(double *a, int n)
+{
+	__m128d max = _mm_set1_pd(a[0]);
+	double lane[3];
+	int i;
+
+	for (i = 0; i + 2 <= n; i += 2)
+		max = _mm_max_pd(_mm_loadu_pd(&a[i]), max);
+	_mm_storeu_pd(lane, max);
+	lane[2] = (i < n) ? a[i] : lane[0];
+
+	return double_max(lane, 3);
+}
+
+SSE2 static double
+double_dot_sse2(double *a, double *b, int n)
+{
+	__m128d acc = _mm_setzero_pd();
+	double lane[2];
+	int i;
+
+	for (i = 0; i + 2 <= n; i += 2)
+		acc = _mm_add_pd(acc, _mm_mul_pd(_mm_loadu_pd(&a[i]),
+										 _mm_loadu_pd(&b[i])));
+	_mm_storeu_pd(lane, acc);
+
+	return lane[0] + lane[1] + double_dot(&a[i], &b[i], n - i);
+}
+
+SSE2 static void
+double_scale_sse2(double *a, int n, double k)
+{
+	__m128d factor = _mm_set1_pd(k);
+	int i;
+
+	for (i = 0; i + 2 <= n; i += 2)
+		_mm_storeu_pd(&a[i], _mm_mul_pd(_mm_loadu_pd(&a[i]), factor));
+	double_scale(&a[i], n - i, k);
+}
+
+SSE2 static void
+double_add_sse2(double *a, double *b, int n)
+{
+	int i;
+
+	for (i = 0; i + 2 <= n; i += 2)
+		_mm_storeu_pd(&a[i], _mm_add_pd(_mm_loadu_pd(&a[i]),
+										_mm_loadu_pd(&b[i])));
+	double_add(&a[i], &b[i], n - i);
+}
+
+SSE2 static void
+double_fill_sse2(double *a, int n, double v)
+{
+	__m128d x = _mm_set1_pd(v);
+	int i;
+
+	for (i = 0; i + 2 <= n; i += 2)
+		_mm_storeu_pd(&a[i], x);
+	double_fill(&a[i], n - i, v);
+}
+
+static VectorKernels sse2_kernels = {
+	int_sum_sse2, int_min_sse2, int_max_sse2, int_dot, int_scale,
+	int_add_sse2, int_fill_sse2, int_range_sse2,
+	double_sum_sse2, double_min_sse2, double_max_sse2, double_dot_sse2,
+	double_scale_sse2, double_add_sse2, double_fill_sse2
+};
+
+#define AVX2	__attribute__((target("avx2")))
+
+AVX2 static int
+int_sum_avx2(int *a, int n)
+{
+	__m256i acc = _mm256_setzero_si256();
+	int lane[8];
+	int i;
+
+	for (i = 0; i + 8 <= n; i += 8)
+		acc = _mm256_add_epi32(acc, _mm256_loadu_si256((__m256i*)&a[i]));
+	_mm256_storeu_si256((__m256i*)lane, acc);
+
+	return (int)((unsigned int)int_sum(lane, 8)
+				 + (unsigned int)int_sum(&a[i], n - i));
+}
+
+AVX2 static int
+int_min_avx2(int *a, int n)
+{
+	__m256i min = _mm256_set1_epi32(a[0]);
+	int lane[9];
+	int i;
+
+	for (i = 0; i + 8 <= n; i += 8)
+		min = _mm256_min_epi32(min, _mm256_loadu_si256((__m256i*)&a[i]));
+	_mm256_storeu_si256((__m256i*)lane, min);
+	lane[8] = (i < n) ? int_min(&a[i], n - i) : lane[0];
+
+	return int_min(lane, 9);
+}
+
+AVX2 static int
+int_max_avx2(int *a, int n)
+{
+	__m256i max = _mm256_set1_epi32(a[0]);
+	int lane[9];
+	int i;
+
+	for (i = 0; i + 8 <= n; i += 8)
+		max = _mm256_max_epi32(max, _mm256_loadu_si256((__m256i*)&a[i]));
+	_mm256_storeu_si256((__m256i*)lane, max);
+	lane[8] = (i < n) ? int_max(&a[i], n - i) : lane[0];
+
+	return int_max(lane, 9);
+}
+
+AVX2 static int
+int_dot_avx2(int *a, int *b, int n)
+{
+	__m256i acc = _mm256_setzero_si256();
+	int lane[8];
+	int i;
+
+	for (i = 0; i + 8 <= n; i += 8)
+		acc = _mm256_add_epi32(acc, _mm256_mullo_epi32(
+								_mm256_loadu_si256((__m256i*)&a[i]),
+								_mm256_loadu_si256((__m256i*)&b[i])));
+	_mm256_storeu_si256((__m256i*)lane, acc);
+
+	return (int)((unsigned int)int_sum(lane, 8)
+				 + (unsigned int)int_dot(&a[i], &b[i], n - i));
+}
+
+AVX2 static void
+int_scale_avx2(int *a, int n, int k)
+{
+	__m256i factor = _mm256_set1_epi32(k);
+	__m256i x;
+	int i;
+
+	for (i = 0; i + 8 <= n; i += 8) {
+		x = _mm256_mullo_epi32(_mm256_loadu_si256((__m256i*)&a[i]), factor);
+		_mm256_storeu_si256((__m256i*)&a[i], x);
+	}
+	int_scale(&a[i], n - i, k);
+}
+
+AVX2 static void
+int_add_avx2(int *a, int *b, int n)
+{
+	__m256i x;
+	int i;
+
+	for (i = 0; i + 8 <= n; i += 8) {
+		x = _mm256_add_epi32(_mm256_loadu_si256((__m256i*)&a[i]),
+							 _mm256_loadu_si256((__m256i*)&b[i]));
+		_mm256_storeu_si256((__m256i*)&a[i], x);
+	}
+	int_add(&a[i], &b[i], n - i);
+}
+
+AVX2 static void
+int_fill_avx2(int *a, int n, int v)
+{
+	__m256i x = _mm256_set1_epi32(v);
+	int i;
+
+	for (i = 0; i + 8 <= n; i += 8)
+		_mm256_storeu_si256((__m256i*)&a[i], x);
+	int_fill(&a[i], n - i, v);
+}
+
+AVX2 static void
+int_range_avx2(int *a, int n, int start)
+{
+	__m256i x = _mm256_add_epi32(_mm256_set1_epi32(start),
+								 _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+	__m256i step = _mm256_set1_epi32(8);
+	int i;
+
+	for (i = 0; i + 8 <= n; i += 8) {
+		_mm256_storeu_si256((__m256i*)&a[i], x);
+		x = _mm256_add_epi32(x, step);
+	}
+	int_range(&a[i], n - i, start + i);
+}
+
+AVX2 static double
+double_sum_avx2(double *a, int n)
+{
+	__m256d acc = _mm256_setzero_pd();
+	double lane[4];
+	int i;
+
+	for (i = 0; i + 4 <= n; i += 4)
+		acc = _mm256_add_pd(acc, _mm256_loadu_pd(&a[i]));
+	_mm256_storeu_pd(lane, acc);
+
+	return double_sum(lane, 4) + double_sum(&a[i], n - i);
+}
+
+AVX2 static double
+double_min_avx2(double *a, int n)
+{
+	__m256d min = _mm256_set1_pd(a[0]);
+	double lane[5];
+	int i;
+
+	for (i = 0; i + 4 <= n; i += 4)
+		min = _mm256_min_pd(_mm256_loadu_pd(&a[i]), min);
+	_mm256_storeu_pd(lane, min);
+	lane[4] = (i < n) ? double_min(&a[i], n - i) : lane[0];
+
+	return double_min(lane, 5);
+}
+
+AVX2 static double
+double_max_avx2(double *a, int n)
+{
+	__m256d max = _mm256_set1_pd(a[0]);
+	double lane[5];
+	int i;
+
+	for (i = 0; i + 4 <= n; i += 4)
+		max = _mm256_max_pd(_mm256_loadu_pd(&a[i]), max);
+	_mm256_storeu_pd(lane, max);
+	lane[4] = (i < n) ? double_max(&a[i], n - i) : lane[0];
+
+	return double_max(lane, 5);
+}
+
+AVX2 static double
+double_dot_avx2(double *a, double *b, int n)
+{
+	__m256d acc = _mm256_setzero_pd();
+	double lane[4];
+	int i;
+
+	for (i = 0; i + 4 <= n; i += 4)
+		acc = _mm256_add_pd(acc, _mm256_mul_pd(_mm256_loadu_pd(&a[i]),
+											   _mm256_loadu_pd(&b[i])));
+	_mm256_storeu_pd(lane, acc);
+
+	return double_sum(lane, 4) + double_dot(&a[i], &b[i], n - i);
+}
+
+AVX2 static void
+double_scale_avx2(double *a, int n, double k)
+{
+	__m256d factor = _mm256_set1_pd(k);
+	int i;
+
+	for (i = 0; i + 4 <= n; i += 4)
+		_mm256_storeu_pd(&a[i], _mm256_mul_pd(_mm256_loadu_pd(&a[i]),
+											  factor));
+	double_scale(&a[i], n - i, k);
+}
+
+AVX2 static void
+double_add_avx2(double *a, double *b, int n)
+{
+	int i;
+
+	for (i = 0; i + 4 <= n; i += 4)
+		_mm256_storeu_pd(&a[i], _mm256_add_pd(_mm256_loadu_pd(&a[i]),
+											  _mm256_loadu_pd(&b[i])));
+	double_add(&a[i], &b[i], n - i);
+}
+
+AVX2 static void
+double_fill_avx2(double *a, int n, double v)
+{
+	__m256d x = _mm256_set1_pd(v);
+	int i;
+
+	for (i = 0; i + 4 <= n; i += 4)
+		_mm256_storeu_pd(&a[i], x);
+	double_fill(&a[i], n - i, v);
+}
+
+static VectorKernels avx2_kernels = {
+	int_sum_avx2, int_min_avx2, int_max_avx2, int_dot_avx2, int_scale_avx2,
+	int_add_avx2, int_fill_avx2, int_range_avx2,
+	double_sum_avx2, double_min_avx2, double_max_avx2, double_dot_avx2,
+	double_scale_avx2, double_add_avx2, double_fill_avx2
+};
+
+#endif /* CRB_VECTOR_X86 */
+
+static VectorKernels *
+select_kernels(void)
+{
+#ifdef CRB_VECTOR_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return &avx2_kernels;
+	if (__builtin_cpu_supports("sse2"))
+		return &sse2_kernels;
+#endif
+	return &portable_kernels;
+}
+
+VectorKernels *
+crb_vector_kernels(void)
+{
+	static VectorKernels *kernels = NULL;
+
+	if (kernels == NULL)
+		kernels = select_kernels();
+
+	return kernels;
+}
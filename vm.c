@@ -0,0 +1,1620 @@
+#include <math.h>
+#include <string.h>
+#include "MEM.h"
+#include "DBG.h"
+#include "crowbar.h"
+
+/* the n-th value from the stack top, no checks */
+#define STACK_TOP(inter, n) \
+	(&(inter)->stack.stack[(inter)->stack.stack_pointer - 1 - (n)])
+
+static void
+push_boolean(CRB_Interpreter *inter, CRB_Boolean boolean_value)
+{
+	CRB_Value v;
+
+	v.type = CRB_BOOLEAN_VALUE;
+	v.u.boolean_value = boolean_value;
+	crb_stack_push_value(inter, &v);
+}
+
+static void
+push_int(CRB_Interpreter *inter, int int_value)
+{
+	CRB_Value v;
+
+	v.type = CRB_INT_VALUE;
+	v.u.int_value = int_value;
+	crb_stack_push_value(inter, &v);
+}
+
+static void
+push_variable(CRB_Interpreter *inter, CRB_LocalEnvironment *env,
+			  char *name, CodeLocation *location)
+{
+	Variable *variable;
+
+	variable = crb_search_local_variable(inter, env, name, CRB_FALSE);
+	if (variable == NULL) {
+		crb_runtime_error(location->filename, location->line_number,
+						VARIABLE_NOT_FOUND_ERR,
+						STRING_MESSAGE_ARGUMENT, "name", name,
+						MESSAGE_ARGUMENT_END);
+	}
+	crb_stack_push_value(inter, &variable->value);
+}
+
+/* the array of [array][index] at depth from the stack top */
+static CRB_Object *
+array_element(CRB_Interpreter *inter, int depth, int *index,
+			  CodeLocation *location)
+{
+	CRB_Value *array_val = STACK_TOP(inter, depth + 1);
+	CRB_Value *index_val = STACK_TOP(inter, depth);
+
+	if (array_val->type != CRB_ARRAY_VALUE)
+		crb_runtime_error(location->filename, location->line_number,
+				INDEX_OPERAND_NOT_ARRAY_ERR,
+				MESSAGE_ARGUMENT_END);
+	if (index_val->type != CRB_INT_VALUE)
+		crb_runtime_error(location->filename, location->line_number,
+				INDEX_OPERAND_NOT_INT_ERR,
+				MESSAGE_ARGUMENT_END);
+	crb_array_sync(array_val->u.object_value);
+	if (index_val->u.int_value < 0 ||
+			index_val->u.int_value >=
+				array_val->u.object_value->u.array.length)
+		crb_runtime_error(location->filename, location->line_number,
+				ARRAY_INDEX_OUT_OF_BOUND_ERR,
+				INT_MESSAGE_ARGUMENT, "size",
+				array_val->u.object_value->u.array.length,
+				INT_MESSAGE_ARGUMENT, "index",
+				index_val->u.int_value);
+
+	*index = index_val->u.int_value;
+	return array_val->u.object_value;
+}
+
+/*
+ * The member expr names of the assoc at depth from the stack top,
+ * created if missing, or the field of the record there.
+ */
+static CRB_Value *
+object_member(CRB_Interpreter *inter, int depth, Expression *expr,
+			  CodeLocation *location)
+{
+	CRB_Value *obj_val = STACK_TOP(inter, depth);
+	char *member_name = expr->u.member_expression.member_name;
+	Variable *variable;
+
+	if (obj_val->type == CRB_RECORD_VALUE)
+		return crb_record_field(inter, obj_val->u.object_value, expr);
+
+	if (obj_val->type != CRB_ASSOC_VALUE)
+		crb_runtime_error(location->filename, location->line_number,
+				MEMBER_OPERATION_NOT_ASSOC_ERR,
+				MESSAGE_ARGUMENT_END);
+
+	variable = crb_search_assoc_variable(inter, obj_val->u.object_value,
+										member_name, CRB_TRUE);
+	if (variable == NULL) {
+		crb_runtime_error(location->filename, location->line_number,
+				NO_SUCH_MEMBER_ERR,
+				STRING_MESSAGE_ARGUMENT, "member_name", member_name,
+				MESSAGE_ARGUMENT_END);
+	}
+
+	return &variable->value;
+}
+
+/* replace the object on the stack top with its member */
+static void
+load_member(CRB_Interpreter *inter, Expression *expr)
+{
+	CRB_Value *obj_val = STACK_TOP(inter, 0);
+	char *member_name = expr->u.member_expression.member_name;
+
+	if (obj_val->type == CRB_RECORD_VALUE) {
+		*obj_val = *crb_record_field(inter, obj_val->u.object_value, expr);
+		return;
+	}
+
+	if (obj_val->type == CRB_ASSOC_VALUE) {
+		Variable *variable = crb_search_assoc_variable(inter,
+								obj_val->u.object_value,
+								member_name, CRB_FALSE);
+		if (variable != NULL) {
+			*obj_val = variable->value;
+			return;
+		}
+	}
+
+	if (!dkc_is_object_value(obj_val->type)) {
+		crb_runtime_error(crb_node_filename(inter, expr),
+				crb_node_line_number(inter, expr),
+				MEMBER_OPERATION_NOT_ASSOC_ERR,
+				MESSAGE_ARGUMENT_END);
+	}
+
+	crb_set_fake_method(obj_val, obj_val->u.object_value, member_name);
+}
+
+/* dest = src, or dest op= src, leaving the result in *src */
+static void
+assign_value(CRB_Interpreter *inter, AssignType type,
+			 CRB_Value *dest, CRB_Value *src, CodeLocation *location)
+{
+	if (type != ASSIGN_TYPE) {
+		CRB_Value result;
+
+		crb_eval_compound_assign(inter, type, dest, src, &result,
+								location->filename, location->line_number);
+		*src = result;
+	}
+	*dest = *src;
+}
+
+/* ++/-- on *dest, the value of the expression goes to *result */
+static void
+incdec_value(ExpressionType type, CRB_Value *dest, CRB_Value *result,
+			 CodeLocation *location)
+{
+	if (dest->type != CRB_INT_VALUE)
+		crb_runtime_error(location->filename, location->line_number,
+				INC_DEC_OPERAND_TYPE_ERR,
+				MESSAGE_ARGUMENT_END);
+
+	*result = *dest;
+	if (type == PREV_INCREMENT_EXPRESSION) {
+		dest->u.int_value++;
+		*result = *dest;
+	}
+	else if (type == POST_INCREMENT_EXPRESSION) {
+		dest->u.int_value++;
+	}
+	else if (type == PREV_DECREMENT_EXPRESSION) {
+		dest->u.int_value--;
+		*result = *dest;
+	}
+	else if (type == POST_DECREMENT_EXPRESSION) {
+		dest->u.int_value--;
+	}
+}
+
+/* [array][index] -> [element] */
+static void
+push_index(CRB_Interpreter *inter, CodeLocation *location)
+{
+	CRB_Object *array;
+	int index;
+
+	array = array_element(inter, 0, &index, location);
+	crb_array_get(array, index, STACK_TOP(inter, 1));
+	crb_stack_shrink_size(inter, 1);
+}
+
+/* [array][index][value] -> [value] */
+static void
+store_index(CRB_Interpreter *inter, AssignType type, CodeLocation *location)
+{
+	CRB_Value *src = STACK_TOP(inter, 0);
+	CRB_Value element;
+	CRB_Object *array;
+	int index;
+
+	array = array_element(inter, 1, &index, location);
+	if (type != ASSIGN_TYPE) {
+		crb_array_get(array, index, &element);
+		assign_value(inter, type, &element, src, location);
+	}
+	crb_array_set(inter, array, index, src);
+	*STACK_TOP(inter, 2) = *src;
+	crb_stack_shrink_size(inter, 2);
+}
+
+/* [array][index] -> [value of ++/--] */
+static void
+incdec_index(CRB_Interpreter *inter, ExpressionType type,
+			 CodeLocation *location)
+{
+	CRB_Value element;
+	CRB_Object *array;
+	int index;
+
+	array = array_element(inter, 0, &index, location);
+	crb_array_get(array, index, &element);
+	incdec_value(type, &element, STACK_TOP(inter, 1), location);
+	crb_array_set(inter, array, index, &element);
+	crb_stack_shrink_size(inter, 1);
+}
+
+static void
+execute_binary(CRB_Interpreter *inter, ExpressionType operator,
+			   CodeLocation *location)
+{
+	CRB_Value result;
+
+	crb_eval_binary_values(inter, operator, STACK_TOP(inter, 1),
+						STACK_TOP(inter, 0), &result,
+						location->filename, location->line_number);
+	*STACK_TOP(inter, 1) = result;
+	crb_stack_shrink_size(inter, 1);
+}
+
+static void
+check_boolean(CRB_Value *value, CodeLocation *location)
+{
+	if (value->type != CRB_BOOLEAN_VALUE) {
+		crb_runtime_error(location->filename, location->line_number,
+						NOT_BOOLEAN_TYPE_ERR, MESSAGE_ARGUMENT_END);
+	}
+}
+
+static void
+new_array(CRB_Interpreter *inter, int size)
+{
+	CRB_Value array_val;
+
+	array_val.type = CRB_ARRAY_VALUE;
+	array_val.u.object_value = crb_create_array_of(inter, size,
+												STACK_TOP(inter, size - 1));
+	crb_stack_shrink_size(inter, size);
+	crb_stack_push_value(inter, &array_val);
+}
+
+/* call obj.method_name() for obj on the stack top, the result is pushed */
+static void
+call_method(CRB_Interpreter *inter, char *method_name,
+			CodeLocation *location)
+{
+	Expression member_expr;
+	Expression call_expr;
+	CRB_Value obj = *STACK_TOP(inter, 0);
+
+	crb_init_member_expression(&member_expr, NULL, method_name,
+								location->filename, location->line_number);
+	crb_init_function_call_expression(&call_expr, &member_expr, NULL,
+								location->filename, location->line_number);
+
+	crb_stack_push_value(inter, &obj);
+	load_member(inter, &member_expr);
+	crb_call_stacked_function(inter, &call_expr, 0);
+}
+
+/*
+ * foreach keeps [iterable][state] on the stack.  For an array the state
+ * is the index, for a map or a set the number of the entry whose key
+ * comes next, anything else must give an iterator by iterator().
+ */
+static void
+foreach_init(CRB_Interpreter *inter, CRB_LocalEnvironment *env,
+			 CodeLocation *location)
+{
+	CRB_Value *pv = STACK_TOP(inter, 0);
+
+	if (pv->type == CRB_ARRAY_VALUE || pv->type == CRB_MAP_VALUE
+			|| pv->type == CRB_SET_VALUE) {
+		push_int(inter, 0);
+	} else if (pv->type == CRB_ASSOC_VALUE
+			&& crb_search_assoc_variable(inter, pv->u.object_value,
+										"iterator", CRB_FALSE) != NULL) {
+		call_method(inter, "iterator", location);
+	} else {
+		crb_runtime_error(location->filename, location->line_number,
+				FOREACH_NOT_ARRAY_TYPE_ERR, MESSAGE_ARGUMENT_END);
+	}
+	env->stack_hold++;
+}
+
+/* assign the next item, CRB_FALSE at the end */
+static CRB_Boolean
+foreach_next(CRB_Interpreter *inter, CRB_LocalEnvironment *env,
+			 char *identifier, CodeLocation *location)
+{
+	CRB_Value *iterable = STACK_TOP(inter, 1);
+	CRB_Value item;
+
+	if (iterable->type == CRB_ARRAY_VALUE) {
+		int index = STACK_TOP(inter, 0)->u.int_value;
+
+		if (index >= crb_array_size(inter, iterable->u.object_value))
+			return CRB_FALSE;
+		crb_array_get(iterable->u.object_value, index, &item);
+	} else if (iterable->type == CRB_MAP_VALUE
+			   || iterable->type == CRB_SET_VALUE) {
+		CRB_Object *map = iterable->u.object_value;
+		int pos = crb_map_next(map, STACK_TOP(inter, 0)->u.int_value);
+
+		if (pos < 0)
+			return CRB_FALSE;
+		STACK_TOP(inter, 0)->u.int_value = pos;
+		item = map->u.map.entry[pos].key;
+	} else {
+		CRB_Boolean is_done;
+
+		call_method(inter, "is_done", location);
+		is_done = (STACK_TOP(inter, 0)->u.boolean_value == CRB_TRUE);
+		crb_stack_shrink_size(inter, 1);
+		if (is_done)
+			return CRB_FALSE;
+
+		call_method(inter, "current_item", location);
+		item = *STACK_TOP(inter, 0);
+		crb_stack_shrink_size(inter, 1);
+	}
+	crb_search_local_variable(inter, env, identifier, CRB_TRUE)->value = item;
+
+	return CRB_TRUE;
+}
+
+static void
+foreach_step(CRB_Interpreter *inter, CodeLocation *location)
+{
+	if (STACK_TOP(inter, 1)->type == CRB_ARRAY_VALUE
+			|| STACK_TOP(inter, 1)->type == CRB_MAP_VALUE
+			|| STACK_TOP(inter, 1)->type == CRB_SET_VALUE) {
+		STACK_TOP(inter, 0)->u.int_value++;
+	} else {
+		call_method(inter, "next", location);
+		crb_stack_shrink_size(inter, 1);
+	}
+}
+
+/* execute_try_statement() with the parts run as bytecode */
+static StatementResult
+execute_try(CRB_Interpreter *inter, CRB_LocalEnvironment *env,
+			TryCode *try_code)
+{
+	StatementResult result;
+	RecoverEnvironment recover;
+	TryStatement *try_s = &try_code->statement->u.try_s;
+	int throw_after_finally = 0;
+	int stack_hold = env->stack_hold;
+
+	env->stack_hold = stack_hold + 1;
+	crb_save_environment(inter, &recover);
+	int jmp_value = setjmp(inter->exception_jumper);
+
+	if (jmp_value == 0) {
+		result = crb_execute_byte_code(inter, env, try_code->run_code);
+
+		crb_recover_environment(inter, &recover);
+	}
+	else {
+		crb_recover_environment(inter, &recover);
+		env->stack_hold = stack_hold + 1;
+
+		if (try_s->identifier != NULL) {
+			CRB_Object *obj = inter->throwed_exception;
+			Variable *variable = crb_search_env_variable(inter, env,
+									try_s->identifier, CRB_TRUE);
+			variable->value.type = CRB_ASSOC_VALUE;
+			variable->value.u.object_value = obj;
+		}
+		inter->throwed_exception = NULL;
+
+		if (try_code->catch_code) {
+			crb_save_environment(inter, &recover);
+
+			jmp_value = setjmp(inter->exception_jumper);
+			if (jmp_value == 0) {
+				result = crb_execute_byte_code(inter, env,
+												try_code->catch_code);
+
+				crb_recover_environment(inter, &recover);
+			}
+			else {
+				crb_recover_environment(inter, &recover);
+				env->stack_hold = stack_hold + 1;
+				throw_after_finally = 1;
+			}
+		}
+	}
+
+	if (try_code->final_code)
+		result = crb_execute_byte_code(inter, env, try_code->final_code);
+	env->stack_hold = stack_hold;
+
+	if (throw_after_finally)
+		longjmp(inter->exception_jumper, 1);
+
+	return result;
+}
+
+/*
+ * With GCC the loop is direct threaded: each instruction holds the
+ * address of its handler, filled in on the first run of the code, and
+ * every handler jumps straight to the next one.  Otherwise it is a
+ * switch in a loop.
+ */
+#ifdef CRB_THREADED_CODE
+#define CASE(opcode)	L_##opcode
+#define NEXT \
+	do { inst = &code->code[pc]; goto *inst->handler; } while (0)
+#define REWRITE(op) \
+	(inst->opcode = (op), inst->handler = handler[op])
+#else
+#define CASE(opcode)	case opcode
+#define NEXT			continue
+#define REWRITE(op)		(inst->opcode = (op))
+#endif
+
+/*
+ * A binary operator instruction rewrites itself to a form specialized
+ * for the operand types it sees.  The specialized form checks the
+ * types and goes back to the generic form for good when they differ,
+ * operand 1 on a generic instruction marks that.
+ */
+#define GENERIC_BINARY(operator) \
+	if ((quick = quicken_binary(inst, STACK_TOP(inter, 1), \
+								STACK_TOP(inter, 0))) != 0) { \
+		REWRITE(quick); \
+		NEXT; \
+	} \
+	execute_binary(inter, (operator), &code->location[pc]); \
+	pc++; \
+	NEXT
+
+#define DEOPTIMIZE(generic) \
+	do { \
+		inst->operand = 1; \
+		REWRITE(generic); \
+	} while (0)
+
+#define INT_OPERANDS() \
+	(STACK_TOP(inter, 1)->type == CRB_INT_VALUE \
+	 && STACK_TOP(inter, 0)->type == CRB_INT_VALUE)
+
+#define INT_ARITHMETIC(opcode, op) \
+	CASE(opcode): \
+		if (!INT_OPERANDS()) { \
+			DEOPTIMIZE(opcode - OP_ADD_INT + OP_ADD); \
+			NEXT; \
+		} \
+		STACK_TOP(inter, 1)->u.int_value \
+			= STACK_TOP(inter, 1)->u.int_value \
+				op STACK_TOP(inter, 0)->u.int_value; \
+		inter->stack.stack_pointer--; \
+		pc++; \
+		NEXT
+
+#define INT_COMPARE(opcode, op) \
+	CASE(opcode): \
+		if (!INT_OPERANDS()) { \
+			DEOPTIMIZE(opcode - OP_ADD_INT + OP_ADD); \
+			NEXT; \
+		} \
+		STACK_TOP(inter, 1)->u.boolean_value \
+			= STACK_TOP(inter, 1)->u.int_value \
+				op STACK_TOP(inter, 0)->u.int_value; \
+		STACK_TOP(inter, 1)->type = CRB_BOOLEAN_VALUE; \
+		inter->stack.stack_pointer--; \
+		pc++; \
+		NEXT
+
+#define IS_NUMBER(v) \
+	((v)->type == CRB_INT_VALUE || (v)->type == CRB_DOUBLE_VALUE)
+#define NUMBER_OF(v) \
+	((v)->type == CRB_INT_VALUE ? (v)->u.int_value : (v)->u.double_value)
+
+/* double with double or int, two ints stay with the int forms */
+#define DOUBLE_OPERANDS() \
+	(IS_NUMBER(STACK_TOP(inter, 1)) && IS_NUMBER(STACK_TOP(inter, 0)) \
+	 && !INT_OPERANDS())
+
+#define DOUBLE_ARITHMETIC(opcode, expr) \
+	CASE(opcode): \
+		if (!DOUBLE_OPERANDS()) { \
+			DEOPTIMIZE(opcode - OP_ADD_DOUBLE + OP_ADD); \
+			NEXT; \
+		} else { \
+			double left = NUMBER_OF(STACK_TOP(inter, 1)); \
+			double right = NUMBER_OF(STACK_TOP(inter, 0)); \
+			STACK_TOP(inter, 1)->type = CRB_DOUBLE_VALUE; \
+			STACK_TOP(inter, 1)->u.double_value = (expr); \
+		} \
+		inter->stack.stack_pointer--; \
+		pc++; \
+		NEXT
+
+#define DOUBLE_COMPARE(opcode, op) \
+	CASE(opcode): \
+		if (!DOUBLE_OPERANDS()) { \
+			DEOPTIMIZE(opcode - OP_ADD_DOUBLE + OP_ADD); \
+			NEXT; \
+		} else { \
+			double left = NUMBER_OF(STACK_TOP(inter, 1)); \
+			double right = NUMBER_OF(STACK_TOP(inter, 0)); \
+			STACK_TOP(inter, 1)->type = CRB_BOOLEAN_VALUE; \
+			STACK_TOP(inter, 1)->u.boolean_value = left op right; \
+		} \
+		inter->stack.stack_pointer--; \
+		pc++; \
+		NEXT
+
+static OpCode
+quicken_binary(Instruction *inst, CRB_Value *left, CRB_Value *right)
+{
+	if (inst->operand)
+		return 0;
+
+	if (left->type == CRB_INT_VALUE && right->type == CRB_INT_VALUE)
+		return inst->opcode - OP_ADD + OP_ADD_INT;
+	if (IS_NUMBER(left) && IS_NUMBER(right))
+		return inst->opcode - OP_ADD + OP_ADD_DOUBLE;
+	if (left->type == CRB_STRING_VALUE && inst->opcode == OP_ADD)
+		return OP_ADD_STRING;
+
+	return 0;
+}
+
+StatementResult
+crb_execute_byte_code(CRB_Interpreter *inter, CRB_LocalEnvironment *env,
+					  ByteCode *code)
+{
+	StatementResult result;
+	Instruction *inst;
+	CodeConstant *constant = code->constant;
+	int base_sp = inter->stack.stack_pointer;
+	int base_stack_hold = env->stack_hold;
+	int pc = 0;
+	OpCode quick;
+	CRB_Value v;
+
+#ifdef CRB_JIT
+	if (code->native == NULL && !code->native_failed && inter->jit_enabled
+		&& ++code->hotness >= CRB_JIT_THRESHOLD)
+		crb_jit_compile(inter, code);
+	if (code->native)
+		goto RUN_NATIVE;
+#endif
+
+#ifdef CRB_THREADED_CODE
+	static void *handler[] = {
+		[OP_PUSH_NULL] = &&L_OP_PUSH_NULL,
+		[OP_PUSH_BOOLEAN] = &&L_OP_PUSH_BOOLEAN,
+		[OP_PUSH_INT] = &&L_OP_PUSH_INT,
+		[OP_PUSH_DOUBLE] = &&L_OP_PUSH_DOUBLE,
+		[OP_PUSH_STRING] = &&L_OP_PUSH_STRING,
+		[OP_PUSH_REGEXP] = &&L_OP_PUSH_REGEXP,
+		[OP_PUSH_VARIABLE] = &&L_OP_PUSH_VARIABLE,
+		[OP_PUSH_INDEX] = &&L_OP_PUSH_INDEX,
+		[OP_PUSH_MEMBER] = &&L_OP_PUSH_MEMBER,
+		[OP_PUSH_CLOSURE] = &&L_OP_PUSH_CLOSURE,
+		[OP_PUSH_CALLEE] = &&L_OP_PUSH_CALLEE,
+		[OP_NEW_ARRAY] = &&L_OP_NEW_ARRAY,
+		[OP_CREATE_VARIABLE] = &&L_OP_CREATE_VARIABLE,
+		[OP_STORE_VARIABLE] = &&L_OP_STORE_VARIABLE,
+		[OP_STORE_INDEX] = &&L_OP_STORE_INDEX,
+		[OP_STORE_MEMBER] = &&L_OP_STORE_MEMBER,
+		[OP_INCDEC_VARIABLE] = &&L_OP_INCDEC_VARIABLE,
+		[OP_INCDEC_INDEX] = &&L_OP_INCDEC_INDEX,
+		[OP_INCDEC_MEMBER] = &&L_OP_INCDEC_MEMBER,
+		[OP_NOT_LVALUE] = &&L_OP_NOT_LVALUE,
+		[OP_POP] = &&L_OP_POP,
+		[OP_ADD] = &&L_OP_ADD,
+		[OP_SUB] = &&L_OP_SUB,
+		[OP_MUL] = &&L_OP_MUL,
+		[OP_DIV] = &&L_OP_DIV,
+		[OP_MOD] = &&L_OP_MOD,
+		[OP_EQ] = &&L_OP_EQ,
+		[OP_NE] = &&L_OP_NE,
+		[OP_GT] = &&L_OP_GT,
+		[OP_GE] = &&L_OP_GE,
+		[OP_LT] = &&L_OP_LT,
+		[OP_LE] = &&L_OP_LE,
+		[OP_ADD_INT] = &&L_OP_ADD_INT,
+		[OP_SUB_INT] = &&L_OP_SUB_INT,
+		[OP_MUL_INT] = &&L_OP_MUL_INT,
+		[OP_DIV_INT] = &&L_OP_DIV_INT,
+		[OP_MOD_INT] = &&L_OP_MOD_INT,
+		[OP_EQ_INT] = &&L_OP_EQ_INT,
+		[OP_NE_INT] = &&L_OP_NE_INT,
+		[OP_GT_INT] = &&L_OP_GT_INT,
+		[OP_GE_INT] = &&L_OP_GE_INT,
+		[OP_LT_INT] = &&L_OP_LT_INT,
+		[OP_LE_INT] = &&L_OP_LE_INT,
+		[OP_ADD_DOUBLE] = &&L_OP_ADD_DOUBLE,
+		[OP_SUB_DOUBLE] = &&L_OP_SUB_DOUBLE,
+		[OP_MUL_DOUBLE] = &&L_OP_MUL_DOUBLE,
+		[OP_DIV_DOUBLE] = &&L_OP_DIV_DOUBLE,
+		[OP_MOD_DOUBLE] = &&L_OP_MOD_DOUBLE,
+		[OP_EQ_DOUBLE] = &&L_OP_EQ_DOUBLE,
+		[OP_NE_DOUBLE] = &&L_OP_NE_DOUBLE,
+		[OP_GT_DOUBLE] = &&L_OP_GT_DOUBLE,
+		[OP_GE_DOUBLE] = &&L_OP_GE_DOUBLE,
+		[OP_LT_DOUBLE] = &&L_OP_LT_DOUBLE,
+		[OP_LE_DOUBLE] = &&L_OP_LE_DOUBLE,
+		[OP_ADD_STRING] = &&L_OP_ADD_STRING,
+		[OP_NOT] = &&L_OP_NOT,
+		[OP_MINUS] = &&L_OP_MINUS,
+		[OP_AND_JUMP] = &&L_OP_AND_JUMP,
+		[OP_OR_JUMP] = &&L_OP_OR_JUMP,
+		[OP_CHECK_BOOLEAN] = &&L_OP_CHECK_BOOLEAN,
+		[OP_JUMP] = &&L_OP_JUMP,
+		[OP_JUMP_IF_FALSE] = &&L_OP_JUMP_IF_FALSE,
+		[OP_CALL] = &&L_OP_CALL,
+		[OP_TAIL_CALL] = &&L_OP_TAIL_CALL,
+		[OP_RETURN] = &&L_OP_RETURN,
+		[OP_BREAK] = &&L_OP_BREAK,
+		[OP_CONTINUE] = &&L_OP_CONTINUE,
+		[OP_GLOBAL] = &&L_OP_GLOBAL,
+		[OP_TRY] = &&L_OP_TRY,
+		[OP_THROW] = &&L_OP_THROW,
+		[OP_FOREACH_INIT] = &&L_OP_FOREACH_INIT,
+		[OP_FOREACH_NEXT] = &&L_OP_FOREACH_NEXT,
+		[OP_FOREACH_STEP] = &&L_OP_FOREACH_STEP,
+		[OP_FOREACH_END] = &&L_OP_FOREACH_END,
+		[OP_HOIST_RECEIVER] = &&L_OP_HOIST_RECEIVER,
+		[OP_HOISTED_SIZE] = &&L_OP_HOISTED_SIZE,
+		[OP_HOISTED_LENGTH] = &&L_OP_HOISTED_LENGTH,
+		[OP_HOIST_END] = &&L_OP_HOIST_END,
+		[OP_END] = &&L_OP_END,
+	};
+
+	if (!code->threaded) {
+		int i;
+
+		for (i = 0; i < code->code_size; i++)
+			code->code[i].handler = handler[code->code[i].opcode];
+		code->threaded = CRB_TRUE;
+	}
+	NEXT;
+#else
+	for (;;) {
+		inst = &code->code[pc];
+		switch (inst->opcode) {
+#endif
+		CASE(OP_PUSH_NULL):
+			v.type = CRB_NULL_VALUE;
+			crb_stack_push_value(inter, &v);
+			pc++;
+			NEXT;
+		CASE(OP_PUSH_BOOLEAN):
+			push_boolean(inter, inst->operand);
+			pc++;
+			NEXT;
+		CASE(OP_PUSH_INT):
+			push_int(inter, inst->operand);
+			pc++;
+			NEXT;
+		CASE(OP_PUSH_DOUBLE):
+			v.type = CRB_DOUBLE_VALUE;
+			v.u.double_value = constant[inst->operand].double_value;
+			crb_stack_push_value(inter, &v);
+			pc++;
+			NEXT;
+		CASE(OP_PUSH_STRING):
+			v.type = CRB_STRING_VALUE;
+			v.u.object_value = crb_literal_to_crb_string(inter,
+									constant[inst->operand].pointer);
+			crb_stack_push_value(inter, &v);
+			pc++;
+			NEXT;
+		CASE(OP_PUSH_REGEXP):
+			CRB_set_native_pointer(&v, constant[inst->operand].pointer,
+									crb_get_regexp_info());
+			crb_stack_push_value(inter, &v);
+			pc++;
+			NEXT;
+		CASE(OP_PUSH_VARIABLE):
+			push_variable(inter, env, constant[inst->operand].pointer,
+							&code->location[pc]);
+			pc++;
+			NEXT;
+		CASE(OP_PUSH_INDEX):
+			push_index(inter, &code->location[pc]);
+			pc++;
+			NEXT;
+		CASE(OP_PUSH_MEMBER):
+			load_member(inter, constant[inst->operand].pointer);
+			pc++;
+			NEXT;
+		CASE(OP_PUSH_CLOSURE):
+			DBG_assert(env->environ_scope != NULL,
+					("closure defined in a frame without scope\n"));
+			crb_create_closure(inter, &v, constant[inst->operand].pointer,
+								env->environ_scope);
+			crb_stack_push_value(inter, &v);
+			pc++;
+			NEXT;
+		CASE(OP_PUSH_CALLEE): {
+			Expression *expr = constant[inst->operand].pointer;
+
+			if (crb_search_called_function(inter, expr)) {
+				v.type = CRB_NULL_VALUE;
+				crb_stack_push_value(inter, &v);
+			} else {
+				push_variable(inter, env,
+						expr->u.function_call_expression.expr->u.identifier,
+						&code->location[pc]);
+			}
+			pc++;
+			NEXT;
+		}
+		CASE(OP_NEW_ARRAY):
+			new_array(inter, inst->operand);
+			pc++;
+			NEXT;
+		CASE(OP_CREATE_VARIABLE):
+			crb_search_local_variable(inter, env,
+									constant[inst->operand].pointer,
+									CRB_TRUE);
+			pc++;
+			NEXT;
+		CASE(OP_STORE_VARIABLE): {
+			Variable *variable = crb_search_local_variable(inter, env,
+									constant[inst->operand].pointer,
+									CRB_TRUE);
+
+			assign_value(inter, inst->operand2, &variable->value,
+						STACK_TOP(inter, 0), &code->location[pc]);
+			pc++;
+			NEXT;
+		}
+		CASE(OP_STORE_INDEX):
+			store_index(inter, inst->operand2, &code->location[pc]);
+			pc++;
+			NEXT;
+		CASE(OP_STORE_MEMBER): {
+			CRB_Value *dest = object_member(inter, 1,
+									constant[inst->operand].pointer,
+									&code->location[pc]);
+
+			assign_value(inter, inst->operand2, dest,
+						STACK_TOP(inter, 0), &code->location[pc]);
+			*STACK_TOP(inter, 1) = *STACK_TOP(inter, 0);
+			crb_stack_shrink_size(inter, 1);
+			pc++;
+			NEXT;
+		}
+		CASE(OP_INCDEC_VARIABLE): {
+			Variable *variable = crb_search_local_variable(inter, env,
+									constant[inst->operand].pointer,
+									CRB_TRUE);
+
+			incdec_value(inst->operand2, &variable->value, &v,
+						&code->location[pc]);
+			crb_stack_push_value(inter, &v);
+			pc++;
+			NEXT;
+		}
+		CASE(OP_INCDEC_INDEX):
+			incdec_index(inter, inst->operand2, &code->location[pc]);
+			pc++;
+			NEXT;
+		CASE(OP_INCDEC_MEMBER):
+			incdec_value(inst->operand2,
+						object_member(inter, 0,
+									constant[inst->operand].pointer,
+									&code->location[pc]),
+						&v, &code->location[pc]);
+			*STACK_TOP(inter, 0) = v;
+			pc++;
+			NEXT;
+		CASE(OP_NOT_LVALUE):
+			crb_runtime_error(code->location[pc].filename,
+							code->location[pc].line_number,
+							NOT_LVALUE_ERR,
+							MESSAGE_ARGUMENT_END);
+			NEXT;
+		CASE(OP_POP):
+			crb_stack_shrink_size(inter, 1);
+			pc++;
+			NEXT;
+		CASE(OP_ADD):
+			GENERIC_BINARY(ADD_EXPRESSION);
+		CASE(OP_SUB):
+			GENERIC_BINARY(SUB_EXPRESSION);
+		CASE(OP_MUL):
+			GENERIC_BINARY(MUL_EXPRESSION);
+		CASE(OP_DIV):
+			GENERIC_BINARY(DIV_EXPRESSION);
+		CASE(OP_MOD):
+			GENERIC_BINARY(MOD_EXPRESSION);
+		CASE(OP_EQ):
+			GENERIC_BINARY(EQ_EXPRESSION);
+		CASE(OP_NE):
+			GENERIC_BINARY(NE_EXPRESSION);
+		CASE(OP_GT):
+			GENERIC_BINARY(GT_EXPRESSION);
+		CASE(OP_GE):
+			GENERIC_BINARY(GE_EXPRESSION);
+		CASE(OP_LT):
+			GENERIC_BINARY(LT_EXPRESSION);
+		CASE(OP_LE):
+			GENERIC_BINARY(LE_EXPRESSION);
+		INT_ARITHMETIC(OP_ADD_INT, +);
+		INT_ARITHMETIC(OP_SUB_INT, -);
+		INT_ARITHMETIC(OP_MUL_INT, *);
+		INT_ARITHMETIC(OP_DIV_INT, /);
+		INT_ARITHMETIC(OP_MOD_INT, %);
+		INT_COMPARE(OP_EQ_INT, ==);
+		INT_COMPARE(OP_NE_INT, !=);
+		INT_COMPARE(OP_GT_INT, >);
+		INT_COMPARE(OP_GE_INT, >=);
+		INT_COMPARE(OP_LT_INT, <);
+		INT_COMPARE(OP_LE_INT, <=);
+		DOUBLE_ARITHMETIC(OP_ADD_DOUBLE, left + right);
+		DOUBLE_ARITHMETIC(OP_SUB_DOUBLE, left - right);
+		DOUBLE_ARITHMETIC(OP_MUL_DOUBLE, left * right);
+		DOUBLE_ARITHMETIC(OP_DIV_DOUBLE, left / right);
+		DOUBLE_ARITHMETIC(OP_MOD_DOUBLE, fmod(left, right));
+		DOUBLE_COMPARE(OP_EQ_DOUBLE, ==);
+		DOUBLE_COMPARE(OP_NE_DOUBLE, !=);
+		DOUBLE_COMPARE(OP_GT_DOUBLE, >);
+		DOUBLE_COMPARE(OP_GE_DOUBLE, >=);
+		DOUBLE_COMPARE(OP_LT_DOUBLE, <);
+		DOUBLE_COMPARE(OP_LE_DOUBLE, <=);
+		CASE(OP_ADD_STRING):
+			if (STACK_TOP(inter, 1)->type != CRB_STRING_VALUE) {
+				DEOPTIMIZE(OP_ADD);
+				NEXT;
+			}
+			crb_chain_string(inter, STACK_TOP(inter, 1), STACK_TOP(inter, 0),
+							&v);
+			*STACK_TOP(inter, 1) = v;
+			inter->stack.stack_pointer--;
+			pc++;
+			NEXT;
+		CASE(OP_NOT): {
+			CRB_Value *pv = STACK_TOP(inter, 0);
+
+			if (pv->type != CRB_BOOLEAN_VALUE) {
+				crb_runtime_error(code->location[pc].filename,
+								code->location[pc].line_number,
+								NOT_BOOLEAN_FOR_NOT_EXPRESSION,
+								MESSAGE_ARGUMENT_END);
+			}
+			pv->u.boolean_value = !pv->u.boolean_value;
+			pc++;
+			NEXT;
+		}
+		CASE(OP_MINUS): {
+			CRB_Value *pv = STACK_TOP(inter, 0);
+
+			if (pv->type == CRB_INT_VALUE) {
+				pv->u.int_value = -pv->u.int_value;
+			} else if (pv->type == CRB_DOUBLE_VALUE) {
+				pv->u.double_value = -pv->u.double_value;
+			} else {
+				crb_runtime_error(code->location[pc].filename,
+								code->location[pc].line_number,
+								MINUS_OPERAND_TYPE_ERR,
+								MESSAGE_ARGUMENT_END);
+			}
+			pc++;
+			NEXT;
+		}
+		CASE(OP_AND_JUMP):
+			check_boolean(STACK_TOP(inter, 0), &code->location[pc]);
+			if (!STACK_TOP(inter, 0)->u.boolean_value) {
+				pc = inst->operand;
+			} else {
+				crb_stack_shrink_size(inter, 1);
+				pc++;
+			}
+			NEXT;
+		CASE(OP_OR_JUMP):
+			check_boolean(STACK_TOP(inter, 0), &code->location[pc]);
+			if (STACK_TOP(inter, 0)->u.boolean_value) {
+				pc = inst->operand;
+			} else {
+				crb_stack_shrink_size(inter, 1);
+				pc++;
+			}
+			NEXT;
+		CASE(OP_CHECK_BOOLEAN):
+			check_boolean(STACK_TOP(inter, 0), &code->location[pc]);
+			pc++;
+			NEXT;
+		CASE(OP_JUMP):
+#ifdef CRB_JIT
+			// operand2 of a backward jump counts the runs of its loop
+			if (inst->operand < pc && inst->operand2 < CRB_OSR_THRESHOLD
+				&& ++inst->operand2 == CRB_OSR_THRESHOLD
+				&& inter->jit_enabled && !code->native_failed
+				&& (code->native || crb_jit_compile(inter, code))) {
+				pc = inst->operand;
+				goto RUN_NATIVE;
+			}
+#endif
+			pc = inst->operand;
+			NEXT;
+		CASE(OP_JUMP_IF_FALSE):
+			check_boolean(STACK_TOP(inter, 0), &code->location[pc]);
+			if (!STACK_TOP(inter, 0)->u.boolean_value)
+				pc = inst->operand;
+			else
+				pc++;
+			crb_stack_shrink_size(inter, 1);
+			NEXT;
+		CASE(OP_CALL):
+			crb_call_stacked_function(inter, constant[inst->operand].pointer,
+									inst->operand2);
+			pc++;
+			NEXT;
+		CASE(OP_TAIL_CALL):
+			if (env == &inter->first_env || env->stack_hold != 0) {
+				// try and foreach need their stack and frame back
+				crb_call_stacked_function(inter,
+									constant[inst->operand].pointer,
+									inst->operand2);
+				result.type = RETURN_STATEMENT_RESULT;
+				result.u.return_value = crb_stack_pop_value(inter);
+			} else {
+				result = crb_tail_call_stacked_function(inter,
+									constant[inst->operand].pointer,
+									inst->operand2);
+			}
+			goto FUNC_END;
+		CASE(OP_RETURN):
+			result.type = RETURN_STATEMENT_RESULT;
+			result.u.return_value = crb_stack_pop_value(inter);
+			goto FUNC_END;
+		CASE(OP_BREAK):
+			result.type = BREAK_STATEMENT_RESULT;
+			goto FUNC_END;
+		CASE(OP_CONTINUE):
+			result.type = CONTINUE_STATEMENT_RESULT;
+			goto FUNC_END;
+		CASE(OP_GLOBAL):
+			crb_execute_global(inter, env, constant[inst->operand].pointer);
+			pc++;
+			NEXT;
+		CASE(OP_TRY):
+			result = execute_try(inter, env, constant[inst->operand].pointer);
+			// a break or continue uses the jump after TRY
+			if (result.type == NORMAL_STATEMENT_RESULT)
+				pc += 3;
+			else if (result.type == BREAK_STATEMENT_RESULT)
+				pc += 1;
+			else if (result.type == CONTINUE_STATEMENT_RESULT)
+				pc += 2;
+			else
+				goto FUNC_END;
+			NEXT;
+		CASE(OP_THROW):
+			crb_throw_value(inter, env, constant[inst->operand].pointer);
+			NEXT;
+		CASE(OP_FOREACH_INIT):
+			foreach_init(inter, env, &code->location[pc]);
+			pc++;
+			NEXT;
+		CASE(OP_FOREACH_NEXT):
+			if (foreach_next(inter, env, constant[inst->operand2].pointer,
+							&code->location[pc]))
+				pc++;
+			else
+				pc = inst->operand;
+			NEXT;
+		CASE(OP_FOREACH_STEP):
+			foreach_step(inter, &code->location[pc]);
+			pc++;
+			NEXT;
+		CASE(OP_FOREACH_END):
+			crb_stack_shrink_size(inter, 2);
+			env->stack_hold--;
+			pc++;
+			NEXT;
+		CASE(OP_HOIST_RECEIVER): {
+			// a missing variable is left for the call to report
+			Variable *variable = crb_search_local_variable(inter, env,
+									constant[inst->operand].pointer,
+									CRB_FALSE);
+
+			if (variable) {
+				v = variable->value;
+			} else {
+				v.type = CRB_NULL_VALUE;
+			}
+			crb_stack_push_value(inter, &v);
+			env->stack_hold++;
+			pc++;
+			NEXT;
+		}
+		CASE(OP_HOISTED_SIZE):
+			v = inter->stack.stack[base_sp + inst->operand];
+			if (v.type == CRB_ARRAY_VALUE) {
+				push_int(inter, crb_array_size(inter, v.u.object_value));
+				pc = inst->operand2;
+			} else {
+				pc++;
+			}
+			NEXT;
+		CASE(OP_HOISTED_LENGTH):
+			v = inter->stack.stack[base_sp + inst->operand];
+			if (v.type == CRB_STRING_VALUE) {
+				push_int(inter, CRB_wcslen(v.u.object_value->u.string.string));
+				pc = inst->operand2;
+			} else {
+				pc++;
+			}
+			NEXT;
+		CASE(OP_HOIST_END):
+			crb_stack_shrink_size(inter, 1);
+			env->stack_hold--;
+			pc++;
+			NEXT;
+		CASE(OP_END):
+			result.type = NORMAL_STATEMENT_RESULT;
+			goto FUNC_END;
+#ifndef CRB_THREADED_CODE
+		case OPCODE_COUNT_PLUS_1:	/* FALLTHRU */
+		default:
+			DBG_panic(("bad opcode..%d\n", inst->opcode));
+		}
+	}
+#endif
+
+#ifdef CRB_JIT
+  RUN_NATIVE: {
+		// the stack and frame are the same for the machine code at pc
+		JitFrame frame;
+
+		frame.inter = inter;
+		frame.env = env;
+		frame.code = code;
+		frame.base_sp = base_sp;
+		crb_jit_run(&frame, pc);
+		result = frame.result;
+	}
+#endif
+
+  FUNC_END:
+	if (result.type != TAIL_CALL_STATEMENT_RESULT) {
+		// drop what loops left on the stack when returning from inside
+		inter->stack.stack_pointer = base_sp;
+		env->stack_hold = base_stack_hold;
+	}
+	return result;
+}
+
+#ifdef CRB_JIT
+/*
+ * Helpers for the machine code of jit.c, each one runs the instruction
+ * at pc like the loop above.  Helpers of jumps return whether to jump,
+ * OP_TRY returns the next pc or -1, the others return 0.  A helper
+ * that ends the code leaves its result in the frame.
+ */
+#define JIT_HELPER(name) \
+	static int \
+	name(JitFrame *frame, int pc)
+#define JIT_INTER		(frame->inter)
+#define JIT_INST		(&frame->code->code[pc])
+#define JIT_CONSTANT	(frame->code->constant[JIT_INST->operand].pointer)
+#define JIT_LOCATION	(&frame->code->location[pc])
+
+JIT_HELPER(jit_push_null)
+{
+	CRB_Value v;
+
+	v.type = CRB_NULL_VALUE;
+	crb_stack_push_value(JIT_INTER, &v);
+	return 0;
+}
+
+JIT_HELPER(jit_push_boolean)
+{
+	push_boolean(JIT_INTER, JIT_INST->operand);
+	return 0;
+}
+
+JIT_HELPER(jit_push_int)
+{
+	push_int(JIT_INTER, JIT_INST->operand);
+	return 0;
+}
+
+JIT_HELPER(jit_push_double)
+{
+	CRB_Value v;
+
+	v.type = CRB_DOUBLE_VALUE;
+	v.u.double_value = frame->code->constant[JIT_INST->operand].double_value;
+	crb_stack_push_value(JIT_INTER, &v);
+	return 0;
+}
+
+JIT_HELPER(jit_push_string)
+{
+	CRB_Value v;
+
+	v.type = CRB_STRING_VALUE;
+	v.u.object_value = crb_literal_to_crb_string(JIT_INTER, JIT_CONSTANT);
+	crb_stack_push_value(JIT_INTER, &v);
+	return 0;
+}
+
+JIT_HELPER(jit_push_regexp)
+{
+	CRB_Value v;
+
+	CRB_set_native_pointer(&v, JIT_CONSTANT, crb_get_regexp_info());
+	crb_stack_push_value(JIT_INTER, &v);
+	return 0;
+}
+
+JIT_HELPER(jit_push_variable)
+{
+	push_variable(JIT_INTER, frame->env, JIT_CONSTANT, JIT_LOCATION);
+	return 0;
+}
+
+JIT_HELPER(jit_push_index)
+{
+	push_index(JIT_INTER, JIT_LOCATION);
+	return 0;
+}
+
+JIT_HELPER(jit_push_member)
+{
+	load_member(JIT_INTER, JIT_CONSTANT);
+	return 0;
+}
+
+JIT_HELPER(jit_push_closure)
+{
+	CRB_Value v;
+
+	DBG_assert(frame->env->environ_scope != NULL,
+			("closure defined in a frame without scope\n"));
+	crb_create_closure(JIT_INTER, &v, JIT_CONSTANT,
+						frame->env->environ_scope);
+	crb_stack_push_value(JIT_INTER, &v);
+	return 0;
+}
+
+JIT_HELPER(jit_push_callee)
+{
+	Expression *expr = JIT_CONSTANT;
+	CRB_Value v;
+
+	if (crb_search_called_function(JIT_INTER, expr)) {
+		v.type = CRB_NULL_VALUE;
+		crb_stack_push_value(JIT_INTER, &v);
+	} else {
+		push_variable(JIT_INTER, frame->env,
+				expr->u.function_call_expression.expr->u.identifier,
+				JIT_LOCATION);
+	}
+	return 0;
+}
+
+JIT_HELPER(jit_new_array)
+{
+	new_array(JIT_INTER, JIT_INST->operand);
+	return 0;
+}
+
+JIT_HELPER(jit_create_variable)
+{
+	crb_search_local_variable(JIT_INTER, frame->env, JIT_CONSTANT,
+							CRB_TRUE);
+	return 0;
+}
+
+JIT_HELPER(jit_store_variable)
+{
+	Variable *variable = crb_search_local_variable(JIT_INTER, frame->env,
+									JIT_CONSTANT, CRB_TRUE);
+
+	assign_value(JIT_INTER, JIT_INST->operand2, &variable->value,
+				STACK_TOP(JIT_INTER, 0), JIT_LOCATION);
+	return 0;
+}
+
+JIT_HELPER(jit_store_index)
+{
+	store_index(JIT_INTER, JIT_INST->operand2, JIT_LOCATION);
+	return 0;
+}
+
+JIT_HELPER(jit_store_member)
+{
+	CRB_Interpreter *inter = JIT_INTER;
+	CRB_Value *dest = object_member(inter, 1, JIT_CONSTANT, JIT_LOCATION);
+
+	assign_value(inter, JIT_INST->operand2, dest, STACK_TOP(inter, 0),
+				JIT_LOCATION);
+	*STACK_TOP(inter, 1) = *STACK_TOP(inter, 0);
+	crb_stack_shrink_size(inter, 1);
+	return 0;
+}
+
+JIT_HELPER(jit_incdec_variable)
+{
+	Variable *variable = crb_search_local_variable(JIT_INTER, frame->env,
+									JIT_CONSTANT, CRB_TRUE);
+	CRB_Value v;
+
+	incdec_value(JIT_INST->operand2, &variable->value, &v, JIT_LOCATION);
+	crb_stack_push_value(JIT_INTER, &v);
+	return 0;
+}
+
+JIT_HELPER(jit_incdec_index)
+{
+	incdec_index(JIT_INTER, JIT_INST->operand2, JIT_LOCATION);
+	return 0;
+}
+
+JIT_HELPER(jit_incdec_member)
+{
+	CRB_Interpreter *inter = JIT_INTER;
+	CRB_Value v;
+
+	incdec_value(JIT_INST->operand2,
+				object_member(inter, 0, JIT_CONSTANT, JIT_LOCATION),
+				&v, JIT_LOCATION);
+	*STACK_TOP(inter, 0) = v;
+	return 0;
+}
+
+JIT_HELPER(jit_not_lvalue)
+{
+	crb_runtime_error(JIT_LOCATION->filename, JIT_LOCATION->line_number,
+					NOT_LVALUE_ERR,
+					MESSAGE_ARGUMENT_END);
+	return 0;
+}
+
+JIT_HELPER(jit_pop)
+{
+	crb_stack_shrink_size(JIT_INTER, 1);
+	return 0;
+}
+
+/* the generic, int and double forms of a binary operator alike */
+JIT_HELPER(jit_binary)
+{
+	static ExpressionType operator[] = {
+		ADD_EXPRESSION, SUB_EXPRESSION, MUL_EXPRESSION, DIV_EXPRESSION,
+		MOD_EXPRESSION, EQ_EXPRESSION, NE_EXPRESSION, GT_EXPRESSION,
+		GE_EXPRESSION, LT_EXPRESSION, LE_EXPRESSION,
+	};
+	OpCode opcode = JIT_INST->opcode;
+
+	if (opcode >= OP_ADD_DOUBLE)
+		opcode = opcode - OP_ADD_DOUBLE + OP_ADD;
+	else if (opcode >= OP_ADD_INT)
+		opcode = opcode - OP_ADD_INT + OP_ADD;
+	execute_binary(JIT_INTER, operator[opcode - OP_ADD], JIT_LOCATION);
+	return 0;
+}
+
+JIT_HELPER(jit_double_binary)
+{
+	CRB_Interpreter *inter = JIT_INTER;
+	CRB_Value *pv = STACK_TOP(inter, 1);
+	double left;
+	double right;
+
+	if (!DOUBLE_OPERANDS())
+		return jit_binary(frame, pc);
+
+	left = NUMBER_OF(STACK_TOP(inter, 1));
+	right = NUMBER_OF(STACK_TOP(inter, 0));
+	pv->type = CRB_DOUBLE_VALUE;
+	switch (JIT_INST->opcode) {
+	case OP_ADD_DOUBLE:
+		pv->u.double_value = left + right;
+		break;
+	case OP_SUB_DOUBLE:
+		pv->u.double_value = left - right;
+		break;
+	case OP_MUL_DOUBLE:
+		pv->u.double_value = left * right;
+		break;
+	case OP_DIV_DOUBLE:
+		pv->u.double_value = left / right;
+		break;
+	case OP_MOD_DOUBLE:
+		pv->u.double_value = fmod(left, right);
+		break;
+	default:
+		pv->type = CRB_BOOLEAN_VALUE;
+		switch (JIT_INST->opcode) {
+		case OP_EQ_DOUBLE:
+			pv->u.boolean_value = left == right;
+			break;
+		case OP_NE_DOUBLE:
+			pv->u.boolean_value = left != right;
+			break;
+		case OP_GT_DOUBLE:
+			pv->u.boolean_value = left > right;
+			break;
+		case OP_GE_DOUBLE:
+			pv->u.boolean_value = left >= right;
+			break;
+		case OP_LT_DOUBLE:
+			pv->u.boolean_value = left < right;
+			break;
+		case OP_LE_DOUBLE:
+			pv->u.boolean_value = left <= right;
+			break;
+		default:
+			DBG_panic(("bad opcode..%d\n", JIT_INST->opcode));
+		}
+	}
+	inter->stack.stack_pointer--;
+	return 0;
+}
+
+JIT_HELPER(jit_add_string)
+{
+	CRB_Interpreter *inter = JIT_INTER;
+	CRB_Value v;
+
+	if (STACK_TOP(inter, 1)->type != CRB_STRING_VALUE)
+		return jit_binary(frame, pc);
+
+	crb_chain_string(inter, STACK_TOP(inter, 1), STACK_TOP(inter, 0), &v);
+	*STACK_TOP(inter, 1) = v;
+	inter->stack.stack_pointer--;
+	return 0;
+}
+
+JIT_HELPER(jit_not)
+{
+	CRB_Value *pv = STACK_TOP(JIT_INTER, 0);
+
+	if (pv->type != CRB_BOOLEAN_VALUE) {
+		crb_runtime_error(JIT_LOCATION->filename, JIT_LOCATION->line_number,
+						NOT_BOOLEAN_FOR_NOT_EXPRESSION,
+						MESSAGE_ARGUMENT_END);
+	}
+	pv->u.boolean_value = !pv->u.boolean_value;
+	return 0;
+}
+
+JIT_HELPER(jit_minus)
+{
+	CRB_Value *pv = STACK_TOP(JIT_INTER, 0);
+
+	if (pv->type == CRB_INT_VALUE) {
+		pv->u.int_value = -pv->u.int_value;
+	} else if (pv->type == CRB_DOUBLE_VALUE) {
+		pv->u.double_value = -pv->u.double_value;
+	} else {
+		crb_runtime_error(JIT_LOCATION->filename, JIT_LOCATION->line_number,
+						MINUS_OPERAND_TYPE_ERR,
+						MESSAGE_ARGUMENT_END);
+	}
+	return 0;
+}
+
+JIT_HELPER(jit_and_jump)
+{
+	check_boolean(STACK_TOP(JIT_INTER, 0), JIT_LOCATION);
+	if (!STACK_TOP(JIT_INTER, 0)->u.boolean_value)
+		return 1;
+	crb_stack_shrink_size(JIT_INTER, 1);
+	return 0;
+}
+
+JIT_HELPER(jit_or_jump)
+{
+	check_boolean(STACK_TOP(JIT_INTER, 0), JIT_LOCATION);
+	if (STACK_TOP(JIT_INTER, 0)->u.boolean_value)
+		return 1;
+	crb_stack_shrink_size(JIT_INTER, 1);
+	return 0;
+}
+
+JIT_HELPER(jit_check_boolean)
+{
+	check_boolean(STACK_TOP(JIT_INTER, 0), JIT_LOCATION);
+	return 0;
+}
+
+JIT_HELPER(jit_jump_if_false)
+{
+	CRB_Boolean jump;
+
+	check_boolean(STACK_TOP(JIT_INTER, 0), JIT_LOCATION);
+	jump = !STACK_TOP(JIT_INTER, 0)->u.boolean_value;
+	crb_stack_shrink_size(JIT_INTER, 1);
+	return jump;
+}
+
+JIT_HELPER(jit_call)
+{
+	crb_call_stacked_function(JIT_INTER, JIT_CONSTANT, JIT_INST->operand2);
+	return 0;
+}
+
+JIT_HELPER(jit_tail_call)
+{
+	CRB_Interpreter *inter = JIT_INTER;
+
+	if (frame->env == &inter->first_env || frame->env->stack_hold != 0) {
+		crb_call_stacked_function(inter, JIT_CONSTANT, JIT_INST->operand2);
+		frame->result.type = RETURN_STATEMENT_RESULT;
+		frame->result.u.return_value = crb_stack_pop_value(inter);
+	} else {
+		frame->result = crb_tail_call_stacked_function(inter, JIT_CONSTANT,
+												JIT_INST->operand2);
+	}
+	return 0;
+}
+
+JIT_HELPER(jit_return)
+{
+	frame->result.type = RETURN_STATEMENT_RESULT;
+	frame->result.u.return_value = crb_stack_pop_value(JIT_INTER);
+	return 0;
+}
+
+JIT_HELPER(jit_break)
+{
+	frame->result.type = BREAK_STATEMENT_RESULT;
+	return 0;
+}
+
+JIT_HELPER(jit_continue)
+{
+	frame->result.type = CONTINUE_STATEMENT_RESULT;
+	return 0;
+}
+
+JIT_HELPER(jit_global)
+{
+	crb_execute_global(JIT_INTER, frame->env, JIT_CONSTANT);
+	return 0;
+}
+
+JIT_HELPER(jit_try)
+{
+	StatementResult result;
+
+	result = execute_try(JIT_INTER, frame->env, JIT_CONSTANT);
+	if (result.type == NORMAL_STATEMENT_RESULT)
+		return pc + 3;
+	else if (result.type == BREAK_STATEMENT_RESULT)
+		return pc + 1;
+	else if (result.type == CONTINUE_STATEMENT_RESULT)
+		return pc + 2;
+	frame->result = result;
+	return -1;
+}
+
+JIT_HELPER(jit_throw)
+{
+	crb_throw_value(JIT_INTER, frame->env, JIT_CONSTANT);
+	return 0;
+}
+
+JIT_HELPER(jit_foreach_init)
+{
+	foreach_init(JIT_INTER, frame->env, JIT_LOCATION);
+	return 0;
+}
+
+JIT_HELPER(jit_foreach_next)
+{
+	return !foreach_next(JIT_INTER, frame->env,
+						frame->code->constant[JIT_INST->operand2].pointer,
+						JIT_LOCATION);
+}
+
+JIT_HELPER(jit_foreach_step)
+{
+	foreach_step(JIT_INTER, JIT_LOCATION);
+	return 0;
+}
+
+JIT_HELPER(jit_foreach_end)
+{
+	crb_stack_shrink_size(JIT_INTER, 2);
+	frame->env->stack_hold--;
+	return 0;
+}
+
+JIT_HELPER(jit_hoist_receiver)
+{
+	Variable *variable = crb_search_local_variable(JIT_INTER, frame->env,
+									JIT_CONSTANT, CRB_FALSE);
+	CRB_Value v;
+
+	if (variable) {
+		v = variable->value;
+	} else {
+		v.type = CRB_NULL_VALUE;
+	}
+	crb_stack_push_value(JIT_INTER, &v);
+	frame->env->stack_hold++;
+	return 0;
+}
+
+JIT_HELPER(jit_hoisted_size)
+{
+	CRB_Value *pv = &JIT_INTER->stack.stack[frame->base_sp
+											+ JIT_INST->operand];
+
+	if (pv->type != CRB_ARRAY_VALUE)
+		return 0;
+	push_int(JIT_INTER, crb_array_size(JIT_INTER, pv->u.object_value));
+	return 1;
+}
+
+JIT_HELPER(jit_hoisted_length)
+{
+	CRB_Value *pv = &JIT_INTER->stack.stack[frame->base_sp
+											+ JIT_INST->operand];
+
+	if (pv->type != CRB_STRING_VALUE)
+		return 0;
+	push_int(JIT_INTER, CRB_wcslen(pv->u.object_value->u.string.string));
+	return 1;
+}
+
+JIT_HELPER(jit_hoist_end)
+{
+	crb_stack_shrink_size(JIT_INTER, 1);
+	frame->env->stack_hold--;
+	return 0;
+}
+
+JIT_HELPER(jit_end)
+{
+	frame->result.type = NORMAL_STATEMENT_RESULT;
+	return 0;
+}
+
+JitHelper
+crb_jit_helper(OpCode opcode)
+{
+	static JitHelper helper[] = {
+		[OP_PUSH_NULL] = jit_push_null,
+		[OP_PUSH_BOOLEAN] = jit_push_boolean,
+		[OP_PUSH_INT] = jit_push_int,
+		[OP_PUSH_DOUBLE] = jit_push_double,
+		[OP_PUSH_STRING] = jit_push_string,
+		[OP_PUSH_REGEXP] = jit_push_regexp,
+		[OP_PUSH_VARIABLE] = jit_push_variable,
+		[OP_PUSH_INDEX] = jit_push_index,
+		[OP_PUSH_MEMBER] = jit_push_member,
+		[OP_PUSH_CLOSURE] = jit_push_closure,
+		[OP_PUSH_CALLEE] = jit_push_callee,
+		[OP_NEW_ARRAY] = jit_new_array,
+		[OP_CREATE_VARIABLE] = jit_create_variable,
+		[OP_STORE_VARIABLE] = jit_store_variable,
+		[OP_STORE_INDEX] = jit_store_index,
+		[OP_STORE_MEMBER] = jit_store_member,
+		[OP_INCDEC_VARIABLE] = jit_incdec_variable,
+		[OP_INCDEC_INDEX] = jit_incdec_index,
+		[OP_INCDEC_MEMBER] = jit_incdec_member,
+		[OP_NOT_LVALUE] = jit_not_lvalue,
+		[OP_POP] = jit_pop,
+		[OP_ADD ... OP_LE_INT] = jit_binary,
+		[OP_ADD_DOUBLE ... OP_LE_DOUBLE] = jit_double_binary,
+		[OP_ADD_STRING] = jit_add_string,
+		[OP_NOT] = jit_not,
+		[OP_MINUS] = jit_minus,
+		[OP_AND_JUMP] = jit_and_jump,
+		[OP_OR_JUMP] = jit_or_jump,
+		[OP_CHECK_BOOLEAN] = jit_check_boolean,
+		[OP_JUMP_IF_FALSE] = jit_jump_if_false,
+		[OP_CALL] = jit_call,
+		[OP_TAIL_CALL] = jit_tail_call,
+		[OP_RETURN] = jit_return,
+		[OP_BREAK] = jit_break,
+		[OP_CONTINUE] = jit_continue,
+		[OP_GLOBAL] = jit_global,
+		[OP_TRY] = jit_try,
+		[OP_THROW] = jit_throw,
+		[OP_FOREACH_INIT] = jit_foreach_init,
+		[OP_FOREACH_NEXT] = jit_foreach_next,
+		[OP_FOREACH_STEP] = jit_foreach_step,
+		[OP_FOREACH_END] = jit_foreach_end,
+		[OP_HOIST_RECEIVER] = jit_hoist_receiver,
+		[OP_HOISTED_SIZE] = jit_hoisted_size,
+		[OP_HOISTED_LENGTH] = jit_hoisted_length,
+		[OP_HOIST_END] = jit_hoist_end,
+		[OP_END] = jit_end,
+	};
+
+	return helper[opcode];
+}
+#endif /* CRB_JIT */